@@ -29,6 +29,9 @@
 #include "md_sink.h"
 #include "file_movie.h"
 #include "player.h"
+#include "async_file_stream.h"
+#include "segment_session.h"
+#include "dash_movie.h"
 #include "util.h"
 
 #include <string.h>
@@ -74,7 +77,8 @@ typedef struct options_t_
     int show_samples; /* (boolean) dump samples info to stdout? */
     const char *pdin_rates;  /* download rates at which to report initial delay (pdin) */
     time_range_t time_ranges; /* time ranges to demux */
-    const char *decryption_keys;
+    const char *decryption_keys; /* KID:key pairs (hex), separated by commas, or NULL */
+    unsigned int decrypt_threads; /* number of threads decrypting samples, or 0 for the demuxing thread */
     const char *filename; /* to demux */
     const char *output_folder; /* output folder's path and name*/
     char output_path[255];  /* output folder's path and name*/
@@ -82,6 +86,16 @@ typedef struct options_t_
     const char *item;  /* filename of iloc contents */
     long int fragment_number;  /* to demux, or 0 for all */
     int dv_single_ves_output_flag; /* to demux dolby vision dual track mp4 into single ves file*/
+    float keyframe_interval;   /* extract one key frame per interval (in seconds), or 0 */
+    int print_byte_ranges;     /* (boolean) list the file byte ranges of the time range instead of demuxing */
+    int low_latency;           /* (boolean) read the input in chunks, output samples as soon as they are read */
+    float follow_timeout;      /* follow the growing input file until it stops growing for this long (in seconds), or 0 */
+    unsigned int queue_depth;  /* number of sample payloads to read ahead without blocking, or 0 */
+    unsigned int prefetch;     /* number of samples per track to hint to the OS for read-ahead, or 0 */
+    const char **segments;     /* media segments following the init segment (filename), or NULL */
+    unsigned int num_segments;
+    unsigned int prefetch_segments; /* number of media segments per representation to read ahead */
+    unsigned int bitrate;      /* bit rate (bps) of the representation to demux, or 0 for the highest */
 } options_t;
 
 /**
@@ -91,6 +105,7 @@ typedef struct
 {
     options_t options;         /* command line options */
     player_t player;           /* demuxer player handle */
+    async_reader_t async_loads; /* payload reader, if queue_depth > 0 */
 } app_data_t;
 
 
@@ -291,11 +306,7 @@ static int
     mp4d_movie_info_t movie_info;
     uint32_t stream_num;
     char *stream_name = NULL;  /* track_ID = 0 */
-    uint32_t polarssl_flag = 0;
-
-#ifdef HAVE_POLARSSL
-    polarssl_flag = 1;
-#endif
+    uint32_t decrypt_flag = (p_data->options.decryption_keys != NULL);
 
     CHECK(p_movie->get_movie_info(p_movie, &movie_info) );
 
@@ -447,13 +458,20 @@ static int
         {
             int i = 0;
             int err_br = 0;
+            int selected = 0;
+            uint32_t rate;
             while (err_br == 0)
             {
-                err_br = p_movie->get_bitrate(p_movie, stream_num, i, &bitrate);
+                err_br = p_movie->get_bitrate(p_movie, stream_num, i, &rate);
 
                 if (err_br == 0)
                 {
-                    logout(LOG_VERBOSE_LVL_INFO, "    Bitrate #%d: %" PRIu32 " bps\n", i, bitrate);
+                    logout(LOG_VERBOSE_LVL_INFO, "    Bitrate #%d: %" PRIu32 " bps\n", i, rate);
+                    if (!selected)
+                    {
+                        bitrate = rate;
+                        selected = (p_data->options.bitrate > 0 && rate == p_data->options.bitrate);
+                    }
                     i += 1;
                 }
                 else
@@ -462,10 +480,51 @@ static int
                 }
             }
             ASSURE( i >= 1, ("No bit rate available!") );
+            if (p_data->options.bitrate > 0 && !selected)
+            {
+                logout(LOG_VERBOSE_LVL_INFO, "    Bit rate %u not available, using %" PRIu32 " bps\n",
+                       p_data->options.bitrate, bitrate);
+            }
         }
 
         /* Create a sink for this stream */
-        if (!p_data->options.no_dump)
+        if (p_data->options.keyframe_interval > 0)
+        {
+            /* Key frames are written only for video tracks with parameter sets in the sample entry */
+            if (MP4D_FOURCC_EQ(stream_info.hdlr, "vide") &&
+                (MP4D_FOURCC_EQ(stream_info.codec, "avc1") ||
+                 MP4D_FOURCC_EQ(stream_info.codec, "H264")))
+            {
+                CHECK( h264_keyframe_writer_new(&sink1, track_ID, stream_name, p_data->options.output_folder) );
+            }
+            else if (MP4D_FOURCC_EQ(stream_info.hdlr, "vide") &&
+                     (MP4D_FOURCC_EQ(stream_info.codec, "hvc1") ||
+                      MP4D_FOURCC_EQ(stream_info.codec, "dvh1") ||
+                      MP4D_FOURCC_EQ(stream_info.codec, "hev1") ||
+                      MP4D_FOURCC_EQ(stream_info.codec, "dvhe") ||
+                      MP4D_FOURCC_EQ(stream_info.codec, "HEVC")))
+            {
+                CHECK( hevc_keyframe_writer_new(&sink1, track_ID, stream_name, p_data->options.output_folder) );
+            }
+            else
+            {
+                logout(LOG_VERBOSE_LVL_INFO, "track_ID %u: no key frames extracted for this track\n", track_ID);
+            }
+
+            if (sink1 != NULL)
+            {
+                CHECK( p_movie->fragment_stream_new(p_movie, stream_num, stream_name, bitrate, &mp4_source) );
+                CHECK( player_set_track(p_data->player, track_ID, stream_name, bitrate, p_movie, mp4_source, sink1, decrypt_flag) );
+            }
+        }
+        else if (p_data->options.print_byte_ranges)
+        {
+            /* Samples are not loaded, only select the track */
+            CHECK( sample_print_new(&sink1, stream_info.time_scale, track_ID, stream_name) );
+            CHECK( p_movie->fragment_stream_new(p_movie, stream_num, stream_name, bitrate, &mp4_source) );
+            CHECK( player_set_track(p_data->player, track_ID, stream_name, bitrate, p_movie, mp4_source, sink1, decrypt_flag) );
+        }
+        else if (!p_data->options.no_dump)
         {
             if ((
                 (MP4D_FOURCC_EQ(stream_info.hdlr, "vide") && MP4D_FOURCC_EQ(stream_info.codec, "avc1")) ||
@@ -523,16 +582,18 @@ static int
             }
 
             CHECK( p_movie->fragment_stream_new(p_movie, stream_num, stream_name, bitrate, &mp4_source) );
-            CHECK( player_set_track(p_data->player, track_ID, stream_name, bitrate, p_movie, mp4_source, sink1, polarssl_flag) );
+            CHECK( player_set_track(p_data->player, track_ID, stream_name, bitrate, p_movie, mp4_source, sink1, decrypt_flag) );
         }
-        if (p_data->options.show_samples)
+        if (p_data->options.show_samples &&
+            !p_data->options.print_byte_ranges &&
+            (p_data->options.keyframe_interval == 0 || sink1 != NULL))
         {
             CHECK( sample_print_new(&sink2, stream_info.time_scale, track_ID, stream_name) );
             if (mp4_source == NULL)
             {
                 CHECK( p_movie->fragment_stream_new(p_movie, stream_num, stream_name, bitrate, &mp4_source) );
             }
-            CHECK( player_set_track(p_data->player, track_ID, stream_name, bitrate, p_movie, mp4_source, sink2, polarssl_flag) );
+            CHECK( player_set_track(p_data->player, track_ID, stream_name, bitrate, p_movie, mp4_source, sink2, decrypt_flag) );
         }
 
 
@@ -680,15 +741,124 @@ cleanup:
     return err;
 }
 
+/** @brief parse 32 hex digits
+ *  @return pointer after the digits, or NULL if invalid
+ */
+static const char *
+parse_hex16(const char *p, unsigned char bytes[16])
+{
+    uint32_t i;
+
+    for (i = 0; i < 32; i++, p++)
+    {
+        int digit;
+
+        if      (*p >= '0' && *p <= '9') digit = *p - '0';
+        else if (*p >= 'a' && *p <= 'f') digit = *p - 'a' + 10;
+        else if (*p >= 'A' && *p <= 'F') digit = *p - 'A' + 10;
+        else return NULL;
+
+        if (i % 2 == 0) bytes[i / 2] = (unsigned char) (digit << 4);
+        else bytes[i / 2] |= (unsigned char) digit;
+    }
+    return p;
+}
+
+/** @brief add the keys of --decryption-keys to the player */
+static int
+add_decryption_keys(player_t player, const char *keys)
+{
+    int err = 0;
+    const char *p = keys;
+
+    while (p != NULL && *p != '\0')
+    {
+        unsigned char key_id[16];
+        unsigned char key[16];
+
+        p = parse_hex16(p, key_id);
+        ASSURE( p != NULL && *p == ':', ("Invalid decryption key '%s', expected KID:key in hex", keys) );
+        p = parse_hex16(p + 1, key);
+        ASSURE( p != NULL && (*p == ',' || *p == '\0'), ("Invalid decryption key '%s', expected KID:key in hex", keys) );
+        if (*p == ',')
+        {
+            p++;
+        }
+        CHECK( player_add_key(player, key_id, key) );
+    }
+
+cleanup:
+    return err;
+}
+
 static int 
     process(app_data_t* data, movie_t p_movie)
 {
     int err = 0;
     CHECK( player_new(&data->player) );
 
+    if (data->options.decryption_keys != NULL)
+    {
+        CHECK( add_decryption_keys(data->player, data->options.decryption_keys) );
+    }
+
+    CHECK( player_set_prefetch(data->player, data->options.prefetch) );
     CHECK( player_select_movie(data, p_movie) );
 
-    if (data->options.time_ranges.start != -1.0f || data->options.time_ranges.end != -1.0f)
+    if (data->options.queue_depth > 0)
+    {
+        if (strcmp(data->options.filename, "-") == 0 ||
+            data->options.low_latency ||
+            data->options.follow_timeout > 0 ||
+            data->options.num_segments > 0 ||
+            endswith(data->options.filename, ".mpd"))
+        {
+            WARNING(("--queue-depth is ignored when reading from stdin or an MPD, or with --low-latency, --follow or --segments\n"));
+        }
+        else
+        {
+            CHECK( async_file_stream_new(&data->async_loads, data->options.filename, data->options.queue_depth) );
+            CHECK( player_set_async_loads(data->player, data->async_loads, data->options.queue_depth) );
+        }
+    }
+
+    if (data->options.decrypt_threads > 0)
+    {
+        if (data->options.low_latency)
+        {
+            WARNING(("--decrypt-threads is ignored with --low-latency\n"));
+        }
+        else
+        {
+            CHECK( player_set_decrypt_threads(data->player, data->options.decrypt_threads) );
+        }
+    }
+
+    if (data->options.print_byte_ranges)
+    {
+        byte_range_t *ranges = NULL;
+        uint32_t num_ranges = 0;
+        uint32_t i;
+        float start = data->options.time_ranges.start >= 0 ? data->options.time_ranges.start : 0.0f;
+
+        CHECK( player_plan_time_range(data->player,
+            &start,
+            (data->options.time_ranges.end >= 0) ? &data->options.time_ranges.end : NULL,
+            &ranges,
+            &num_ranges) );
+
+        for (i = 0; i < num_ranges; i++)
+        {
+            fprintf(stdout, "%" PRIu64 " %" PRIu64 "\n", ranges[i].offset, ranges[i].size);
+        }
+        free(ranges);
+    }
+    else if (data->options.keyframe_interval > 0)
+    {
+        /* one sync sample per interval, sample position order */
+        CHECK( player_play_keyframes(data->player, data->options.keyframe_interval) );
+    }
+    else if (data->options.time_ranges.start != -1.0f || data->options.time_ranges.end != -1.0f)
     {
         /* presentation time order */
         CHECK( player_play_time_range(data->player,
@@ -702,7 +872,9 @@ static int
     }
 cleanup:
     player_destroy(&data->player);
-    return 0;
+    async_reader_destroy(data->async_loads);
+    data->async_loads = NULL;
+    return err;
 }
 
 static int
@@ -739,8 +911,33 @@ static void
 
     fprintf(stdout, "\nOption description:\n");
     fprintf(stdout, "    --input-file            Specifies the input file (.mp4) for demultiplex.\n");
+    fprintf(stdout, "                            Use - to read fragmented MP4 from stdin, or a DASH\n");
+    fprintf(stdout, "                            manifest (.mpd) with local segment files.\n");
     fprintf(stdout, "    --output-folder         Specifies the output folder path and name.\n");
     fprintf(stdout, "    --time-ranges           A time range (in seconds) to demultiplex.\n");
+    fprintf(stdout, "    --keyframes-every       Extracts one key frame per interval (in seconds) of each video track,\n");
+    fprintf(stdout, "                            each written to its own file.\n");
+    fprintf(stdout, "    --byte-ranges           Lists the file byte ranges (offset and size) needed to demultiplex\n");
+    fprintf(stdout, "                            the time range, instead of demultiplexing.\n");
+    fprintf(stdout, "    --low-latency           Reads the input in chunks and outputs each sample as soon as its\n");
+    fprintf(stdout, "                            data is read, e.g. for low-latency CMAF chunks still being written\n");
+    fprintf(stdout, "                            (with --follow, or from stdin or a FIFO).\n");
+    fprintf(stdout, "    --follow                Keeps reading the input file while it is being written, until it\n");
+    fprintf(stdout, "                            has not grown for the given time (in seconds).\n");
+    fprintf(stdout, "    --queue-depth           Reads up to this number of sample payloads ahead, as a batch of\n");
+    fprintf(stdout, "                            non-blocking reads (io_uring on Linux).\n");
+    fprintf(stdout, "    --prefetch              Hints the byte ranges of this number of upcoming samples per track\n");
+    fprintf(stdout, "                            to the OS, to be read in the background.\n");
+    fprintf(stdout, "    --segments              Media segments (one or more files) to demultiplex, with the\n");
+    fprintf(stdout, "                            input file as their init segment.\n");
+    fprintf(stdout, "    --prefetch-segments     Reads this number of media segments ahead in the background, for\n");
+    fprintf(stdout, "                            --segments or an MPD (default 2).\n");
+    fprintf(stdout, "    --bitrate               Bit rate (bps) of the DASH representation to demultiplex\n");
+    fprintf(stdout, "                            (default is the highest).\n");
+    fprintf(stdout, "    --decryption-keys       Decrypts 'cenc' and 'cbcs' protected tracks with these keys, as\n");
+    fprintf(stdout, "                            KID:key pairs in hex (32 digits each), separated by commas.\n");
+    fprintf(stdout, "    --decrypt-threads       Decrypts the samples on this number of threads, while the next\n");
+    fprintf(stdout, "                            samples are loaded (default 0: on the demuxing thread).\n");
     fprintf(stdout, "    --version               Prints version information\n");
     fprintf(stdout, "    --help                  Displays help information\n");
     fprintf(stdout, "    --verbose               Displays More information for debugging.\n");
@@ -759,6 +956,16 @@ static void
     fprintf(stdout, "    2. Demux playloads of mp4 file with an indicated time range \n");
     fprintf(stdout, "      from 0s to 5.2s: mp4demuxer --input-file input.mp4 --output-folder tmp --time-ranges 0-5.2\n");
     fprintf(stdout, "      from 4s to end: mp4demuxer --input-file input.mp4 --output-folder tmp --time-ranges 4-\n\n");
+    fprintf(stdout, "    3. Extract one key frame every 10 seconds\n");
+    fprintf(stdout, "      mp4demuxer --input-file input.mp4 --output-folder tmp --keyframes-every 10\n\n");
+    fprintf(stdout, "    4. List the byte ranges to prefetch for the time range from 4s to 8s\n");
+    fprintf(stdout, "      mp4demuxer --input-file input.mp4 --time-ranges 4-8 --byte-ranges\n\n");
+    fprintf(stdout, "    5. Demux DASH media segments\n");
+    fprintf(stdout, "      mp4demuxer --input-file init.mp4 --output-folder tmp --segments seg-1.m4s seg-2.m4s\n\n");
+    fprintf(stdout, "    6. Demux the 500 kbps representations of a DASH presentation\n");
+    fprintf(stdout, "      mp4demuxer --input-file manifest.mpd --output-folder tmp --bitrate 500000\n\n");
+    fprintf(stdout, "    7. Demux and decrypt a protected file\n");
+    fprintf(stdout, "      mp4demuxer --input-file input.mp4 --output-folder tmp --decryption-keys <KID>:<key>\n\n");
 }
 
 static void
@@ -775,6 +982,18 @@ static void
     options->show_samples = 0;  /* default is to dump */
     g_verbose_level = LOG_VERBOSE_LVL_COMPACT;
     options->fragment_number = 0;
+    options->keyframe_interval = 0.0f;  /* default is to demux all samples */
+    options->print_byte_ranges = 0;
+    options->low_latency = 0;
+    options->follow_timeout = 0;
+    options->queue_depth = 0;  /* default is to read each sample when it is written */
+    options->prefetch = 0;
+    options->segments = NULL;
+    options->num_segments = 0;
+    options->prefetch_segments = 2;
+    options->bitrate = 0;
+    options->decryption_keys = NULL;
+    options->decrypt_threads = 0;
 }
 
 static int
@@ -839,14 +1058,16 @@ static int
         if(!strcmp(option, "--input-file")) 
         {
             char ext[10];
-			if (i + 1 >= argc || argv[i + 1][0] == '-'){
+			if (i + 1 >= argc || (argv[i + 1][0] == '-' && strcmp(argv[i + 1], "-"))){
 				printf("Error: invalid input file found.\n");
 				return -1;
 			}
 
             options->filename = argv[++i];
 			get_extension(options->filename, ext);
-            if (strcmp(ext, ".mp4") && strcmp(ext, ".m4a") && strcmp(ext, ".m4v"))
+            if (strcmp(options->filename, "-") &&  /* stdin */
+                strcmp(ext, ".mp4") && strcmp(ext, ".m4a") && strcmp(ext, ".m4v") &&
+                strcmp(ext, ".mpd"))
             {
                 return -1;
             }
@@ -893,6 +1114,105 @@ static int
                 }
             }
         }
+        else if (!strcmp(option, "--keyframes-every"))
+        {
+            if (i + 1 >= argc || sscanf(argv[i + 1], "%f", &options->keyframe_interval) != 1 ||
+                options->keyframe_interval <= 0)
+            {
+                printf("Error: invalid key frame interval found.\n");
+                return -1;
+            }
+            i++;
+        }
+        else if (!strcmp(option, "--follow"))
+        {
+            if (i + 1 >= argc || sscanf(argv[i + 1], "%f", &options->follow_timeout) != 1 ||
+                options->follow_timeout <= 0)
+            {
+                printf("Error: invalid follow timeout found.\n");
+                return -1;
+            }
+            i++;
+        }
+        else if (!strcmp(option, "--queue-depth"))
+        {
+            if (i + 1 >= argc || sscanf(argv[i + 1], "%u", &options->queue_depth) != 1 ||
+                options->queue_depth == 0)
+            {
+                printf("Error: invalid queue depth found.\n");
+                return -1;
+            }
+            i++;
+        }
+        else if (!strcmp(option, "--prefetch"))
+        {
+            if (i + 1 >= argc || sscanf(argv[i + 1], "%u", &options->prefetch) != 1)
+            {
+                printf("Error: invalid prefetch sample count found.\n");
+                return -1;
+            }
+            i++;
+        }
+        else if (!strcmp(option, "--segments"))
+        {
+            options->segments = &argv[i + 1];
+            while (i + 1 < argc && strncmp(argv[i + 1], "--", 2))
+            {
+                options->num_segments++;
+                i++;
+            }
+            if (options->num_segments == 0)
+            {
+                printf("Error: invalid segments found.\n");
+                return -1;
+            }
+        }
+        else if (!strcmp(option, "--prefetch-segments"))
+        {
+            if (i + 1 >= argc || sscanf(argv[i + 1], "%u", &options->prefetch_segments) != 1)
+            {
+                printf("Error: invalid prefetch segment count found.\n");
+                return -1;
+            }
+            i++;
+        }
+        else if (!strcmp(option, "--bitrate"))
+        {
+            if (i + 1 >= argc || sscanf(argv[i + 1], "%u", &options->bitrate) != 1 ||
+                options->bitrate == 0)
+            {
+                printf("Error: invalid bit rate found.\n");
+                return -1;
+            }
+            i++;
+        }
+        else if (!strcmp(option, "--decryption-keys"))
+        {
+            if (i + 1 >= argc || argv[i + 1][0] == '-')
+            {
+                printf("Error: invalid decryption keys found.\n");
+                return -1;
+            }
+            options->decryption_keys = argv[++i];
+        }
+        else if (!strcmp(option, "--decrypt-threads"))
+        {
+            if (i + 1 >= argc || sscanf(argv[i + 1], "%u", &options->decrypt_threads) != 1 ||
+                options->decrypt_threads > DECRYPT_POOL_MAX_THREADS)
+            {
+                printf("Error: invalid decryption thread count found.\n");
+                return -1;
+            }
+            i++;
+        }
+        else if (!strcmp(option, "--byte-ranges"))
+        {
+            options->print_byte_ranges = 1;
+        }
+        else if (!strcmp(option, "--low-latency"))
+        {
+            options->low_latency = 1;
+        }
         else if (!strcmp(option, "--no-dump)"))
         {
             options->no_dump = 1;
@@ -963,6 +1283,28 @@ static int
     return 0;
 }
 
+/* Movie of an init segment and the media segments following it */
+static int
+    open_segments(const options_t *options, movie_t *p_movie)
+{
+    int err = 0;
+    segment_session_t session = NULL;
+    unsigned int i;
+
+    CHECK( segment_session_new(&session) );
+    CHECK( segment_session_add_file(session, options->filename) );
+    for (i = 0; i < options->num_segments; i++)
+    {
+        CHECK( segment_session_add_file(session, options->segments[i]) );
+    }
+    CHECK( segment_session_set_prefetch(session, options->prefetch_segments) );
+    CHECK( segment_movie_new(session, p_movie) );
+
+cleanup:
+    segment_session_release(session);
+    return err;
+}
+
 int
     main(int argc, const char* argv[])
 {
@@ -973,7 +1315,26 @@ int
 	memset(&data, 0, sizeof(app_data_t));
 	CHECK( parse_options(argc, argv, &data.options) );
 	if (data.options.filename){
-		CHECK( movie_new(data.options.filename, &p_movie) );
+		if (data.options.num_segments > 0)
+		{
+			CHECK( open_segments(&data.options, &p_movie) );
+		}
+		else if (endswith(data.options.filename, ".mpd"))
+		{
+			CHECK( dash_movie_new(data.options.filename, data.options.prefetch_segments, &p_movie) );
+		}
+		else if (data.options.low_latency)
+		{
+			CHECK( chunked_movie_new(data.options.filename, (uint32_t) (data.options.follow_timeout * 1000), &p_movie) );
+		}
+		else if (data.options.follow_timeout > 0)
+		{
+			CHECK( following_movie_new(data.options.filename, (uint32_t) (data.options.follow_timeout * 1000), &p_movie) );
+		}
+		else
+		{
+			CHECK( movie_new(data.options.filename, &p_movie) );
+		}
 		CHECK( movie_validation(&data, p_movie) );
 		CHECK( process(&data, p_movie));
 	}
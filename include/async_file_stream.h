@@ -0,0 +1,62 @@
+/************************************************************************************************************
+ * Copyright (c) 2017, Dolby Laboratories Inc.
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ *    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+ *    promote products derived from this software without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ ************************************************************************************************************/
+/** @defgroup async_file_stream
+ *
+ * @brief Provide fragments from a local file without blocking.
+ *
+ * Implements the async_reader_t API, on top of a file_stream.
+ *
+ * On Linux, loads are read through io_uring, and the file descriptor is an
+ * eventfd registered with the ring. Loads into the buffer given to
+ * async_reader_register_buffer() are fixed-buffer reads, if the kernel
+ * accepts the registration (limited by RLIMIT_MEMLOCK). Elsewhere, or if
+ * io_uring is not available, loads are read with pread() by a pool of
+ * worker threads.
+ * next_atom() and seek() always run on a worker thread. Without thread
+ * support (MSVC), all operations finish in async_reader_submit().
+ * @{
+ */
+#ifndef ASYNC_FILE_STREAM_H
+#define ASYNC_FILE_STREAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "async_stream.h"
+
+/** @brief Create a non-blocking fragment stream from a local file
+ * @return error
+ */
+int async_file_stream_new(async_reader_t *,   /**< [out] */
+                          const char *path,
+                          uint32_t queue_depth  /**< Maximum number of loads in progress */
+                          );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @} */
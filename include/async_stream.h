@@ -0,0 +1,165 @@
+/************************************************************************************************************
+ * Copyright (c) 2017, Dolby Laboratories Inc.
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ *    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+ *    promote products derived from this software without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ ************************************************************************************************************/
+/** @defgroup async_stream
+ *
+ * @brief Non-blocking variant of the fragment_stream API
+ *
+ * The operations of fragment_reader_t are started by this API, and return
+ * without waiting for input. When an operation has finished, its completion
+ * callback is called from async_reader_process(), in the thread calling that
+ * function, so that an event loop can wait for the file descriptor given by
+ * async_reader_get_fd() and then call async_reader_process().
+ *
+ * Operations are queued by async_reader_next_atom(), async_reader_seek() and
+ * async_reader_load(), and started by async_reader_submit() (or
+ * async_reader_process()), so that several loads reach the I/O backend at
+ * once. Any number of loads may be pending; next_atom() and seek() change the
+ * current box, so only one of them may be pending at a time.
+ *
+ * @{
+ */
+#ifndef ASYNC_STREAM_H
+#define ASYNC_STREAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "fragment_stream.h"
+
+#include <stddef.h>
+
+typedef struct async_reader_t_ * async_reader_t;
+
+/** @brief Completion callback
+ *
+ * err is the return code of the corresponding fragment_reader_t operation.
+ */
+typedef void (*async_reader_done_t)(void *p_user, int err);
+
+struct async_reader_t_
+{
+    /* The current box is fragments->p_dmux. Must not be accessed while a next_atom() or seek() is pending. */
+    fragment_reader_t fragments;
+
+    /** @brief Destructor. Waits for the pending operations, without calling their callbacks.
+     */
+    void (*destroy)(async_reader_t);
+
+    /** @brief Queue fragment_reader_next_atom()
+     * @return error
+     */
+    int (*next_atom)(async_reader_t, async_reader_done_t, void *p_user);
+
+    /** @brief Queue fragment_reader_seek(). out_time must stay valid until the callback.
+     * @return error
+     */
+    int (*seek)(async_reader_t,
+                uint32_t track_ID,
+                uint64_t seek_time,
+                uint64_t *out_time,
+                async_reader_done_t, void *p_user);
+
+    /** @brief Queue fragment_reader_load(). p_buffer must stay valid until the callback.
+     * @return error
+     */
+    int (*load)(async_reader_t,
+                uint64_t position,
+                uint32_t size,
+                unsigned char *p_buffer,
+                async_reader_done_t, void *p_user);
+
+    /** @brief Start the queued operations
+     * @return error
+     */
+    int (*submit)(async_reader_t);
+
+    /** @brief Start the queued operations, then call the callbacks of finished operations
+     *
+     * If wait is true and operations are pending, blocks until at least one has finished.
+     *
+     * @return error
+     */
+    int (*process)(async_reader_t, int wait);
+
+    /** @brief Get the number of operations whose callback has not been called
+     */
+    uint32_t (*get_pending)(async_reader_t);
+
+    /** @brief Get a file descriptor which is readable when async_reader_process() has callbacks to call
+     *
+     * May not be available, in which case -1 is returned and operations finish in async_reader_submit().
+     */
+    int (*get_fd)(async_reader_t);
+
+    /** @brief Register a buffer which loads will target, optional
+     *
+     * Loads into the registered buffer may avoid mapping the destination
+     * for each read. A new call replaces the registered buffer, and NULL
+     * unregisters it. No load may be pending.
+     * @return error
+     */
+    int (*register_buffer)(async_reader_t, unsigned char *p_buffer, size_t size);
+};
+
+void async_reader_destroy(async_reader_t);
+
+int async_reader_next_atom(async_reader_t, async_reader_done_t, void *p_user);
+
+int async_reader_seek(async_reader_t,
+                      uint32_t track_ID,
+                      uint64_t seek_time, /**< presentation time, in media time scale */
+                      uint64_t *out_time, /**< [out] on success, actual seek time */
+                      async_reader_done_t, void *p_user);
+
+int async_reader_load(async_reader_t,
+                      uint64_t position,
+                      uint32_t size,
+                      unsigned char *p_buffer,  /* Output */
+                      async_reader_done_t, void *p_user);
+
+int async_reader_submit(async_reader_t);
+
+int async_reader_process(async_reader_t, int wait);
+
+uint32_t async_reader_get_pending(async_reader_t);
+
+int async_reader_get_fd(async_reader_t);
+
+/** @brief Register a buffer for loads. Does nothing if not supported by the reader
+ * @return error
+ */
+int async_reader_register_buffer(async_reader_t, unsigned char *p_buffer, size_t size);
+
+/** @brief Wait for all pending operations, calling their callbacks
+ * @return error
+ */
+int async_reader_wait_all(async_reader_t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @} */
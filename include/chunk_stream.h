@@ -0,0 +1,67 @@
+/************************************************************************************************************
+ * Copyright (c) 2017, Dolby Laboratories Inc.
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ *    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+ *    promote products derived from this software without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ ************************************************************************************************************/
+/** @defgroup chunk_stream
+ * @brief Provide fragments from a source that is read in chunks.
+ * Implements the fragment_reader_t API.
+ *
+ * The input is read in chunks as it becomes available and fed to the
+ * mp4d_pusher_push() parser. A 'moof' (or 'moov') box is returned by
+ * next_atom() as soon as it is complete, without waiting for its 'mdat'.
+ * Loading a sample only waits for the bytes of that sample, so samples of
+ * a low-latency CMAF chunk are released while the 'mdat' is still arriving.
+ * @{
+ */
+#ifndef CHUNK_STREAM_H
+#define CHUNK_STREAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "fragment_stream.h"
+
+/** @brief Create a chunked fragment stream from a local file or FIFO
+ * @return error
+ */
+int chunk_stream_new(fragment_reader_t *,     /**< [out] */
+                     const char *path);
+
+/** @brief Follow a file which is still being written
+ *
+ * At the end of the file, the stream waits for the file to grow (see
+ * file_stream_follow()), so samples are released while their 'mdat' is
+ * being written. The end of the stream is reached when the file has not
+ * grown for timeout_ms.
+ *
+ * @return error
+ */
+int chunk_stream_follow(fragment_reader_t,    /**< Chunk stream object */
+                        uint32_t timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @} */
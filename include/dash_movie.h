@@ -0,0 +1,73 @@
+/************************************************************************************************************
+ * Copyright (c) 2017, Dolby Laboratories Inc.
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ *    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+ *    promote products derived from this software without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ ************************************************************************************************************/
+/** @defgroup dash_movie
+ *
+ * @brief Open a DASH presentation from a local MPD and its segment files
+ *
+ * Implements the movie_t API. Each AdaptationSet of the (first) Period is a
+ * stream, with the @bandwidth of its Representations as the bit rates (in
+ * increasing order). The stream_info of a stream has track_ID 0, and the
+ * stream name is the @id of the AdaptationSet (or its index). get_stream_info()
+ * and get_sampleentry() describe the first track of the init segment of the
+ * selected Representation; get_movie_info() takes the movie time scale from
+ * the first AdaptationSet.
+ *
+ * Segment addressing:
+ * - SegmentTemplate: @initialization and @media, with $RepresentationID$,
+ *   $Number$, $Bandwidth$ and $Time$ (and %0<width>d formats), from @duration or a
+ *   SegmentTimeline. If the Period has no duration, media segments are taken
+ *   until the first one which does not exist.
+ * - SegmentList: Initialization and SegmentURL, with byte ranges.
+ * - SegmentBase (or only a BaseURL): one file, split into segments by its
+ *   'sidx' box, or at each 'moof' if it has none.
+ * URLs are resolved relative to the MPD; only local files are supported.
+ *
+ * Each Representation is a segment_session, created when it is first used.
+ * Its init segment is parsed once, and the next prefetch_segments media
+ * segments are read in the background (see segment_session_set_prefetch()).
+ * @{
+ */
+#ifndef DASH_MOVIE_H
+#define DASH_MOVIE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "movie.h"
+
+/** @brief Constructor
+ * @return error
+ */
+int dash_movie_new(const char *mpd_path,          /**< path to the MPD */
+                   uint32_t prefetch_segments,    /**< segments to load ahead per Representation, or 0 */
+                   movie_t *                      /**< [out] */
+                   );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @} */
@@ -0,0 +1,108 @@
+/************************************************************************************************************
+ * Copyright (c) 2017, Dolby Laboratories Inc.
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ *    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+ *    promote products derived from this software without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ ************************************************************************************************************/
+/** @defgroup decrypt_pool
+ * @brief Decrypt samples on worker threads.
+ *
+ * The samples of a fragment can be decrypted independently of each other
+ * once they are loaded and their IV and subsample map are known. A pool
+ * decrypts the submitted samples on its worker threads, in any order; the
+ * caller waits for each sample before its output, so that the output order
+ * is kept.
+ *
+ * The jobs are owned by the caller, and must stay valid (with the sample
+ * data and the sample_crypt_t they point to) until they are done. A pool
+ * without threads (num_threads 0, or built without pthreads) decrypts in
+ * decrypt_pool_submit().
+ *
+ * A pool is used from one thread: the one submitting and waiting.
+ * @{
+ */
+#ifndef DECRYPT_POOL_H
+#define DECRYPT_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "decryptor.h"
+
+#define DECRYPT_POOL_MAX_THREADS 64
+
+typedef struct decrypt_pool_t_ * decrypt_pool_t;
+
+/** @brief A sample to decrypt in place */
+typedef struct decrypt_job_t_
+{
+    decryptor_t decryptor;
+    const sample_crypt_t *p_crypt;
+    unsigned char *p_data;
+    uint32_t size;
+
+    int done;                      /* (boolean) set by the pool */
+    int err;                       /* of decryptor_decrypt(), when done */
+    struct decrypt_job_t_ *next;   /* of the pool queue */
+} decrypt_job_t;
+
+/** @brief Create a pool of worker threads
+ * @return error
+ */
+int decrypt_pool_new(decrypt_pool_t *,     /**< [out] */
+                     uint32_t num_threads  /**< up to DECRYPT_POOL_MAX_THREADS */
+                     );
+
+/** @brief Wait for the submitted jobs, destroy and set to NULL */
+void decrypt_pool_destroy(decrypt_pool_t *);
+
+/** @brief Number of worker threads, 0 if samples are decrypted when submitted */
+uint32_t decrypt_pool_get_num_threads(decrypt_pool_t);
+
+/** @brief Queue a job. Its decryptor, p_crypt, p_data and size must be set */
+void decrypt_pool_submit(decrypt_pool_t, decrypt_job_t *);
+
+/** @brief Wait until a submitted job is done
+ * @return error of its decryption
+ */
+int decrypt_pool_wait(decrypt_pool_t, decrypt_job_t *);
+
+/** @brief Wait until all submitted jobs are done */
+void decrypt_pool_wait_all(decrypt_pool_t);
+
+/** @brief Decryption statistics of the pool
+ *
+ * busy_seconds is the sum of the decryption times of the samples (all
+ * threads), active_seconds the wall clock time during which samples were
+ * submitted and not done.
+ */
+void decrypt_pool_get_stats(decrypt_pool_t,
+                            uint64_t *p_bytes,         /**< [out] decrypted */
+                            double *p_busy_seconds,    /**< [out] */
+                            double *p_active_seconds   /**< [out] */
+                            );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @} */
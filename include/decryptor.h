@@ -0,0 +1,174 @@
+/************************************************************************************************************
+ * Copyright (c) 2017, Dolby Laboratories Inc.
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ *    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+ *    promote products derived from this software without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ ************************************************************************************************************/
+/** @defgroup decryptor
+ * @brief Decrypt the samples of 'cenc' (AES-CTR) and 'cbcs' (AES-CBC with
+ * an encryption pattern) protected tracks, in place.
+ *
+ * A decryptor holds the key and the scheme of one sample entry. Each sample
+ * is decrypted with its IV and subsample map (the clear and protected bytes
+ * of the 'senc' box, or of the sample auxiliary information), which the
+ * caller collects into a sample_crypt_t.
+ *
+ * 'cenc': the protected bytes of all subsamples are one AES-CTR stream,
+ * starting with the counter block of the sample IV.
+ * 'cbcs': the protected bytes of each subsample are AES-CBC decrypted with
+ * the constant IV (or the sample IV), in the crypt_byte_block and
+ * skip_byte_block pattern of 'tenc'. A partial block at the end is clear.
+ * PIFF tracks with AlgorithmID 1 (AES-CTR) are decrypted like 'cenc'.
+ *
+ * AES-128 uses the AES-NI instructions if the CPU has them (x86, unless
+ * built with DECRYPTOR_NO_AESNI), and portable C otherwise.
+ *
+ * decryptor_decrypt() does not modify the decryptor, and can be called from
+ * several threads at once.
+ * @{
+ */
+#ifndef DECRYPTOR_H
+#define DECRYPTOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "mp4d_types.h"
+
+#include <stddef.h>
+
+typedef struct decryptor_t_ * decryptor_t;
+typedef struct decryptor_key_t_ * decryptor_key_t;
+
+/** @brief IV and subsample map of one sample */
+typedef struct
+{
+    unsigned char iv[16];
+    uint8_t iv_size;             /* 8 or 16, or 0 for the constant IV of the decryptor */
+    uint32_t num_subsamples;     /* 0: the whole sample is protected */
+    uint32_t *clear_bytes;       /* per subsample */
+    uint32_t *protected_bytes;   /* per subsample, following its clear bytes */
+    uint32_t max_subsamples;     /* allocated entries */
+} sample_crypt_t;
+
+/** @brief Initialize without subsamples */
+void sample_crypt_init(sample_crypt_t *);
+
+/** @brief Free the subsample map */
+void sample_crypt_free(sample_crypt_t *);
+
+/** @brief Set the IV and the subsample map
+ *
+ * The subsample entries have the format of the 'senc' box and the 'cenc'
+ * sample auxiliary information: 16-bit BytesOfClearData followed by 32-bit
+ * BytesOfProtectedData (big endian). They are copied.
+ *
+ * @return error
+ */
+int sample_crypt_set(sample_crypt_t *,
+                     const unsigned char *p_iv,       /**< iv_size bytes */
+                     uint8_t iv_size,
+                     const unsigned char *p_entries,  /**< 6 * num_subsamples bytes, or NULL */
+                     uint32_t num_subsamples
+                     );
+
+/** @brief Set the IV and the subsample map from the 'senc' entries of a subsample map
+ *
+ * The clear and protected bytes of p_map are copied.
+ *
+ * @return error
+ */
+int sample_crypt_set_map(sample_crypt_t *,
+                         const unsigned char *p_iv,          /**< iv_size bytes */
+                         uint8_t iv_size,
+                         const mp4d_subsample_map_t *p_map
+                         );
+
+/** @brief Set the IV and the subsample map from 'cenc' sample auxiliary information
+ *
+ * The aux info is the IV, optionally followed by the 16-bit subsample count
+ * and the subsample entries.
+ *
+ * @return error
+ */
+int sample_crypt_parse_aux(sample_crypt_t *,
+                           const unsigned char *p_aux,
+                           size_t size,
+                           uint8_t iv_size
+                           );
+
+/** @brief Expand an AES-128 key into its round keys, once for all the decryptors using it
+ * @return error
+ */
+int decryptor_key_new(decryptor_key_t *,             /**< [out] */
+                      const unsigned char key[16]
+                      );
+
+/** @brief Destroy and set to NULL */
+void decryptor_key_destroy(decryptor_key_t *);
+
+/** @brief Create a decryptor for the encryption of a sample entry
+ *
+ * The round keys are expanded from the key.
+ *
+ * @return error, e.g. an unsupported scheme
+ */
+int decryptor_new(decryptor_t *,                    /**< [out] */
+                  const mp4d_crypt_info_t *p_info,  /**< scheme, pattern and constant IV */
+                  const unsigned char key[16]
+                  );
+
+/** @brief Create a decryptor using an expanded key
+ *
+ * The key is shared, not copied: it must be destroyed after the decryptor.
+ *
+ * @return error, e.g. an unsupported scheme
+ */
+int decryptor_new_with_key(decryptor_t *,                    /**< [out] */
+                           const mp4d_crypt_info_t *p_info,  /**< scheme, pattern and constant IV */
+                           decryptor_key_t key
+                           );
+
+/** @brief Destroy and set to NULL */
+void decryptor_destroy(decryptor_t *);
+
+/** @brief Decrypt a sample in place
+ *
+ * The clear and protected bytes of the subsamples must not exceed the sample
+ * size. Bytes after the last subsample are clear.
+ *
+ * @return error
+ */
+int decryptor_decrypt(decryptor_t,
+                      const sample_crypt_t *,
+                      unsigned char *p_data,
+                      uint32_t size
+                      );
+
+/** @brief Name of the AES implementation in use: "AES-NI" or "portable" */
+const char *decryptor_implementation(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @} */
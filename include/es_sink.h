@@ -155,6 +155,15 @@ h264_writer_new(
     const char *output_folder
     );
 
+/* Writes each sample to its own Annex-B file, preceded by the parameter sets */
+int
+h264_keyframe_writer_new(
+    es_sink_t *,     /**< [out] */
+    uint32_t track_ID,
+    const char *stream_name,
+    const char *output_folder
+    );
+
 int
 h264_validator_new(
     es_sink_t *,     /**< [out] */
@@ -191,6 +200,15 @@ hevc_writer_new(
     uint32_t stdout_flag
     );
 
+/* Writes each sample to its own Annex-B file, preceded by the parameter sets */
+int
+hevc_keyframe_writer_new(
+    es_sink_t *,     /**< [out] */
+    uint32_t track_ID,
+    const char *stream_name,
+    const char *output_folder
+    );
+
 int
 hevc_validator_new(
     es_sink_t *,     /**< [out] */
@@ -31,6 +31,9 @@
  * is ignored for file based streams, and all segments are provided.
  *
  * Always returns 0 as the only possible bit rate (not applicable).
+ *
+ * If the path is "-" (stdin) or a FIFO, the input is read once, from start
+ * to end, and shared by all fragment streams (see pipe_stream).
  * @{
  */
 #ifndef FILE_MOVIE_H
@@ -49,6 +52,32 @@ int movie_new(const char *path,   /**< path to MP4 file */
                            movie_t *        /**< [out] */
                            );
 
+/** @brief Constructor for low-latency playback
+ *
+ * Same as movie_new(), but the fragment streams read the file in chunks
+ * (see chunk_stream, or pipe_source_set_chunked() for a pipe), and samples
+ * are provided as soon as their data has been read, before the enclosing
+ * 'mdat' is complete. If timeout_ms is non-zero, the file is followed while
+ * it is being written, as with following_movie_new().
+ * @return error
+ */
+int chunked_movie_new(const char *path,   /**< path to MP4 file */
+                      uint32_t timeout_ms,
+                      movie_t *           /**< [out] */
+                      );
+
+/** @brief Constructor for a file which is still being written
+ *
+ * Same as movie_new(), but at the end of the file the fragment streams wait
+ * for the file to grow (see file_stream_follow()). The presentation ends when
+ * the file has not grown for timeout_ms.
+ * @return error
+ */
+int following_movie_new(const char *path,   /**< path to MP4 file */
+                        uint32_t timeout_ms,
+                        movie_t *           /**< [out] */
+                        );
+
 int movie_destroy(movie_t);
 
 #ifdef __cplusplus
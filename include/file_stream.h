@@ -44,6 +44,43 @@ extern "C" {
 int file_stream_new(fragment_reader_t *,     /**< [out] */
                              const char *path);
 
+/** @brief Follow a file which is still being written
+ *
+ * At the end of the file, next_atom() and load() wait for the file to grow
+ * (woken by inotify where available, otherwise by polling the file size),
+ * and continue after the last complete box. The end of the stream is
+ * reached when the file has not grown for timeout_ms.
+ *
+ * @return error
+ */
+int file_stream_follow(fragment_reader_t,    /* File stream object */
+                       uint32_t timeout_ms);
+
+/** @brief Wait for a file which is still being written, see file_stream_follow() */
+typedef struct
+{
+    uint32_t timeout_ms;    /* Give up after the file did not grow for this long */
+    int inotify_fd;         /* -1: poll the file size */
+} file_follower_t;
+
+void file_follower_init(file_follower_t *,
+                        const char *path,
+                        uint32_t timeout_ms);
+
+void file_follower_deinit(file_follower_t *);
+
+/** @brief Wait until the file open as fd has at least min_size bytes
+ *
+ *  Wakes up on inotify events if available, otherwise polls the file size.
+ *
+ *  @return 0: file has grown
+ *          1: unexpected error
+ *          2: timeout, the file did not grow
+ */
+int file_follower_wait(file_follower_t *,
+                       int fd,
+                       uint64_t min_size);
+
 
 
 /** @brief Seek according to a sidx box in the file
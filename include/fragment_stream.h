@@ -105,6 +105,37 @@ struct fragment_reader_t_
     int (*get_type)(fragment_reader_t,
                     mp4d_ftyp_info_t *p_type  /**< [out] pointer to memory owned by the mp4_source object. */
                     );
+
+    /* @brief Hint that a byte range will be loaded soon
+     *
+     * The source may start reading the range in the background.
+     * Optional (NULL if not implemented).
+     *
+     * @return error
+     */
+    int (*prefetch)(fragment_reader_t,
+                    uint64_t position,
+                    uint64_t size
+                    );
+
+    /* @brief Get a pointer to data held in memory, instead of loading a copy
+     *
+     * For sources reading from caller-owned memory. The data stays valid
+     * until the source is destroyed.
+     * Optional (NULL if not implemented).
+     *
+     * @return 0: *pp_data points to the data
+     *         other: the data is not in memory, load() it instead
+     */
+    int (*get_data)(fragment_reader_t,
+                    uint64_t position,
+                    uint32_t size,
+                    const unsigned char **pp_data  /**< [out] */
+                    );
+
+    /* Reports the byte ranges read from the input, see fragment_reader_set_read_callback() */
+    void (*on_read)(void *p_user, uint64_t position, uint64_t size);
+    void *p_read_user;
 };
 
 /** @brief Destructor
@@ -149,6 +180,41 @@ int fragment_reader_get_type(fragment_reader_t,
                 mp4d_ftyp_info_t *p_type  /**< [out] pointer to memory owned by the mp4_source object. */
                 );
 
+/** @brief Hint that a byte range will be loaded soon. Does nothing if not supported by the source.
+ */
+int fragment_reader_prefetch(fragment_reader_t,
+                uint64_t position,
+                uint64_t size
+                );
+
+/** @brief Get a pointer to data held in memory by the source, without copying
+ *  @return 0: *pp_data points to the data
+ *          other: not supported by the source, or not in memory: use fragment_reader_load()
+ */
+int fragment_reader_get_data(fragment_reader_t,
+                uint64_t position,
+                uint32_t size,
+                const unsigned char **pp_data  /**< [out] */
+                );
+
+/** @brief Report the byte ranges which the source reads to a callback, NULL: stop reporting
+ *
+ *  Reported are the boxes of next_atom() (of mdat, free and skip boxes only
+ *  the header, their payload is not parsed), the loads, and what a seek
+ *  reads besides, e.g. an mfra box. The source must implement get_offset().
+ */
+void fragment_reader_set_read_callback(fragment_reader_t,
+                void (*on_read)(void *p_user, uint64_t position, uint64_t size),
+                void *p_user
+                );
+
+/** @brief Report a byte range read by the source itself, to the callback if set
+ */
+void fragment_reader_report_read(fragment_reader_t,
+                uint64_t position,
+                uint64_t size
+                );
+
 
 
 
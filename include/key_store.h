@@ -0,0 +1,87 @@
+/************************************************************************************************************
+ * Copyright (c) 2017, Dolby Laboratories Inc.
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ *    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+ *    promote products derived from this software without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ ************************************************************************************************************/
+/** @defgroup key_store
+ * @brief Content keys by KID, with their expanded AES round keys.
+ *
+ * The keys are looked up by their 16-byte KID in a hash table, so that
+ * content with many keys (key rotation, a key per track) is not scanned
+ * key by key. The round keys of a key are expanded once, when the key is
+ * added. The decryptors created for a KID and an encryption scheme are
+ * kept by the store, and shared by all the sample entries and fragments
+ * that use them.
+ * @{
+ */
+#ifndef KEY_STORE_H
+#define KEY_STORE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "decryptor.h"
+
+typedef struct key_store_t_ * key_store_t;
+
+/** @brief Create an empty key store
+ * @return error
+ */
+int key_store_new(key_store_t *);
+
+/** @brief Destroy the keys and the decryptors of the store, and set to NULL */
+void key_store_destroy(key_store_t *);
+
+/** @brief Add the key of a KID, and expand its round keys
+ *
+ * Adding the same key again has no effect.
+ *
+ * @return error, e.g. another key for the KID
+ */
+int key_store_add(key_store_t,
+                  const unsigned char kid[16],
+                  const unsigned char key[16]
+                  );
+
+/** @brief Number of keys */
+uint32_t key_store_get_num_keys(key_store_t);
+
+/** @brief Get the decryptor of the key of p_info->key_id, for the scheme of p_info
+ *
+ * The decryptor is created on the first request for the KID and the scheme
+ * (scheme type, pattern and constant IV), and returned again afterwards.
+ * It belongs to the store.
+ *
+ * @return error, e.g. an unsupported scheme. If there is no key for the
+ *         KID, *p_decryptor is set to NULL and no error is returned
+ */
+int key_store_get_decryptor(key_store_t,
+                            const mp4d_crypt_info_t *p_info,
+                            decryptor_t *p_decryptor          /**< [out] */
+                            );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @} */
@@ -0,0 +1,85 @@
+/************************************************************************************************************
+ * Copyright (c) 2017, Dolby Laboratories Inc.
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ *    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+ *    promote products derived from this software without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ ************************************************************************************************************/
+/** @defgroup mem_stream
+ * @brief Provide fragments from segments already in memory.
+ * Implements the fragment_reader_t API.
+ *
+ * The segments (e.g. an init segment followed by media segments) are owned
+ * by the caller, and must stay valid until the stream is destroyed. They are
+ * addressed as if they were concatenated into one file: the first byte of a
+ * segment has the position of the end of the previous segment. Each top-level
+ * box must be contained in one segment.
+ *
+ * Boxes are parsed in place and no file is accessed. Samples need not be
+ * copied either: fragment_reader_get_data() returns pointers into the
+ * segments, load() copies.
+ * Segments can be appended at any time; next_atom() returns 2 at the end of
+ * the last segment, and continues with the next one after it is appended.
+ *
+ * seek() moves to the first 'moov' or 'moof', at time 0.
+ * @{
+ */
+#ifndef MEM_STREAM_H
+#define MEM_STREAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "fragment_stream.h"
+
+/** @brief Create a fragment stream without segments
+ * @return error
+ */
+int mem_stream_new(fragment_reader_t *     /**< [out] */
+                   );
+
+/** @brief Append a segment
+ * @return error
+ */
+int mem_stream_append(fragment_reader_t,
+                      const unsigned char *p_data,  /**< caller-owned, valid until the stream is destroyed */
+                      uint64_t size
+                      );
+
+/** @brief Get a pointer to data in the segments, without copying
+ *
+ * The get_data() function of the fragment_reader_t: same as
+ * fragment_reader_load(), but returns a pointer into the segment memory.
+ * The data must be contained in one segment.
+ *
+ * @return error
+ */
+int mem_stream_get_data(fragment_reader_t,
+                        uint64_t position,
+                        uint32_t size,
+                        const unsigned char **pp_data  /**< [out] */
+                        );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @} */
@@ -98,6 +98,25 @@ mp4d_tts_get_stts_next(tts_reader_t *p_r, uint64_t *p_ts, uint32_t *p_duration);
 mp4d_error_t
 mp4d_tts_get_ctts_next(tts_reader_t *p_r, uint32_t *p_ts);
 
+/* @brief Skip samples
+
+   Moves the reader forward by 'count' samples, jumping over whole
+   table entries. After skipping, p_r->cur_dts is the time stamp of the
+   last skipped sample (stts).
+*/
+mp4d_error_t
+mp4d_tts_skip(tts_reader_t *p_r, uint32_t count);
+
+/* @brief Move back by 'count' samples
+
+   Reverse of mp4d_tts_skip(): steps back over whole table entries. After
+   rewinding, p_r->cur_dts is the time stamp of the sample before the next
+   sample to be returned (stts). Rewinding to the first sample restores
+   the state after mp4d_tts_init().
+*/
+mp4d_error_t
+mp4d_tts_rewind(tts_reader_t *p_r, uint32_t count);
+
 /** 
   @brief Reader of the sample size atoms (stsz/stz2)
 */
@@ -128,6 +147,24 @@ mp4d_stsz_get(stsz_reader_t *,
               uint64_t sample_index, /* counting from zero */
               uint32_t *);
 
+/**
+  @brief Skip sample sizes without reading them
+
+  @return MP4D_NO_ERROR, or
+          MP4D_E_NEXT_SEGMENT: fewer than 'count' samples are left
+*/
+mp4d_error_t
+mp4d_stsz_skip(stsz_reader_t *, uint32_t count);
+
+/**
+  @brief Move back by 'count' sample sizes
+
+  @return MP4D_NO_ERROR, or
+          MP4D_E_WRONG_ARGUMENT: fewer than 'count' samples have been read
+*/
+mp4d_error_t
+mp4d_stsz_rewind(stsz_reader_t *, uint32_t count);
+
 /**
    @brief Reader of the sample to chunk index (stsc) atoms
 */
@@ -157,6 +194,29 @@ mp4d_stsc_get_next(stsc_reader_t *,
                    uint32_t *sample_index_in_chunk     /** [out] sample number in this chunk, counting from zero */
                    );
 
+/**
+   @brief Skip samples, jumping over whole chunks of an entry
+
+   After skipping, p_r->samples_consumed - 1 is the index in chunk of the
+   last skipped sample.
+*/
+mp4d_error_t
+mp4d_stsc_skip(stsc_reader_t *,
+               uint32_t count,
+               uint32_t *p_chunks_started   /**< [out] number of chunks entered while skipping */
+               );
+
+/**
+   @brief Move back by 'count' samples
+
+   After rewinding, p_r->cur_chunk is the chunk of the sample before the
+   next sample to be returned, and p_r->samples_consumed - 1 is its index
+   in the chunk. Rewinding to the first sample restores the state after
+   mp4d_stsc_init().
+*/
+mp4d_error_t
+mp4d_stsc_rewind(stsc_reader_t *, uint32_t count);
+
 /**
    @brief Reader of the chunk offsets boxes (stco/co64)
 */
@@ -180,6 +240,12 @@ mp4d_co_get_next(co_reader_t *,
                  uint64_t *  /** [out] 64-bit integer for both stco and co64 */
     );
 
+mp4d_error_t
+mp4d_co_skip(co_reader_t *, uint32_t count);
+
+mp4d_error_t
+mp4d_co_rewind(co_reader_t *, uint32_t count);
+
 
 
 /**
@@ -205,38 +271,93 @@ mp4d_stss_get_next(stss_reader_t *,
                    int * is_sync  /** [out] */
     );
 
+mp4d_error_t
+mp4d_stss_skip(stss_reader_t *, uint32_t count);
+
+/**
+   @brief Get the first sync sample after the current sample, without moving forward
+
+   @return MP4D_E_INFO_NOT_AVAIL if there is no stss box
+*/
+mp4d_error_t
+mp4d_stss_peek_sync(stss_reader_t *,
+                    uint32_t *p_sample_number  /**< [out] counting from one, (uint32_t) -1 if no more sync samples */
+    );
+
+mp4d_error_t
+mp4d_stss_rewind(stss_reader_t *, uint32_t count);
+
+/**
+   @brief Random access to the stss table
+
+   @return MP4D_E_INFO_NOT_AVAIL if there is no stss box,
+           MP4D_E_WRONG_ARGUMENT if entry_index is out of range
+*/
+mp4d_error_t
+mp4d_stss_get_entry(const stss_reader_t *,
+                    uint32_t entry_index,      /**< counting from zero, less than p_r->count */
+                    uint32_t *p_sample_number  /**< [out] counting from one */
+    );
+
+
+/**
+   @brief A segment of the edit list, in the media time scale
+
+   Empty edits are not stored, they only shift the presentation time of the
+   following segments.
+*/
+typedef struct elst_entry_t_
+{
+    int64_t media_time;          /* start of the segment in the media */
+    int64_t media_end;           /* media_time + segment_duration */
+    int64_t max_end;             /* largest end of this and the preceding segments, the search key */
+    uint64_t presentation_time;  /* start of the segment in the presentation */
+    int16_t media_rate;          /* 1, or 0 for a dwell */
+} elst_entry_t;
 
 /**
    @brief Reader of edit list box (elst)
+
+   The edits are converted to a table of segments (in memory provided by the
+   caller) when initializing, so that the presentation time of any media time
+   is found in O(log n) time, in any order.
 */
 typedef struct elst_reader_t_
 {
-    mp4d_buffer_t buffer;
-    uint8_t version;
-    uint32_t entries_left;
-    uint32_t movie_ts, media_ts; /* movie, media time scale */
-
-    /* current entry: */
-    int64_t media_time;           /* media time scale */
-    uint64_t segment_start;       /* movie time scale */
-    uint64_t segment_duration;    /* movie time scale */
-    int16_t media_rate;
+    elst_entry_t *p_entries;     /* NULL means: no elst box, trivial mapping */
+    uint32_t num_entries;
+    mp4d_error_t end_error;      /* for media times after the last segment */
 } elst_reader_t;
 
+/**
+   @brief Get the number of entries of an elst box, to size the table of mp4d_elst_init()
+*/
+mp4d_error_t
+mp4d_elst_get_entry_count(const mp4d_atom_t *,
+                          uint32_t *p_count    /**< [out] */
+    );
+
+/**
+   @return MP4D_E_BUFFER_TOO_SMALL if the elst box has more than max_entries entries
+*/
 mp4d_error_t
 mp4d_elst_init(elst_reader_t *,
                mp4d_atom_t *,        /**<  NULL means: no elst box, trivial mapping */
+               elst_entry_t *p_entries,  /**< table for the segments, kept by the reader */
+               uint32_t max_entries,     /**< size of p_entries, see mp4d_elst_get_entry_count() */
                uint32_t media_time_scale,
                uint32_t movie_time_scale
     );
 
 
 /*
+   Does not change the reader, media times can be given in any order.
+
    @return: MP4D_E_INFO_NOT_AVAIL if no part of the sample corresponds
             to a presentation time
 */
 mp4d_error_t
-mp4d_elst_get_presentation_time(elst_reader_t *p_r,
+mp4d_elst_get_presentation_time(const elst_reader_t *p_r,
                                 uint64_t media_time,  /** sample cts (media time scale) */
                                 uint32_t duration,    /** sample duration (media time scale) */
                                 int64_t *p_time,      /**< [out] PTS (media time scale) of sample begin, whether sample begin is included
@@ -268,6 +389,12 @@ mp4d_sdtp_get_next(sdtp_reader_t *,
                    uint8_t *entry     /**< [out] is_leading + sample_depends_on + sample_is_depended_on + sample_has_redundancy */
     );
 
+mp4d_error_t
+mp4d_sdtp_skip(sdtp_reader_t *, uint32_t count);
+
+mp4d_error_t
+mp4d_sdtp_rewind(sdtp_reader_t *, uint32_t count);
+
 
 /**
    @brief Reader of sample degradation priority (stdp)
@@ -290,6 +417,12 @@ mp4d_stdp_get_next(stdp_reader_t *,
                    uint16_t *p_priority /**< [out] is_leading + sample_depends_on + sample_is_depended_on + sample_has_redundancy */
     );
 
+mp4d_error_t
+mp4d_stdp_skip(stdp_reader_t *, uint32_t count);
+
+mp4d_error_t
+mp4d_stdp_rewind(stdp_reader_t *, uint32_t count);
+
 /**
    @brief Reader of trick play box (trik)
 */
@@ -312,6 +445,9 @@ mp4d_trik_get_next(trik_reader_t *,
                    uint8_t *p_dependency_level /**< [out]  picture dependency level of the sample */
     );
 
+mp4d_error_t
+mp4d_trik_skip(trik_reader_t *, uint32_t count);
+
 /**
    @brief Reader of senc box (CFF senc)
 */
@@ -331,11 +467,30 @@ mp4d_senc_init(senc_reader_t *,
 mp4d_error_t
 mp4d_senc_get_next(senc_reader_t *p_r,
                           uint8_t *init_vector,      /**< [out] initilization vector */
-                          uint8_t iv_size,           /**< [in]  initilization vector size: 8 or 16 */
+                          uint8_t iv_size,           /**< [in]  initilization vector size: 8 or 16 (0: constant IV) */
                           uint16_t *subsample_count, /**< [out] subsample count  */
                           const uint8_t **p_encryp_info     /**< [out] pointer to begin of clear and encrypted bytes */
     );
 
+mp4d_error_t
+mp4d_senc_skip(senc_reader_t *p_r,
+               uint8_t iv_size,           /**< [in]  initilization vector size: 8 or 16 (0: constant IV) */
+               uint32_t count
+    );
+
+/**
+   @brief Decode the subsample entries returned by mp4d_senc_get_next()
+
+   The 'count' entries (16-bit BytesOfClearData, 32-bit BytesOfProtectedData)
+   are decoded into two arrays.
+*/
+mp4d_error_t
+mp4d_senc_decode_subsamples(const uint8_t *p_encryp_info,  /**< as returned by mp4d_senc_get_next() */
+                            uint16_t subsample_count,
+                            uint32_t *p_clear_bytes,       /**< [out] array of subsample_count entries */
+                            uint32_t *p_protected_bytes    /**< [out] array of subsample_count entries */
+    );
+
 
 /**
    @brief Reader of padding bits (padb)
@@ -359,6 +514,12 @@ mp4d_padb_get_next(padb_reader_t *,
                    uint8_t *padding     /**< [out]  */
     );
 
+mp4d_error_t
+mp4d_padb_skip(padb_reader_t *, uint32_t count);
+
+mp4d_error_t
+mp4d_padb_rewind(padb_reader_t *, uint32_t count);
+
 /**
    @brief Reader of subsample info (subs)
 
@@ -404,6 +565,24 @@ mp4d_subs_get_next_size(subs_reader_t *,
                         uint32_t *p_offset    /** relative to sample beginning */
     );
 
+/**
+   @brief Get the sizes of 'count' subsamples at once. Same as calling
+   mp4d_subs_get_next_size() 'count' times, except that the reader is not
+   modified on error.
+*/
+mp4d_error_t
+mp4d_subs_get_sizes(subs_reader_t *,
+                    uint32_t sample_size, /* needed when the subsample info is implicitly given */
+                    uint32_t count,
+                    uint32_t *p_sizes     /**< [out] array of 'count' entries */
+    );
+
+/**
+   @brief Skip samples. Same as calling mp4d_subs_get_next_count() 'count' times
+*/
+mp4d_error_t
+mp4d_subs_skip(subs_reader_t *, uint32_t count);
+
 /**
    @brief Reader of sample aux size (saiz)
 */
@@ -427,6 +606,12 @@ mp4d_saiz_get_next_size(saiz_reader_t *,
                         uint8_t *p_size     /**< [out] zero: no aux information */
     );
 
+mp4d_error_t
+mp4d_saiz_skip(saiz_reader_t *,
+               uint32_t count,
+               uint64_t *p_total_size  /**< [out] sum of the skipped aux info sizes */
+    );
+
 /**
    @brief Reader of sample aux offset (saio)
 */
@@ -456,4 +641,85 @@ mp4d_saio_get_next(saio_reader_t *,
                                                        (for later than the first chunk/trun) */
     );
 
+/**
+   @brief Sample entry of a track fragment run (trun)
+
+   The fields which are not present in the trun are taken from the defaults.
+*/
+typedef struct trun_entry_t_
+{
+    uint32_t duration;
+    uint32_t size;
+    uint32_t flags;
+    int64_t composition_offset;  /* 0 if not present */
+} trun_entry_t;
+
+/**
+   @brief Decoder of trun sample entries
+
+   There is one decode function for each combination of the trun flags
+   0x000100, 0x000200, 0x000400 and 0x000800 (and of the version, for the
+   composition offsets), so that the flags are tested once per trun
+   instead of once per sample. first_sample_flags is not applied.
+*/
+typedef struct trun_decoder_t_
+{
+    void (*decode)(const unsigned char *p_data,
+                   const trun_entry_t *p_defaults,
+                   trun_entry_t *p_entries,
+                   uint32_t count);
+    uint32_t entry_size;      /* bytes per sample entry */
+    trun_entry_t defaults;
+} trun_decoder_t;
+
+mp4d_error_t
+mp4d_trun_decoder_init(trun_decoder_t *,
+                       uint8_t version,
+                       uint32_t tr_flags,
+                       const trun_entry_t *p_defaults  /**< for the fields not in the trun */
+    );
+
+/**
+   @brief Decode the next 'count' sample entries, without consuming them
+
+   @return MP4D_E_BUFFER_TOO_SMALL if p_entries holds less than 'count' entries
+*/
+mp4d_error_t
+mp4d_trun_decode(const trun_decoder_t *,
+                 const mp4d_buffer_t *p_entries,  /**< trun entries, from the next sample */
+                 trun_entry_t *p_out,             /**< [out] array of 'count' entries */
+                 uint32_t count
+    );
+
+/**
+   @brief Get the track_ID of the tfhd of a traf
+*/
+mp4d_error_t
+mp4d_traf_get_track_ID(const mp4d_atom_t *p_traf,
+                       uint32_t *p_track_ID      /**< [out] */
+    );
+
+/**
+   @brief Add a traf to the moof index, in the order of the moof
+
+   A traf without a valid tfhd is counted, but never matches a track_ID.
+*/
+mp4d_error_t
+mp4d_moof_add_traf(mp4d_moof_t *,
+                   const mp4d_atom_t *p_traf
+    );
+
+/**
+   @brief Look up the traf for a track_ID in the moof index
+
+   @return MP4D_E_INFO_NOT_AVAIL if the index is incomplete
+*/
+mp4d_error_t
+mp4d_moof_find_traf(const mp4d_moof_t *,
+                    uint32_t track_ID,
+                    mp4d_atom_t *p_traf,      /**< [out] the first matching traf */
+                    uint32_t *p_count,        /**< [out] number of matching trafs */
+                    uint32_t *p_preceding     /**< [out] number of trafs of other tracks before the first match */
+    );
+
 #endif
@@ -334,6 +334,102 @@ mp4d_demuxer_get_atom
      ,mp4d_atom_t *p_atom              /**< [out] */
     );
     
+/**************************************************
+    Push Interface
+**************************************************/
+
+/**
+ * @brief Opaque declaration of pointer to the push parser object.
+ *
+ * The push parser sits in front of a demuxer instance. It accepts input in
+ * chunks of any size and keeps just enough state to assemble top-level boxes,
+ * so the caller never has to re-submit data it has already pushed.
+ */
+typedef struct mp4d_pusher_t_ *mp4d_pusher_ptr_t;
+
+/**
+ * @brief Push parser event types.
+ */
+typedef enum
+{
+    MP4D_PUSH_NONE = 0,   /**< All input was consumed without completing an event. Push more data. */
+    MP4D_PUSH_BOX,        /**< A top-level box is available. For buffered boxes, the demuxer has been initialized
+                               with this box, exactly as if mp4d_demuxer_parse() had been called on it. For
+                               streamed boxes ('mdat', 'free', 'skip', and boxes larger than max_box_size),
+                               only the box header has been parsed and the payload follows as MP4D_PUSH_DATA events. */
+    MP4D_PUSH_DATA        /**< Payload bytes of a streamed box. */
+} mp4d_push_event_type_t;
+
+/**
+ * @brief Push parser event.
+ */
+typedef struct mp4d_push_event_t_
+{
+    mp4d_push_event_type_t type;     /**< Event type */
+    mp4d_fourcc_t          box_type; /**< Type of the top-level box the event belongs to */
+    uint64_t               offset;   /**< MP4D_PUSH_BOX: file offset of the box.
+                                          MP4D_PUSH_DATA: file offset of p_data[0]. */
+    uint64_t               size;     /**< MP4D_PUSH_BOX: total box size including the header, or 0 if the box
+                                          extends to the end of the file.
+                                          MP4D_PUSH_DATA: number of bytes in p_data. */
+    uint32_t               header_size; /**< MP4D_PUSH_BOX: size of the box header */
+    int                    is_streamed; /**< MP4D_PUSH_BOX: true if the payload follows as MP4D_PUSH_DATA events */
+    const unsigned char   *p_data;   /**< MP4D_PUSH_BOX: the box (buffered boxes) or the box header (streamed boxes).
+                                          MP4D_PUSH_DATA: payload bytes. Points into the chunk passed to
+                                          mp4d_pusher_push() whenever possible, otherwise into the internal buffer.
+                                          Valid until the next call of mp4d_pusher_push(). */
+} mp4d_push_event_t;
+
+/**
+ * @brief Return the memory needed by a push parser instance.
+ *
+ * @return Error code:
+ *     OK (0) for success.
+ */
+int
+mp4d_pusher_query_mem
+    (uint64_t  max_box_size       /**< [in]  Size of the largest box that is buffered, e.g. 'moov' or 'moof' */
+    ,uint64_t *p_static_mem_size  /**< [out] Static memory size */
+    );
+
+/**
+ * @brief Initialize a push parser instance.
+ *
+ * @return Error code:
+ *     OK (0) for success.
+ */
+int
+mp4d_pusher_init
+    (mp4d_pusher_ptr_t  *p_pusher_ptr  /**< [out] Pointer to push parser pointer */
+    ,mp4d_demuxer_ptr_t  p_demuxer     /**< [in]  Demuxer which is initialized with each buffered box */
+    ,uint64_t            max_box_size  /**< [in]  Same value as passed to mp4d_pusher_query_mem() */
+    ,void               *p_static_mem  /**< [in]  Static memory */
+    );
+
+/**
+ * @brief Push a chunk of input data.
+ *
+ * Consumes input until one event is complete, or until the chunk is exhausted.
+ * Call repeatedly with the unconsumed remainder of the chunk until MP4D_PUSH_NONE
+ * is returned. Boxes which are completely contained in the chunk are parsed in place,
+ * without copying. 'moov' and 'moof' boxes larger than max_box_size are an error,
+ * other large boxes are streamed.
+ *
+ * @return Error code:
+ *     OK (0) for success.
+ *     MP4D_E_BUFFER_TOO_SMALL - A 'moov' or 'moof' box is larger than max_box_size.
+ *     MP4D_E_INVALID_ATOM     - Invalid box header, or the input ended inside a box.
+ */
+int
+mp4d_pusher_push
+    (mp4d_pusher_ptr_t    p_pusher     /**< [in]  Pointer to the push parser */
+    ,const unsigned char *p_chunk      /**< [in]  Input chunk. May be NULL if size is 0. */
+    ,uint64_t             size         /**< [in]  Input chunk size */
+    ,int                  is_eof       /**< [in]  Indicates that the chunk ends at the end of the file. */
+    ,uint64_t            *p_consumed   /**< [out] Number of bytes consumed from the chunk */
+    ,mp4d_push_event_t   *p_event      /**< [out] Event */
+    );
+
 /**************************************************
     Instantiate
 **************************************************/
@@ -155,6 +155,20 @@ typedef struct mp4d_moov_t_ {
     mp4d_meta_t meta;
 } mp4d_moov_t;
 
+#define MP4D_MAX_TRAFS 32
+
+/* Index of the traf boxes of a moof, by the track_ID of their tfhd.
+   Built once per moof, so that each track reader finds its own traf
+   without walking the whole moof. */
+typedef struct mp4d_moof_t_ {
+    uint32_t num_traf;     /* All trafs, may exceed MP4D_MAX_TRAFS (then the index is incomplete) */
+    struct {
+        uint32_t track_ID; /* 0 if the traf has no valid tfhd */
+        mp4d_atom_t atom;
+    } traf[MP4D_MAX_TRAFS];
+    int complete;          /* boolean: all of the moof was walked */
+} mp4d_moof_t;
+
 typedef union mp4d_scratch_t_ {
     mp4d_trak_t trak;
 } mp4d_demuxer_scratch_t;
@@ -170,6 +184,7 @@ struct mp4d_demuxer_t_ {
         mp4d_bloc_t bloc;
         mp4d_pdin_t pdin;
         mp4d_moov_t moov;
+        mp4d_moof_t moof;
     } curr;
     mp4d_hdlr_t hdlr;
     mp4d_meta_t meta;
@@ -179,6 +194,32 @@ struct mp4d_demuxer_t_ {
     struct mp4d_navigator_t_ navigator;
 };
 
+/**
+ * @brief Push parser states
+ */
+typedef enum
+{
+    MP4D_PUSH_STATE_HEADER = 0,   /**< Collecting the header of the next box */
+    MP4D_PUSH_STATE_BUFFER,       /**< Collecting a box in the internal buffer */
+    MP4D_PUSH_STATE_STREAM        /**< Passing through the payload of a streamed box */
+} mp4d_push_state_t;
+
+struct mp4d_pusher_t_ {
+    struct mp4d_demuxer_t_ *p_dmux;
+    mp4d_push_state_t state;
+    unsigned char header[32];     /**< Box header: size, type, largesize, uuid */
+    uint32_t header_fill;
+    uint32_t header_size;
+    mp4d_fourcc_t box_type;
+    uint64_t box_offset;          /**< File offset of the current box */
+    uint64_t box_size;            /**< Total size of the current box, 0 if it extends to the end of the file */
+    uint64_t offset;              /**< File offset of the next input byte */
+    uint64_t remaining;           /**< Streamed payload bytes left in the current box */
+    unsigned char *p_buf;         /**< Box buffer, max_box_size bytes */
+    uint64_t buf_size;
+    uint64_t buf_fill;
+};
+
 
 /****************************************************************************
     System Calls
@@ -39,21 +39,77 @@ extern "C" {
 #include "mp4d_demux.h"
 #include "mp4d_types.h"
 
-/** @brief The maximum number of edits (number of entries in moov:trak:edts:elst)
- * that the trackreader guarantees to support. Can be redefined to a higher number.
+/** @brief The number of edits (number of entries in moov:trak:edts:elst)
+ * that the trackreader holds without further memory. Can be redefined to a higher number.
  *
- * A runtime error, MP4D_E_UNSUPPRTED_FORMAT, will happen if reading an elst box
- * which does not fit into the reserved memory bloxk.
+ * Longer edit lists are held in memory given to mp4d_trackreader_set_edit_mem().
+ * Without it, mp4d_trackreader_init_segment() fails with MP4D_E_BUFFER_TOO_SMALL
+ * for such an edit list, see mp4d_trackreader_query_edit_mem().
  *
- * The memory cost is 20 bytes per edit per trackreader instance. (This figure
- * applies to an elst box of version 1; an elst box of version 0 with more than
- * MP4D_MAX_EDITS entries may fit into the reserved memory.)
+ * The memory cost is 40 bytes per edit per trackreader instance.
  *
  */
 #ifndef MP4D_MAX_EDITS          /* allow to define from outside */
 #define MP4D_MAX_EDITS 2
 #endif
 
+/** @brief The number of GOP checkpoints of mp4d_trackreader_prev_gop() in the
+ * dynamic memory of a trackreader. Can be redefined, 0 for none.
+ *
+ * The memory cost is the static memory size per checkpoint, see
+ * mp4d_trackreader_query_mem() and mp4d_trackreader_set_gop_mem().
+ */
+#ifndef MP4D_TRACKREADER_GOP_CHECKPOINTS    /* allow to define from outside */
+#define MP4D_TRACKREADER_GOP_CHECKPOINTS 16
+#endif
+
+/** @brief The features of the trackreader, selected when building the library.
+ *
+ * Each trackreader instance reserves memory for the box readers of all features
+ * that are compiled in (see mp4d_trackreader_query_mem()). Applications running
+ * many trackreaders can leave out the readers they do not need, by defining
+ * one of the profiles
+ *
+ *   MP4D_TRACKREADER_PROFILE_CMAF_CLEAR       movie fragments
+ *   MP4D_TRACKREADER_PROFILE_CMAF_ENCRYPTED   movie fragments, sample encryption
+ *   MP4D_TRACKREADER_PROFILE_PROGRESSIVE      samples in the moov
+ *
+ * or by defining the features below to 0 or 1. All features are compiled in by
+ * default.
+ *
+ *   MP4D_TRACKREADER_MOOV   samples in the moov (stts, ctts, stsc, stco/co64, stss)
+ *   MP4D_TRACKREADER_MOOF   samples in movie fragments (moof: traf, trun, trik)
+ *   MP4D_TRACKREADER_CENC   sample encryption (saiz, saio, senc, PIFF 'senc')
+ *
+ * mp4d_trackreader_init_segment() fails with MP4D_E_UNSUPPRTED_FORMAT for a segment
+ * which needs a left out feature. A moov without samples (e.g. the init segment of
+ * a fragmented file) is read without MP4D_TRACKREADER_MOOV.
+ * test/trackreader_profile_benchmark.sh compares the profiles.
+ */
+#if defined(MP4D_TRACKREADER_PROFILE_CMAF_CLEAR)
+#define MP4D_TRACKREADER_MOOV 0
+#define MP4D_TRACKREADER_MOOF 1
+#define MP4D_TRACKREADER_CENC 0
+#elif defined(MP4D_TRACKREADER_PROFILE_CMAF_ENCRYPTED)
+#define MP4D_TRACKREADER_MOOV 0
+#define MP4D_TRACKREADER_MOOF 1
+#define MP4D_TRACKREADER_CENC 1
+#elif defined(MP4D_TRACKREADER_PROFILE_PROGRESSIVE)
+#define MP4D_TRACKREADER_MOOV 1
+#define MP4D_TRACKREADER_MOOF 0
+#define MP4D_TRACKREADER_CENC 0
+#endif
+
+#ifndef MP4D_TRACKREADER_MOOV   /* allow to define from outside */
+#define MP4D_TRACKREADER_MOOV 1
+#endif
+#ifndef MP4D_TRACKREADER_MOOF
+#define MP4D_TRACKREADER_MOOF 1
+#endif
+#ifndef MP4D_TRACKREADER_CENC
+#define MP4D_TRACKREADER_CENC 1
+#endif
+
 /** @brief Track reader handle
 */
 typedef struct mp4d_trackreader_t_ *mp4d_trackreader_ptr_t;
@@ -137,6 +193,146 @@ mp4d_trackreader_next_subsample
     uint32_t *p_size                  /**< [out] sample size in bytes */
 );
 
+/** @brief Get the subsample map of a sample at once
+
+   Decodes the subsample sizes and the 'senc' clear/protected entries of the
+   last sample returned by mp4d_trackreader_next_sample into caller memory
+   of at least MP4D_SUBSAMPLE_MAP_ENTRIES(p_sample) entries. The map points
+   into that memory. This replaces sample.num_subsamples calls of
+   mp4d_trackreader_next_subsample, and the two must not be mixed for the
+   same sample.
+
+   @return MP4D_NO_ERROR:           OK
+           MP4D_E_BUFFER_TOO_SMALL: mem_entries too small. Nothing is consumed,
+                                    the call can be repeated with more memory
+           MP4D_E_INVALID_ATOM:     truncated 'senc' box
+           MP4D_E_WRONG_ARGUMENT:   NULL pointers
+*/
+int
+mp4d_trackreader_get_subsamples
+(
+    mp4d_trackreader_ptr_t p_tr,      /**< trackreader handle */
+    const mp4d_sampleref_t *p_sample, /**< sample which was provided by mp4d_trackreader_next_sample */
+    uint32_t *p_mem,                  /**< caller memory for the map */
+    uint32_t mem_entries,             /**< number of uint32_t in p_mem */
+    mp4d_subsample_map_t *p_map       /**< [out] subsample map, valid as long as p_mem */
+);
+
+/** @brief Skip samples in this track
+
+   Has the same effect as calling mp4d_trackreader_next_sample() 'count' times
+   and discarding the output, but advances the sample tables in bulk: only the
+   data needed for the time stamp and position of the following sample is read.
+
+   @return error code:
+        OK (0) - 'count' samples skipped
+        MP4D_E_NEXT_SEGMENT - fewer than 'count' samples left in this segment.
+            The track reader position is then undefined until the next call of
+            mp4d_trackreader_init_segment() or mp4d_trackreader_seek_to().
+        MP4D_E_WRONG_ARGUMENT - NULL pointers or track reader object not initialized
+*/
+int
+mp4d_trackreader_skip
+(
+    mp4d_trackreader_ptr_t trackreader_ptr,
+    uint64_t count
+);
+
+/** @brief Get the next samples of this segment without consuming them
+
+   Returns the samples which the next calls of mp4d_trackreader_next_sample()
+   will return, up to the end of the current segment. The track reader is
+   copied to scratch_mem, which needs the static memory size given by
+   mp4d_trackreader_query_mem(), and the copy is advanced. The buffers of the
+   segment are only read.
+
+   @return error code:
+        OK (0) - *p_count (<= max_count) samples returned
+        MP4D_E_WRONG_ARGUMENT - NULL pointers or track reader object not initialized
+*/
+int
+mp4d_trackreader_peek_samples
+(
+    mp4d_trackreader_ptr_t trackreader_ptr,
+    void *scratch_mem,
+    mp4d_sampleref_t *samples,   /**< [out] array of max_count samples */
+    uint32_t max_count,
+    uint32_t *p_count            /**< [out] */
+);
+
+/** @brief return the next sync sample in this track
+
+   Skips the non-sync samples before the next sync sample, see mp4d_trackreader_skip(),
+   and returns the sync sample like mp4d_trackreader_next_sample().
+
+   In a moov, the sync samples are listed in stss (all samples are sync samples
+   if stss is absent). In a moof, the sync samples are the samples with
+   sample_depends_on = 2 and, if a trik box is present, I and P pictures.
+
+   @return error code:
+        OK (0) - sample found
+        MP4D_E_NEXT_SEGMENT - no more sync samples in this segment
+        MP4D_E_WRONG_ARGUMENT - NULL pointers or track reader object not initialized
+*/
+int
+mp4d_trackreader_next_sync_sample
+(
+    mp4d_trackreader_ptr_t trackreader_ptr,
+    mp4d_sampleref_t *sample_ptr_out
+);
+
+/** @brief return the next sync sample in this track which is presented at or after a time stamp
+
+   Like mp4d_trackreader_next_sync_sample(), but the sync samples presented before
+   time_stamp are skipped as well. Only the sample tables are read, not the samples.
+   Use it to step through a track in intervals, e.g. for trick play.
+
+   @return error code:
+        OK (0) - sample found
+        MP4D_E_NEXT_SEGMENT - no more such sync samples in this segment
+        MP4D_E_WRONG_ARGUMENT - NULL pointers or track reader object not initialized
+*/
+int
+mp4d_trackreader_next_sync_sample_at
+(
+    mp4d_trackreader_ptr_t trackreader_ptr,
+    int64_t time_stamp,           /**< presentation time in media time scale, as sampleref.pts */
+    mp4d_sampleref_t *sample_ptr_out
+);
+
+/** @brief Move to the previous GOP in this track
+
+   Iterates the segment backwards, one GOP at a time: the first call after
+   mp4d_trackreader_init_segment() positions the track reader at the first
+   sample of the last GOP, each further call at the first sample of the GOP
+   before the previously returned GOP. The next *p_num_samples calls of
+   mp4d_trackreader_next_sample() return that GOP in decoding order.
+
+   A GOP starts at a sync sample (see mp4d_trackreader_next_sync_sample()).
+   Samples before the first sync sample form a GOP of their own.
+
+   In a moov, the sample tables are stepped backwards, so that iterating all
+   GOPs costs about the same as reading all samples once. Where that is not
+   possible (a moof, or a moov with subs or sample auxiliary information), the
+   segment is read forward from copies of the track reader kept on the way, see
+   mp4d_trackreader_set_gop_mem(). Without that memory, the segment is re-read
+   from the beginning once per GOP.
+
+   The time stamp of the segment following a reverse iteration should be given
+   explicitly to mp4d_trackreader_init_segment().
+
+   @return error code:
+        OK (0) - GOP found
+        MP4D_E_PREV_SEGMENT - no earlier GOP in this segment
+        MP4D_E_WRONG_ARGUMENT - NULL pointers or track reader object not initialized
+*/
+int
+mp4d_trackreader_prev_gop
+(
+    mp4d_trackreader_ptr_t trackreader_ptr,
+    uint32_t *p_num_samples   /**< [out] number of samples in the GOP */
+);
+
 /** @brief Seek to a sample inside the current fragment.
 
     After calling this function, the next call to mp4d_trackreader_next_sample() will
@@ -206,6 +402,9 @@ mp4d_trackreader_set_type
 /**
  * @brief Return the memory needed by an mp4d_trackreader instance.
  *
+ * The size depends on the features compiled in, see MP4D_TRACKREADER_MOOV.
+ * The dynamic memory holds the GOP checkpoints, see MP4D_TRACKREADER_GOP_CHECKPOINTS.
+ *
  * @return Error code:
  *     MP4D_NO_ERROR for success.
  */
@@ -220,6 +419,9 @@ mp4d_trackreader_query_mem
 /**
  * @brief initialize an mp4d_trackreader instance.
  *
+ * dynamic_mem, of the size given by mp4d_trackreader_query_mem(), is used for
+ * the GOP checkpoints, as by mp4d_trackreader_set_gop_mem(). May be NULL.
+ *
  * @return Error code:
  *     OK (0) for success.
  */
@@ -228,7 +430,70 @@ mp4d_trackreader_init
 (
     mp4d_trackreader_ptr_t *trackreader_ptr,   
     void *static_mem,    
-    void *dynamic_mem    
+    void *dynamic_mem
+);
+
+/**
+ * @brief Return the memory needed for the edit list of the latest moov.
+ *
+ * If mp4d_trackreader_init_segment() with a moov failed with MP4D_E_BUFFER_TOO_SMALL,
+ * the edit list of the track has more than MP4D_MAX_EDITS edits. Pass memory of this
+ * size to mp4d_trackreader_set_edit_mem(), and initialize the segment again.
+ * Zero if the edit list fits into the trackreader.
+ *
+ * @return Error code:
+ *     OK (0) for success.
+ */
+int
+mp4d_trackreader_query_edit_mem
+(
+    mp4d_trackreader_ptr_t trackreader_ptr,
+    uint64_t *edit_mem_size     /**< [out] */
+);
+
+/**
+ * @brief Provide memory for edit lists of more than MP4D_MAX_EDITS edits.
+ *
+ * Used from the next mp4d_trackreader_init_segment() with a moov. The memory must
+ * stay valid while samples are read with the edit list, i.e. until another moov
+ * is read. NULL to hold MP4D_MAX_EDITS edits only.
+ *
+ * @return Error code:
+ *     OK (0) for success.
+ */
+int
+mp4d_trackreader_set_edit_mem
+(
+    mp4d_trackreader_ptr_t trackreader_ptr,
+    void *edit_mem,             /**< suitably aligned, e.g. by malloc() */
+    uint64_t edit_mem_size
+);
+
+/**
+ * @brief Provide memory for the GOP checkpoints of mp4d_trackreader_prev_gop().
+ *
+ * A moof, or a moov with subs or sample auxiliary information, cannot be read
+ * backwards. mp4d_trackreader_prev_gop() then reads the segment forward, and
+ * copies the track reader at samples on the way into this memory, spread evenly
+ * over the samples left, so that the following calls start from a copy instead
+ * of the beginning of the segment. Each copy takes static_mem_size bytes, see
+ * mp4d_trackreader_query_mem(). With room for all GOPs of a segment, the segment
+ * is read about three times; with room for n copies, the way back from a GOP is
+ * split into up to n parts.
+ *
+ * Replaces the dynamic memory given to mp4d_trackreader_init(). The memory must
+ * stay valid while the track reader uses it. NULL to re-read the segment for
+ * each GOP.
+ *
+ * @return Error code:
+ *     OK (0) for success.
+ */
+int
+mp4d_trackreader_set_gop_mem
+(
+    mp4d_trackreader_ptr_t trackreader_ptr,
+    void *gop_mem,              /**< suitably aligned, e.g. by malloc() */
+    uint64_t gop_mem_size
 );
 
 /**
@@ -249,6 +514,11 @@ mp4d_trackreader_set_tenc
 /**
  * @brief fetch the latest 'tenc' data to be used during decryption
  *
+ * The data of the PIFF 'senc' box of the current track fragment if it
+ * overrides the defaults, else the defaults of mp4d_trackreader_set_tenc().
+ * It is resolved once per fragment: constant until the next
+ * mp4d_trackreader_init_segment().
+ *
  * @return Error code:
  *     OK (0) for success.
  */
@@ -261,6 +531,30 @@ mp4d_trackreader_get_cur_tenc
     uint8_t* kid
 );
 
+/**
+ * @brief get the byte range of the sample aux info of the current track fragment
+ *
+ * The range is resolved when the fragment is initialized, from the 'saio'
+ * offset and the 'saiz' sizes. It holds the aux info of all samples of the
+ * traf (auxdata[].pos of each sample lies in it), so that it can be read at
+ * once. If it lies in the 'moof' box (e.g. in 'senc'), *pp_data points to
+ * it in memory, valid until the next init_segment(); otherwise NULL.
+ *
+ * @return Error code:
+ *     OK (0) for success.
+ *     MP4D_E_INFO_NOT_AVAIL - no aux info of this type, not a moof, or
+ *                             not contiguous ('saio' with an offset per trun)
+ */
+int
+mp4d_trackreader_get_aux_range
+(
+    mp4d_trackreader_ptr_t p_tr,
+    uint32_t aux_info_type,
+    uint64_t *p_pos,                  /**< [out] file position */
+    uint64_t *p_size,                 /**< [out] in bytes */
+    const unsigned char **pp_data     /**< [out] in memory, or NULL */
+);
+
 #ifdef __cplusplus
 }
 #endif
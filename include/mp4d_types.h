@@ -111,6 +111,28 @@ typedef struct mp4d_sencref_t_ {
     uint8_t * ClearEncryptBytes;
 }mp4d_sencref_t;
 
+/**
+    @brief Subsample map of a sample
+
+    Read-only view of the subsamples of a sample, decoded at once by
+    mp4d_trackreader_get_subsamples() into memory provided by the caller:
+    the subsample sizes of the Sub-Sample Information Box ('subs'), and the
+    clear and protected bytes of the subsample entries of the 'senc' box.
+*/
+typedef struct mp4d_subsample_map_t_ {
+    uint32_t num_subsamples;          /**< number (>= 1) of subsamples, as sampleref.num_subsamples */
+    const uint32_t *size;             /**< size of each subsample in octets. The subsamples
+                                           follow each other from the beginning of the sample */
+    uint32_t num_crypt_entries;       /**< number of clear/protected entries, zero if
+                                           the sample has no 'senc' subsample entries */
+    const uint32_t *clear_bytes;      /**< octets in the clear, per entry */
+    const uint32_t *protected_bytes;  /**< encrypted octets following the clear ones, per entry */
+} mp4d_subsample_map_t;
+
+/** Number of uint32_t of caller memory needed by mp4d_trackreader_get_subsamples() for a sample */
+#define MP4D_SUBSAMPLE_MAP_ENTRIES(p_sample) \
+    ((uint32_t) (p_sample)->num_subsamples + 2 * (uint32_t) (p_sample)->sencdata.subsample_count)
+
 /**
     @brief MP4 Sample Reference
 
@@ -186,6 +208,11 @@ typedef struct mp4d_crypt_info_t_ {
     uint32_t method;            /**< Signals the encryption method according to ISO/IEC 23001-7:2011, section 9.2, 'IsEncrypted' */
     uint8_t iv_size;            /**< IV size in bytes */
     unsigned char key_id[16];
+    mp4d_fourcc_t scheme_type;  /**< Protection scheme ('cenc', 'cbcs' or 'piff') */
+    uint8_t crypt_byte_block;   /**< Encrypted blocks of the pattern ('tenc' version 1), or 0 */
+    uint8_t skip_byte_block;    /**< Clear blocks of the pattern ('tenc' version 1), or 0 */
+    uint8_t constant_iv_size;   /**< Size of constant_iv in bytes, used if iv_size is 0 */
+    unsigned char constant_iv[16];
 } mp4d_crypt_info_t;
 
 
@@ -0,0 +1,84 @@
+/************************************************************************************************************
+ * Copyright (c) 2017, Dolby Laboratories Inc.
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ *    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+ *    promote products derived from this software without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ ************************************************************************************************************/
+/** @defgroup pipe_stream
+ * @brief Provide fragments from a forward-only source, e.g. a pipe or stdin.
+ * Implements the fragment_reader_t API.
+ *
+ * All fragment streams of a presentation share one pipe_source, which reads
+ * each top-level box once. A 'moof' and the boxes following it are kept until
+ * every stream has moved past them, so memory is bounded by the fragment size
+ * (and the distance between the streams), not by the file size. The boxes
+ * before the first 'moof' are kept for streams created later.
+ *
+ * Seeking cannot go backwards: seek() moves to the current or next 'moov'/'moof',
+ * and reports time 0, so fragments without 'tfdt' cannot be time stamped after a seek.
+ * @{
+ */
+#ifndef PIPE_STREAM_H
+#define PIPE_STREAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "fragment_stream.h"
+
+typedef struct pipe_source_t_ * pipe_source_t;
+
+/** @brief Open a forward-only source
+ * @return error
+ */
+int pipe_source_new(pipe_source_t *,          /**< [out] */
+                    const char *path          /**< file or FIFO path, or "-" for stdin */
+                    );
+
+/** @brief Release the source. It is destroyed when no fragment stream uses it anymore.
+ */
+void pipe_source_release(pipe_source_t);
+
+/** @brief Provide 'mdat' boxes while they are received
+ *
+ * next_atom() returns a streamed box as soon as its header is read, and
+ * load() only waits for the bytes of the requested sample, so samples are
+ * released before their 'mdat' is complete (see chunk_stream).
+ *
+ * @return error
+ */
+int pipe_source_set_chunked(pipe_source_t);
+
+/** @brief Create a fragment stream reading from the shared source
+ * @return error
+ */
+int pipe_stream_new(fragment_reader_t *,      /**< [out] */
+                    pipe_source_t,
+                    int header_only           /**< If true, the stream only reads the boxes before the first 'moof',
+                                                   and does not hold back the release of fragment data */
+                    );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @} */
@@ -40,15 +40,20 @@ extern "C" {
 
 #include "stream.h"
 #include "movie.h"
+#include "async_stream.h"
 
 #include "es_sink.h"
+#include "decryptor.h"
+#include "decrypt_pool.h"
+#include "key_store.h"
 
 /**
  * @brief player handle
  */
 typedef struct player_t_ *player_t;
 
-/* Decryption (id, key) pair */
+/* Decryption (id, key) pairs.
+   Deprecated, use player_add_key(): player_set_track() adds these keys with it. */
 typedef struct
 {
     struct {
@@ -62,7 +67,8 @@ struct player_t_
 {
     uint32_t movie_time_scale;
 
-    decrypt_info_t decrypt_info;
+    decrypt_info_t decrypt_info;  /* deprecated, keys array freed by player_destroy() */
+    key_store_t key_store;        /* decryption keys by KID */
 
     /* active streams */
     struct
@@ -75,6 +81,10 @@ struct player_t_
             uint32_t index;                /* sample description index, initialized only if encrypted */
             mp4d_sampleentry_t entry;      /* sample entry, initialized only if encrypted */
             uint8_t iv_size;               /* initial value size in bytes */
+            mp4d_crypt_info_t crypt_info;  /* scheme, KID and IV of the sample entry, if encrypted */
+            decryptor_t decryptor;         /* NULL if not encrypted, or no key. Owned by key_store */
+            int warn_encrypted;            /* (bool) to be decrypted, but not protected by default: warn
+                                              about the first sample with 'cenc' or 'cbcs' aux info */
         } *sample_entries;
         uint32_t num_sample_entries;
 
@@ -83,9 +93,14 @@ struct player_t_
 
         int end_of_track;         /* (bool) Last sample was later than stop time */
 
-        unsigned char *data;      /* Sample payload (size = sample.size)
-                                     Stored in memory, until the next sample is ready. */
+        unsigned char *data;      /* Sample payload (size = sample.size), unless the source holds
+                                     it in memory. Stored in memory, until the next sample is ready. */
         size_t data_size;         /* Allocated size >= sample.size */
+        sample_crypt_t crypt;     /* IV and subsample map of the sample being loaded */
+
+        movie_t movie;            /* of player_set_track(), for the readers of player_plan_time_range() */
+        uint32_t stream_num;      /* in movie, counting from zero */
+        uint32_t bit_rate;
 
     } * streams;
     uint32_t num_streams;
@@ -99,6 +114,21 @@ struct player_t_
        are returned before samples with a higher value.
     */
     uint64_t (*eval_sample)(const mp4d_sampleref_t *, uint32_t media_time_scale);
+
+    /* Loading ahead, see player_set_async_loads() */
+    async_reader_t async_loads;          /* NULL: load each sample when it is output */
+    uint32_t queue_depth;
+    struct pending_sample_t_ *pending;   /* queue_depth samples being loaded */
+    unsigned char *load_buffer;          /* payloads of the pending samples */
+    size_t load_buffer_size;
+
+    uint32_t prefetch_count;  /* see player_set_prefetch() */
+
+    decrypt_pool_t decrypt_pool;  /* NULL: decrypt in the playing thread, see player_set_decrypt_threads() */
+
+    /* Decryption throughput in the playing thread */
+    uint64_t decrypted_bytes;
+    double decrypt_seconds;
 };
 
 /**
@@ -136,7 +166,69 @@ player_set_track(player_t,
                  movie_t p_movie,        /* movie information */
                  fragment_reader_t mp4_source,  /* fragment stream, transfer of ownership, must not be freed by caller */
                  es_sink_t sink,
-                 uint32_t polarssl_flag);
+                 uint32_t decrypt_flag);  /* (boolean, formerly polarssl_flag) decrypt encrypted samples with the keys of player_add_key() */
+
+/**
+ * @brief add a decryption key
+ *
+ * The samples of an encrypted sample entry are decrypted if a key with its
+ * default KID ('tenc') is added before player_set_track(), and decrypt_flag
+ * is set. Otherwise they are output encrypted; with decrypt_flag set, a
+ * warning is printed for a sample entry without a key or with an unsupported
+ * scheme, and for the first encrypted sample of a sample entry which is not
+ * protected by default.
+ *
+ * The keys are kept in a key_store_t: looked up by KID, with their round
+ * keys expanded once. A different key for a KID already added is an error.
+ */
+int
+player_add_key(player_t,
+               const unsigned char key_id[16],
+               const unsigned char key[16]
+    );
+
+/**
+ * @brief load sample payloads ahead of their output
+ *
+ * The player queues the payload reads of the next queue_depth samples (of
+ * all tracks, in output order) on the reader, and passes each sample to the
+ * sinks when its read has finished. The reads target a buffer registered
+ * with async_reader_register_buffer(); larger samples get their own buffer.
+ *
+ * The reader must read the file of the tracks' fragment streams (the sample
+ * positions are file offsets). It is not owned by the player, and must stay
+ * valid until player_destroy() or the next call of this function.
+ * NULL reverts to loading each sample with fragment_reader_load().
+ */
+int
+player_set_async_loads(player_t,
+                       async_reader_t,
+                       uint32_t queue_depth   /**> maximum number of samples loaded ahead */
+    );
+
+/**
+ * @brief hint the sources to read the next samples of each track in the background
+ *
+ * Applies stream_set_prefetch() to the current and later tracks.
+ */
+int
+player_set_prefetch(player_t,
+                    uint32_t num_samples   /**> samples to look ahead per track, 0: off */
+    );
+
+/**
+ * @brief decrypt samples on worker threads
+ *
+ * The encrypted samples are decrypted by a pool of num_threads threads,
+ * while the next samples are loaded; they are passed to the sinks in the
+ * same order as without threads. Without player_set_async_loads(), the
+ * samples are loaded ahead (PLAYER_DECRYPT_SAMPLES_PER_THREAD per thread)
+ * with fragment_reader_load(). 0 decrypts each sample when it is output.
+ */
+int
+player_set_decrypt_threads(player_t,
+                           uint32_t num_threads   /**> up to DECRYPT_POOL_MAX_THREADS, 0: off */
+    );
 
 /**
  * @brief provide samples in the order of presentation time
@@ -149,6 +241,40 @@ player_play_time_range(player_t,
                        float *stop_time     /**> in seconds, NULL: end */
     );
 
+/**
+ * @brief Byte range in the MP4 file
+ */
+typedef struct
+{
+    uint64_t offset;
+    uint64_t size;
+} byte_range_t;
+
+/**
+ * @brief list the file byte ranges needed to process a presentation time range
+ *
+ * Walks the samples of player_play_time_range() without loading them, and
+ * returns the ranges which the playback reads: the boxes up to the moov
+ * (ftyp, moov, and the headers of the boxes in between), the boxes which the
+ * seek reads to reach the start time (e.g. mfra, and the moofs from the
+ * fragment it finds), the moov/moof boxes holding the samples, the samples
+ * (from the sync sample preceding the start time) and their aux info. A copy
+ * of the file with only these ranges plays the time range as the file does.
+ * The ranges are sorted by offset, and overlapping or adjacent ranges are
+ * merged.
+ *
+ * The samples are walked on new readers of the movies given to
+ * player_set_track(), which must still exist, so that the player position
+ * does not change. Requires a file-based source (fragment_reader_t::get_offset).
+ */
+int
+player_plan_time_range(player_t,
+                       float *start_time,       /**> in seconds */
+                       float *stop_time,        /**> in seconds, NULL: end */
+                       byte_range_t **p_ranges, /**> [out] must be freed by the caller */
+                       uint32_t *p_num_ranges   /**> [out] */
+    );
+
 /**
  * @brief process samples in order of sample position
  *
@@ -159,6 +285,17 @@ player_play_fragments(player_t,
                       uint32_t fragment_number /**> counting from 1 (moov), 0: all */
     );
 
+/**
+ * @brief process one sync sample per time interval, in order of sample position
+ *
+ * For each track, the first sync sample of every interval is processed.
+ * The other samples are skipped without being loaded.
+ */
+int
+player_play_keyframes(player_t,
+                      float interval   /**> in seconds */
+    );
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,146 @@
+/************************************************************************************************************
+ * Copyright (c) 2017, Dolby Laboratories Inc.
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ *    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+ *    promote products derived from this software without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ ************************************************************************************************************/
+/** @defgroup segment_session
+ * @brief Demux many media segments which share one init segment (DASH/CMAF).
+ * Implements the fragment_reader_t and movie_t APIs.
+ *
+ * A session holds an init segment followed by media segments. The init
+ * segment is read into memory and parsed once: the movie information, sample
+ * entries, time scales and 'trex' defaults are taken from its 'moov' for all
+ * media segments. Media segments are files or caller-owned buffers, and can
+ * be added at any time, also while the streams are being read.
+ *
+ * The segments are addressed as if they were concatenated into one file: the
+ * first byte of a segment has the position of the end of the previous segment.
+ * Each top-level box must be contained in one segment.
+ *
+ * Every fragment stream of the session parses the init 'moov' once, then only
+ * the boxes of each media segment. Its trackreader is not reset between
+ * segments: a 'moof' without 'tfdt' continues at the end of the previous one.
+ * Of file segments, only the boxes other than 'mdat', 'free' and 'skip' are
+ * read by next_atom(); sample data is read by load().
+ *
+ * seek() moves to the 'moov' of the init segment, at time 0.
+ *
+ * A session is not thread-safe: all streams must be used from one thread
+ * (the prefetcher, see segment_session_set_prefetch(), synchronizes itself).
+ * @{
+ */
+#ifndef SEGMENT_SESSION_H
+#define SEGMENT_SESSION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "movie.h"
+
+typedef struct segment_session_t_ * segment_session_t;
+
+/** @brief Create a session without segments
+ * @return error
+ */
+int segment_session_new(segment_session_t *      /**< [out] */
+                        );
+
+/** @brief Release the session. It is destroyed when no fragment stream or movie uses it anymore.
+ */
+void segment_session_release(segment_session_t);
+
+/** @brief Add a segment from a file
+ *
+ * The first segment added is the init segment, which must contain a 'moov'.
+ * It is read into memory. Of later (media) segments, only the size is
+ * determined; they are read when the streams get to them.
+ *
+ * @return error
+ */
+int segment_session_add_file(segment_session_t,
+                             const char *path
+                             );
+
+/** @brief Add a segment from a byte range of a file
+ *
+ * Same as segment_session_add_file(), e.g. for the segments of one file
+ * indexed by a 'sidx' box.
+ *
+ * @return error
+ */
+int segment_session_add_file_range(segment_session_t,
+                                   const char *path,
+                                   uint64_t offset,     /**< of the first byte in the file */
+                                   uint64_t size
+                                   );
+
+/** @brief Add a segment from memory
+ *
+ * Same as segment_session_add_file(). The boxes are parsed in place, and
+ * fragment_reader_get_data() returns the samples without copying them.
+ *
+ * @return error
+ */
+int segment_session_add_buffer(segment_session_t,
+                               const unsigned char *p_data,  /**< caller-owned, valid until the session is destroyed */
+                               uint64_t size
+                               );
+
+/** @brief Keep file segments loaded ahead of the streams
+ *
+ * A background thread reads the next count file segments, starting from the
+ * first segment which a stream is in, into memory. The streams then parse
+ * and load from memory instead of the file. Loaded segments are freed when
+ * all streams have moved past them. 0 (default) stops loading ahead.
+ *
+ * Not available on Windows, where the streams always read the files.
+ *
+ * @return error
+ */
+int segment_session_set_prefetch(segment_session_t,
+                                 uint32_t count
+                                 );
+
+/** @brief Create a fragment stream over the segments of the session
+ * @return error
+ */
+int segment_stream_new(fragment_reader_t *,      /**< [out] */
+                       segment_session_t
+                       );
+
+/** @brief Create a movie from the init segment of the session
+ *
+ * Its fragment streams are segment streams of the session. Like file_movie,
+ * the stream_num of fragment_stream_new() is ignored, and 0 is the only bit rate.
+ *
+ * @return error
+ */
+int segment_movie_new(segment_session_t,
+                      movie_t *                  /**< [out] */
+                      );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @} */
@@ -54,6 +54,7 @@ typedef struct
     mp4d_trackreader_ptr_t p_tr;
     void *p_static_mem;
     void *p_dynamic_mem;
+    void *p_edit_mem;   /* edit list longer than the trackreader holds, see trackreader_init_segment() */
 
     fragment_reader_t fragments;  /* handle to the current moov/moof used by the trackreader */
     int have_fragment;   /* bool, false until loading the first fragment */
@@ -62,12 +63,28 @@ typedef struct
     int have_sample;     /* true iff sample in queue */
 
     mp4d_sampleref_t sample;
-    uint64_t *subsample_pos;  /* Arrays of length sample.num_subsamples */
-    uint32_t *subsample_size;
-    size_t size_subsample;    /* allocated size */
+    mp4d_subsample_map_t subsamples;  /* of sample, once output */
+    uint32_t *subsample_mem;          /* of subsamples */
+    uint32_t subsample_mem_entries;   /* allocated entries */
     uint32_t subtitle_track_flag; /* a flag for subtitle track: it will be 1; audio/video track should not be 1*/
     uint32_t stss_count;
     unsigned char *stss_buf;
+
+    uint64_t sync_interval;  /* in media time scale. If non-zero, only the first sync sample in each
+                                interval of this length is put in the sample queue */
+    int64_t next_sync_pts;   /* start of the next interval, if sync_interval is non-zero */
+
+    /* Read-ahead, see stream_set_prefetch() */
+    uint32_t prefetch_count;          /* number of samples to look ahead, 0: off */
+    uint32_t prefetch_left;           /* samples to output before the next look ahead */
+    void *p_peek_mem;                 /* trackreader copy for mp4d_trackreader_peek_samples() */
+    mp4d_sampleref_t *peek_samples;   /* prefetch_count samples */
+
+    /* Sample aux info, see stream_get_aux() */
+    unsigned char *aux_buffer;        /* aux info loaded from the fragments */
+    size_t aux_buffer_size;           /* allocated */
+    uint64_t aux_pos;                 /* file position of aux_buffer */
+    uint64_t aux_size;                /* bytes loaded, 0: none */
 } stream_t;
 
 /** @brief initialize a stream from the given source
@@ -92,6 +109,21 @@ stream_init(stream_t *p_s,
 void
 stream_deinit(stream_t *p_s);
 
+/** @brief Hint the source to read the upcoming samples in the background
+ *
+ * The stream peeks the byte ranges of the next num_samples samples of the
+ * current fragment (sample data and aux info), and passes them to
+ * fragment_reader_prefetch(). This is repeated after half of them, so that
+ * the source can read ahead of the loads. Not done if sync_interval is set,
+ * since most of the samples are skipped.
+ *
+ * @return error
+ */
+int
+stream_set_prefetch(stream_t *p_s,
+                    uint32_t num_samples   /**< 0: off */
+    );
+
 /** @brief Seek to the given presentation_time in a stream.
  */
 int
@@ -105,6 +137,10 @@ stream_seek(stream_t *p_s,
  *  Sets have_sample to true if a next sample could be read.
  *  Otherwise have_sample is false and the function succeeds.
  *
+ *  If sync_interval is non-zero, samples are skipped until the first sync
+ *  sample whose presentation time stamp is in a later interval than the
+ *  previous sample. They are skipped in the trackreader, without loading them.
+ *
  *  @return error
  */
 int
@@ -125,6 +161,22 @@ subtitle_next_sample(stream_t *p_s,
                    int single_fragment   /**< If true, do not load the next fragment if out of samples */
                    );
 
+/**
+ * @brief get the sample aux info ('saiz', 'saio') of the current sample
+ *
+ * The aux info of all samples of a fragment is loaded with one read when it
+ * is first needed, and kept until aux info outside of it is requested. Aux
+ * info in the 'moof' box is not read. The aux info of a fragment with a
+ * 'saio' offset per trun is read per sample.
+ *
+ * @return error
+ */
+int
+stream_get_aux(stream_t *p_s,
+               const mp4d_auxref_t *p_aux,   /**< of the current sample, size > 0 */
+               const unsigned char **pp_data /**< [out] valid until the next call, or the next fragment */
+    );
+
 /**
  * @brief assign the default 'tenc' data to the stream
  *
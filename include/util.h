@@ -111,6 +111,9 @@ void logout(int level, const char *format, ...);
  */
 char *string_dup(const char *);
 
+/** @brief monotonic clock in seconds, e.g. to measure a throughput */
+double clock_seconds(void);
+
 #ifdef __cplusplus
 }
 #endif
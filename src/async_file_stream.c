@@ -0,0 +1,941 @@
+/************************************************************************************************************
+ * Copyright (c) 2017, Dolby Laboratories Inc.
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ *    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+ *    promote products derived from this software without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ ************************************************************************************************************/
+#include "async_file_stream.h"
+
+#include "file_stream.h"
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#ifndef _MSC_VER
+#define ASYNC_USE_THREADS
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef __linux__
+#define ASYNC_USE_URING
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#define ASYNC_FILE_STREAM_THREADS 4  /* Worker threads if loads do not use io_uring */
+
+enum
+{
+    ASYNC_OP_NEXT_ATOM,
+    ASYNC_OP_SEEK,
+    ASYNC_OP_LOAD
+};
+
+typedef struct async_op_ async_op_t;
+struct async_op_
+{
+    int type;
+    uint64_t position;         /* load: file position of the next byte to read */
+    uint32_t size;             /* load: bytes left to read */
+    unsigned char *p_buffer;   /* load: destination of the next byte */
+#ifdef ASYNC_USE_URING
+    struct iovec iov;
+#endif
+    uint32_t track_ID;         /* seek */
+    uint64_t seek_time;
+    uint64_t *out_time;
+
+    async_reader_done_t done;
+    void *p_user;
+    int err;
+    async_op_t *next;
+};
+
+typedef struct
+{
+    async_op_t *head;
+    async_op_t *tail;
+} op_queue_t;
+
+#ifdef ASYNC_USE_URING
+/* Submission and completion rings, shared with the kernel */
+typedef struct
+{
+    int fd;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned to_submit;        /* queued in the submission ring, not yet passed to the kernel */
+    struct iovec fixed;        /* registered buffer, for READ_FIXED */
+    int have_fixed;
+} uring_t;
+#endif
+
+/** @brief async_file_stream implementation of the async_reader API */
+typedef struct
+{
+    struct async_reader_t_ base;
+
+    char *path;
+    int fd;                    /* For loads, -1 if they use the fragment stream */
+    int notify_fd[2];          /* Read and write end; the same eventfd on Linux */
+
+    uint32_t queue_depth;
+    uint32_t num_pending;      /* Operations whose callback has not been called */
+    uint32_t loads_in_flight;  /* Loads started and not finished */
+    int have_box_op;           /* A next_atom() or seek() is pending */
+    int discard;               /* Do not call callbacks (destructor) */
+
+    op_queue_t queued;         /* Not started yet */
+    op_queue_t completed;      /* Finished, callback not called. Locked if using threads */
+    async_op_t *free_ops;
+
+#ifdef ASYNC_USE_THREADS
+    pthread_t threads[ASYNC_FILE_STREAM_THREADS];
+    uint32_t num_threads;
+    int have_lock;
+    pthread_mutex_t lock;
+    pthread_cond_t job_cond;
+    op_queue_t jobs;           /* Started, for the worker threads. Locked */
+    int stop;                  /* Locked */
+#endif
+#ifdef ASYNC_USE_URING
+    uring_t ring;
+    int have_ring;
+#endif
+} *async_file_stream_t;
+
+static void
+queue_push(op_queue_t *q, async_op_t *op)
+{
+    op->next = NULL;
+    if (q->tail != NULL)
+    {
+        q->tail->next = op;
+    }
+    else
+    {
+        q->head = op;
+    }
+    q->tail = op;
+}
+
+static async_op_t *
+queue_pop(op_queue_t *q)
+{
+    async_op_t *op = q->head;
+
+    if (op != NULL)
+    {
+        q->head = op->next;
+        if (q->head == NULL)
+        {
+            q->tail = NULL;
+        }
+    }
+    return op;
+}
+
+/* Move all operations of src to the end of dst */
+static void
+queue_move(op_queue_t *dst, op_queue_t *src)
+{
+    if (src->head == NULL)
+    {
+        return;
+    }
+    if (dst->tail != NULL)
+    {
+        dst->tail->next = src->head;
+    }
+    else
+    {
+        dst->head = src->head;
+    }
+    dst->tail = src->tail;
+    src->head = NULL;
+    src->tail = NULL;
+}
+
+#ifdef ASYNC_USE_URING
+static void
+uring_deinit(uring_t *u)
+{
+    if (u->sqes != NULL)
+    {
+        munmap(u->sqes, u->sqes_size);
+    }
+    if (u->cq_ring != NULL && u->cq_ring != u->sq_ring)
+    {
+        munmap(u->cq_ring, u->cq_ring_size);
+    }
+    if (u->sq_ring != NULL)
+    {
+        munmap(u->sq_ring, u->sq_ring_size);
+    }
+    if (u->fd >= 0)
+    {
+        close(u->fd);
+    }
+    memset(u, 0, sizeof(*u));
+    u->fd = -1;
+}
+
+/** @brief Set up a ring which signals completions on event_fd
+ *  @return 0: ring available, otherwise not supported
+ */
+static int
+uring_init(uring_t *u, uint32_t entries, int event_fd)
+{
+    struct io_uring_params p;
+    unsigned char *sq;
+    unsigned char *cq;
+
+    memset(u, 0, sizeof(*u));
+    memset(&p, 0, sizeof(p));
+
+    u->fd = (int) syscall(__NR_io_uring_setup, entries, &p);
+    if (u->fd < 0)
+    {
+        return 1;
+    }
+
+    u->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (u->cq_ring_size > u->sq_ring_size)
+        {
+            u->sq_ring_size = u->cq_ring_size;
+        }
+        u->cq_ring_size = u->sq_ring_size;
+    }
+
+    u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if (u->sq_ring == MAP_FAILED)
+    {
+        u->sq_ring = NULL;
+        uring_deinit(u);
+        return 1;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        u->cq_ring = u->sq_ring;
+    }
+    else
+    {
+        u->cq_ring = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+        if (u->cq_ring == MAP_FAILED)
+        {
+            u->cq_ring = NULL;
+            uring_deinit(u);
+            return 1;
+        }
+    }
+    u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED)
+    {
+        u->sqes = NULL;
+        uring_deinit(u);
+        return 1;
+    }
+
+    sq = u->sq_ring;
+    cq = u->cq_ring;
+    u->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+    u->sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+    u->sq_array = (unsigned *) (sq + p.sq_off.array);
+    u->cq_head = (unsigned *) (cq + p.cq_off.head);
+    u->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+    u->cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+    if (syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_EVENTFD, &event_fd, 1) != 0)
+    {
+        uring_deinit(u);
+        return 1;
+    }
+
+    return 0;
+}
+
+static void
+uring_queue_read(uring_t *u, int fd, async_op_t *op)
+{
+    unsigned tail = *u->sq_tail;
+    unsigned index = tail & *u->sq_mask;
+    struct io_uring_sqe *sqe = &u->sqes[index];
+    uintptr_t offset = (uintptr_t) op->p_buffer - (uintptr_t) u->fixed.iov_base;  /* into the registered buffer */
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = fd;
+    sqe->off = op->position;
+    sqe->user_data = (uint64_t) (uintptr_t) op;
+
+    if (u->have_fixed &&
+        offset <= u->fixed.iov_len &&
+        op->size <= u->fixed.iov_len - offset)
+    {
+        /* The kernel keeps the registered pages mapped */
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->addr = (uint64_t) (uintptr_t) op->p_buffer;
+        sqe->len = op->size;
+        sqe->buf_index = 0;
+    }
+    else
+    {
+        /* READV rather than READ, which needs Linux 5.6 */
+        op->iov.iov_base = op->p_buffer;
+        op->iov.iov_len = op->size;
+
+        sqe->opcode = IORING_OP_READV;
+        sqe->addr = (uint64_t) (uintptr_t) &op->iov;
+        sqe->len = 1;
+    }
+
+    u->sq_array[index] = index;
+    __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    u->to_submit++;
+}
+
+/** @brief Register the buffer of READ_FIXED, or unregister if NULL
+ *  @return 0: registered, otherwise not supported (e.g. RLIMIT_MEMLOCK)
+ */
+static int
+uring_register_buffer(uring_t *u, unsigned char *p_buffer, size_t size)
+{
+    if (u->have_fixed)
+    {
+        syscall(__NR_io_uring_register, u->fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+        u->have_fixed = 0;
+    }
+    if (p_buffer == NULL || size == 0)
+    {
+        return 1;
+    }
+
+    u->fixed.iov_base = p_buffer;
+    u->fixed.iov_len = size;
+    if (syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_BUFFERS, &u->fixed, 1) != 0)
+    {
+        return 1;
+    }
+    u->have_fixed = 1;
+
+    return 0;
+}
+
+/* Pass the queued reads to the kernel */
+static int
+uring_enter(uring_t *u)
+{
+    int err = 0;
+
+    while (u->to_submit > 0)
+    {
+        long submitted = syscall(__NR_io_uring_enter, u->fd, u->to_submit, 0, 0, NULL, 0);
+
+        if (submitted < 0 && (errno == EINTR || errno == EAGAIN))
+        {
+            continue;
+        }
+        ASSURE( submitted > 0, ("io_uring_enter() failed (errno %d)", errno) );
+        u->to_submit -= (unsigned) submitted;
+    }
+
+cleanup:
+    return err;
+}
+#endif
+
+static void
+notify(async_file_stream_t fs)
+{
+#ifdef ASYNC_USE_URING
+    uint64_t one = 1;
+
+    if (write(fs->notify_fd[1], &one, sizeof(one)) < 0)
+    {
+        /* Counter overflow, already readable */
+    }
+#elif defined(ASYNC_USE_THREADS)
+    char c = 0;
+
+    if (write(fs->notify_fd[1], &c, 1) < 0)
+    {
+        /* Pipe full, already readable */
+    }
+#else
+    (void) fs;
+#endif
+}
+
+static void
+drain_notifications(async_file_stream_t fs)
+{
+#ifdef ASYNC_USE_THREADS
+    unsigned char buf[64];
+
+    while (read(fs->notify_fd[0], buf, sizeof(buf)) > 0)
+    {
+        /* Non-blocking, empty */
+    }
+#else
+    (void) fs;
+#endif
+}
+
+/* Blocking I/O for an operation, on a worker thread (or in submit() without threads) */
+static void
+run_op(async_file_stream_t fs, async_op_t *op)
+{
+    fragment_reader_t s = fs->base.fragments;
+
+    if (op->type == ASYNC_OP_NEXT_ATOM)
+    {
+        op->err = fragment_reader_next_atom(s);
+    }
+    else if (op->type == ASYNC_OP_SEEK)
+    {
+        op->err = fragment_reader_seek(s, op->track_ID, op->seek_time, op->out_time);
+    }
+    else
+    {
+#ifdef ASYNC_USE_THREADS
+        /* pread() does not share a file position with other threads */
+        op->err = 0;
+        while (op->size > 0)
+        {
+            ssize_t n = pread(fs->fd, op->p_buffer, op->size, (off_t) op->position);
+
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                warning("Reading %" PRIu32 " bytes from '%s' @%" PRIu64 " failed\n", op->size, fs->path, op->position);
+                op->err = 1;
+                break;
+            }
+            op->p_buffer += n;
+            op->position += (uint64_t) n;
+            op->size -= (uint32_t) n;
+        }
+#else
+        op->err = fragment_reader_load(s, op->position, op->size, op->p_buffer);
+#endif
+    }
+}
+
+#ifdef ASYNC_USE_THREADS
+static void *
+worker_main(void *arg)
+{
+    async_file_stream_t fs = arg;
+
+    pthread_mutex_lock(&fs->lock);
+    for (;;)
+    {
+        async_op_t *op;
+
+        while (!fs->stop && fs->jobs.head == NULL)
+        {
+            pthread_cond_wait(&fs->job_cond, &fs->lock);
+        }
+        op = queue_pop(&fs->jobs);
+        if (op == NULL)
+        {
+            break;
+        }
+        pthread_mutex_unlock(&fs->lock);
+
+        run_op(fs, op);
+
+        pthread_mutex_lock(&fs->lock);
+        queue_push(&fs->completed, op);
+        notify(fs);
+    }
+    pthread_mutex_unlock(&fs->lock);
+
+    return NULL;
+}
+#endif
+
+static int
+queue_op(async_file_stream_t fs, int type, async_reader_done_t done, void *p_user, async_op_t **p_op)
+{
+    int err = 0;
+    async_op_t *op = fs->free_ops;
+
+    if (type != ASYNC_OP_LOAD)
+    {
+        ASSURE( !fs->have_box_op, ("next_atom() or seek() already pending") );
+        fs->have_box_op = 1;
+    }
+
+    if (op != NULL)
+    {
+        fs->free_ops = op->next;
+    }
+    else
+    {
+        op = malloc(sizeof(*op));
+        ASSURE( op != NULL, ("Allocation error") );
+    }
+    memset(op, 0, sizeof(*op));
+    op->type = type;
+    op->done = done;
+    op->p_user = p_user;
+
+    queue_push(&fs->queued, op);
+    fs->num_pending++;
+    *p_op = op;
+
+cleanup:
+    return err;
+}
+
+static int
+async_file_stream_next_atom(async_reader_t r, async_reader_done_t done, void *p_user)
+{
+    async_op_t *op;
+
+    return queue_op((async_file_stream_t) r, ASYNC_OP_NEXT_ATOM, done, p_user, &op);
+}
+
+static int
+async_file_stream_seek(async_reader_t r,
+                       uint32_t track_ID,
+                       uint64_t seek_time,
+                       uint64_t *out_time,
+                       async_reader_done_t done, void *p_user)
+{
+    int err = 0;
+    async_op_t *op;
+
+    CHECK( queue_op((async_file_stream_t) r, ASYNC_OP_SEEK, done, p_user, &op) );
+    op->track_ID = track_ID;
+    op->seek_time = seek_time;
+    op->out_time = out_time;
+
+cleanup:
+    return err;
+}
+
+static int
+async_file_stream_load(async_reader_t r,
+                       uint64_t position,
+                       uint32_t size,
+                       unsigned char *p_buffer,
+                       async_reader_done_t done, void *p_user)
+{
+    int err = 0;
+    async_op_t *op;
+
+    CHECK( queue_op((async_file_stream_t) r, ASYNC_OP_LOAD, done, p_user, &op) );
+    op->position = position;
+    op->size = size;
+    op->p_buffer = p_buffer;
+
+cleanup:
+    return err;
+}
+
+static int
+async_file_stream_submit(async_reader_t r)
+{
+    int err = 0;
+    async_file_stream_t fs = (async_file_stream_t) r;
+    op_queue_t jobs = {NULL, NULL};
+    async_op_t *op;
+
+    /* Start in order, loads up to the queue depth */
+    while ((op = fs->queued.head) != NULL)
+    {
+        if (op->type == ASYNC_OP_LOAD)
+        {
+            if (fs->loads_in_flight == fs->queue_depth)
+            {
+                break;
+            }
+            fs->loads_in_flight++;
+        }
+        queue_pop(&fs->queued);
+
+#ifdef ASYNC_USE_URING
+        if (op->type == ASYNC_OP_LOAD && fs->have_ring)
+        {
+            uring_queue_read(&fs->ring, fs->fd, op);
+            continue;
+        }
+#endif
+#ifdef ASYNC_USE_THREADS
+        queue_push(&jobs, op);
+#else
+        run_op(fs, op);
+        queue_push(&fs->completed, op);
+#endif
+    }
+
+#ifdef ASYNC_USE_URING
+    if (fs->have_ring)
+    {
+        CHECK( uring_enter(&fs->ring) );
+    }
+#endif
+#ifdef ASYNC_USE_THREADS
+    if (jobs.head != NULL)
+    {
+        pthread_mutex_lock(&fs->lock);
+        queue_move(&fs->jobs, &jobs);
+        pthread_cond_broadcast(&fs->job_cond);
+        pthread_mutex_unlock(&fs->lock);
+    }
+#endif
+    (void) jobs;
+
+cleanup:
+    return err;
+}
+
+/* Move finished operations to done, restart partial reads */
+static void
+collect(async_file_stream_t fs, op_queue_t *done)
+{
+#ifdef ASYNC_USE_URING
+    if (fs->have_ring)
+    {
+        uring_t *u = &fs->ring;
+        unsigned head = *u->cq_head;
+        unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+
+        while (head != tail)
+        {
+            const struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+            async_op_t *op = (async_op_t *) (uintptr_t) cqe->user_data;
+            int res = cqe->res;
+
+            head++;
+            if (res > 0 && (uint32_t) res < op->size)
+            {
+                /* Short read, continue with the rest */
+                op->p_buffer += res;
+                op->position += (uint64_t) res;
+                op->size -= (uint32_t) res;
+                fs->loads_in_flight--;
+                op->next = fs->queued.head;
+                fs->queued.head = op;
+                if (fs->queued.tail == NULL)
+                {
+                    fs->queued.tail = op;
+                }
+                continue;
+            }
+            op->err = 0;
+            if (res < 0 || (res == 0 && op->size > 0))
+            {
+                warning("Reading %" PRIu32 " bytes from '%s' @%" PRIu64 " failed (%d)\n", op->size, fs->path, op->position, res);
+                op->err = 1;
+            }
+            queue_push(done, op);
+        }
+        __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+    }
+#endif
+#ifdef ASYNC_USE_THREADS
+    pthread_mutex_lock(&fs->lock);
+    queue_move(done, &fs->completed);
+    pthread_mutex_unlock(&fs->lock);
+#else
+    queue_move(done, &fs->completed);
+#endif
+}
+
+static int
+async_file_stream_process(async_reader_t r, int wait)
+{
+    int err = 0;
+    async_file_stream_t fs = (async_file_stream_t) r;
+    int num_called = 0;
+
+    do
+    {
+        op_queue_t done = {NULL, NULL};
+        async_op_t *op;
+
+        CHECK( async_file_stream_submit(r) );
+
+#ifdef ASYNC_USE_THREADS
+        if (wait && fs->num_pending > 0)
+        {
+            struct pollfd pfd;
+
+            pfd.fd = fs->notify_fd[0];
+            pfd.events = POLLIN;
+            while (poll(&pfd, 1, -1) < 0)
+            {
+                ASSURE( errno == EINTR, ("poll() failed (errno %d)", errno) );
+            }
+        }
+#endif
+        drain_notifications(fs);
+        collect(fs, &done);
+
+        while ((op = queue_pop(&done)) != NULL)
+        {
+            if (op->type == ASYNC_OP_LOAD)
+            {
+                fs->loads_in_flight--;
+            }
+            else
+            {
+                fs->have_box_op = 0;
+            }
+            fs->num_pending--;
+            if (!fs->discard && op->done != NULL)
+            {
+                op->done(op->p_user, op->err);
+            }
+            num_called++;
+
+            op->next = fs->free_ops;
+            fs->free_ops = op;
+        }
+    } while (wait && num_called == 0 && fs->num_pending > 0);
+
+cleanup:
+    return err;
+}
+
+static uint32_t
+async_file_stream_get_pending(async_reader_t r)
+{
+    return ((async_file_stream_t) r)->num_pending;
+}
+
+static int
+async_file_stream_get_fd(async_reader_t r)
+{
+    return ((async_file_stream_t) r)->notify_fd[0];
+}
+
+static int
+async_file_stream_register_buffer(async_reader_t r, unsigned char *p_buffer, size_t size)
+{
+    int err = 0;
+    async_file_stream_t fs = (async_file_stream_t) r;
+    const async_op_t *op;
+
+    ASSURE( fs->loads_in_flight == 0, ("Loads pending") );
+    for (op = fs->queued.head; op != NULL; op = op->next)
+    {
+        ASSURE( op->type != ASYNC_OP_LOAD, ("Loads pending") );
+    }
+
+#ifdef ASYNC_USE_URING
+    if (fs->have_ring &&
+        uring_register_buffer(&fs->ring, p_buffer, size) != 0 &&
+        p_buffer != NULL)
+    {
+        logout(LOG_VERBOSE_LVL_INFO, "%s: buffer registration failed (errno %d), using unregistered reads\n", fs->path, errno);
+    }
+#else
+    (void) p_buffer;
+    (void) size;
+#endif
+
+cleanup:
+    return err;
+}
+
+static void
+async_file_stream_destroy(async_reader_t r)
+{
+    async_file_stream_t fs = (async_file_stream_t) r;
+
+    if (fs == NULL)
+    {
+        return;
+    }
+
+    /* The kernel or the workers may still write to the buffers */
+    fs->discard = 1;
+    while (fs->num_pending > 0 && async_file_stream_process(r, 1) == 0)
+    {
+    }
+
+#ifdef ASYNC_USE_THREADS
+    if (fs->have_lock)
+    {
+        uint32_t i;
+
+        pthread_mutex_lock(&fs->lock);
+        fs->stop = 1;
+        pthread_cond_broadcast(&fs->job_cond);
+        pthread_mutex_unlock(&fs->lock);
+        for (i = 0; i < fs->num_threads; i++)
+        {
+            pthread_join(fs->threads[i], NULL);
+        }
+        pthread_cond_destroy(&fs->job_cond);
+        pthread_mutex_destroy(&fs->lock);
+    }
+#endif
+#ifdef ASYNC_USE_URING
+    if (fs->have_ring)
+    {
+        uring_deinit(&fs->ring);
+    }
+#endif
+#ifdef ASYNC_USE_THREADS
+    if (fs->notify_fd[0] >= 0)
+    {
+        close(fs->notify_fd[0]);
+    }
+    if (fs->notify_fd[1] >= 0 && fs->notify_fd[1] != fs->notify_fd[0])
+    {
+        close(fs->notify_fd[1]);
+    }
+    if (fs->fd >= 0)
+    {
+        close(fs->fd);
+    }
+#endif
+
+    while (fs->queued.head != NULL)
+    {
+        free(queue_pop(&fs->queued));
+    }
+    while (fs->free_ops != NULL)
+    {
+        async_op_t *op = fs->free_ops;
+
+        fs->free_ops = op->next;
+        free(op);
+    }
+    fragment_reader_destroy(fs->base.fragments);
+    free(fs->path);
+    free(fs);
+}
+
+int
+async_file_stream_new(async_reader_t *p_r,
+                      const char *path,
+                      uint32_t queue_depth)
+{
+    int err = 0;
+    async_file_stream_t fs = malloc(sizeof(*fs));
+
+    ASSURE( fs != NULL, ("Allocation error") );
+    memset(fs, 0, sizeof(*fs));
+    fs->fd = -1;
+    fs->notify_fd[0] = -1;
+    fs->notify_fd[1] = -1;
+
+    fs->base.destroy = async_file_stream_destroy;
+    fs->base.next_atom = async_file_stream_next_atom;
+    fs->base.seek = async_file_stream_seek;
+    fs->base.load = async_file_stream_load;
+    fs->base.submit = async_file_stream_submit;
+    fs->base.process = async_file_stream_process;
+    fs->base.get_pending = async_file_stream_get_pending;
+    fs->base.get_fd = async_file_stream_get_fd;
+    fs->base.register_buffer = async_file_stream_register_buffer;
+
+    ASSURE( queue_depth > 0, ("Queue depth must be positive") );
+    fs->queue_depth = queue_depth;
+
+    fs->path = string_dup(path);
+    ASSURE( fs->path != NULL, ("Allocation error") );
+    CHECK( file_stream_new(&fs->base.fragments, fs->path) );
+
+#ifdef ASYNC_USE_THREADS
+    fs->fd = open(path, O_RDONLY);
+    ASSURE( fs->fd >= 0, ("Failed to open input file '%s'", path) );
+
+#ifdef ASYNC_USE_URING
+    fs->notify_fd[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ASSURE( fs->notify_fd[0] >= 0, ("Failed to create eventfd (errno %d)", errno) );
+    fs->notify_fd[1] = fs->notify_fd[0];
+
+    fs->have_ring = (uring_init(&fs->ring, queue_depth, fs->notify_fd[0]) == 0);
+    logout(LOG_VERBOSE_LVL_INFO, "%s: loads use %s\n", path, fs->have_ring ? "io_uring" : "worker threads");
+#else
+    ASSURE( pipe(fs->notify_fd) == 0, ("Failed to create pipe (errno %d)", errno) );
+    fcntl(fs->notify_fd[0], F_SETFL, O_NONBLOCK);
+    fcntl(fs->notify_fd[1], F_SETFL, O_NONBLOCK);
+#endif
+
+    ASSURE( pthread_mutex_init(&fs->lock, NULL) == 0, ("Failed to create mutex") );
+    if (pthread_cond_init(&fs->job_cond, NULL) != 0)
+    {
+        pthread_mutex_destroy(&fs->lock);
+        ASSURE( 0, ("Failed to create condition variable") );
+    }
+    fs->have_lock = 1;
+
+    {
+        /* One thread for next_atom() and seek() if loads use the ring */
+        uint32_t num_threads = ASYNC_FILE_STREAM_THREADS;
+
+#ifdef ASYNC_USE_URING
+        if (fs->have_ring)
+        {
+            num_threads = 1;
+        }
+#endif
+        while (fs->num_threads < num_threads)
+        {
+            ASSURE( pthread_create(&fs->threads[fs->num_threads], NULL, worker_main, fs) == 0,
+                    ("Failed to create worker thread") );
+            fs->num_threads++;
+        }
+    }
+#endif
+
+    *p_r = &fs->base;
+cleanup:
+    if (err && fs != NULL)
+    {
+        async_file_stream_destroy(&fs->base);
+    }
+    return err;
+}
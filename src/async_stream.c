@@ -0,0 +1,135 @@
+/************************************************************************************************************
+ * Copyright (c) 2017, Dolby Laboratories Inc.
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ *    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+ *    promote products derived from this software without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ ************************************************************************************************************/
+#include "async_stream.h"
+
+#include "util.h"
+
+void async_reader_destroy(async_reader_t r)
+{
+    if (r != NULL && r->destroy != NULL)
+    {
+        r->destroy(r);
+    }
+}
+
+int async_reader_next_atom(async_reader_t r, async_reader_done_t done, void *p_user)
+{
+    if (r != NULL && r->next_atom != NULL)
+    {
+        return r->next_atom(r, done, p_user);
+    }
+
+    return -1;
+}
+
+int async_reader_seek(async_reader_t r,
+                      uint32_t track_ID,
+                      uint64_t seek_time,
+                      uint64_t *out_time,
+                      async_reader_done_t done, void *p_user)
+{
+    if (r != NULL && r->seek != NULL)
+    {
+        return r->seek(r, track_ID, seek_time, out_time, done, p_user);
+    }
+
+    return -1;
+}
+
+int async_reader_load(async_reader_t r,
+                      uint64_t position,
+                      uint32_t size,
+                      unsigned char *p_buffer,
+                      async_reader_done_t done, void *p_user)
+{
+    if (r != NULL && r->load != NULL)
+    {
+        return r->load(r, position, size, p_buffer, done, p_user);
+    }
+
+    return -1;
+}
+
+int async_reader_submit(async_reader_t r)
+{
+    if (r != NULL && r->submit != NULL)
+    {
+        return r->submit(r);
+    }
+
+    return -1;
+}
+
+int async_reader_process(async_reader_t r, int wait)
+{
+    if (r != NULL && r->process != NULL)
+    {
+        return r->process(r, wait);
+    }
+
+    return -1;
+}
+
+uint32_t async_reader_get_pending(async_reader_t r)
+{
+    if (r != NULL && r->get_pending != NULL)
+    {
+        return r->get_pending(r);
+    }
+
+    return 0;
+}
+
+int async_reader_get_fd(async_reader_t r)
+{
+    if (r != NULL && r->get_fd != NULL)
+    {
+        return r->get_fd(r);
+    }
+
+    return -1;
+}
+
+int async_reader_register_buffer(async_reader_t r, unsigned char *p_buffer, size_t size)
+{
+    if (r != NULL && r->register_buffer != NULL)
+    {
+        return r->register_buffer(r, p_buffer, size);
+    }
+
+    return 0;
+}
+
+int async_reader_wait_all(async_reader_t r)
+{
+    int err = 0;
+
+    while (async_reader_get_pending(r) > 0)
+    {
+        CHECK( async_reader_process(r, 1) );
+    }
+
+cleanup:
+    return err;
+}
@@ -0,0 +1,507 @@
+/************************************************************************************************************
+ * Copyright (c) 2017, Dolby Laboratories Inc.
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ *    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+ *    promote products derived from this software without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ ************************************************************************************************************/
+#include "chunk_stream.h"
+
+#include "file_stream.h"
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#ifdef _MSC_VER
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+/** @brief chunk_stream implementation of the mp4_source API */
+typedef struct chunk_stream_
+{
+    struct fragment_reader_t_ base;
+
+    int fd;                     /* Input file descriptor (owned) */
+    const char *path;
+
+    mp4d_pusher_ptr_t p_push;   /* Push parser, with its own demuxer instance */
+    void *p_push_mem;
+    mp4d_demuxer_ptr_t p_push_dmux;
+    void *p_push_dmux_static_mem;
+    void *p_push_dmux_dynamic_mem;
+
+    unsigned char *chunk;       /* Last chunk read from the input */
+    size_t chunk_size;          /* bytes allocated */
+    size_t chunk_fill;          /* bytes used */
+    size_t chunk_rpos;          /* first byte not yet pushed */
+    uint64_t read_offs;         /* file position after the last chunk */
+    int is_eof;
+    int follow;                 /* Wait for the file to grow at EOF */
+    file_follower_t follower;
+
+    unsigned char *atom;        /* Copy of the current moov/moof, referenced by p_dmux */
+    size_t atom_size;           /* bytes allocated */
+    uint64_t atom_offset;       /* file position of the current atom */
+    uint64_t atom_fill;         /* size of the current atom, if buffered */
+
+    unsigned char *data;        /* Streamed payload received since the current atom */
+    size_t data_size;           /* bytes allocated */
+    size_t data_fill;           /* bytes used */
+    uint64_t data_offs;         /* file position corresponding to data[0] */
+
+    mp4d_ftyp_info_t ftyp;
+    unsigned char *compat_brands;
+
+} *chunk_stream_t;
+
+static const size_t CHUNK_STREAM_READ_SIZE = 16*1024;
+static const uint64_t CHUNK_STREAM_MAX_BOX_SIZE = 16*1024*1024;
+
+static int64_t
+chunk_read(int fd, unsigned char *p_buffer, size_t size)
+{
+#ifdef _MSC_VER
+    return _read(fd, p_buffer, (unsigned int) size);
+#else  /* posix */
+    ssize_t n;
+
+    do
+    {
+        n = read(fd, p_buffer, size);
+    } while (n < 0 && errno == EINTR);
+
+    return n;
+#endif
+}
+
+static int
+chunk_seek(int fd, uint64_t offset)
+{
+#ifdef _MSC_VER
+    return _lseeki64(fd, offset, SEEK_SET) < 0 ? -1 : 0;
+#else  /* posix */
+    return lseek(fd, (off_t) offset, SEEK_SET) < 0 ? -1 : 0;
+#endif
+}
+
+/* Restart parsing at the beginning of the input */
+static int
+chunk_stream_rewind(chunk_stream_t cs)
+{
+    int err = 0;
+
+    ASSURE( chunk_seek(cs->fd, 0) == 0, ("Cannot rewind '%s'", cs->path) );
+    CHECK( mp4d_pusher_init(&cs->p_push, cs->p_push_dmux, CHUNK_STREAM_MAX_BOX_SIZE, cs->p_push_mem) );
+
+    cs->chunk_fill = 0;
+    cs->chunk_rpos = 0;
+    cs->read_offs = 0;
+    cs->is_eof = 0;
+    cs->atom_offset = 0;
+    cs->atom_fill = 0;
+    cs->data_fill = 0;
+    cs->data_offs = 0;
+
+cleanup:
+    return err;
+}
+
+/** @brief Get the next push parser event, reading more input as needed
+ *  @return 0: event available
+ *          1: unexpected error
+ *          2: end of input
+ */
+static int
+chunk_stream_next_event(chunk_stream_t cs, mp4d_push_event_t *p_ev)
+{
+    int err = 0;
+
+    for (;;)
+    {
+        uint64_t consumed;
+        int64_t bytes_read;
+        int rv = mp4d_pusher_push(cs->p_push,
+                                  cs->chunk + cs->chunk_rpos,
+                                  cs->chunk_fill - cs->chunk_rpos,
+                                  cs->is_eof,
+                                  &consumed,
+                                  p_ev);
+
+        ASSURE( rv == MP4D_NO_ERROR, ("Invalid or truncated box in '%s' (%d)", cs->path, rv) );
+        cs->chunk_rpos += (size_t) consumed;
+
+        if (p_ev->type != MP4D_PUSH_NONE)
+        {
+            break;
+        }
+        if (cs->is_eof)
+        {
+            return 2;
+        }
+
+        /* Returns whatever is available, rather than waiting for a full chunk */
+        bytes_read = chunk_read(cs->fd, cs->chunk, cs->chunk_size);
+        ASSURE( bytes_read >= 0, ("Failed to read from '%s'", cs->path) );
+        if (bytes_read == 0 && cs->follow)
+        {
+            /* The file may still be written */
+            int err_wait = file_follower_wait(&cs->follower, cs->fd, cs->read_offs + 1);
+
+            ASSURE( err_wait != 1, ("Failed to wait for '%s' to grow", cs->path) );
+            if (err_wait == 0)
+            {
+                continue;
+            }
+        }
+
+        cs->chunk_fill = (size_t) bytes_read;
+        cs->chunk_rpos = 0;
+        cs->read_offs += (uint64_t) bytes_read;
+        cs->is_eof = (bytes_read == 0);
+    }
+
+cleanup:
+    return err;
+}
+
+/* Append streamed payload to the data window, which must stay contiguous */
+static int
+chunk_stream_add_data(chunk_stream_t cs, const mp4d_push_event_t *p_ev)
+{
+    int err = 0;
+
+    if (p_ev->offset != cs->data_offs + cs->data_fill)
+    {
+        cs->data_fill = 0;
+        cs->data_offs = p_ev->offset;
+    }
+    if (cs->data_fill + p_ev->size > cs->data_size)
+    {
+        size_t size = cs->data_fill + (size_t) p_ev->size;
+
+        cs->data = realloc(cs->data, size);
+        ASSURE( cs->data != NULL, ("Failed to allocate %" PRIz " bytes", size) );
+        cs->data_size = size;
+    }
+    memcpy(cs->data + cs->data_fill, p_ev->p_data, (size_t) p_ev->size);
+    cs->data_fill += (size_t) p_ev->size;
+
+cleanup:
+    return err;
+}
+
+static int
+chunk_stream_next_atom(fragment_reader_t s)
+{
+    chunk_stream_t cs = (chunk_stream_t) s;
+    mp4d_push_event_t ev;
+    uint64_t box_size;
+    int err = 0;
+
+    do
+    {
+        err = chunk_stream_next_event(cs, &ev);
+        if (err)
+        {
+            return err;
+        }
+    } while (ev.type == MP4D_PUSH_DATA);
+
+    cs->atom_offset = ev.offset;
+    cs->atom_fill = 0;
+    cs->data_fill = 0;
+    cs->data_offs = ev.offset + ev.size;
+
+    if (!ev.is_streamed)
+    {
+        /* Keep a copy, the event data only lives until the next push */
+        if (ev.size > cs->atom_size)
+        {
+            cs->atom = realloc(cs->atom, (size_t) ev.size);
+            ASSURE( cs->atom != NULL, ("Failed to allocate %" PRIu64 " bytes", ev.size) );
+            cs->atom_size = (size_t) ev.size;
+        }
+        memcpy(cs->atom, ev.p_data, (size_t) ev.size);
+        cs->atom_fill = ev.size;
+
+        CHECK( mp4d_demuxer_parse(s->p_dmux, cs->atom, ev.size, cs->is_eof, ev.offset, &box_size) );
+    }
+    else
+    {
+        /* Only the header is known, the payload is received by load() */
+        int rv = mp4d_demuxer_parse(s->p_dmux, ev.p_data, ev.header_size, 0, ev.offset, &box_size);
+
+        ASSURE( rv == MP4D_NO_ERROR || rv == MP4D_E_BUFFER_TOO_SMALL,
+                ("Failed to parse box header @%" PRIu64 " (%d)", ev.offset, rv) );
+        cs->data_offs = ev.offset + ev.header_size;
+    }
+
+cleanup:
+    return err;
+}
+
+static int
+chunk_stream_load(fragment_reader_t s, uint64_t position, uint32_t size, unsigned char *p_buffer)
+{
+    chunk_stream_t cs = (chunk_stream_t) s;
+    int err = 0;
+
+    if (cs->atom_fill > 0 &&
+        position >= cs->atom_offset && position + size <= cs->atom_offset + cs->atom_fill)
+    {
+        /* e.g. sample auxiliary information inside the moof */
+        memcpy(p_buffer, cs->atom + (position - cs->atom_offset), size);
+        return 0;
+    }
+
+    if (position < cs->data_offs)
+    {
+        /* Data before the window, only possible for seekable input */
+        int64_t bytes_read;
+
+        ASSURE( chunk_seek(cs->fd, position) == 0, ("Seek to %" PRIu64 " on '%s' failed", position, cs->path) );
+        bytes_read = chunk_read(cs->fd, p_buffer, size);
+        ASSURE( bytes_read == (int64_t) size,
+                ("Reading %" PRIu32 " bytes from input @%" PRIu64 " failed", size, position) );
+        ASSURE( chunk_seek(cs->fd, cs->read_offs) == 0, ("Seek to %" PRIu64 " on '%s' failed", cs->read_offs, cs->path) );
+        return 0;
+    }
+
+    /* Wait only until the requested bytes have arrived */
+    while (cs->data_offs + cs->data_fill < position + size)
+    {
+        mp4d_push_event_t ev;
+        int err_next = chunk_stream_next_event(cs, &ev);
+
+        ASSURE( err_next != 2, ("Reading %" PRIu32 " bytes @%" PRIu64 " failed: end of input", size, position) );
+        CHECK( err_next );
+        ASSURE( ev.type == MP4D_PUSH_DATA || ev.is_streamed,
+                ("Reading %" PRIu32 " bytes @%" PRIu64 " failed: data not in the following 'mdat'", size, position) );
+
+        if (ev.type == MP4D_PUSH_DATA && ev.offset + ev.size > position)
+        {
+            CHECK( chunk_stream_add_data(cs, &ev) );
+        }
+    }
+    ASSURE( position >= cs->data_offs, ("Reading %" PRIu32 " bytes @%" PRIu64 " failed: data skipped", size, position) );
+
+    memcpy(p_buffer, cs->data + (position - cs->data_offs), size);
+
+    /* Samples are read in increasing file position, drop what is before this one */
+    memmove(cs->data, cs->data + (position - cs->data_offs), (size_t) (cs->data_offs + cs->data_fill - position));
+    cs->data_fill = (size_t) (cs->data_offs + cs->data_fill - position);
+    cs->data_offs = position;
+
+cleanup:
+    return err;
+}
+
+/* Without random access information, move to the first fragment */
+static int
+chunk_stream_seek(fragment_reader_t s,
+                  uint32_t track_ID,
+                  uint64_t seek_time,
+                  uint64_t *out_time)
+{
+    int err = 0;
+    chunk_stream_t cs = (chunk_stream_t) s;
+    mp4d_fourcc_t type;
+
+    (void) track_ID;
+    (void) seek_time;
+
+    CHECK( chunk_stream_rewind(cs) );
+    do
+    {
+        CHECK( fragment_reader_next_atom(s) );
+        CHECK( mp4d_demuxer_get_type(s->p_dmux, &type) );
+    } while (!MP4D_FOURCC_EQ(type, "moov") &&
+             !MP4D_FOURCC_EQ(type, "moof"));
+
+    *out_time = 0;
+
+cleanup:
+    return err;
+}
+
+static int
+chunk_stream_get_offset(fragment_reader_t s, uint64_t *offset)
+{
+    int err = 0;
+    chunk_stream_t cs = (chunk_stream_t) s;
+
+    ASSURE( offset != NULL, ("Null input") );
+    *offset = cs->atom_offset;
+
+cleanup:
+    return err;
+}
+
+static int
+chunk_stream_get_type(fragment_reader_t s, mp4d_ftyp_info_t *p_type)
+{
+    int err = 0;
+    chunk_stream_t cs = (chunk_stream_t) s;
+
+    ASSURE( cs->compat_brands != NULL, ("No ftyp atom found, cannot get file type") );
+    *p_type = cs->ftyp;
+
+cleanup:
+    return err;
+}
+
+static void
+chunk_stream_destroy(fragment_reader_t s)
+{
+    chunk_stream_t cs = (chunk_stream_t) s;
+
+    if (cs != NULL)
+    {
+        if (cs->fd >= 0)
+        {
+#ifdef _MSC_VER
+            _close(cs->fd);
+#else
+            close(cs->fd);
+#endif
+        }
+        file_follower_deinit(&cs->follower);
+        free(cs->p_push_mem);
+        free(cs->p_push_dmux_static_mem);
+        free(cs->p_push_dmux_dynamic_mem);
+        free(cs->chunk);
+        free(cs->atom);
+        free(cs->data);
+        free(cs->compat_brands);
+
+        fragment_reader_deinit(s);
+        free(s);
+    }
+}
+
+int chunk_stream_new(fragment_reader_t *p_s,  /**< [out] */
+                     const char *path)
+{
+    int err = 0;
+    chunk_stream_t cs = malloc(sizeof *cs);
+    fragment_reader_t s;
+
+    ASSURE( cs != NULL, ("Allocation error") );
+    memset(cs, 0, sizeof(*cs));
+    cs->fd = -1;
+    cs->follower.inotify_fd = -1;
+    s = &cs->base;
+    CHECK( fragment_reader_init(s) );
+
+    s->next_atom = chunk_stream_next_atom;
+    s->seek = chunk_stream_seek;
+    s->destroy = chunk_stream_destroy;
+    s->load = chunk_stream_load;
+    s->get_offset = chunk_stream_get_offset;
+    s->get_type = chunk_stream_get_type;
+
+    {
+        uint64_t static_mem_size, dyn_mem_size;
+
+        CHECK( mp4d_demuxer_query_mem(&static_mem_size, &dyn_mem_size) );
+        cs->p_push_dmux_static_mem = malloc((size_t) static_mem_size);
+        cs->p_push_dmux_dynamic_mem = malloc((size_t) dyn_mem_size);
+        ASSURE( cs->p_push_dmux_static_mem != NULL && cs->p_push_dmux_dynamic_mem != NULL, ("Allocation error") );
+        CHECK( mp4d_demuxer_init(&cs->p_push_dmux, cs->p_push_dmux_static_mem, cs->p_push_dmux_dynamic_mem) );
+
+        CHECK( mp4d_pusher_query_mem(CHUNK_STREAM_MAX_BOX_SIZE, &static_mem_size) );
+        ASSURE( (uint64_t) (size_t) static_mem_size == static_mem_size, ("Cannot allocate %" PRIu64 " bytes of memory", static_mem_size) );
+        cs->p_push_mem = malloc((size_t) static_mem_size);
+        ASSURE( cs->p_push_mem != NULL, ("Allocation error") );
+    }
+
+    cs->chunk_size = CHUNK_STREAM_READ_SIZE;
+    cs->chunk = malloc(cs->chunk_size);
+    ASSURE( cs->chunk != NULL, ("Allocation error") );
+
+#ifdef _MSC_VER
+    cs->fd = _open(path, _O_RDONLY | _O_BINARY);
+#else
+    cs->fd = open(path, O_RDONLY);
+#endif
+    ASSURE( cs->fd >= 0, ("Failed to open input file '%s'", path) );
+    cs->path = path;
+
+    CHECK( chunk_stream_rewind(cs) );
+
+    {
+        mp4d_atom_t atom;
+
+        int err_next = fragment_reader_next_atom(s);
+
+        ASSURE( err_next != 2, ("Found no boxes in %s", path) );
+        ASSURE( err_next == 0, ("Unexpected error %d when reading first box from %s", err_next, path) );
+        CHECK( mp4d_demuxer_get_atom(s->p_dmux, &atom) );
+        if (MP4D_FOURCC_EQ(atom.type, "ftyp") )
+        {
+            CHECK( mp4d_demuxer_get_ftyp_info(s->p_dmux, &cs->ftyp) );
+
+            /* Copy the compatible_brands memory */
+            cs->compat_brands = (unsigned char*)malloc(4 * cs->ftyp.num_compat_brands + 1);
+            ASSURE( cs->compat_brands != NULL, ("malloc failure") );
+            memcpy(cs->compat_brands, cs->ftyp.compat_brands, 4 * cs->ftyp.num_compat_brands);
+
+            cs->ftyp.compat_brands = cs->compat_brands;
+        }
+        else
+        {
+            /* Assume Quicktime, see file_stream_new() */
+            cs->ftyp.num_compat_brands = 1;
+            cs->compat_brands = (unsigned char*)malloc(4);
+            ASSURE( cs->compat_brands != NULL, ("malloc failure") );
+            memcpy(cs->compat_brands, "qt  ", 4);
+
+            cs->ftyp.compat_brands = cs->compat_brands;
+            memcpy(cs->ftyp.major_brand, cs->ftyp.compat_brands, 4);
+            cs->ftyp.minor_version = 0;
+        }
+
+        CHECK( chunk_stream_rewind(cs) );
+    }
+
+    *p_s = s;
+cleanup:
+    if (err && cs != NULL)
+    {
+        chunk_stream_destroy(&cs->base);
+    }
+    return err;
+}
+
+int chunk_stream_follow(fragment_reader_t s,
+                        uint32_t timeout_ms)
+{
+    chunk_stream_t cs = (chunk_stream_t) s;
+
+    file_follower_deinit(&cs->follower);
+    file_follower_init(&cs->follower, cs->path, timeout_ms);
+    cs->follow = 1;
+
+    return 0;
+}
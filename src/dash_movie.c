@@ -0,0 +1,1372 @@
+/************************************************************************************************************
+ * Copyright (c) 2017, Dolby Laboratories Inc.
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ *    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+ *    promote products derived from this software without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ ************************************************************************************************************/
+#include "dash_movie.h"
+
+#include "segment_session.h"
+#include "file_stream.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Minimal XML document tree, enough for an MPD. Names and values point into the document. */
+typedef struct xml_node_ xml_node_t;
+struct xml_node_
+{
+    const char *name;       /* without namespace prefix */
+    const char **attrs;     /* name and value pairs */
+    uint32_t num_attrs;
+    uint32_t max_attrs;
+    const char *text;       /* character data, or NULL */
+    xml_node_t *parent;
+    xml_node_t *child;      /* first child */
+    xml_node_t *last_child;
+    xml_node_t *next;       /* next sibling */
+};
+
+typedef struct
+{
+    char *path;
+    uint64_t offset;        /* of the first byte in the file */
+    uint64_t size;          /* 0: the whole file */
+} dash_segment_t;
+
+typedef struct
+{
+    char *id;
+    uint32_t bandwidth;
+    dash_segment_t *segments;       /* init segment, then media segments */
+    uint32_t num_segments;
+    uint32_t max_segments;
+    int indexed;                    /* media segments are found in the file of the init segment */
+    movie_t movie;                  /* segment movie, created when the representation is first used */
+} dash_representation_t;
+
+typedef struct
+{
+    char *name;
+    dash_representation_t *reps;
+    uint32_t num_reps;
+} dash_adaptation_t;
+
+typedef struct
+{
+    struct movie_t_ base;
+
+    dash_adaptation_t *sets;
+    uint32_t num_sets;
+    double duration;                /* of the presentation in seconds, or 0 if unknown */
+    uint32_t prefetch_segments;
+} *dash_movie_t;
+
+static int
+is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static char *
+skip_space(char *p)
+{
+    while (is_space(*p))
+    {
+        p++;
+    }
+    return p;
+}
+
+static void
+xml_free(xml_node_t *node)
+{
+    while (node != NULL)
+    {
+        xml_node_t *next = node->next;
+
+        xml_free(node->child);
+        free(node->attrs);
+        free(node);
+        node = next;
+    }
+}
+
+/* Decode the predefined entities and character references, in place */
+static void
+xml_unescape(char *s)
+{
+    char *out = s;
+
+    while (*s != '\0')
+    {
+        char *end = *s == '&' ? strchr(s, ';') : NULL;
+
+        if (end != NULL)
+        {
+            static const char *const names[] = {"amp;", "lt;", "gt;", "quot;", "apos;"};
+            static const char chars[] = "&<>\"'";
+            size_t i;
+
+            for (i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+            {
+                if (strncmp(s + 1, names[i], strlen(names[i])) == 0)
+                {
+                    break;
+                }
+            }
+            if (i < sizeof(names) / sizeof(names[0]))
+            {
+                *out++ = chars[i];
+                s = end + 1;
+                continue;
+            }
+            if (s[1] == '#')
+            {
+                unsigned long c = s[2] == 'x' ? strtoul(s + 3, NULL, 16) : strtoul(s + 2, NULL, 10);
+
+                *out++ = c < 0x80 ? (char) c : '?';  /* only ASCII in paths */
+                s = end + 1;
+                continue;
+            }
+        }
+        *out++ = *s++;
+    }
+    *out = '\0';
+}
+
+static int
+xml_add_attr(xml_node_t *node, const char *name, const char *value)
+{
+    int err = 0;
+
+    if (node->num_attrs == node->max_attrs)
+    {
+        const char **attrs = realloc((void *) node->attrs, 2 * (2 * node->max_attrs + 4) * sizeof(*attrs));
+
+        ASSURE( attrs != NULL, ("Allocation error") );
+        node->attrs = attrs;
+        node->max_attrs = 2 * node->max_attrs + 4;
+    }
+    node->attrs[2 * node->num_attrs] = name;
+    node->attrs[2 * node->num_attrs + 1] = value;
+    node->num_attrs++;
+
+cleanup:
+    return err;
+}
+
+/* Parse a document in place. Comments, processing instructions and DOCTYPE are skipped. */
+static int
+xml_parse(char *p, xml_node_t **p_root)
+{
+    int err = 0;
+    xml_node_t *root = NULL;
+    xml_node_t *cur = NULL;     /* innermost open element */
+
+    while (*p != '\0')
+    {
+        xml_node_t *node;
+        const char *colon;
+
+        if (*p != '<')
+        {
+            char *text = skip_space(p);
+            char *end;
+
+            p = strchr(p, '<');
+            if (p == NULL)
+            {
+                break;
+            }
+            for (end = p; end > text && is_space(end[-1]); end--)
+            {
+            }
+            *end = '\0';
+            if (cur != NULL && cur->text == NULL && *text != '\0')
+            {
+                xml_unescape(text);
+                cur->text = text;
+            }
+        }
+        *p++ = '\0';
+
+        if (*p == '?')
+        {
+            p = strstr(p, "?>");
+            ASSURE( p != NULL, ("Unterminated processing instruction") );
+            p += 2;
+            continue;
+        }
+        if (strncmp(p, "!--", 3) == 0)
+        {
+            p = strstr(p + 3, "-->");
+            ASSURE( p != NULL, ("Unterminated comment") );
+            p += 3;
+            continue;
+        }
+        if (*p == '!')
+        {
+            p = strchr(p, '>');
+            ASSURE( p != NULL, ("Unterminated declaration") );
+            p++;
+            continue;
+        }
+        if (*p == '/')
+        {
+            ASSURE( cur != NULL, ("Unexpected end tag") );
+            cur = cur->parent;
+            p = strchr(p, '>');
+            ASSURE( p != NULL, ("Unterminated end tag") );
+            p++;
+            continue;
+        }
+
+        node = calloc(1, sizeof(*node));
+        ASSURE( node != NULL, ("Allocation error") );
+        node->parent = cur;
+        if (cur == NULL)
+        {
+            ASSURE( root == NULL, ("More than one root element") );
+            root = node;
+        }
+        else if (cur->last_child == NULL)
+        {
+            cur->child = cur->last_child = node;
+        }
+        else
+        {
+            cur->last_child->next = node;
+            cur->last_child = node;
+        }
+
+        node->name = p;
+        p += strcspn(p, " \t\r\n/>");
+        for (;;)
+        {
+            char *name;
+            char quote;
+
+            if (is_space(*p))
+            {
+                *p++ = '\0';
+                p = skip_space(p);
+            }
+            if (*p == '>')
+            {
+                *p++ = '\0';
+                cur = node;
+                break;
+            }
+            if (p[0] == '/' && p[1] == '>')
+            {
+                *p = '\0';
+                p += 2;
+                break;
+            }
+            ASSURE( *p != '\0' && *p != '/' && *p != '=', ("Malformed start tag") );
+
+            name = p;
+            p += strcspn(p, " \t\r\n=/>");
+            if (is_space(*p))
+            {
+                *p++ = '\0';
+                p = skip_space(p);
+            }
+            ASSURE( *p == '=', ("Missing value of attribute") );
+            *p++ = '\0';
+            p = skip_space(p);
+            quote = *p;
+            ASSURE( quote == '"' || quote == '\'', ("Unquoted attribute value") );
+            CHECK( xml_add_attr(node, name, ++p) );
+            p = strchr(p, quote);
+            ASSURE( p != NULL, ("Unterminated attribute value") );
+            *p++ = '\0';
+            xml_unescape((char *) node->attrs[2 * node->num_attrs - 1]);
+        }
+
+        colon = strrchr(node->name, ':');
+        if (colon != NULL)
+        {
+            node->name = colon + 1;
+        }
+    }
+    ASSURE( root != NULL, ("No root element") );
+
+    *p_root = root;
+    root = NULL;
+
+cleanup:
+    xml_free(root);
+    return err;
+}
+
+static const char *
+xml_attr(const xml_node_t *node, const char *name)
+{
+    uint32_t i;
+
+    if (node == NULL)
+    {
+        return NULL;
+    }
+    for (i = 0; i < node->num_attrs; i++)
+    {
+        if (strcmp(node->attrs[2 * i], name) == 0)
+        {
+            return node->attrs[2 * i + 1];
+        }
+    }
+    return NULL;
+}
+
+/* First child element with the name, after (or, if NULL, from the start of) the children of parent */
+static const xml_node_t *
+xml_child(const xml_node_t *parent, const char *name, const xml_node_t *after)
+{
+    const xml_node_t *node;
+
+    if (parent == NULL)
+    {
+        return NULL;
+    }
+    for (node = after != NULL ? after->next : parent->child; node != NULL; node = node->next)
+    {
+        if (strcmp(node->name, name) == 0)
+        {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+/** @brief Decimal digits, returns the end of the digits */
+static const char *
+parse_u64(const char *s, uint64_t *p_value)
+{
+    uint64_t value = 0;
+
+    while (*s >= '0' && *s <= '9')
+    {
+        value = 10 * value + (uint64_t) (*s - '0');
+        s++;
+    }
+    *p_value = value;
+    return s;
+}
+
+static uint64_t
+u64_value(const char *s, uint64_t default_value)
+{
+    uint64_t value;
+
+    if (s == NULL || parse_u64(s, &value) == s)
+    {
+        return default_value;
+    }
+    return value;
+}
+
+/** @brief ISO 8601 duration, e.g. "PT1H2M3.5S", in seconds (years and months are approximated) */
+static double
+parse_duration(const char *s)
+{
+    double seconds = 0;
+    int time_part = 0;
+
+    if (s == NULL || *s != 'P')
+    {
+        return 0;
+    }
+    for (s++; *s != '\0'; )
+    {
+        char *end;
+        double value;
+
+        if (*s == 'T')
+        {
+            time_part = 1;
+            s++;
+            continue;
+        }
+        value = strtod(s, &end);
+        if (end == s)
+        {
+            return 0;
+        }
+        switch (*end)
+        {
+        case 'Y': seconds += value * 365.25 * 86400; break;
+        case 'M': seconds += time_part ? value * 60 : value * 30.4375 * 86400; break;
+        case 'W': seconds += value * 7 * 86400; break;
+        case 'D': seconds += value * 86400; break;
+        case 'H': seconds += value * 3600; break;
+        case 'S': seconds += value; break;
+        default: return 0;
+        }
+        s = end + 1;
+    }
+    return seconds;
+}
+
+/** @brief Byte range "first-last" */
+static int
+parse_range(const char *s, uint64_t *p_offset, uint64_t *p_size)
+{
+    uint64_t first, last;
+    const char *end;
+
+    if (s == NULL || (end = parse_u64(s, &first)) == s || *end != '-')
+    {
+        return 1;
+    }
+    s = end + 1;
+    if (parse_u64(s, &last) == s || last < first)
+    {
+        return 1;
+    }
+    *p_offset = first;
+    *p_size = last - first + 1;
+    return 0;
+}
+
+/** @brief Resolve a URL reference against a base (a file path, relative to its directory) */
+static int
+resolve_url(const char *base, const char *ref, char **p_path)
+{
+    int err = 0;
+    size_t dir_len = 0;
+    size_t i;
+
+    ASSURE( ref != NULL, ("Missing URL") );
+    if (strncmp(ref, "file://", 7) == 0)
+    {
+        ref += 7;
+    }
+    ASSURE( strstr(ref, "://") == NULL, ("Only local files are supported: '%s'", ref) );
+
+    if (ref[0] != '/' && ref[0] != '\\' && !(ref[0] != '\0' && ref[1] == ':'))
+    {
+        for (i = 0; base[i] != '\0'; i++)
+        {
+            if (base[i] == '/' || base[i] == '\\')
+            {
+                dir_len = i + 1;
+            }
+        }
+    }
+    *p_path = malloc(dir_len + strlen(ref) + 1);
+    ASSURE( *p_path != NULL, ("Allocation error") );
+    memcpy(*p_path, base, dir_len);
+    strcpy(*p_path + dir_len, ref);
+
+cleanup:
+    return err;
+}
+
+/* Resolve the BaseURL of an element, if any, against base */
+static int
+resolve_base(const char *base, const xml_node_t *element, char **p_base)
+{
+    const xml_node_t *base_url = xml_child(element, "BaseURL", NULL);
+
+    if (base_url == NULL || base_url->text == NULL)
+    {
+        *p_base = string_dup(base);
+        return *p_base == NULL;
+    }
+    return resolve_url(base, base_url->text, p_base);
+}
+
+/** @brief Expand $RepresentationID$, $Number$, $Bandwidth$, $Time$ and $$ of a SegmentTemplate */
+static int
+expand_template(const char *tmpl,
+                const dash_representation_t *p_rep,
+                uint64_t number,
+                uint64_t time,
+                char **p_out)
+{
+    int err = 0;
+    char *out = NULL;
+    size_t len = 0;
+    size_t max_len = strlen(tmpl) + 64;
+
+    out = malloc(max_len);
+    ASSURE( out != NULL, ("Allocation error") );
+
+    while (*tmpl != '\0')
+    {
+        char value[64];
+        const char *end;
+        const char *insert = value;
+        size_t insert_len;
+
+        if (*tmpl != '$')
+        {
+            value[0] = *tmpl++;
+            value[1] = '\0';
+        }
+        else
+        {
+            int width = 0;
+            size_t name_len;
+
+            end = strchr(tmpl + 1, '$');
+            ASSURE( end != NULL, ("Unterminated identifier in template '%s'", tmpl) );
+            name_len = strcspn(tmpl + 1, "%$");
+            if (tmpl[1 + name_len] == '%')
+            {
+                ASSURE( sscanf(tmpl + 2 + name_len, "0%dd", &width) == 1 && width < 32,
+                        ("Unsupported format in template '%s'", tmpl) );
+            }
+
+            if (name_len == 0)
+            {
+                strcpy(value, "$");
+            }
+            else if (strncmp(tmpl + 1, "RepresentationID", name_len) == 0 && name_len == 16)
+            {
+                insert = p_rep->id;
+            }
+            else if (strncmp(tmpl + 1, "Number", name_len) == 0 && name_len == 6)
+            {
+                sprintf(value, "%0*" PRIu64, width, number);
+            }
+            else if (strncmp(tmpl + 1, "Bandwidth", name_len) == 0 && name_len == 9)
+            {
+                sprintf(value, "%0*" PRIu32, width, p_rep->bandwidth);
+            }
+            else if (strncmp(tmpl + 1, "Time", name_len) == 0 && name_len == 4)
+            {
+                sprintf(value, "%0*" PRIu64, width, time);
+            }
+            else
+            {
+                ASSURE( 0, ("Unsupported identifier in template '%s'", tmpl) );
+            }
+            tmpl = end + 1;
+        }
+
+        insert_len = strlen(insert);
+        if (len + insert_len + 1 > max_len)
+        {
+            char *grown;
+
+            max_len = 2 * (len + insert_len + 1);
+            grown = realloc(out, max_len);
+            ASSURE( grown != NULL, ("Allocation error") );
+            out = grown;
+        }
+        memcpy(out + len, insert, insert_len);
+        len += insert_len;
+    }
+    out[len] = '\0';
+
+    *p_out = out;
+    out = NULL;
+
+cleanup:
+    free(out);
+    return err;
+}
+
+static int
+add_segment(dash_representation_t *p_rep,
+            char *path,          /* owned by the representation, also on error */
+            uint64_t offset,
+            uint64_t size)
+{
+    int err = 0;
+
+    if (p_rep->num_segments == p_rep->max_segments)
+    {
+        dash_segment_t *segments = realloc(p_rep->segments, (2 * p_rep->max_segments + 16) * sizeof(*segments));
+
+        if (segments == NULL)
+        {
+            free(path);
+        }
+        ASSURE( segments != NULL, ("Allocation error") );
+        p_rep->segments = segments;
+        p_rep->max_segments = 2 * p_rep->max_segments + 16;
+    }
+    p_rep->segments[p_rep->num_segments].path = path;
+    p_rep->segments[p_rep->num_segments].offset = offset;
+    p_rep->segments[p_rep->num_segments].size = size;
+    p_rep->num_segments++;
+
+cleanup:
+    return err;
+}
+
+static int
+file_exists(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+
+    if (file != NULL)
+    {
+        fclose(file);
+        return 1;
+    }
+    return 0;
+}
+
+/* Attribute of the innermost element of the given name, among the levels (Representation, AdaptationSet, Period) */
+static const char *
+inherited_attr(const xml_node_t *const levels[3], const char *element, const char *name)
+{
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        const char *value = xml_attr(xml_child(levels[i], element, NULL), name);
+
+        if (value != NULL)
+        {
+            return value;
+        }
+    }
+    return NULL;
+}
+
+static uint64_t
+inherited_u64(const xml_node_t *const levels[3], const char *element, const char *name, uint64_t default_value)
+{
+    return u64_value(inherited_attr(levels, element, name), default_value);
+}
+
+/* Add a media segment of a SegmentTemplate. Returns 2 if probing, and the file does not exist. */
+static int
+add_template_segment(dash_representation_t *p_rep,
+                     const char *base,
+                     const char *media,
+                     uint64_t number,
+                     uint64_t time,
+                     int probe)
+{
+    int err = 0;
+    char *name = NULL;
+    char *path = NULL;
+
+    CHECK( expand_template(media, p_rep, number, time, &name) );
+    CHECK( resolve_url(base, name, &path) );
+    if (probe && !file_exists(path))
+    {
+        free(path);
+        err = 2;
+        goto cleanup;
+    }
+    CHECK( add_segment(p_rep, path, 0, 0) );
+
+cleanup:
+    free(name);
+    return err;
+}
+
+static int
+template_segments(dash_representation_t *p_rep,
+                  const xml_node_t *const levels[3],
+                  const char *base,
+                  double period_duration)
+{
+    int err = 0;
+    const char *init = inherited_attr(levels, "SegmentTemplate", "initialization");
+    const char *media = inherited_attr(levels, "SegmentTemplate", "media");
+    uint64_t timescale = inherited_u64(levels, "SegmentTemplate", "timescale", 1);
+    uint64_t number = inherited_u64(levels, "SegmentTemplate", "startNumber", 1);
+    uint64_t duration = inherited_u64(levels, "SegmentTemplate", "duration", 0);
+    uint64_t end_time = (uint64_t) (period_duration * (double) timescale + 0.5);  /* 0: unknown */
+    const xml_node_t *timeline = NULL;
+    char *path = NULL;
+    int i;
+
+    ASSURE( init != NULL && media != NULL, ("SegmentTemplate without @initialization or @media") );
+    CHECK( expand_template(init, p_rep, 0, 0, &path) );
+    {
+        char *resolved = NULL;
+
+        err = resolve_url(base, path, &resolved);
+        free(path);
+        CHECK( err );
+        CHECK( add_segment(p_rep, resolved, 0, 0) );
+    }
+
+    for (i = 0; i < 3 && timeline == NULL; i++)
+    {
+        timeline = xml_child(xml_child(levels[i], "SegmentTemplate", NULL), "SegmentTimeline", NULL);
+    }
+
+    if (timeline != NULL)
+    {
+        const xml_node_t *s = NULL;
+        uint64_t time = 0;
+
+        while ((s = xml_child(timeline, "S", s)) != NULL)
+        {
+            const xml_node_t *next = xml_child(timeline, "S", s);
+            const char *r = xml_attr(s, "r");
+            uint64_t d = u64_value(xml_attr(s, "d"), 0);
+            uint64_t repeat = u64_value(r, 0);
+            uint64_t until = UINT64_MAX;    /* for a negative repeat count */
+            int probe = 0;
+            uint64_t k;
+
+            ASSURE( d > 0, ("SegmentTimeline S without @d") );
+            time = u64_value(xml_attr(s, "t"), time);
+            if (r != NULL && r[0] == '-')
+            {
+                /* Until the next S, the end of the Period, or the last file */
+                if (next != NULL && xml_attr(next, "t") != NULL)
+                {
+                    until = u64_value(xml_attr(next, "t"), 0);
+                }
+                else if (end_time > 0)
+                {
+                    until = end_time;
+                }
+                else
+                {
+                    probe = 1;
+                }
+                repeat = UINT64_MAX - 1;
+            }
+            for (k = 0; k <= repeat && time < until; k++)
+            {
+                int err_add = add_template_segment(p_rep, base, media, number, time, probe);
+
+                if (err_add == 2)
+                {
+                    break;
+                }
+                CHECK( err_add );
+                number++;
+                time += d;
+            }
+        }
+    }
+    else
+    {
+        uint64_t count = UINT64_MAX;
+        uint64_t k;
+
+        ASSURE( duration > 0, ("SegmentTemplate without @duration or SegmentTimeline") );
+        if (end_time > 0)
+        {
+            count = (end_time + duration - 1) / duration;
+        }
+        for (k = 0; k < count; k++)
+        {
+            int err_add = add_template_segment(p_rep, base, media, number + k, k * duration, count == UINT64_MAX);
+
+            if (err_add == 2)
+            {
+                break;
+            }
+            CHECK( err_add );
+        }
+    }
+    ASSURE( p_rep->num_segments > 1, ("No media segments for representation '%s'", p_rep->id) );
+
+cleanup:
+    return err;
+}
+
+static int
+list_segments(dash_representation_t *p_rep,
+              const xml_node_t *list,
+              const char *base)
+{
+    int err = 0;
+    const xml_node_t *init = xml_child(list, "Initialization", NULL);
+    const xml_node_t *url = NULL;
+    char *path = NULL;
+    uint64_t offset = 0, size = 0;
+
+    ASSURE( init != NULL, ("SegmentList without Initialization") );
+    CHECK( resolve_url(base, xml_attr(init, "sourceURL") != NULL ? xml_attr(init, "sourceURL") : base, &path) );
+    if (xml_attr(init, "range") != NULL)
+    {
+        ASSURE( parse_range(xml_attr(init, "range"), &offset, &size) == 0, ("Invalid range '%s'", xml_attr(init, "range")) );
+    }
+    CHECK( add_segment(p_rep, path, offset, size) );
+
+    while ((url = xml_child(list, "SegmentURL", url)) != NULL)
+    {
+        offset = 0;
+        size = 0;
+        CHECK( resolve_url(base, xml_attr(url, "media") != NULL ? xml_attr(url, "media") : base, &path) );
+        if (xml_attr(url, "mediaRange") != NULL)
+        {
+            ASSURE( parse_range(xml_attr(url, "mediaRange"), &offset, &size) == 0,
+                    ("Invalid range '%s'", xml_attr(url, "mediaRange")) );
+        }
+        CHECK( add_segment(p_rep, path, offset, size) );
+    }
+    ASSURE( p_rep->num_segments > 1, ("No media segments for representation '%s'", p_rep->id) );
+
+cleanup:
+    if (err && (p_rep->num_segments == 0 || p_rep->segments[p_rep->num_segments - 1].path != path))
+    {
+        free(path);
+    }
+    return err;
+}
+
+/** @brief Split the file of an indexed representation into its segments
+ *
+ * The media segments are the references of the first 'sidx' box, or start at
+ * each 'moof' if there is none. The init segment ends at the first 'sidx' or
+ * 'moof', unless its range is given. The segments are contiguous, from the
+ * end of the init segment to the end of the file.
+ */
+static int
+index_file(dash_representation_t *p_rep)
+{
+    int err = 0;
+    fragment_reader_t s = NULL;
+    dash_segment_t *p_init = &p_rep->segments[0];
+    uint64_t init_end = p_init->size > 0 ? p_init->offset + p_init->size : 0;
+    uint64_t file_end = 0;
+    uint32_t first_media = p_rep->num_segments;
+    uint32_t i;
+
+    CHECK( file_stream_new(&s, p_init->path) );
+    for (;;)
+    {
+        int err_next = fragment_reader_next_atom(s);
+        mp4d_fourcc_t type;
+        mp4d_atom_t atom;
+        uint64_t offset;
+
+        if (err_next == 2)
+        {
+            break;
+        }
+        CHECK( err_next );
+        CHECK( mp4d_demuxer_get_type(s->p_dmux, &type) );
+        CHECK( fragment_reader_get_offset(s, &offset) );
+        CHECK( mp4d_demuxer_get_atom(s->p_dmux, &atom) );
+        file_end = offset + atom.header + atom.size;
+
+        if (init_end == 0 && (MP4D_FOURCC_EQ(type, "sidx") || MP4D_FOURCC_EQ(type, "moof")))
+        {
+            init_end = offset;
+        }
+        if (MP4D_FOURCC_EQ(type, "sidx") && p_rep->num_segments == first_media)
+        {
+            uint64_t ref_offset, time;
+            uint32_t ref_size;
+
+            for (i = 0; mp4d_demuxer_get_sidx_entry(s->p_dmux, i, &ref_offset, &ref_size, &time) == MP4D_NO_ERROR; i++)
+            {
+                char *path = string_dup(p_init->path);
+
+                ASSURE( path != NULL, ("Allocation error") );
+                CHECK( add_segment(p_rep, path, file_end + ref_offset, ref_size) );
+                p_init = &p_rep->segments[0];
+            }
+            ASSURE( i > 0, ("Empty 'sidx' in '%s'", p_init->path) );
+            break;
+        }
+        if (MP4D_FOURCC_EQ(type, "moof"))
+        {
+            char *path = string_dup(p_init->path);
+
+            ASSURE( path != NULL, ("Allocation error") );
+            CHECK( add_segment(p_rep, path, offset, 0) );
+            p_init = &p_rep->segments[0];
+        }
+    }
+    ASSURE( p_rep->num_segments > first_media, ("No 'sidx' or 'moof' in '%s'", p_init->path) );
+    ASSURE( init_end > p_init->offset && p_rep->segments[first_media].offset >= init_end,
+            ("Invalid init segment range in '%s'", p_init->path) );
+    p_init->size = init_end - p_init->offset;
+
+    /* A segment found at a 'moof' ends at the next one, or at the end of the file */
+    for (i = first_media; i < p_rep->num_segments; i++)
+    {
+        dash_segment_t *p_seg = &p_rep->segments[i];
+
+        if (p_seg->size == 0)
+        {
+            p_seg->size = (i + 1 < p_rep->num_segments ? p_seg[1].offset : file_end) - p_seg->offset;
+        }
+    }
+
+    /* The first one includes the 'sidx', so that positions are file offsets */
+    p_rep->segments[first_media].size += p_rep->segments[first_media].offset - init_end;
+    p_rep->segments[first_media].offset = init_end;
+
+cleanup:
+    if (s != NULL)
+    {
+        fragment_reader_destroy(s);
+    }
+    return err;
+}
+
+static int
+parse_representation(dash_representation_t *p_rep,
+                     const xml_node_t *const levels[3],
+                     const char *base,
+                     double period_duration)
+{
+    int err = 0;
+    const char *id = xml_attr(levels[0], "id");
+    const char *bandwidth = xml_attr(levels[0], "bandwidth");
+    int i;
+
+    ASSURE( id != NULL && bandwidth != NULL, ("Representation without @id or @bandwidth") );
+    p_rep->id = string_dup(id);
+    ASSURE( p_rep->id != NULL, ("Allocation error") );
+    p_rep->bandwidth = (uint32_t) u64_value(bandwidth, 0);
+
+    /* The innermost segment information applies */
+    for (i = 0; i < 3; i++)
+    {
+        const xml_node_t *segment_base = xml_child(levels[i], "SegmentBase", NULL);
+        const xml_node_t *list = xml_child(levels[i], "SegmentList", NULL);
+
+        if (xml_child(levels[i], "SegmentTemplate", NULL) != NULL)
+        {
+            CHECK( template_segments(p_rep, levels, base, period_duration) );
+            goto cleanup;
+        }
+        if (list != NULL)
+        {
+            CHECK( list_segments(p_rep, list, base) );
+            goto cleanup;
+        }
+        if (segment_base != NULL)
+        {
+            break;
+        }
+    }
+
+    /* SegmentBase, or a single file: the segments are found when the representation is used */
+    {
+        const char *range = xml_attr(xml_child(xml_child(levels[i < 3 ? i : 0], "SegmentBase", NULL), "Initialization", NULL), "range");
+        uint64_t offset = 0, size = 0;
+        char *path = string_dup(base);
+
+        ASSURE( path != NULL, ("Allocation error") );
+        if (range != NULL && parse_range(range, &offset, &size) != 0)
+        {
+            free(path);
+            ASSURE( 0, ("Invalid range '%s'", range) );
+        }
+        CHECK( add_segment(p_rep, path, offset, size) );
+        p_rep->indexed = 1;
+    }
+
+cleanup:
+    return err;
+}
+
+/* Orders Representations by increasing @bandwidth, as listed by get_bitrate() */
+static int
+compare_bandwidth(const void *a, const void *b)
+{
+    const dash_representation_t *p_a = (const dash_representation_t *) a;
+    const dash_representation_t *p_b = (const dash_representation_t *) b;
+
+    return (p_a->bandwidth > p_b->bandwidth) - (p_a->bandwidth < p_b->bandwidth);
+}
+
+static int
+parse_mpd(dash_movie_t p_dm, const char *mpd_path)
+{
+    int err = 0;
+    FILE *file = NULL;
+    char *doc = NULL;
+    xml_node_t *root = NULL;
+    const xml_node_t *period;
+    const xml_node_t *set = NULL;
+    char *mpd_base = NULL;
+    char *period_base = NULL;
+    char *set_base = NULL;
+    char *rep_base = NULL;
+    double period_duration;
+    long size;
+
+    file = fopen(mpd_path, "rb");
+    ASSURE( file != NULL, ("Failed to open '%s'", mpd_path) );
+    ASSURE( fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) >= 0 && fseek(file, 0, SEEK_SET) == 0,
+            ("Failed to get the size of '%s'", mpd_path) );
+    doc = malloc((size_t) size + 1);
+    ASSURE( doc != NULL, ("Allocation error") );
+    ASSURE( fread(doc, 1, (size_t) size, file) == (size_t) size, ("Failed to read '%s'", mpd_path) );
+    doc[size] = '\0';
+
+    CHECK( xml_parse(doc, &root) );
+    ASSURE( strcmp(root->name, "MPD") == 0, ("'%s' is not an MPD", mpd_path) );
+    p_dm->duration = parse_duration(xml_attr(root, "mediaPresentationDuration"));
+
+    period = xml_child(root, "Period", NULL);
+    ASSURE( period != NULL, ("No Period in '%s'", mpd_path) );
+    if (xml_child(root, "Period", period) != NULL)
+    {
+        logout(LOG_VERBOSE_LVL_INFO, "Only the first Period of '%s' is demultiplexed\n", mpd_path);
+    }
+    period_duration = parse_duration(xml_attr(period, "duration"));
+    if (period_duration == 0)
+    {
+        period_duration = p_dm->duration;
+    }
+
+    CHECK( resolve_base(mpd_path, root, &mpd_base) );
+    CHECK( resolve_base(mpd_base, period, &period_base) );
+
+    while ((set = xml_child(period, "AdaptationSet", set)) != NULL)
+    {
+        dash_adaptation_t *p_set;
+        const xml_node_t *rep = NULL;
+        dash_adaptation_t *sets = realloc(p_dm->sets, (p_dm->num_sets + 1) * sizeof(*sets));
+
+        ASSURE( sets != NULL, ("Allocation error") );
+        p_dm->sets = sets;
+        p_set = &p_dm->sets[p_dm->num_sets++];
+        memset(p_set, 0, sizeof(*p_set));
+
+        if (xml_attr(set, "id") != NULL)
+        {
+            p_set->name = string_dup(xml_attr(set, "id"));
+        }
+        else
+        {
+            char name[16];
+
+            sprintf(name, "%" PRIu32, p_dm->num_sets - 1);
+            p_set->name = string_dup(name);
+        }
+        ASSURE( p_set->name != NULL, ("Allocation error") );
+
+        free(set_base);
+        set_base = NULL;
+        CHECK( resolve_base(period_base, set, &set_base) );
+
+        while ((rep = xml_child(set, "Representation", rep)) != NULL)
+        {
+            const xml_node_t *levels[3];
+            dash_representation_t *reps = realloc(p_set->reps, (p_set->num_reps + 1) * sizeof(*reps));
+
+            ASSURE( reps != NULL, ("Allocation error") );
+            p_set->reps = reps;
+            memset(&p_set->reps[p_set->num_reps], 0, sizeof(*reps));
+            p_set->num_reps++;
+
+            levels[0] = rep;
+            levels[1] = set;
+            levels[2] = period;
+            free(rep_base);
+            rep_base = NULL;
+            CHECK( resolve_base(set_base, rep, &rep_base) );
+            CHECK( parse_representation(&p_set->reps[p_set->num_reps - 1], levels, rep_base, period_duration) );
+        }
+        ASSURE( p_set->num_reps > 0, ("AdaptationSet '%s' has no Representation", p_set->name) );
+        qsort(p_set->reps, p_set->num_reps, sizeof(*p_set->reps), compare_bandwidth);
+    }
+    ASSURE( p_dm->num_sets > 0, ("No AdaptationSet in '%s'", mpd_path) );
+
+cleanup:
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+    free(mpd_base);
+    free(period_base);
+    free(set_base);
+    free(rep_base);
+    xml_free(root);
+    free(doc);
+    return err;
+}
+
+/* Movie of a representation, created when it is first used */
+static int
+representation_movie(dash_movie_t p_dm,
+                     dash_representation_t *p_rep,
+                     movie_t *p_movie)
+{
+    int err = 0;
+    segment_session_t session = NULL;
+    uint32_t i;
+
+    if (p_rep->movie == NULL)
+    {
+        if (p_rep->indexed)
+        {
+            CHECK( index_file(p_rep) );
+            p_rep->indexed = 0;
+        }
+
+        CHECK( segment_session_new(&session) );
+        for (i = 0; i < p_rep->num_segments; i++)
+        {
+            const dash_segment_t *p_seg = &p_rep->segments[i];
+
+            if (p_seg->size == 0)
+            {
+                CHECK( segment_session_add_file(session, p_seg->path) );
+            }
+            else
+            {
+                CHECK( segment_session_add_file_range(session, p_seg->path, p_seg->offset, p_seg->size) );
+            }
+        }
+        CHECK( segment_session_set_prefetch(session, p_dm->prefetch_segments) );
+        CHECK( segment_movie_new(session, &p_rep->movie) );
+    }
+    *p_movie = p_rep->movie;
+
+cleanup:
+    segment_session_release(session);
+    return err;
+}
+
+/* Movie of the representation of a stream with the given bit rate, or of its first one */
+static int
+find_representation(dash_movie_t p_dm,
+                    uint32_t stream_num,
+                    uint32_t bit_rate,
+                    movie_t *p_movie)
+{
+    int err = 0;
+    const dash_adaptation_t *p_set;
+    uint32_t i;
+
+    ASSURE( stream_num < p_dm->num_sets, ("No stream %" PRIu32, stream_num) );
+    p_set = &p_dm->sets[stream_num];
+    for (i = 0; i < p_set->num_reps; i++)
+    {
+        if (p_set->reps[i].bandwidth == bit_rate)
+        {
+            break;
+        }
+    }
+    if (i == p_set->num_reps)
+    {
+        i = 0;
+    }
+    CHECK( representation_movie(p_dm, &p_set->reps[i], p_movie) );
+
+cleanup:
+    return err;
+}
+
+static void
+dash_movie_destroy(movie_t p_movie)
+{
+    dash_movie_t p_dm = (dash_movie_t) p_movie;
+
+    if (p_dm != NULL)
+    {
+        uint32_t i, j, k;
+
+        for (i = 0; i < p_dm->num_sets; i++)
+        {
+            dash_adaptation_t *p_set = &p_dm->sets[i];
+
+            for (j = 0; j < p_set->num_reps; j++)
+            {
+                dash_representation_t *p_rep = &p_set->reps[j];
+
+                if (p_rep->movie != NULL)
+                {
+                    p_rep->movie->destroy(p_rep->movie);
+                }
+                for (k = 0; k < p_rep->num_segments; k++)
+                {
+                    free(p_rep->segments[k].path);
+                }
+                free(p_rep->segments);
+                free(p_rep->id);
+            }
+            free(p_set->reps);
+            free(p_set->name);
+        }
+        free(p_dm->sets);
+        free(p_dm);
+    }
+}
+
+static int
+dash_movie_get_movie_info(movie_t p_movie,
+                          mp4d_movie_info_t *p_movie_info
+                          )
+{
+    int err = 0;
+    dash_movie_t p_dm = (dash_movie_t) p_movie;
+    movie_t p_rep_movie;
+
+    /* Time scale from the init segment of the first stream */
+    CHECK( find_representation(p_dm, 0, 0, &p_rep_movie) );
+    CHECK( p_rep_movie->get_movie_info(p_rep_movie, p_movie_info) );
+
+    p_movie_info->num_streams = p_dm->num_sets;
+    if (p_dm->duration > 0)
+    {
+        p_movie_info->movie_dur = (uint64_t) (p_dm->duration * p_movie_info->time_scale + 0.5);
+    }
+
+cleanup:
+    return err;
+}
+
+static int
+dash_movie_get_stream_info(movie_t p_movie,
+                           uint32_t stream_num,
+                           uint32_t bit_rate,
+                           mp4d_stream_info_t *p_stream_info,
+                           char **stream_name
+    )
+{
+    int err = 0;
+    dash_movie_t p_dm = (dash_movie_t) p_movie;
+    movie_t p_rep_movie;
+
+    *stream_name = NULL;
+    CHECK( find_representation(p_dm, stream_num, bit_rate, &p_rep_movie) );
+    CHECK( p_rep_movie->get_stream_info(p_rep_movie, 0, 0, p_stream_info, stream_name) );
+
+    /* The track_IDs of different init segments may be equal */
+    p_stream_info->track_id = 0;
+    free(*stream_name);
+    *stream_name = string_dup(p_dm->sets[stream_num].name);
+    ASSURE( *stream_name != NULL, ("Allocation error") );
+
+cleanup:
+    return err;
+}
+
+static int
+dash_movie_get_sampleentry(movie_t p_movie,
+                           uint32_t stream_num,
+                           uint32_t bit_rate,
+                           uint32_t sample_description_index,
+                           mp4d_sampleentry_t *p_sampleentry
+                           )
+{
+    int err = 0;
+    dash_movie_t p_dm = (dash_movie_t) p_movie;
+    movie_t p_rep_movie;
+
+    CHECK( find_representation(p_dm, stream_num, bit_rate, &p_rep_movie) );
+    CHECK( p_rep_movie->get_sampleentry(p_rep_movie, 0, 0, sample_description_index, p_sampleentry) );
+
+cleanup:
+    return err;
+}
+
+static int
+dash_movie_get_bitrate(movie_t p_movie,
+                       uint32_t stream_num,
+                       uint32_t index,
+                       uint32_t *p_bitrate
+                       )
+{
+    dash_movie_t p_dm = (dash_movie_t) p_movie;
+
+    if (stream_num >= p_dm->num_sets)
+    {
+        return 1;
+    }
+    if (index < p_dm->sets[stream_num].num_reps)
+    {
+        *p_bitrate = p_dm->sets[stream_num].reps[index].bandwidth;
+        return 0;
+    }
+    else
+    {
+        /* out of bit rates */
+        return 2;
+    }
+}
+
+static int
+dash_movie_fragment_stream_new(movie_t p_movie,
+                               uint32_t stream_num,
+                               const char *stream_name,
+                               uint32_t bitrate,
+                               fragment_reader_t *p_source
+                               )
+{
+    int err = 0;
+    dash_movie_t p_dm = (dash_movie_t) p_movie;
+    movie_t p_rep_movie;
+
+    if (stream_name != NULL)
+    {
+        for (stream_num = 0; stream_num < p_dm->num_sets; stream_num++)
+        {
+            if (strcmp(p_dm->sets[stream_num].name, stream_name) == 0)
+            {
+                break;
+            }
+        }
+        ASSURE( stream_num < p_dm->num_sets, ("No stream '%s'", stream_name) );
+    }
+    else if (stream_num >= p_dm->num_sets)
+    {
+        /* Any stream, e.g. for the file type and movie header */
+        stream_num = 0;
+    }
+    CHECK( find_representation(p_dm, stream_num, bitrate, &p_rep_movie) );
+    CHECK( p_rep_movie->fragment_stream_new(p_rep_movie, 0, NULL, 0, p_source) );
+
+cleanup:
+    return err;
+}
+
+int
+dash_movie_new(const char *mpd_path,
+               uint32_t prefetch_segments,
+               movie_t *p_movie)
+{
+    int err = 0;
+    dash_movie_t p_dm = malloc(sizeof(*p_dm));
+
+    ASSURE( p_dm != NULL, ("malloc failure") );
+    memset(p_dm, 0, sizeof(*p_dm));
+    p_dm->prefetch_segments = prefetch_segments;
+
+    p_dm->base.destroy = dash_movie_destroy;
+    p_dm->base.get_movie_info = dash_movie_get_movie_info;
+    p_dm->base.get_stream_info = dash_movie_get_stream_info;
+    p_dm->base.get_sampleentry = dash_movie_get_sampleentry;
+    p_dm->base.get_bitrate = dash_movie_get_bitrate;
+    p_dm->base.fragment_stream_new = dash_movie_fragment_stream_new;
+
+    CHECK( parse_mpd(p_dm, mpd_path) );
+
+    *p_movie = &p_dm->base;
+    p_dm = NULL;
+
+cleanup:
+    if (p_dm != NULL)
+    {
+        dash_movie_destroy(&p_dm->base);
+        *p_movie = NULL;
+    }
+    return err;
+}
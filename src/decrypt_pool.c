@@ -0,0 +1,319 @@
+/************************************************************************************************************
+ * Copyright (c) 2017, Dolby Laboratories Inc.
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ *    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+ *    promote products derived from this software without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ ************************************************************************************************************/
+
+#include "decrypt_pool.h"
+
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _MSC_VER
+#define DECRYPT_POOL_USE_THREADS
+#include <pthread.h>
+#endif
+
+struct decrypt_pool_t_
+{
+    decrypt_job_t *head;            /* Submitted, not started. Locked */
+    decrypt_job_t *tail;
+    uint32_t num_in_flight;         /* Submitted, not done. Locked */
+
+    /* Statistics. Locked */
+    uint64_t bytes;
+    double busy_seconds;
+    double active_seconds;
+    double active_start;            /* when num_in_flight became positive */
+
+#ifdef DECRYPT_POOL_USE_THREADS
+    pthread_t threads[DECRYPT_POOL_MAX_THREADS];
+    uint32_t num_threads;
+    int have_lock;
+    pthread_mutex_t lock;
+    pthread_cond_t job_cond;        /* a job was queued, or stop */
+    pthread_cond_t done_cond;       /* a job is done */
+    int stop;                       /* Locked */
+#endif
+};
+
+/** @brief decrypt a job, and return the time it took */
+static double
+run_job(decrypt_job_t *job)
+{
+    double start = clock_seconds();
+
+    job->err = decryptor_decrypt(job->decryptor, job->p_crypt, job->p_data, job->size);
+    return clock_seconds() - start;
+}
+
+/** @brief account for a finished job. Call with the lock held */
+static void
+job_done(decrypt_pool_t pool, decrypt_job_t *job, double seconds)
+{
+    pool->bytes += job->size;
+    pool->busy_seconds += seconds;
+    pool->num_in_flight--;
+    if (pool->num_in_flight == 0)
+    {
+        pool->active_seconds += clock_seconds() - pool->active_start;
+    }
+    job->done = 1;
+}
+
+#ifdef DECRYPT_POOL_USE_THREADS
+static void *
+worker_main(void *arg)
+{
+    decrypt_pool_t pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;)
+    {
+        decrypt_job_t *job;
+        double seconds;
+
+        while (!pool->stop && pool->head == NULL)
+        {
+            pthread_cond_wait(&pool->job_cond, &pool->lock);
+        }
+        job = pool->head;
+        if (job == NULL)
+        {
+            break;
+        }
+        pool->head = job->next;
+        if (pool->head == NULL)
+        {
+            pool->tail = NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        seconds = run_job(job);
+
+        pthread_mutex_lock(&pool->lock);
+        job_done(pool, job, seconds);
+        pthread_cond_broadcast(&pool->done_cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+#endif
+
+int
+decrypt_pool_new(decrypt_pool_t *p_pool,
+                 uint32_t num_threads
+    )
+{
+    int err = 0;
+    decrypt_pool_t pool = NULL;
+
+    ASSURE( p_pool != NULL, ("Null pointer") );
+    ASSURE( num_threads <= DECRYPT_POOL_MAX_THREADS, ("At most %d decryption threads", DECRYPT_POOL_MAX_THREADS) );
+
+    pool = malloc(sizeof(*pool));
+    ASSURE( pool != NULL, ("Allocation failure") );
+    memset(pool, 0, sizeof(*pool));
+
+#ifdef DECRYPT_POOL_USE_THREADS
+    if (num_threads > 0)
+    {
+        ASSURE( pthread_mutex_init(&pool->lock, NULL) == 0, ("Failed to create mutex") );
+        if (pthread_cond_init(&pool->job_cond, NULL) != 0)
+        {
+            pthread_mutex_destroy(&pool->lock);
+            ASSURE( 0, ("Failed to create condition variable") );
+        }
+        if (pthread_cond_init(&pool->done_cond, NULL) != 0)
+        {
+            pthread_cond_destroy(&pool->job_cond);
+            pthread_mutex_destroy(&pool->lock);
+            ASSURE( 0, ("Failed to create condition variable") );
+        }
+        pool->have_lock = 1;
+
+        while (pool->num_threads < num_threads)
+        {
+            ASSURE( pthread_create(&pool->threads[pool->num_threads], NULL, worker_main, pool) == 0,
+                    ("Failed to create decryption thread") );
+            pool->num_threads++;
+        }
+    }
+#endif
+
+    *p_pool = pool;
+    pool = NULL;
+
+cleanup:
+    decrypt_pool_destroy(&pool);
+    return err;
+}
+
+void
+decrypt_pool_destroy(decrypt_pool_t *p_pool)
+{
+    decrypt_pool_t pool;
+
+    if (p_pool == NULL || *p_pool == NULL)
+    {
+        return;
+    }
+    pool = *p_pool;
+
+#ifdef DECRYPT_POOL_USE_THREADS
+    if (pool->have_lock)
+    {
+        uint32_t i;
+
+        decrypt_pool_wait_all(pool);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->stop = 1;
+        pthread_cond_broadcast(&pool->job_cond);
+        pthread_mutex_unlock(&pool->lock);
+        for (i = 0; i < pool->num_threads; i++)
+        {
+            pthread_join(pool->threads[i], NULL);
+        }
+        pthread_cond_destroy(&pool->done_cond);
+        pthread_cond_destroy(&pool->job_cond);
+        pthread_mutex_destroy(&pool->lock);
+    }
+#endif
+
+    free(pool);
+    *p_pool = NULL;
+}
+
+uint32_t
+decrypt_pool_get_num_threads(decrypt_pool_t pool)
+{
+#ifdef DECRYPT_POOL_USE_THREADS
+    return pool->num_threads;
+#else
+    (void) pool;
+    return 0;
+#endif
+}
+
+void
+decrypt_pool_submit(decrypt_pool_t pool,
+                    decrypt_job_t *job
+    )
+{
+    job->done = 0;
+    job->err = 0;
+    job->next = NULL;
+
+#ifdef DECRYPT_POOL_USE_THREADS
+    if (pool->num_threads > 0)
+    {
+        pthread_mutex_lock(&pool->lock);
+        if (pool->num_in_flight++ == 0)
+        {
+            pool->active_start = clock_seconds();
+        }
+        if (pool->tail != NULL)
+        {
+            pool->tail->next = job;
+        }
+        else
+        {
+            pool->head = job;
+        }
+        pool->tail = job;
+        pthread_cond_signal(&pool->job_cond);
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+#endif
+
+    pool->num_in_flight++;
+    pool->active_start = clock_seconds();
+    job_done(pool, job, run_job(job));
+}
+
+int
+decrypt_pool_wait(decrypt_pool_t pool,
+                  decrypt_job_t *job
+    )
+{
+#ifdef DECRYPT_POOL_USE_THREADS
+    if (pool->num_threads > 0)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while (!job->done)
+        {
+            pthread_cond_wait(&pool->done_cond, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+#else
+    (void) pool;
+#endif
+
+    return job->err;
+}
+
+void
+decrypt_pool_wait_all(decrypt_pool_t pool)
+{
+#ifdef DECRYPT_POOL_USE_THREADS
+    if (pool->num_threads > 0)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->num_in_flight > 0)
+        {
+            pthread_cond_wait(&pool->done_cond, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+#else
+    (void) pool;
+#endif
+}
+
+void
+decrypt_pool_get_stats(decrypt_pool_t pool,
+                       uint64_t *p_bytes,
+                       double *p_busy_seconds,
+                       double *p_active_seconds
+    )
+{
+#ifdef DECRYPT_POOL_USE_THREADS
+    if (pool->have_lock)
+    {
+        pthread_mutex_lock(&pool->lock);
+    }
+#endif
+    *p_bytes = pool->bytes;
+    *p_busy_seconds = pool->busy_seconds;
+    *p_active_seconds = pool->active_seconds;
+#ifdef DECRYPT_POOL_USE_THREADS
+    if (pool->have_lock)
+    {
+        pthread_mutex_unlock(&pool->lock);
+    }
+#endif
+}
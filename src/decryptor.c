@@ -0,0 +1,840 @@
+/************************************************************************************************************
+ * Copyright (c) 2017, Dolby Laboratories Inc.
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ *    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+ *    promote products derived from this software without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ ************************************************************************************************************/
+#include "decryptor.h"
+
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(DECRYPTOR_NO_AESNI) && \
+    ((defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))) || \
+     (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))))
+#define DECRYPTOR_AESNI
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AESNI_TARGET
+#else
+#include <cpuid.h>
+#define AESNI_TARGET __attribute__((target("aes,sse2")))
+#endif
+#endif
+
+#define AES_BLOCK 16
+#define AES_ROUNDS 10
+
+/* Blocks processed per call of the block functions */
+#define BATCH_BLOCKS 16
+
+/** Expanded AES-128 key */
+struct decryptor_key_t_
+{
+    uint32_t ek[4 * (AES_ROUNDS + 1)];                 /* encryption round keys */
+    unsigned char ek_bytes[AES_ROUNDS + 1][AES_BLOCK];
+    unsigned char dk_bytes[AES_ROUNDS + 1][AES_BLOCK]; /* AES-NI decryption round keys */
+
+    /* AES on whole blocks, AES-NI or portable */
+    void (*encrypt_blocks)(const struct decryptor_key_t_ *, const unsigned char *in, unsigned char *out, size_t num_blocks);
+    void (*decrypt_blocks)(const struct decryptor_key_t_ *, const unsigned char *in, unsigned char *out, size_t num_blocks);
+};
+
+struct decryptor_t_
+{
+    int is_cbc;                   /* boolean: 'cbcs', else AES-CTR */
+    uint8_t crypt_byte_block;     /* 0 (and skip_byte_block 0): all blocks encrypted */
+    uint8_t skip_byte_block;
+    unsigned char constant_iv[16];
+
+    const struct decryptor_key_t_ *key;
+    struct decryptor_key_t_ *own_key;  /* of decryptor_new(), NULL if the key is shared */
+};
+
+static const uint8_t k_sbox[256] =
+{
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+static const uint8_t k_inv_sbox[256] =
+{
+    0x52, 0x09, 0x6a, 0xd5, 0x30, 0x36, 0xa5, 0x38, 0xbf, 0x40, 0xa3, 0x9e, 0x81, 0xf3, 0xd7, 0xfb,
+    0x7c, 0xe3, 0x39, 0x82, 0x9b, 0x2f, 0xff, 0x87, 0x34, 0x8e, 0x43, 0x44, 0xc4, 0xde, 0xe9, 0xcb,
+    0x54, 0x7b, 0x94, 0x32, 0xa6, 0xc2, 0x23, 0x3d, 0xee, 0x4c, 0x95, 0x0b, 0x42, 0xfa, 0xc3, 0x4e,
+    0x08, 0x2e, 0xa1, 0x66, 0x28, 0xd9, 0x24, 0xb2, 0x76, 0x5b, 0xa2, 0x49, 0x6d, 0x8b, 0xd1, 0x25,
+    0x72, 0xf8, 0xf6, 0x64, 0x86, 0x68, 0x98, 0x16, 0xd4, 0xa4, 0x5c, 0xcc, 0x5d, 0x65, 0xb6, 0x92,
+    0x6c, 0x70, 0x48, 0x50, 0xfd, 0xed, 0xb9, 0xda, 0x5e, 0x15, 0x46, 0x57, 0xa7, 0x8d, 0x9d, 0x84,
+    0x90, 0xd8, 0xab, 0x00, 0x8c, 0xbc, 0xd3, 0x0a, 0xf7, 0xe4, 0x58, 0x05, 0xb8, 0xb3, 0x45, 0x06,
+    0xd0, 0x2c, 0x1e, 0x8f, 0xca, 0x3f, 0x0f, 0x02, 0xc1, 0xaf, 0xbd, 0x03, 0x01, 0x13, 0x8a, 0x6b,
+    0x3a, 0x91, 0x11, 0x41, 0x4f, 0x67, 0xdc, 0xea, 0x97, 0xf2, 0xcf, 0xce, 0xf0, 0xb4, 0xe6, 0x73,
+    0x96, 0xac, 0x74, 0x22, 0xe7, 0xad, 0x35, 0x85, 0xe2, 0xf9, 0x37, 0xe8, 0x1c, 0x75, 0xdf, 0x6e,
+    0x47, 0xf1, 0x1a, 0x71, 0x1d, 0x29, 0xc5, 0x89, 0x6f, 0xb7, 0x62, 0x0e, 0xaa, 0x18, 0xbe, 0x1b,
+    0xfc, 0x56, 0x3e, 0x4b, 0xc6, 0xd2, 0x79, 0x20, 0x9a, 0xdb, 0xc0, 0xfe, 0x78, 0xcd, 0x5a, 0xf4,
+    0x1f, 0xdd, 0xa8, 0x33, 0x88, 0x07, 0xc7, 0x31, 0xb1, 0x12, 0x10, 0x59, 0x27, 0x80, 0xec, 0x5f,
+    0x60, 0x51, 0x7f, 0xa9, 0x19, 0xb5, 0x4a, 0x0d, 0x2d, 0xe5, 0x7a, 0x9f, 0x93, 0xc9, 0x9c, 0xef,
+    0xa0, 0xe0, 0x3b, 0x4d, 0xae, 0x2a, 0xf5, 0xb0, 0xc8, 0xeb, 0xbb, 0x3c, 0x83, 0x53, 0x99, 0x61,
+    0x17, 0x2b, 0x04, 0x7e, 0xba, 0x77, 0xd6, 0x26, 0xe1, 0x69, 0x14, 0x63, 0x55, 0x21, 0x0c, 0x7d
+};
+
+/**************************************************
+    Portable AES-128, on 32-bit big endian columns
+**************************************************/
+
+#define ROTL8(w)  (((w) << 8) | ((w) >> 24))
+#define ROTL16(w) (((w) << 16) | ((w) >> 16))
+#define ROTL24(w) (((w) << 24) | ((w) >> 8))
+
+/* Multiplication by x of each byte of a word, in GF(2^8) */
+#define XTIME4(w) ((((w) & 0x7f7f7f7fu) << 1) ^ ((((w) >> 7) & 0x01010101u) * 0x1b))
+
+static uint32_t
+load_be32(const unsigned char *p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+static void
+store_be32(unsigned char *p, uint32_t v)
+{
+    p[0] = (unsigned char) (v >> 24);
+    p[1] = (unsigned char) (v >> 16);
+    p[2] = (unsigned char) (v >> 8);
+    p[3] = (unsigned char) v;
+}
+
+static uint32_t
+mix_column(uint32_t w)
+{
+    uint32_t r = ROTL8(w);
+
+    return XTIME4(w ^ r) ^ r ^ ROTL16(w) ^ ROTL24(w);
+}
+
+static uint32_t
+inv_mix_column(uint32_t w)
+{
+    uint32_t u = XTIME4(XTIME4(w ^ ROTL16(w)));
+
+    return mix_column(w ^ u);
+}
+
+/* SubBytes and ShiftRows: byte r of column c from column c + r */
+#define SUB_SHIFT(s, c) \
+    (((uint32_t) k_sbox[(s)[(c) & 3] >> 24] << 24) | \
+     ((uint32_t) k_sbox[((s)[((c) + 1) & 3] >> 16) & 0xff] << 16) | \
+     ((uint32_t) k_sbox[((s)[((c) + 2) & 3] >> 8) & 0xff] << 8) | \
+     (uint32_t) k_sbox[(s)[((c) + 3) & 3] & 0xff])
+
+/* InvShiftRows and InvSubBytes: byte r of column c from column c - r */
+#define INV_SHIFT_SUB(s, c) \
+    (((uint32_t) k_inv_sbox[(s)[(c) & 3] >> 24] << 24) | \
+     ((uint32_t) k_inv_sbox[((s)[((c) + 3) & 3] >> 16) & 0xff] << 16) | \
+     ((uint32_t) k_inv_sbox[((s)[((c) + 2) & 3] >> 8) & 0xff] << 8) | \
+     (uint32_t) k_inv_sbox[(s)[((c) + 1) & 3] & 0xff])
+
+static void
+expand_key(struct decryptor_key_t_ *d, const unsigned char key[16])
+{
+    static const uint8_t rcon[AES_ROUNDS] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36 };
+    uint32_t i;
+
+    for (i = 0; i < 4; i++)
+    {
+        d->ek[i] = load_be32(key + 4 * i);
+    }
+    for (i = 4; i < 4 * (AES_ROUNDS + 1); i++)
+    {
+        uint32_t t = d->ek[i - 1];
+
+        if (i % 4 == 0)
+        {
+            t = ROTL8(t);
+            t = ((uint32_t) k_sbox[t >> 24] << 24) | ((uint32_t) k_sbox[(t >> 16) & 0xff] << 16) |
+                ((uint32_t) k_sbox[(t >> 8) & 0xff] << 8) | (uint32_t) k_sbox[t & 0xff];
+            t ^= (uint32_t) rcon[i / 4 - 1] << 24;
+        }
+        d->ek[i] = d->ek[i - 4] ^ t;
+    }
+    for (i = 0; i < 4 * (AES_ROUNDS + 1); i++)
+    {
+        store_be32(&d->ek_bytes[i / 4][4 * (i % 4)], d->ek[i]);
+    }
+}
+
+static void
+encrypt_blocks_portable(const struct decryptor_key_t_ *d,
+                        const unsigned char *in,
+                        unsigned char *out,
+                        size_t num_blocks)
+{
+    for (; num_blocks > 0; num_blocks--, in += AES_BLOCK, out += AES_BLOCK)
+    {
+        uint32_t s[4], t[4];
+        uint32_t round, c;
+
+        for (c = 0; c < 4; c++)
+        {
+            s[c] = load_be32(in + 4 * c) ^ d->ek[c];
+        }
+        for (round = 1; round < AES_ROUNDS; round++)
+        {
+            for (c = 0; c < 4; c++)
+            {
+                t[c] = SUB_SHIFT(s, c);
+            }
+            for (c = 0; c < 4; c++)
+            {
+                s[c] = mix_column(t[c]) ^ d->ek[4 * round + c];
+            }
+        }
+        for (c = 0; c < 4; c++)
+        {
+            t[c] = SUB_SHIFT(s, c) ^ d->ek[4 * AES_ROUNDS + c];
+        }
+        for (c = 0; c < 4; c++)
+        {
+            store_be32(out + 4 * c, t[c]);
+        }
+    }
+}
+
+static void
+decrypt_blocks_portable(const struct decryptor_key_t_ *d,
+                        const unsigned char *in,
+                        unsigned char *out,
+                        size_t num_blocks)
+{
+    for (; num_blocks > 0; num_blocks--, in += AES_BLOCK, out += AES_BLOCK)
+    {
+        uint32_t s[4], t[4];
+        uint32_t round, c;
+
+        for (c = 0; c < 4; c++)
+        {
+            s[c] = load_be32(in + 4 * c) ^ d->ek[4 * AES_ROUNDS + c];
+        }
+        for (round = AES_ROUNDS - 1; round > 0; round--)
+        {
+            for (c = 0; c < 4; c++)
+            {
+                t[c] = INV_SHIFT_SUB(s, c);
+            }
+            for (c = 0; c < 4; c++)
+            {
+                s[c] = inv_mix_column(t[c] ^ d->ek[4 * round + c]);
+            }
+        }
+        for (c = 0; c < 4; c++)
+        {
+            t[c] = INV_SHIFT_SUB(s, c) ^ d->ek[c];
+        }
+        for (c = 0; c < 4; c++)
+        {
+            store_be32(out + 4 * c, t[c]);
+        }
+    }
+}
+
+/**************************************************
+    AES-NI
+**************************************************/
+#ifdef DECRYPTOR_AESNI
+
+static int
+have_aesni(void)
+{
+#ifdef _MSC_VER
+    int info[4];
+
+    __cpuid(info, 1);
+    return (info[2] >> 25) & 1;
+#else
+    unsigned int a, b, c, d;
+
+    if (!__get_cpuid(1, &a, &b, &c, &d))
+    {
+        return 0;
+    }
+    return (c >> 25) & 1;
+#endif
+}
+
+/* Decryption round keys of the equivalent inverse cipher */
+AESNI_TARGET static void
+expand_dec_key_aesni(struct decryptor_key_t_ *d)
+{
+    uint32_t i;
+
+    _mm_storeu_si128((__m128i *) d->dk_bytes[0], _mm_loadu_si128((const __m128i *) d->ek_bytes[AES_ROUNDS]));
+    for (i = 1; i < AES_ROUNDS; i++)
+    {
+        _mm_storeu_si128((__m128i *) d->dk_bytes[i],
+                         _mm_aesimc_si128(_mm_loadu_si128((const __m128i *) d->ek_bytes[AES_ROUNDS - i])));
+    }
+    _mm_storeu_si128((__m128i *) d->dk_bytes[AES_ROUNDS], _mm_loadu_si128((const __m128i *) d->ek_bytes[0]));
+}
+
+/* Four blocks at a time, to keep the AES unit busy */
+AESNI_TARGET static void
+encrypt_blocks_aesni(const struct decryptor_key_t_ *d,
+                     const unsigned char *in,
+                     unsigned char *out,
+                     size_t num_blocks)
+{
+    __m128i k[AES_ROUNDS + 1];
+    uint32_t r;
+
+    for (r = 0; r <= AES_ROUNDS; r++)
+    {
+        k[r] = _mm_loadu_si128((const __m128i *) d->ek_bytes[r]);
+    }
+    for (; num_blocks >= 4; num_blocks -= 4, in += 4 * AES_BLOCK, out += 4 * AES_BLOCK)
+    {
+        __m128i b0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) in), k[0]);
+        __m128i b1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (in + 16)), k[0]);
+        __m128i b2 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (in + 32)), k[0]);
+        __m128i b3 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (in + 48)), k[0]);
+
+        for (r = 1; r < AES_ROUNDS; r++)
+        {
+            b0 = _mm_aesenc_si128(b0, k[r]);
+            b1 = _mm_aesenc_si128(b1, k[r]);
+            b2 = _mm_aesenc_si128(b2, k[r]);
+            b3 = _mm_aesenc_si128(b3, k[r]);
+        }
+        _mm_storeu_si128((__m128i *) out, _mm_aesenclast_si128(b0, k[AES_ROUNDS]));
+        _mm_storeu_si128((__m128i *) (out + 16), _mm_aesenclast_si128(b1, k[AES_ROUNDS]));
+        _mm_storeu_si128((__m128i *) (out + 32), _mm_aesenclast_si128(b2, k[AES_ROUNDS]));
+        _mm_storeu_si128((__m128i *) (out + 48), _mm_aesenclast_si128(b3, k[AES_ROUNDS]));
+    }
+    for (; num_blocks > 0; num_blocks--, in += AES_BLOCK, out += AES_BLOCK)
+    {
+        __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *) in), k[0]);
+
+        for (r = 1; r < AES_ROUNDS; r++)
+        {
+            b = _mm_aesenc_si128(b, k[r]);
+        }
+        _mm_storeu_si128((__m128i *) out, _mm_aesenclast_si128(b, k[AES_ROUNDS]));
+    }
+}
+
+AESNI_TARGET static void
+decrypt_blocks_aesni(const struct decryptor_key_t_ *d,
+                     const unsigned char *in,
+                     unsigned char *out,
+                     size_t num_blocks)
+{
+    __m128i k[AES_ROUNDS + 1];
+    uint32_t r;
+
+    for (r = 0; r <= AES_ROUNDS; r++)
+    {
+        k[r] = _mm_loadu_si128((const __m128i *) d->dk_bytes[r]);
+    }
+    for (; num_blocks >= 4; num_blocks -= 4, in += 4 * AES_BLOCK, out += 4 * AES_BLOCK)
+    {
+        __m128i b0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) in), k[0]);
+        __m128i b1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (in + 16)), k[0]);
+        __m128i b2 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (in + 32)), k[0]);
+        __m128i b3 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (in + 48)), k[0]);
+
+        for (r = 1; r < AES_ROUNDS; r++)
+        {
+            b0 = _mm_aesdec_si128(b0, k[r]);
+            b1 = _mm_aesdec_si128(b1, k[r]);
+            b2 = _mm_aesdec_si128(b2, k[r]);
+            b3 = _mm_aesdec_si128(b3, k[r]);
+        }
+        _mm_storeu_si128((__m128i *) out, _mm_aesdeclast_si128(b0, k[AES_ROUNDS]));
+        _mm_storeu_si128((__m128i *) (out + 16), _mm_aesdeclast_si128(b1, k[AES_ROUNDS]));
+        _mm_storeu_si128((__m128i *) (out + 32), _mm_aesdeclast_si128(b2, k[AES_ROUNDS]));
+        _mm_storeu_si128((__m128i *) (out + 48), _mm_aesdeclast_si128(b3, k[AES_ROUNDS]));
+    }
+    for (; num_blocks > 0; num_blocks--, in += AES_BLOCK, out += AES_BLOCK)
+    {
+        __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *) in), k[0]);
+
+        for (r = 1; r < AES_ROUNDS; r++)
+        {
+            b = _mm_aesdec_si128(b, k[r]);
+        }
+        _mm_storeu_si128((__m128i *) out, _mm_aesdeclast_si128(b, k[AES_ROUNDS]));
+    }
+}
+
+#endif /* DECRYPTOR_AESNI */
+
+const char *
+decryptor_implementation(void)
+{
+#ifdef DECRYPTOR_AESNI
+    if (have_aesni())
+    {
+        return "AES-NI";
+    }
+#endif
+    return "portable";
+}
+
+/**************************************************
+    Modes
+**************************************************/
+
+/** AES-CTR state, continued over the protected ranges of a sample */
+typedef struct
+{
+    unsigned char counter[AES_BLOCK];   /* next counter block */
+    unsigned char keystream[BATCH_BLOCKS * AES_BLOCK];
+    size_t keystream_left;              /* unused bytes at the end of keystream */
+} ctr_state_t;
+
+/* The block counter is the lower 64 bits of the counter block */
+static void
+ctr_increment(unsigned char counter[AES_BLOCK])
+{
+    int i;
+
+    for (i = AES_BLOCK - 1; i >= 8; i--)
+    {
+        if (++counter[i] != 0)
+        {
+            break;
+        }
+    }
+}
+
+/* Keystream of the next num_blocks counter blocks, at the end of s->keystream */
+static void
+ctr_fill(const struct decryptor_t_ *d, ctr_state_t *s, size_t num_blocks)
+{
+    unsigned char *k = s->keystream + sizeof(s->keystream) - num_blocks * AES_BLOCK;
+    size_t i;
+
+    for (i = 0; i < num_blocks; i++)
+    {
+        memcpy(k + i * AES_BLOCK, s->counter, AES_BLOCK);
+        ctr_increment(s->counter);
+    }
+    d->key->encrypt_blocks(d->key, k, k, num_blocks);
+    s->keystream_left = num_blocks * AES_BLOCK;
+}
+
+static void
+ctr_decrypt(const struct decryptor_t_ *d, ctr_state_t *s, unsigned char *p, size_t size)
+{
+    while (size > 0)
+    {
+        size_t n, i;
+        const unsigned char *k;
+
+        if (s->keystream_left == 0)
+        {
+            size_t num_blocks = (size + AES_BLOCK - 1) / AES_BLOCK;
+
+            if (num_blocks > BATCH_BLOCKS)
+            {
+                num_blocks = BATCH_BLOCKS;
+            }
+            ctr_fill(d, s, num_blocks);
+        }
+
+        n = size < s->keystream_left ? size : s->keystream_left;
+        k = s->keystream + sizeof(s->keystream) - s->keystream_left;
+        for (i = 0; i < n; i++)
+        {
+            p[i] ^= k[i];
+        }
+        p += n;
+        size -= n;
+        s->keystream_left -= n;
+    }
+}
+
+/** AES-CBC decryption of whole blocks, chained from iv, which is updated
+    to the last ciphertext block */
+static void
+cbc_decrypt(const struct decryptor_t_ *d, unsigned char iv[AES_BLOCK], unsigned char *p, size_t num_blocks)
+{
+    unsigned char plain[BATCH_BLOCKS * AES_BLOCK];
+
+    while (num_blocks > 0)
+    {
+        size_t n = num_blocks < BATCH_BLOCKS ? num_blocks : BATCH_BLOCKS;
+        size_t i;
+
+        d->key->decrypt_blocks(d->key, p, plain, n);
+        for (i = 0; i < AES_BLOCK; i++)
+        {
+            plain[i] ^= iv[i];
+        }
+        for (i = AES_BLOCK; i < n * AES_BLOCK; i++)
+        {
+            plain[i] ^= p[i - AES_BLOCK];
+        }
+        memcpy(iv, p + (n - 1) * AES_BLOCK, AES_BLOCK);
+        memcpy(p, plain, n * AES_BLOCK);
+
+        p += n * AES_BLOCK;
+        num_blocks -= n;
+    }
+}
+
+/** 'cbcs': the pattern restarts, and the chain starts from the IV, in each protected range */
+static void
+cbcs_decrypt(const struct decryptor_t_ *d, const unsigned char iv[AES_BLOCK], unsigned char *p, size_t size)
+{
+    unsigned char chain[AES_BLOCK];
+    size_t num_blocks = size / AES_BLOCK;  /* a partial block at the end is clear */
+
+    memcpy(chain, iv, AES_BLOCK);
+    if (d->crypt_byte_block == 0)
+    {
+        cbc_decrypt(d, chain, p, num_blocks);
+        return;
+    }
+    while (num_blocks > 0)
+    {
+        size_t n = num_blocks < d->crypt_byte_block ? num_blocks : d->crypt_byte_block;
+
+        cbc_decrypt(d, chain, p, n);
+        p += n * AES_BLOCK;
+        num_blocks -= n;
+
+        n = num_blocks < d->skip_byte_block ? num_blocks : d->skip_byte_block;
+        p += n * AES_BLOCK;
+        num_blocks -= n;
+    }
+}
+
+/**************************************************
+    API
+**************************************************/
+
+void
+sample_crypt_init(sample_crypt_t *p_crypt)
+{
+    memset(p_crypt, 0, sizeof(*p_crypt));
+}
+
+void
+sample_crypt_free(sample_crypt_t *p_crypt)
+{
+    free(p_crypt->clear_bytes);
+    free(p_crypt->protected_bytes);
+    sample_crypt_init(p_crypt);
+}
+
+/* Grow the subsample map to at least num_subsamples entries */
+static int
+sample_crypt_reserve(sample_crypt_t *p_crypt,
+                     uint32_t num_subsamples
+    )
+{
+    int err = 0;
+
+    if (p_crypt->max_subsamples < num_subsamples)
+    {
+        uint32_t *clear = realloc(p_crypt->clear_bytes, num_subsamples * sizeof(*clear));
+        uint32_t *protected_bytes;
+
+        ASSURE( clear != NULL, ("Allocation failure") );
+        p_crypt->clear_bytes = clear;
+        protected_bytes = realloc(p_crypt->protected_bytes, num_subsamples * sizeof(*protected_bytes));
+        ASSURE( protected_bytes != NULL, ("Allocation failure") );
+        p_crypt->protected_bytes = protected_bytes;
+        p_crypt->max_subsamples = num_subsamples;
+    }
+
+cleanup:
+    return err;
+}
+
+int
+sample_crypt_set(sample_crypt_t *p_crypt,
+                 const unsigned char *p_iv,
+                 uint8_t iv_size,
+                 const unsigned char *p_entries,
+                 uint32_t num_subsamples
+    )
+{
+    int err = 0;
+    uint32_t i;
+
+    ASSURE( iv_size == 0 || iv_size == 8 || iv_size == 16, ("Illegal IV size %u", (unsigned int) iv_size) );
+    ASSURE( p_entries != NULL || num_subsamples == 0, ("Null pointer") );
+
+    memset(p_crypt->iv, 0, sizeof(p_crypt->iv));
+    memcpy(p_crypt->iv, p_iv, iv_size);
+    p_crypt->iv_size = iv_size;
+
+    CHECK( sample_crypt_reserve(p_crypt, num_subsamples) );
+    for (i = 0; i < num_subsamples; i++, p_entries += 6)
+    {
+        p_crypt->clear_bytes[i] = ((uint32_t) p_entries[0] << 8) | p_entries[1];
+        p_crypt->protected_bytes[i] = load_be32(p_entries + 2);
+    }
+    p_crypt->num_subsamples = num_subsamples;
+
+cleanup:
+    return err;
+}
+
+int
+sample_crypt_set_map(sample_crypt_t *p_crypt,
+                     const unsigned char *p_iv,
+                     uint8_t iv_size,
+                     const mp4d_subsample_map_t *p_map
+    )
+{
+    int err = 0;
+
+    ASSURE( p_map != NULL, ("Null pointer") );
+    CHECK( sample_crypt_set(p_crypt, p_iv, iv_size, NULL, 0) );
+    CHECK( sample_crypt_reserve(p_crypt, p_map->num_crypt_entries) );
+    memcpy(p_crypt->clear_bytes, p_map->clear_bytes, p_map->num_crypt_entries * sizeof(*p_crypt->clear_bytes));
+    memcpy(p_crypt->protected_bytes, p_map->protected_bytes, p_map->num_crypt_entries * sizeof(*p_crypt->protected_bytes));
+    p_crypt->num_subsamples = p_map->num_crypt_entries;
+
+cleanup:
+    return err;
+}
+
+int
+sample_crypt_parse_aux(sample_crypt_t *p_crypt,
+                       const unsigned char *p_aux,
+                       size_t size,
+                       uint8_t iv_size
+    )
+{
+    int err = 0;
+    uint32_t num_subsamples = 0;
+
+    ASSURE( size >= iv_size, ("Sample aux info (%" PRIz " bytes) shorter than the IV", size) );
+    if (size > iv_size)
+    {
+        ASSURE( size >= (size_t) iv_size + 2, ("Truncated subsample count in sample aux info") );
+        num_subsamples = ((uint32_t) p_aux[iv_size] << 8) | p_aux[iv_size + 1];
+        ASSURE( size >= (size_t) iv_size + 2 + 6 * num_subsamples,
+                ("Sample aux info (%" PRIz " bytes) too short for %" PRIu32 " subsamples", size, num_subsamples) );
+    }
+    CHECK( sample_crypt_set(p_crypt, p_aux, iv_size, p_aux + iv_size + 2, num_subsamples) );
+
+cleanup:
+    return err;
+}
+
+int
+decryptor_key_new(decryptor_key_t *p_key,
+                  const unsigned char key[16]
+    )
+{
+    int err = 0;
+    decryptor_key_t k = NULL;
+
+    ASSURE( p_key != NULL && key != NULL, ("Null pointer") );
+
+    k = malloc(sizeof(*k));
+    ASSURE( k != NULL, ("Allocation failure") );
+
+    expand_key(k, key);
+    k->encrypt_blocks = encrypt_blocks_portable;
+    k->decrypt_blocks = decrypt_blocks_portable;
+#ifdef DECRYPTOR_AESNI
+    if (have_aesni())
+    {
+        expand_dec_key_aesni(k);
+        k->encrypt_blocks = encrypt_blocks_aesni;
+        k->decrypt_blocks = decrypt_blocks_aesni;
+    }
+#endif
+
+    *p_key = k;
+    k = NULL;
+
+cleanup:
+    free(k);
+    return err;
+}
+
+void
+decryptor_key_destroy(decryptor_key_t *p_key)
+{
+    if (p_key != NULL)
+    {
+        free(*p_key);
+        *p_key = NULL;
+    }
+}
+
+int
+decryptor_new_with_key(decryptor_t *p_d,
+                       const mp4d_crypt_info_t *p_info,
+                       decryptor_key_t key
+    )
+{
+    int err = 0;
+    decryptor_t d = NULL;
+
+    ASSURE( p_d != NULL && p_info != NULL && key != NULL, ("Null pointer") );
+
+    d = malloc(sizeof(*d));
+    ASSURE( d != NULL, ("Allocation failure") );
+    memset(d, 0, sizeof(*d));
+
+    if (MP4D_FOURCC_EQ(p_info->scheme_type, "cbcs"))
+    {
+        d->is_cbc = 1;
+        d->crypt_byte_block = p_info->crypt_byte_block;
+        d->skip_byte_block = p_info->skip_byte_block;
+        ASSURE( d->crypt_byte_block > 0 || d->skip_byte_block == 0,
+                ("Illegal 'cbcs' pattern %u:%u", (unsigned int) d->crypt_byte_block, (unsigned int) d->skip_byte_block) );
+    }
+    else if (MP4D_FOURCC_EQ(p_info->scheme_type, "cenc"))
+    {
+        d->is_cbc = 0;
+    }
+    else if (MP4D_FOURCC_EQ(p_info->scheme_type, "piff"))
+    {
+        ASSURE( p_info->method == 1, ("Unsupported PIFF AlgorithmID %" PRIu32 ", only AES-CTR (1) is supported", p_info->method) );
+        d->is_cbc = 0;
+    }
+    else
+    {
+        ASSURE( 0, ("Unsupported protection scheme '%c%c%c%c'",
+                    p_info->scheme_type[0], p_info->scheme_type[1], p_info->scheme_type[2], p_info->scheme_type[3]) );
+    }
+    memcpy(d->constant_iv, p_info->constant_iv, p_info->constant_iv_size <= 16 ? p_info->constant_iv_size : 16);
+    d->key = key;
+
+    *p_d = d;
+    d = NULL;
+
+cleanup:
+    free(d);
+    return err;
+}
+
+int
+decryptor_new(decryptor_t *p_d,
+              const mp4d_crypt_info_t *p_info,
+              const unsigned char key[16]
+    )
+{
+    int err = 0;
+    decryptor_key_t k = NULL;
+
+    ASSURE( p_d != NULL && key != NULL, ("Null pointer") );
+
+    CHECK( decryptor_key_new(&k, key) );
+    CHECK( decryptor_new_with_key(p_d, p_info, k) );
+    (*p_d)->own_key = k;
+    k = NULL;
+
+cleanup:
+    decryptor_key_destroy(&k);
+    return err;
+}
+
+void
+decryptor_destroy(decryptor_t *p_d)
+{
+    if (p_d != NULL && *p_d != NULL)
+    {
+        free((*p_d)->own_key);
+        free(*p_d);
+        *p_d = NULL;
+    }
+}
+
+int
+decryptor_decrypt(decryptor_t d,
+                  const sample_crypt_t *p_crypt,
+                  unsigned char *p_data,
+                  uint32_t size
+    )
+{
+    int err = 0;
+    const unsigned char *iv;
+    uint64_t pos = 0;
+    uint32_t i;
+    ctr_state_t ctr;
+
+    ASSURE( d != NULL && p_crypt != NULL && (p_data != NULL || size == 0), ("Null pointer") );
+
+    iv = p_crypt->iv_size > 0 ? p_crypt->iv : d->constant_iv;
+
+    if (!d->is_cbc)
+    {
+        memcpy(ctr.counter, iv, AES_BLOCK);  /* an 8 byte IV is followed by zeros */
+        ctr.keystream_left = 0;
+    }
+
+    if (p_crypt->num_subsamples == 0)
+    {
+        if (d->is_cbc)
+        {
+            cbcs_decrypt(d, iv, p_data, size);
+        }
+        else
+        {
+            ctr_decrypt(d, &ctr, p_data, size);
+        }
+    }
+
+    for (i = 0; i < p_crypt->num_subsamples; i++)
+    {
+        pos += p_crypt->clear_bytes[i];
+        ASSURE( pos + p_crypt->protected_bytes[i] <= size,
+                ("Subsamples (%" PRIu64 " bytes) exceed the sample size (%" PRIu32 ")",
+                 pos + p_crypt->protected_bytes[i], size) );
+        if (d->is_cbc)
+        {
+            cbcs_decrypt(d, iv, p_data + pos, p_crypt->protected_bytes[i]);
+        }
+        else
+        {
+            ctr_decrypt(d, &ctr, p_data + pos, p_crypt->protected_bytes[i]);
+        }
+        pos += p_crypt->protected_bytes[i];
+    }
+
+cleanup:
+    return err;
+}
@@ -797,6 +797,145 @@ cleanup:
 }
 
 
+/* Key frame writer: each sample is written to its own file '<prefix>_<n>.<extension>'.
+ * The NAL units are written by the writer of the codec, which adds the parameter sets
+ * to every file, so that each file can be decoded on its own.
+ */
+typedef int (*keyframe_write_t)(es_sink_t codec_sink,
+                                FILE *out_file,
+                                const mp4d_sampleref_t *sample,
+                                const unsigned char *payload);
+
+typedef struct keyframe_writer_t_
+{
+    struct es_sink_t_ base;
+
+    es_sink_t codec_sink;                /* owned */
+    keyframe_write_t write_access_unit;  /* writes one sample of codec_sink to a file */
+    uint32_t track_ID;  /* For messaging */
+
+    const char *extension;
+    char prefix[255];
+    uint32_t num_keyframes;
+} *keyframe_writer_t;
+
+static void
+keyframe_writer_destroy(es_sink_t p_es_sink)
+{
+    keyframe_writer_t p_keyframe_writer = (keyframe_writer_t) p_es_sink;
+
+    if (p_keyframe_writer->codec_sink != NULL)
+    {
+        p_keyframe_writer->codec_sink->destroy(p_keyframe_writer->codec_sink);
+    }
+    free(p_es_sink);
+}
+
+static int
+keyframe_writer_sample_entry(es_sink_t p_es_sink,
+                             const mp4d_sampleentry_t *sample_entry)
+{
+    keyframe_writer_t p_keyframe_writer = (keyframe_writer_t) p_es_sink;
+
+    return p_keyframe_writer->codec_sink->sample_entry(p_keyframe_writer->codec_sink, sample_entry);
+}
+
+static int
+keyframe_writer_sample_ready(es_sink_t p_es_sink,
+                             const mp4d_sampleref_t *sample,
+                             const unsigned char *payload)
+{
+    keyframe_writer_t p_keyframe_writer = (keyframe_writer_t) p_es_sink;
+    char filename[255 + 16];
+    FILE *out_file = NULL;
+    int err = 0;
+
+    p_keyframe_writer->num_keyframes++;
+    ASSURE( snprintf(filename, sizeof filename, "%s_%05" PRIu32 ".%s",
+                     p_keyframe_writer->prefix, p_keyframe_writer->num_keyframes,
+                     p_keyframe_writer->extension) < (int) sizeof filename,
+            (" "));
+    out_file = fopen(filename, "wb");
+    ASSURE( out_file != NULL, ("Could not open '%s' for writing", filename) );
+    logout(LOG_VERBOSE_LVL_INFO,"Writing track_ID = %" PRIu32 " sample with pts = %" PRId64 " to %s\n",
+           p_keyframe_writer->track_ID, sample->pts, filename);
+
+    CHECK( p_keyframe_writer->write_access_unit(p_keyframe_writer->codec_sink, out_file, sample, payload) );
+
+cleanup:
+    if (out_file != NULL)
+    {
+        fclose(out_file);
+    }
+    return err;
+}
+
+/** @brief Create a key frame writer on top of the writer of a codec
+ *
+ *  Takes ownership of codec_sink, also on failure.
+ */
+static int
+keyframe_writer_new(es_sink_t *p_es_sink,
+                    es_sink_t codec_sink,
+                    keyframe_write_t write_access_unit,
+                    const char *extension,
+                    uint32_t track_ID,
+                    const char *stream_name,
+                    const char *output_folder)
+{
+    keyframe_writer_t p_keyframe_writer;
+    int err = 0;
+
+    *p_es_sink = malloc(sizeof(struct keyframe_writer_t_));
+    if (*p_es_sink == NULL)
+    {
+        codec_sink->destroy(codec_sink);
+    }
+    ASSURE( *p_es_sink != NULL, ("Allocation failure") );
+    (*p_es_sink)->sample_ready = keyframe_writer_sample_ready;
+    (*p_es_sink)->subsample_ready = NULL;
+    (*p_es_sink)->sample_entry = keyframe_writer_sample_entry;
+    (*p_es_sink)->destroy = keyframe_writer_destroy;
+
+    p_keyframe_writer = (keyframe_writer_t) *p_es_sink;
+
+    p_keyframe_writer->codec_sink = codec_sink;
+    p_keyframe_writer->write_access_unit = write_access_unit;
+    p_keyframe_writer->track_ID = track_ID;
+    p_keyframe_writer->extension = extension;
+    p_keyframe_writer->num_keyframes = 0;
+    {
+        char *filename = p_keyframe_writer->prefix;
+        int n = sizeof p_keyframe_writer->prefix;
+        int folder_len = 0;
+
+        filename[0] = '\0';
+        if (NULL != output_folder)
+        {
+            snprintf(filename, n, "%s", output_folder);
+            folder_len = (int)strlen(output_folder);
+            n -=  folder_len;
+        }
+
+        if (track_ID > 0)
+        {
+            ASSURE( snprintf(filename + folder_len, n, "out_%" PRIu32, track_ID) < n,
+                    (" "));
+        }
+        else
+        {
+            ASSURE( snprintf(filename + folder_len, n, "%s", stream_name) < n,
+                    (" "));
+        }
+        logout(LOG_VERBOSE_LVL_INFO,"Writing key frames of track_ID = %" PRIu32 " to %s_*.%s\n",
+               track_ID, filename, extension);
+    }
+
+cleanup:
+    return err;
+}
+
+
 typedef struct h264_parameter_set_t_
 {
     unsigned char * buf;
@@ -1096,22 +1235,39 @@ cleanup:
     return err;
 }
 
-int h264_writer_new(es_sink_t *p_es_sink, uint32_t track_ID, const char *stream_name, const char *output_folder)
+/* Allocates a writer without output file */
+static int
+h264_writer_alloc(es_sink_t *p_es_sink, uint32_t track_ID)
 {
     h264_writer_t p_h264_writer;
     int err = 0;
 
     *p_es_sink = malloc(sizeof(struct h264_writer_t_));
+    ASSURE( *p_es_sink != NULL, ("Allocation failure") );
     (*p_es_sink)->sample_ready = h264_writer_sample_ready;
     (*p_es_sink)->subsample_ready = NULL;
     (*p_es_sink)->sample_entry = h264_writer_sample_entry;
     (*p_es_sink)->destroy = h264_writer_destroy;
-    
 
-    p_h264_writer = (h264_writer_t) *p_es_sink; 
+    p_h264_writer = (h264_writer_t) *p_es_sink;
 
+    p_h264_writer->out_file = NULL;
     p_h264_writer->track_ID = track_ID;
     p_h264_writer->wrote_sps_pps = 0;
+    p_h264_writer->sample_entries = NULL;
+    p_h264_writer->num_sample_entries = 0;
+
+cleanup:
+    return err;
+}
+
+int h264_writer_new(es_sink_t *p_es_sink, uint32_t track_ID, const char *stream_name, const char *output_folder)
+{
+    h264_writer_t p_h264_writer;
+    int err = 0;
+
+    CHECK( h264_writer_alloc(p_es_sink, track_ID) );
+    p_h264_writer = (h264_writer_t) *p_es_sink;
     {
         char filename[255];
         int n = sizeof filename;
@@ -1139,13 +1295,40 @@ int h264_writer_new(es_sink_t *p_es_sink, uint32_t track_ID, const char *stream_
         logout(LOG_VERBOSE_LVL_INFO,"Writing track_ID = %" PRIu32 " to %s\n", track_ID, filename);
     }
 
-    p_h264_writer->sample_entries = NULL;
-    p_h264_writer->num_sample_entries = 0;
-
 cleanup:
     return err;
 }
 
+/* Writes all NAL units of a sample, preceded by the SPS/PPS, to out_file */
+static int
+h264_write_access_unit(es_sink_t p_es_sink,
+                       FILE *out_file,
+                       const mp4d_sampleref_t *sample,
+                       const unsigned char *payload)
+{
+    h264_writer_t p_h264_writer = (h264_writer_t) p_es_sink;
+    int err;
+
+    p_h264_writer->out_file = out_file;
+    p_h264_writer->wrote_sps_pps = 0;
+    err = h264_writer_sample_ready(p_es_sink, sample, payload);
+    p_h264_writer->out_file = NULL;
+
+    return err;
+}
+
+int h264_keyframe_writer_new(es_sink_t *p_es_sink, uint32_t track_ID, const char *stream_name, const char *output_folder)
+{
+    es_sink_t h264_sink;
+    int err = 0;
+
+    CHECK( h264_writer_alloc(&h264_sink, track_ID) );
+    CHECK( keyframe_writer_new(p_es_sink, h264_sink, h264_write_access_unit, "h264",
+                               track_ID, stream_name, output_folder) );
+
+cleanup:
+    return err;
+}
 
 
 typedef struct hevc_parameter_set_t_
@@ -1499,23 +1682,40 @@ cleanup:
     return err;
 }
 
-int 
-hevc_writer_new(es_sink_t *p_es_sink, uint32_t track_ID, const char *stream_name, const char *output_folder, uint32_t stdout_flag)
+/* Allocates a writer without output file */
+static int
+hevc_writer_alloc(es_sink_t *p_es_sink, uint32_t track_ID)
 {
     hevc_writer_t p_hevc_writer;
     int err = 0;
 
     *p_es_sink = malloc(sizeof(struct hevc_writer_t_));
+    ASSURE( *p_es_sink != NULL, ("Allocation failure") );
     (*p_es_sink)->sample_ready = hevc_writer_sample_ready;
     (*p_es_sink)->subsample_ready = NULL;
     (*p_es_sink)->sample_entry = hevc_writer_sample_entry;
     (*p_es_sink)->destroy = hevc_writer_destroy;
-    
 
-    p_hevc_writer = (hevc_writer_t) *p_es_sink; 
+    p_hevc_writer = (hevc_writer_t) *p_es_sink;
 
+    p_hevc_writer->out_file = NULL;
     p_hevc_writer->track_ID = track_ID;
     p_hevc_writer->wrote_vps_sps_pps = 0;
+    p_hevc_writer->sample_entries = NULL;
+    p_hevc_writer->num_sample_entries = 0;
+
+cleanup:
+    return err;
+}
+
+int 
+hevc_writer_new(es_sink_t *p_es_sink, uint32_t track_ID, const char *stream_name, const char *output_folder, uint32_t stdout_flag)
+{
+    hevc_writer_t p_hevc_writer;
+    int err = 0;
+
+    CHECK( hevc_writer_alloc(p_es_sink, track_ID) );
+    p_hevc_writer = (hevc_writer_t) *p_es_sink;
     if (!stdout_flag)
     {
         char filename[255];
@@ -1557,8 +1757,37 @@ hevc_writer_new(es_sink_t *p_es_sink, uint32_t track_ID, const char *stream_name
         p_hevc_writer->out_file = stdout;
     }
 
-    p_hevc_writer->sample_entries = NULL;
-    p_hevc_writer->num_sample_entries = 0;
+cleanup:
+    return err;
+}
+
+/* Writes all NAL units of a sample, preceded by the VPS/SPS/PPS, to out_file */
+static int
+hevc_write_access_unit(es_sink_t p_es_sink,
+                       FILE *out_file,
+                       const mp4d_sampleref_t *sample,
+                       const unsigned char *payload)
+{
+    hevc_writer_t p_hevc_writer = (hevc_writer_t) p_es_sink;
+    int err;
+
+    p_hevc_writer->out_file = out_file;
+    p_hevc_writer->wrote_vps_sps_pps = 0;
+    err = hevc_writer_sample_ready(p_es_sink, sample, payload);
+    p_hevc_writer->out_file = NULL;
+
+    return err;
+}
+
+int
+hevc_keyframe_writer_new(es_sink_t *p_es_sink, uint32_t track_ID, const char *stream_name, const char *output_folder)
+{
+    es_sink_t hevc_sink;
+    int err = 0;
+
+    CHECK( hevc_writer_alloc(&hevc_sink, track_ID) );
+    CHECK( keyframe_writer_new(p_es_sink, hevc_sink, hevc_write_access_unit, "h265",
+                               track_ID, stream_name, output_folder) );
 
 cleanup:
     return err;
@@ -25,10 +25,13 @@
 #include "movie.h"
 
 #include "file_stream.h"
+#include "chunk_stream.h"
+#include "pipe_stream.h"
 #include "util.h"
 
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 typedef struct
 {
@@ -36,6 +39,10 @@ typedef struct
 
     char *path;     /* Of mp4 file */
     fragment_reader_t file_source;
+    int chunked;    /* Provide chunk_stream instead of file_stream fragment streams */
+    pipe_source_t pipe;  /* Non-NULL if the input cannot seek (stdin or FIFO) */
+    uint32_t follow_ms;  /* If non-zero, fragment streams follow the growing file for this long,
+                            see file_stream_follow() */
 
 } *file_movie_t;
 
@@ -51,7 +58,19 @@ init_file_source(file_movie_t p_fi)
         return 0;
     }
 
-    CHECK( file_stream_new(&p_fi->file_source, p_fi->path) );
+    if (p_fi->pipe != NULL)
+    {
+        CHECK( pipe_stream_new(&p_fi->file_source, p_fi->pipe, 1) );
+    }
+    else
+    {
+        CHECK( file_stream_new(&p_fi->file_source, p_fi->path) );
+        if (p_fi->follow_ms > 0)
+        {
+            /* The moov may not have been written yet */
+            CHECK( file_stream_follow(p_fi->file_source, p_fi->follow_ms) );
+        }
+    }
     do
     {
         int err_next = fragment_reader_next_atom(p_fi->file_source);
@@ -75,6 +94,7 @@ void file_movie_destroy(movie_t p_movie)
         {
             fragment_reader_destroy(p_fi->file_source);
         }
+        pipe_source_release(p_fi->pipe);
         free(p_fi->path);
         free(p_fi);
     }
@@ -172,15 +192,58 @@ file_movie_fragment_stream_new(movie_t p_movie,
     (void) bitrate;
     (void) stream_num;
     (void) stream_name;
-    CHECK( file_stream_new(p_source, p_fi->path) );
+    if (p_fi->pipe != NULL)
+    {
+        CHECK( pipe_stream_new(p_source, p_fi->pipe, 0) );
+    }
+    else if (p_fi->chunked)
+    {
+        CHECK( chunk_stream_new(p_source, p_fi->path) );
+        if (p_fi->follow_ms > 0)
+        {
+            CHECK( chunk_stream_follow(*p_source, p_fi->follow_ms) );
+        }
+    }
+    else
+    {
+        CHECK( file_stream_new(p_source, p_fi->path) );
+        if (p_fi->follow_ms > 0)
+        {
+            CHECK( file_stream_follow(*p_source, p_fi->follow_ms) );
+        }
+    }
 
 cleanup:
     return err;
 }
 
-int movie_new(const char *path,   /**< path to MP4 file */
-                           movie_t *p_movie        /**< [out] */
-                           )
+/* Input which can only be read once, from start to end */
+static int
+is_pipe(const char *path)
+{
+    if (strcmp(path, "-") == 0)
+    {
+        return 1;
+    }
+#ifndef _MSC_VER
+    {
+        struct stat st;
+
+        if (stat(path, &st) == 0 && S_ISFIFO(st.st_mode))
+        {
+            return 1;
+        }
+    }
+#endif
+    return 0;
+}
+
+static int
+file_movie_new(const char *path,
+               int chunked,
+               uint32_t follow_ms,
+               movie_t *p_movie
+               )
 {
     int err = 0;
     file_movie_t p_fi = malloc(sizeof(*p_fi));
@@ -188,6 +251,10 @@ int movie_new(const char *path,   /**< path to MP4 file */
     ASSURE( p_fi != NULL, ("malloc failure") );
 
     p_fi->file_source = NULL;
+    p_fi->chunked = chunked;
+    p_fi->follow_ms = follow_ms;
+    p_fi->pipe = NULL;
+    p_fi->path = NULL;
 
     p_fi->base.destroy = file_movie_destroy;
     p_fi->base.get_movie_info = file_movie_get_movie_info;
@@ -200,18 +267,55 @@ int movie_new(const char *path,   /**< path to MP4 file */
     ASSURE( p_fi->path != NULL, ("malloc failure") );
     strcpy(p_fi->path, path);
 
+    if (is_pipe(path))
+    {
+        CHECK( pipe_source_new(&p_fi->pipe, path) );
+        if (chunked)
+        {
+            CHECK( pipe_source_set_chunked(p_fi->pipe) );
+        }
+    }
+
     *p_movie = &p_fi->base;
 cleanup:
     if (err)
     {
         *p_movie = NULL;
-        free(p_fi);
+        if (p_fi != NULL)
+        {
+            pipe_source_release(p_fi->pipe);
+            free(p_fi->path);
+            free(p_fi);
+        }
     }
     return err;
 }
 
+int movie_new(const char *path,   /**< path to MP4 file */
+                           movie_t *p_movie        /**< [out] */
+                           )
+{
+    return file_movie_new(path, 0, 0, p_movie);
+}
+
+int chunked_movie_new(const char *path,
+                      uint32_t timeout_ms,
+                      movie_t *p_movie
+                      )
+{
+    return file_movie_new(path, 1, timeout_ms, p_movie);
+}
+
+int following_movie_new(const char *path,
+                        uint32_t timeout_ms,
+                        movie_t *p_movie
+                        )
+{
+    return file_movie_new(path, 0, timeout_ms, p_movie);
+}
+
 void movie_destroy(movie_t p_movie){
-    if (p_movie != NULL){
+    if (p_movie != NULL){
         p_movie->destroy(p_movie);
     }
 }
\ No newline at end of file
@@ -28,11 +28,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #ifdef _MSC_VER0
 #include <Windows.h>
 #endif
 
+#ifdef _MSC_VER
+#include <windows.h>
+#else
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
 static
 int file_seek(FILE *stream,
               uint64_t offset   /* offset relative to beginning of file (i.e. SEEK_SET is implied) */
@@ -64,10 +77,150 @@ typedef struct file_stream_
     mp4d_ftyp_info_t ftyp;
     unsigned char *compat_brands;
 
+    int follow;                 /* Wait for the file to grow at EOF */
+    file_follower_t follower;
+
 } *file_stream_t;
 
 static const size_t SOURCE_BUFFER_SIZE = 2*1024*200;
 static const size_t SOURCE_BUFFER_GRANULARITY = 1024;
+static const uint32_t FOLLOW_POLL_INTERVAL_MS = 20;
+
+static int
+file_size(int fd, uint64_t *p_size)
+{
+#ifdef _MSC_VER
+    struct _stati64 st;
+
+    if (_fstati64(fd, &st) != 0)
+    {
+        return 1;
+    }
+#else
+    struct stat st;
+
+    if (fstat(fd, &st) != 0)
+    {
+        return 1;
+    }
+#endif
+    *p_size = (uint64_t) st.st_size;
+    return 0;
+}
+
+static uint64_t
+time_ms(void)
+{
+#ifdef _MSC_VER
+    return GetTickCount64();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+#endif
+}
+
+void
+file_follower_init(file_follower_t *p_follower,
+                   const char *path,
+                   uint32_t timeout_ms)
+{
+    p_follower->timeout_ms = timeout_ms;
+    p_follower->inotify_fd = -1;
+#ifdef __linux__
+    p_follower->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (p_follower->inotify_fd >= 0 &&
+        inotify_add_watch(p_follower->inotify_fd, path, IN_MODIFY) < 0)
+    {
+        /* Fall back to polling */
+        close(p_follower->inotify_fd);
+        p_follower->inotify_fd = -1;
+    }
+#else
+    (void) path;
+#endif
+}
+
+void
+file_follower_deinit(file_follower_t *p_follower)
+{
+#ifdef __linux__
+    if (p_follower->inotify_fd >= 0)
+    {
+        close(p_follower->inotify_fd);
+    }
+#endif
+    p_follower->inotify_fd = -1;
+}
+
+int
+file_follower_wait(file_follower_t *p_follower,
+                   int fd,
+                   uint64_t min_size)
+{
+    int err = 0;
+    uint64_t size;
+    uint64_t start = time_ms();
+
+    CHECK( file_size(fd, &size) );
+    while (size < min_size)
+    {
+        uint64_t elapsed = time_ms() - start;
+        uint32_t wait_ms = FOLLOW_POLL_INTERVAL_MS;
+
+        if (elapsed >= p_follower->timeout_ms)
+        {
+            return 2;
+        }
+        if (p_follower->timeout_ms - elapsed < wait_ms)
+        {
+            wait_ms = (uint32_t) (p_follower->timeout_ms - elapsed);
+        }
+
+#ifdef _MSC_VER
+        Sleep(wait_ms);
+#else
+        if (p_follower->inotify_fd >= 0)
+        {
+            struct pollfd pfd;
+
+            /* The poll interval still applies, in case the file was written before the
+               watch was added, or through a mount which does not report events */
+            pfd.fd = p_follower->inotify_fd;
+            pfd.events = POLLIN;
+            if (poll(&pfd, 1, (int) wait_ms) > 0)
+            {
+                char events[4096];
+
+                while (read(p_follower->inotify_fd, events, sizeof(events)) > 0)
+                {
+                    /* Discard, only the file size matters */
+                }
+            }
+        }
+        else
+        {
+            usleep(wait_ms * 1000);
+        }
+#endif
+        CHECK( file_size(fd, &size) );
+    }
+
+cleanup:
+    return err;
+}
+
+/** @brief Wait until the file has at least min_size bytes, see file_follower_wait() */
+static int
+follow_wait(file_stream_t fs, uint64_t min_size)
+{
+#ifdef _MSC_VER
+    return file_follower_wait(&fs->follower, _fileno(fs->infile), min_size);
+#else
+    return file_follower_wait(&fs->follower, fileno(fs->infile), min_size);
+#endif
+}
 
 /** @brief Parses mfra box and returns seek point
  *
@@ -76,7 +229,7 @@ static const size_t SOURCE_BUFFER_GRANULARITY = 1024;
  */
 
 static int
-get_mfra_seek_point(FILE *infile,
+get_mfra_seek_point(file_stream_t fs,
                     uint32_t track_ID,      /**< of track to consider */
                     uint64_t seek_time,     /**< in media time scale */
                     uint64_t *box_offset,   /**< [out] offset of latest moof, not after the seek_time according to mfra */
@@ -84,6 +237,7 @@ get_mfra_seek_point(FILE *infile,
     )
 {
     int err = 0;
+    FILE *infile = fs->infile;
     uint64_t file_size;
     uint64_t mfra_size;
     unsigned char mfro_buffer[16];
@@ -136,6 +290,7 @@ get_mfra_seek_point(FILE *infile,
     ASSURE( mfra_buffer != NULL, ("Allocation failure") );
 
     ASSURE( fread(mfra_buffer, (size_t) mfra_size, 1, infile) == 1, ("Failed to read mfra atom of size %" PRIu64, mfra_size) );
+    fragment_reader_report_read(&fs->base, file_size - mfra_size, mfra_size);
 
     CHECK( mp4d_demuxer_fragment_for_time(mfra_buffer,
                                           mfra_size,
@@ -243,7 +398,7 @@ file_stream_seek(fragment_reader_t s,
     uint64_t offset;
     mp4d_fourcc_t type;
 
-    CHECK( get_mfra_seek_point(fs->infile,
+    CHECK( get_mfra_seek_point(fs,
                                track_ID,
                                seek_time,
                                &offset,
@@ -270,6 +425,15 @@ file_stream_load(fragment_reader_t s, uint64_t position, uint32_t size, unsigned
     file_stream_t fs = (file_stream_t) s;
     int err = 0;
 
+    if (fs->follow)
+    {
+        /* The sample data may not have been written yet */
+        int err_wait = follow_wait(fs, position + size);
+
+        ASSURE( err_wait != 2, ("Timeout waiting for %" PRIu32 " bytes @%" PRIu64 " of input", size, position) );
+        CHECK( err_wait );
+    }
+
     ASSURE( file_seek(fs->infile, position) == 0, ("fseek to %" PRIu64 " on input file failed", position) );
     ASSURE( fread(p_buffer, size, 1, fs->infile) == 1, ("Reading %" PRIu32 " bytes from input @%" PRIu64 " failed", size, position) );
 
@@ -277,6 +441,29 @@ cleanup:
     return err;
 }
 
+/* Let the OS read the range into the page cache in the background */
+static int
+file_stream_prefetch(fragment_reader_t s, uint64_t position, uint64_t size)
+{
+#if defined(__APPLE__)
+    file_stream_t fs = (file_stream_t) s;
+    struct radvisory ra;
+
+    ra.ra_offset = (off_t) position;
+    ra.ra_count = size < INT32_MAX ? (int) size : INT32_MAX;
+    fcntl(fileno(fs->infile), F_RDADVISE, &ra);  /* advisory, errors are ignored */
+#elif !defined(_MSC_VER)
+    file_stream_t fs = (file_stream_t) s;
+
+    posix_fadvise(fileno(fs->infile), (off_t) position, (off_t) size, POSIX_FADV_WILLNEED);  /* advisory, errors are ignored */
+#else
+    (void) s;
+    (void) position;
+    (void) size;
+#endif
+    return 0;
+}
+
 static void
 file_stream_destroy(fragment_reader_t s)
 {
@@ -288,6 +475,7 @@ file_stream_destroy(fragment_reader_t s)
         {
             fclose(fs->infile);
         }
+        file_follower_deinit(&fs->follower);
         free(fs->inbuf);
         free(fs->compat_brands);
 
@@ -343,7 +531,8 @@ file_stream_next_atom(fragment_reader_t s)
         is_eof = feof(fs->infile);
         ASSURE( is_eof || bytes_read > 0, ("Failed to read input file") );
 
-        rv = mp4d_demuxer_parse(s->p_dmux, fs->inbuf, fs->inbuf_fill, is_eof, fs->file_offs, &atom_size);
+        /* In follow mode, more data may be written after EOF */
+        rv = mp4d_demuxer_parse(s->p_dmux, fs->inbuf, fs->inbuf_fill, is_eof && !fs->follow, fs->file_offs, &atom_size);
 
         if (rv == MP4D_E_BUFFER_TOO_SMALL) {
             CHECK( mp4d_demuxer_get_type(s->p_dmux, &type) );
@@ -358,6 +547,20 @@ file_stream_next_atom(fragment_reader_t s)
             }
         }
 
+        if (rv == MP4D_E_BUFFER_TOO_SMALL && is_eof && fs->follow)
+        {
+            /* Resume after the complete boxes read so far */
+            int err_wait = follow_wait(fs, fs->file_offs + fs->inbuf_fill + 1);
+
+            ASSURE( err_wait != 1, ("Failed to wait for input file to grow") );
+            if (err_wait == 0)
+            {
+                is_eof = 0;
+                clearerr(fs->infile);
+                ASSURE( file_seek(fs->infile, fs->file_offs + fs->inbuf_fill) == 0, ("file seek to %" PRIu64 " failed!", fs->file_offs + fs->inbuf_fill) );
+            }
+        }
+
     } while (rv == MP4D_E_BUFFER_TOO_SMALL && !is_eof);
 
     if (rv)
@@ -449,6 +652,8 @@ int file_stream_new(fragment_reader_t *p_s,  /**< [out] */
     fs->is_eof = 0;
     fs->ftyp.num_compat_brands = 0;
     fs->compat_brands = NULL;
+    fs->follow = 0;
+    fs->follower.inotify_fd = -1;
 
     s->next_atom = file_stream_next_atom;
     s->seek = file_stream_seek;
@@ -456,6 +661,7 @@ int file_stream_new(fragment_reader_t *p_s,  /**< [out] */
     s->load = file_stream_load;
     s->get_offset = file_stream_get_offset;
     s->get_type = file_stream_get_type;
+    s->prefetch = file_stream_prefetch;
 
     {
         mp4d_atom_t atom;
@@ -512,3 +718,15 @@ int file_stream_new(fragment_reader_t *p_s,  /**< [out] */
 cleanup:
     return err;
 }
+
+int file_stream_follow(fragment_reader_t s,
+                       uint32_t timeout_ms)
+{
+    file_stream_t fs = (file_stream_t) s;
+
+    file_follower_deinit(&fs->follower);
+    file_follower_init(&fs->follower, fs->path, timeout_ms);
+    fs->follow = 1;
+
+    return 0;
+}
@@ -38,6 +38,11 @@ int fragment_reader_init(fragment_reader_t s)
     ASSURE( (uint64_t) (size_t) static_mem_size == static_mem_size, ("Cannot allocate %" PRIu64 " bytes of memory", static_mem_size) );
     ASSURE( (uint64_t) (size_t) dyn_mem_size == dyn_mem_size, ("Cannot allocate %" PRIu64 " bytes of memory", dyn_mem_size) );
 
+    s->prefetch = NULL;  /* optional */
+    s->get_data = NULL;  /* optional */
+    s->on_read = NULL;
+    s->p_read_user = NULL;
+
     s->p_static_mem = malloc((size_t) static_mem_size);
     s->p_dynamic_mem = malloc((size_t) dyn_mem_size);
 
@@ -66,11 +71,42 @@ void fragment_reader_destroy(fragment_reader_t s)
 
 }
 
+/** @brief Report the box which next_atom() has read, the header only if its payload is not parsed
+ */
+static void
+report_atom(fragment_reader_t s)
+{
+    uint64_t offset;
+    mp4d_atom_t atom;
+
+    if (s->get_offset == NULL || s->get_offset(s, &offset) != 0 ||
+        mp4d_demuxer_get_atom(s->p_dmux, &atom) != MP4D_NO_ERROR)
+    {
+        return;
+    }
+    if (MP4D_FOURCC_EQ(atom.type, "mdat") ||
+        MP4D_FOURCC_EQ(atom.type, "free") ||
+        MP4D_FOURCC_EQ(atom.type, "skip"))
+    {
+        s->on_read(s->p_read_user, offset, atom.header);
+    }
+    else
+    {
+        s->on_read(s->p_read_user, offset, atom.header + atom.size);
+    }
+}
+
 int fragment_reader_next_atom(fragment_reader_t s)
 {
     if (s != NULL && s->next_atom != NULL)
     {
-         return (s->next_atom(s));
+        int err = s->next_atom(s);
+
+        if (err == 0 && s->on_read != NULL)
+        {
+            report_atom(s);
+        }
+        return err;
     }
 
     return -1;
@@ -97,7 +133,13 @@ int fragment_reader_load(fragment_reader_t s,
 {
     if (s != NULL && s->load != NULL)
     {
-         return (s->load(s, position, size, p_buffer));
+        int err = s->load(s, position, size, p_buffer);
+
+        if (err == 0)
+        {
+            fragment_reader_report_read(s, position, size);
+        }
+        return err;
     }
 
     return -1;
@@ -124,4 +166,50 @@ int fragment_reader_get_type(fragment_reader_t s,
     }
 
     return -1;
-}
\ No newline at end of file
+}
+int fragment_reader_prefetch(fragment_reader_t s,
+                uint64_t position,
+                uint64_t size
+                )
+{
+    if (s != NULL && s->prefetch != NULL)
+    {
+         return (s->prefetch(s, position, size));
+    }
+
+    return 0;
+}
+
+int fragment_reader_get_data(fragment_reader_t s,
+                uint64_t position,
+                uint32_t size,
+                const unsigned char **pp_data  /**< [out] */
+                )
+{
+    if (s != NULL && s->get_data != NULL)
+    {
+         return (s->get_data(s, position, size, pp_data));
+    }
+
+    return -1;
+}
+
+void fragment_reader_set_read_callback(fragment_reader_t s,
+                void (*on_read)(void *p_user, uint64_t position, uint64_t size),
+                void *p_user
+                )
+{
+    s->on_read = on_read;
+    s->p_read_user = p_user;
+}
+
+void fragment_reader_report_read(fragment_reader_t s,
+                uint64_t position,
+                uint64_t size
+                )
+{
+    if (s->on_read != NULL && size > 0)
+    {
+        s->on_read(s->p_read_user, position, size);
+    }
+}
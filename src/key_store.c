@@ -0,0 +1,254 @@
+/************************************************************************************************************
+ * Copyright (c) 2017, Dolby Laboratories Inc.
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ *    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+ *    promote products derived from this software without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ ************************************************************************************************************/
+
+#include "key_store.h"
+
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Initial number of hash table slots (a power of 2). The table grows before it is half full. */
+#define KEY_STORE_MIN_SLOTS 16
+
+/** A decryptor of a key, for one scheme */
+typedef struct scheme_decryptor_t_
+{
+    mp4d_crypt_info_t info;                 /* scheme, pattern and constant IV */
+    decryptor_t decryptor;
+    struct scheme_decryptor_t_ *next;
+} scheme_decryptor_t;
+
+typedef struct
+{
+    unsigned char kid[16];
+    unsigned char key[16];
+    decryptor_key_t round_keys;             /* NULL: free slot */
+    scheme_decryptor_t *decryptors;
+} key_slot_t;
+
+struct key_store_t_
+{
+    key_slot_t *slots;                      /* open addressing, linear probing */
+    uint32_t num_slots;                     /* power of 2 */
+    uint32_t num_keys;
+};
+
+/** FNV-1a */
+static uint32_t
+kid_hash(const unsigned char kid[16])
+{
+    uint32_t h = 2166136261u;
+    uint32_t i;
+
+    for (i = 0; i < 16; i++)
+    {
+        h = (h ^ kid[i]) * 16777619u;
+    }
+    return h;
+}
+
+/** @return the slot of a KID, or the free slot for it */
+static key_slot_t *
+find_slot(key_slot_t *slots,
+          uint32_t num_slots,
+          const unsigned char kid[16]
+    )
+{
+    uint32_t i = kid_hash(kid) & (num_slots - 1);
+
+    while (slots[i].round_keys != NULL && memcmp(slots[i].kid, kid, 16) != 0)
+    {
+        i = (i + 1) & (num_slots - 1);
+    }
+    return &slots[i];
+}
+
+static int
+grow(key_store_t p_ks)
+{
+    int err = 0;
+    uint32_t num_slots = p_ks->num_slots > 0 ? 2 * p_ks->num_slots : KEY_STORE_MIN_SLOTS;
+    key_slot_t *slots = calloc(num_slots, sizeof(*slots));
+    uint32_t i;
+
+    ASSURE( slots != NULL, ("Allocation failure") );
+    for (i = 0; i < p_ks->num_slots; i++)
+    {
+        if (p_ks->slots[i].round_keys != NULL)
+        {
+            *find_slot(slots, num_slots, p_ks->slots[i].kid) = p_ks->slots[i];
+        }
+    }
+    free(p_ks->slots);
+    p_ks->slots = slots;
+    p_ks->num_slots = num_slots;
+
+cleanup:
+    return err;
+}
+
+/** @return (boolean) the decryptors of two crypt infos are the same, given the key */
+static int
+same_scheme(const mp4d_crypt_info_t *a,
+            const mp4d_crypt_info_t *b
+    )
+{
+    return MP4D_FOURCC_EQ(a->scheme_type, b->scheme_type) &&
+        a->method == b->method &&
+        a->crypt_byte_block == b->crypt_byte_block &&
+        a->skip_byte_block == b->skip_byte_block &&
+        a->constant_iv_size == b->constant_iv_size &&
+        memcmp(a->constant_iv, b->constant_iv, a->constant_iv_size <= 16 ? a->constant_iv_size : 16) == 0;
+}
+
+int
+key_store_new(key_store_t *p_ks)
+{
+    int err = 0;
+
+    ASSURE( p_ks != NULL, ("Null pointer") );
+
+    *p_ks = malloc(sizeof(**p_ks));
+    ASSURE( *p_ks != NULL, ("Allocation failure") );
+    (*p_ks)->slots = NULL;
+    (*p_ks)->num_slots = 0;
+    (*p_ks)->num_keys = 0;
+
+cleanup:
+    return err;
+}
+
+void
+key_store_destroy(key_store_t *p_ks)
+{
+    uint32_t i;
+
+    if (p_ks == NULL || *p_ks == NULL)
+    {
+        return;
+    }
+    for (i = 0; i < (*p_ks)->num_slots; i++)
+    {
+        key_slot_t *p_slot = &(*p_ks)->slots[i];
+
+        while (p_slot->decryptors != NULL)
+        {
+            scheme_decryptor_t *next = p_slot->decryptors->next;
+
+            decryptor_destroy(&p_slot->decryptors->decryptor);
+            free(p_slot->decryptors);
+            p_slot->decryptors = next;
+        }
+        decryptor_key_destroy(&p_slot->round_keys);
+    }
+    free((*p_ks)->slots);
+    free(*p_ks);
+    *p_ks = NULL;
+}
+
+int
+key_store_add(key_store_t p_ks,
+              const unsigned char kid[16],
+              const unsigned char key[16]
+    )
+{
+    int err = 0;
+    key_slot_t *p_slot;
+
+    ASSURE( p_ks != NULL && kid != NULL && key != NULL, ("Null pointer") );
+
+    if (2 * (p_ks->num_keys + 1) > p_ks->num_slots)
+    {
+        CHECK( grow(p_ks) );
+    }
+    p_slot = find_slot(p_ks->slots, p_ks->num_slots, kid);
+    if (p_slot->round_keys != NULL)
+    {
+        ASSURE( memcmp(p_slot->key, key, 16) == 0, ("Two keys for the same KID") );
+        goto cleanup;
+    }
+
+    CHECK( decryptor_key_new(&p_slot->round_keys, key) );
+    memcpy(p_slot->kid, kid, 16);
+    memcpy(p_slot->key, key, 16);
+    p_slot->decryptors = NULL;
+    p_ks->num_keys++;
+
+cleanup:
+    return err;
+}
+
+uint32_t
+key_store_get_num_keys(key_store_t p_ks)
+{
+    return p_ks->num_keys;
+}
+
+int
+key_store_get_decryptor(key_store_t p_ks,
+                        const mp4d_crypt_info_t *p_info,
+                        decryptor_t *p_decryptor
+    )
+{
+    int err = 0;
+    key_slot_t *p_slot;
+    scheme_decryptor_t *p_sd = NULL;
+
+    ASSURE( p_ks != NULL && p_info != NULL && p_decryptor != NULL, ("Null pointer") );
+
+    *p_decryptor = NULL;
+    if (p_ks->num_keys == 0)
+    {
+        goto cleanup;
+    }
+    p_slot = find_slot(p_ks->slots, p_ks->num_slots, p_info->key_id);
+    if (p_slot->round_keys == NULL)
+    {
+        goto cleanup;
+    }
+
+    for (p_sd = p_slot->decryptors; p_sd != NULL; p_sd = p_sd->next)
+    {
+        if (same_scheme(&p_sd->info, p_info))
+        {
+            *p_decryptor = p_sd->decryptor;
+            p_sd = NULL;
+            goto cleanup;
+        }
+    }
+
+    p_sd = malloc(sizeof(*p_sd));
+    ASSURE( p_sd != NULL, ("Allocation failure") );
+    p_sd->info = *p_info;
+    CHECK( decryptor_new_with_key(&p_sd->decryptor, p_info, p_slot->round_keys) );
+    p_sd->next = p_slot->decryptors;
+    p_slot->decryptors = p_sd;
+    *p_decryptor = p_sd->decryptor;
+    p_sd = NULL;
+
+cleanup:
+    free(p_sd);
+    return err;
+}
@@ -0,0 +1,324 @@
+/************************************************************************************************************
+ * Copyright (c) 2017, Dolby Laboratories Inc.
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ *    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+ *    promote products derived from this software without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ ************************************************************************************************************/
+#include "mem_stream.h"
+
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    const unsigned char *p_data;
+    uint64_t size;
+    uint64_t position;      /* of the first byte */
+} mem_segment_t;
+
+/** @brief mem_stream implementation of the mp4_source API */
+typedef struct
+{
+    struct fragment_reader_t_ base;
+
+    mem_segment_t *segments;
+    uint32_t num_segments;
+    uint32_t max_segments;
+
+    uint32_t segment;       /* index of the segment containing the next box */
+    uint64_t segment_pos;   /* position of the next box in that segment */
+    uint64_t atom_offset;   /* position of the current box */
+
+    mp4d_ftyp_info_t ftyp;
+} *mem_stream_t;
+
+/* Find the segment containing the byte at position */
+static int
+find_segment(mem_stream_t ms, uint64_t position, uint32_t *p_index)
+{
+    uint32_t lo = 0;
+    uint32_t hi = ms->num_segments;
+
+    /* Binary search for the last segment starting at or before position */
+    while (hi - lo > 1)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (ms->segments[mid].position <= position)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    if (ms->num_segments == 0 ||
+        position - ms->segments[lo].position >= ms->segments[lo].size)
+    {
+        return 1;
+    }
+    *p_index = lo;
+    return 0;
+}
+
+int
+mem_stream_get_data(fragment_reader_t s,
+                    uint64_t position,
+                    uint32_t size,
+                    const unsigned char **pp_data)
+{
+    int err = 0;
+    mem_stream_t ms = (mem_stream_t) s;
+    const mem_segment_t *p_seg;
+    uint32_t index;
+
+    ASSURE( find_segment(ms, position, &index) == 0,
+            ("Position %" PRIu64 " is not in the segments", position) );
+    p_seg = &ms->segments[index];
+    ASSURE( position + size <= p_seg->position + p_seg->size,
+            ("Reading %" PRIu32 " bytes @%" PRIu64 " failed: crosses the end of segment %" PRIu32, size, position, index) );
+
+    *pp_data = p_seg->p_data + (position - p_seg->position);
+
+cleanup:
+    return err;
+}
+
+static int
+mem_stream_load(fragment_reader_t s, uint64_t position, uint32_t size, unsigned char *p_buffer)
+{
+    int err = 0;
+    const unsigned char *p_data;
+
+    CHECK( mem_stream_get_data(s, position, size, &p_data) );
+    memcpy(p_buffer, p_data, size);
+
+cleanup:
+    return err;
+}
+
+static int
+mem_stream_next_atom(fragment_reader_t s)
+{
+    mem_stream_t ms = (mem_stream_t) s;
+    const mem_segment_t *p_seg;
+    uint64_t atom_size;
+    mp4d_error_t rv;
+    int err = 0;
+
+    /* Skip to the next segment which has data left */
+    while (ms->segment < ms->num_segments &&
+           ms->segment_pos == ms->segments[ms->segment].size)
+    {
+        if (ms->segment + 1 == ms->num_segments)
+        {
+            return 2;
+        }
+        ms->segment++;
+        ms->segment_pos = 0;
+    }
+    if (ms->segment == ms->num_segments)
+    {
+        return 2;
+    }
+
+    p_seg = &ms->segments[ms->segment];
+    rv = mp4d_demuxer_parse(s->p_dmux,
+                            p_seg->p_data + ms->segment_pos,
+                            p_seg->size - ms->segment_pos,
+                            1,  /* a box of size 0 extends to the end of the segment */
+                            p_seg->position + ms->segment_pos,
+                            &atom_size);
+    ASSURE( rv != MP4D_E_BUFFER_TOO_SMALL,
+            ("Box @%" PRIu64 " crosses the end of segment %" PRIu32, p_seg->position + ms->segment_pos, ms->segment) );
+    ASSURE( rv == MP4D_NO_ERROR, ("Failed (%d) to parse box @%" PRIu64, rv, p_seg->position + ms->segment_pos) );
+
+    ms->atom_offset = p_seg->position + ms->segment_pos;
+    ms->segment_pos += atom_size;
+
+cleanup:
+    return err;
+}
+
+static void
+mem_stream_rewind(mem_stream_t ms)
+{
+    ms->segment = 0;
+    ms->segment_pos = 0;
+}
+
+static int
+mem_stream_seek(fragment_reader_t s,
+                uint32_t track_ID,
+                uint64_t seek_time,
+                uint64_t *out_time)
+{
+    int err = 0;
+    mp4d_fourcc_t type;
+
+    (void) track_ID;
+    (void) seek_time;
+
+    mem_stream_rewind((mem_stream_t) s);
+    do
+    {
+        CHECK( fragment_reader_next_atom(s) );
+        CHECK( mp4d_demuxer_get_type(s->p_dmux, &type) );
+    } while (!MP4D_FOURCC_EQ(type, "moov") &&
+             !MP4D_FOURCC_EQ(type, "moof"));
+
+    *out_time = 0;
+
+cleanup:
+    return err;
+}
+
+static int
+mem_stream_get_offset(fragment_reader_t s, uint64_t *offset)
+{
+    int err = 0;
+    mem_stream_t ms = (mem_stream_t) s;
+
+    ASSURE( offset != NULL, ("Null input") );
+    *offset = ms->atom_offset;
+
+cleanup:
+    return err;
+}
+
+static int
+mem_stream_get_type(fragment_reader_t s, mp4d_ftyp_info_t *p_type)
+{
+    int err = 0;
+    mem_stream_t ms = (mem_stream_t) s;
+
+    ASSURE( ms->num_segments > 0, ("No segments") );
+    *p_type = ms->ftyp;
+
+cleanup:
+    return err;
+}
+
+/* File type from the first box of the first segment */
+static int
+read_ftyp(mem_stream_t ms)
+{
+    int err = 0;
+    fragment_reader_t s = &ms->base;
+    mp4d_fourcc_t type;
+
+    CHECK( fragment_reader_next_atom(s) );
+    CHECK( mp4d_demuxer_get_type(s->p_dmux, &type) );
+    if (MP4D_FOURCC_EQ(type, "ftyp"))
+    {
+        /* compatible_brands point into the segment */
+        CHECK( mp4d_demuxer_get_ftyp_info(s->p_dmux, &ms->ftyp) );
+    }
+    else
+    {
+        /* Assume Quicktime, see file_stream_new() */
+        ms->ftyp.num_compat_brands = 1;
+        ms->ftyp.compat_brands = (const unsigned char *) "qt  ";
+        memcpy(ms->ftyp.major_brand, ms->ftyp.compat_brands, 4);
+        ms->ftyp.minor_version = 0;
+    }
+    mem_stream_rewind(ms);
+
+cleanup:
+    return err;
+}
+
+int
+mem_stream_append(fragment_reader_t s,
+                  const unsigned char *p_data,
+                  uint64_t size)
+{
+    int err = 0;
+    mem_stream_t ms = (mem_stream_t) s;
+    mem_segment_t *p_seg;
+
+    ASSURE( p_data != NULL && size > 0, ("Empty segment") );
+
+    if (ms->num_segments == ms->max_segments)
+    {
+        ms->max_segments = 2 * ms->max_segments + 4;
+        ms->segments = realloc(ms->segments, ms->max_segments * sizeof(*ms->segments));
+        ASSURE( ms->segments != NULL, ("Allocation error") );
+    }
+    p_seg = &ms->segments[ms->num_segments];
+    p_seg->p_data = p_data;
+    p_seg->size = size;
+    p_seg->position = 0;
+    if (ms->num_segments > 0)
+    {
+        p_seg->position = p_seg[-1].position + p_seg[-1].size;
+    }
+    ms->num_segments++;
+
+    if (ms->num_segments == 1)
+    {
+        CHECK( read_ftyp(ms) );
+    }
+
+cleanup:
+    return err;
+}
+
+static void
+mem_stream_destroy(fragment_reader_t s)
+{
+    mem_stream_t ms = (mem_stream_t) s;
+
+    if (ms != NULL)
+    {
+        free(ms->segments);
+        fragment_reader_deinit(s);
+        free(ms);
+    }
+}
+
+int
+mem_stream_new(fragment_reader_t *p_s)
+{
+    int err = 0;
+    mem_stream_t ms = malloc(sizeof(*ms));
+    fragment_reader_t s;
+
+    ASSURE( ms != NULL, ("Allocation error") );
+    memset(ms, 0, sizeof(*ms));
+    s = &ms->base;
+    CHECK( fragment_reader_init(s) );
+
+    s->next_atom = mem_stream_next_atom;
+    s->seek = mem_stream_seek;
+    s->destroy = mem_stream_destroy;
+    s->load = mem_stream_load;
+    s->get_offset = mem_stream_get_offset;
+    s->get_type = mem_stream_get_type;
+    s->get_data = mem_stream_get_data;
+
+    *p_s = s;
+cleanup:
+    return err;
+}
@@ -216,6 +216,88 @@ mp4d_tts_get_ts(tts_reader_t *p_r, uint64_t sample_index, uint64_t *p_ts, uint32
     return MP4D_NO_ERROR;
 }
 
+mp4d_error_t
+mp4d_tts_skip(tts_reader_t *p_r, uint32_t count)
+{
+    uint64_t ts;
+    uint32_t duration;
+
+    ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_r->buffer.p_data != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );  /* not initialized */
+
+    if (count == 0)
+    {
+        return MP4D_NO_ERROR;
+    }
+
+    /* Random access to the last skipped sample jumps over whole entries */
+    return mp4d_tts_get_ts(p_r,
+                           p_r->next_sample_index + count - 1,
+                           &ts,
+                           p_r->delta_encoded ? &duration : NULL);
+}
+
+/* Load the entry with the given index as the current entry */
+static void
+tts_load_entry(tts_reader_t *p_r, uint32_t entry_index)
+{
+    mp4d_seek(&p_r->buffer, 1 + 3 + 4 + (uint64_t) entry_index * 8);  /* version + flags + entry_count */
+
+    p_r->cur_entry_sample_count = mp4d_read_u32(&p_r->buffer);
+    p_r->cur_entry_sample_value = mp4d_read_u32(&p_r->buffer);
+    p_r->cur_entry_index = entry_index;
+}
+
+mp4d_error_t
+mp4d_tts_rewind(tts_reader_t *p_r, uint32_t count)
+{
+    ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_r->buffer.p_data != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );  /* not initialized */
+    ASSURE( count <= p_r->next_sample_index, MP4D_E_WRONG_ARGUMENT,
+            ("*tts: Cannot rewind %" PRIu32 " samples, at sample %" PRIu64, count, p_r->next_sample_index) );
+
+    if (count == p_r->next_sample_index)
+    {
+        /* Back to the beginning: force rewind in the next call to get_ts() */
+        p_r->next_sample_index = 0;
+        p_r->cur_entry_sample_count = 0;
+        p_r->cur_entry_consumed = 0;
+
+        return MP4D_NO_ERROR;
+    }
+
+    p_r->next_sample_index -= count;
+
+    while (count > 0)
+    {
+        if (count < p_r->cur_entry_consumed)
+        {
+            /* Stay inside this entry */
+            p_r->cur_entry_consumed -= count;
+            p_r->cur_dts -= (uint64_t) count * p_r->cur_entry_sample_value;
+            count = 0;
+        }
+        else
+        {
+            /* Move to the last sample of the previous non-empty entry */
+            uint32_t consumed = p_r->cur_entry_consumed;
+            uint32_t value = p_r->cur_entry_sample_value;
+
+            do
+            {
+                ASSURE( p_r->cur_entry_index > 0, MP4D_E_WRONG_ARGUMENT, ("*tts: Out of entries while rewinding") );
+                tts_load_entry(p_r, p_r->cur_entry_index - 1);
+            } while (p_r->cur_entry_sample_count == 0);
+
+            p_r->cur_entry_consumed = p_r->cur_entry_sample_count;
+            p_r->cur_dts -= (uint64_t) (consumed - 1) * value + p_r->cur_entry_sample_value;
+            count -= consumed;
+        }
+    }
+
+    return MP4D_NO_ERROR;
+}
+
 /* end stts */
 
 /* begin stsz */
@@ -346,6 +428,85 @@ mp4d_stsz_get_next(stsz_reader_t *p_r, uint32_t *p_size)
     }
 }
 
+mp4d_error_t
+mp4d_stsz_skip(stsz_reader_t *p_r, uint32_t count)
+{
+    ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_r->buffer.p_data != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") ); /* not initialized */
+
+    ASSURE( count <= p_r->sample_count - p_r->next_sample_index, MP4D_E_NEXT_SEGMENT,
+            ("Out of stsz samples (count is %" PRIu32 ")", p_r->sample_count) );
+
+    if (p_r->sample_size == 0 && count > 0)
+    {
+        switch(p_r->field_size)
+        {
+        case 4:
+        {
+            /* Two samples per byte. Keep the last byte read, it may hold the next sample */
+            uint32_t bytes_read = (p_r->next_sample_index + 1) / 2;
+            uint32_t bytes_needed = (p_r->next_sample_index + count + 1) / 2;
+
+            if (bytes_needed > bytes_read)
+            {
+                mp4d_skip_bytes(&p_r->buffer, bytes_needed - bytes_read - 1);
+                p_r->size_4 = mp4d_read_u8(&p_r->buffer);
+            }
+            break;
+        }
+        case 8:
+            mp4d_skip_bytes(&p_r->buffer, count);
+            break;
+        case 16:
+            mp4d_skip_bytes(&p_r->buffer, (uint64_t) count * 2);
+            break;
+        case 32:
+            mp4d_skip_bytes(&p_r->buffer, (uint64_t) count * 4);
+            break;
+        default:
+            /* impossible */
+            break;
+        }
+    }
+
+    p_r->next_sample_index += count;
+
+    return MP4D_NO_ERROR;
+}
+
+mp4d_error_t
+mp4d_stsz_rewind(stsz_reader_t *p_r, uint32_t count)
+{
+    ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_r->buffer.p_data != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") ); /* not initialized */
+
+    ASSURE( count <= p_r->next_sample_index, MP4D_E_WRONG_ARGUMENT,
+            ("stsz: Cannot rewind %" PRIu32 " samples, at sample %" PRIu32, count, p_r->next_sample_index) );
+
+    p_r->next_sample_index -= count;
+
+    if (p_r->sample_size == 0 && count > 0)
+    {
+        const uint64_t header_size = 1 + 3 + 4 + 4;  /* version + flags + sample_size/field_size + sample_count */
+
+        if (p_r->field_size == 4)
+        {
+            /* Two samples per byte. If the next sample is the second half of a byte, re-read that byte */
+            mp4d_seek(&p_r->buffer, header_size + p_r->next_sample_index / 2);
+            if (p_r->next_sample_index & 1)
+            {
+                p_r->size_4 = mp4d_read_u8(&p_r->buffer);
+            }
+        }
+        else
+        {
+            mp4d_seek(&p_r->buffer, header_size + (uint64_t) p_r->next_sample_index * (p_r->field_size / 8));
+        }
+    }
+
+    return MP4D_NO_ERROR;
+}
+
 /* end stsz */
 
 /* begin stsc */
@@ -386,6 +547,45 @@ mp4d_stsc_init(stsc_reader_t *p_r, mp4d_atom_t *p_stsc)
     return MP4D_NO_ERROR;
 }
 
+/* Move to the first sample of the next chunk */
+static mp4d_error_t
+stsc_next_chunk(stsc_reader_t *p_r)
+{
+    p_r->cur_chunk++;
+    p_r->samples_consumed = 0;
+
+    /* While no more samples in the current entry */
+    while (p_r->cur_chunk == p_r->next_first_chunk || p_r->cur_samples_per_chunk == 0)
+    {
+        /* Read the next entry */
+        ASSURE( p_r->cur_entry_index < p_r->entry_count, MP4D_E_NEXT_SEGMENT,
+                ("Out of stsc entries (count is %" PRIu32 ")", p_r->entry_count) );
+
+        p_r->cur_chunk = p_r->next_first_chunk;
+        p_r->cur_samples_per_chunk = mp4d_read_u32(&p_r->buffer);
+        p_r->cur_sample_description_index = mp4d_read_u32(&p_r->buffer);
+        p_r->cur_entry_index++;
+
+        if (p_r->entry_count > p_r->cur_entry_index)
+        {
+            /* Peek the next entry, in order to determine the number of chunks in the current entry */
+            p_r->next_first_chunk = mp4d_read_u32(&p_r->buffer);
+
+            /* first_chunk must be ascending */
+            ASSURE( p_r->next_first_chunk >= p_r->cur_chunk, MP4D_E_UNSUPPRTED_FORMAT,
+                    ("stsc: First chunk must be ascending, current = %" PRIu32", next = %" PRIu32,
+                     p_r->cur_chunk, p_r->next_first_chunk) );
+        }
+        else
+        {
+            /* Current entry is the last entry */
+            p_r->next_first_chunk = (uint32_t) -1;
+        }
+    }
+
+    return MP4D_NO_ERROR;
+}
+
 mp4d_error_t
 mp4d_stsc_get_next(stsc_reader_t *p_r, uint32_t *chunk_index, uint32_t *sample_description_index,
                    uint32_t *sample_index_in_chunk)
@@ -398,43 +598,142 @@ mp4d_stsc_get_next(stsc_reader_t *p_r, uint32_t *chunk_index, uint32_t *sample_d
 
     while (p_r->samples_consumed == p_r->cur_samples_per_chunk)
     {
-        p_r->cur_chunk++;
-        p_r->samples_consumed = 0;
+        CHECK( stsc_next_chunk(p_r) );
+    }
 
-        /* While no more samples in the current entry */
-        while (p_r->cur_chunk == p_r->next_first_chunk || p_r->cur_samples_per_chunk == 0)
-        {
-            /* Read the next entry */
-            ASSURE( p_r->cur_entry_index < p_r->entry_count, MP4D_E_NEXT_SEGMENT,
-                    ("Out of stsc entries (count is %" PRIu32 ")", p_r->entry_count) );
+    *chunk_index = p_r->cur_chunk;
+    *sample_description_index = p_r->cur_sample_description_index;
+    *sample_index_in_chunk = p_r->samples_consumed;
+    p_r->samples_consumed++;
 
-            p_r->cur_chunk = p_r->next_first_chunk;
-            p_r->cur_samples_per_chunk = mp4d_read_u32(&p_r->buffer);
-            p_r->cur_sample_description_index = mp4d_read_u32(&p_r->buffer);
-            p_r->cur_entry_index++;
+    return MP4D_NO_ERROR;
+}
 
-            if (p_r->entry_count > p_r->cur_entry_index)
-            {
-                /* Peek the next entry, in order to determine the number of chunks in the current entry */
-                p_r->next_first_chunk = mp4d_read_u32(&p_r->buffer);
+mp4d_error_t
+mp4d_stsc_skip(stsc_reader_t *p_r, uint32_t count, uint32_t *p_chunks_started)
+{
+    ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_chunks_started != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_r->buffer.p_data != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") ); /* not initialized */
 
-                /* first_chunk must be ascending */
-                ASSURE( p_r->next_first_chunk >= p_r->cur_chunk, MP4D_E_UNSUPPRTED_FORMAT,
-                        ("stsc: First chunk must be ascending, current = %" PRIu32", next = %" PRIu32,
-                         p_r->cur_chunk, p_r->next_first_chunk) );
-            }
-            else
+    *p_chunks_started = 0;
+
+    while (count > 0)
+    {
+        uint32_t step;
+
+        if (p_r->samples_consumed == p_r->cur_samples_per_chunk)
+        {
+            CHECK( stsc_next_chunk(p_r) );
+            (*p_chunks_started)++;
+
+            if (count > p_r->cur_samples_per_chunk)
             {
-                /* Current entry is the last entry */
-                p_r->next_first_chunk = (uint32_t) -1;
+                /* Jump over whole chunks of the current entry, but
+                   leave at least one sample for the last chunk */
+                uint32_t chunks = (count - 1) / p_r->cur_samples_per_chunk;
+                uint32_t chunks_left = p_r->next_first_chunk - p_r->cur_chunk - 1;
+
+                if (chunks > chunks_left)
+                {
+                    chunks = chunks_left;
+                }
+                p_r->cur_chunk += chunks;
+                *p_chunks_started += chunks;
+                count -= chunks * p_r->cur_samples_per_chunk;
             }
         }
+
+        step = p_r->cur_samples_per_chunk - p_r->samples_consumed;
+        if (step > count)
+        {
+            step = count;
+        }
+        p_r->samples_consumed += step;
+        count -= step;
     }
 
-    *chunk_index = p_r->cur_chunk;
-    *sample_description_index = p_r->cur_sample_description_index;
-    *sample_index_in_chunk = p_r->samples_consumed;
-    p_r->samples_consumed++;
+    return MP4D_NO_ERROR;
+}
+
+/* Load the entry with the given number (counting from one) as the current entry, returns its first_chunk */
+static uint32_t
+stsc_load_entry(stsc_reader_t *p_r, uint32_t entry_number)
+{
+    uint32_t first_chunk;
+
+    mp4d_seek(&p_r->buffer, 1 + 3 + 4 + (uint64_t) (entry_number - 1) * 12);  /* version + flags + entry_count */
+
+    first_chunk = mp4d_read_u32(&p_r->buffer);
+    p_r->cur_samples_per_chunk = mp4d_read_u32(&p_r->buffer);
+    p_r->cur_sample_description_index = mp4d_read_u32(&p_r->buffer);
+    p_r->cur_entry_index = entry_number;
+
+    if (p_r->entry_count > entry_number)
+    {
+        p_r->next_first_chunk = mp4d_read_u32(&p_r->buffer);
+    }
+    else
+    {
+        p_r->next_first_chunk = (uint32_t) -1;
+    }
+
+    return first_chunk;
+}
+
+/* first_chunk of the current entry */
+static uint32_t
+stsc_first_chunk(const stsc_reader_t *p_r)
+{
+    mp4d_buffer_t buffer = p_r->buffer;
+
+    mp4d_seek(&buffer, 1 + 3 + 4 + (uint64_t) (p_r->cur_entry_index - 1) * 12);
+
+    return mp4d_read_u32(&buffer);
+}
+
+mp4d_error_t
+mp4d_stsc_rewind(stsc_reader_t *p_r, uint32_t count)
+{
+    ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_r->buffer.p_data != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") ); /* not initialized */
+
+    while (count > 0 && count >= p_r->samples_consumed)
+    {
+        count -= p_r->samples_consumed;
+
+        /* Move to the last sample of the previous chunk */
+        if (p_r->cur_entry_index > 0 && p_r->cur_chunk > stsc_first_chunk(p_r))
+        {
+            p_r->cur_chunk--;
+        }
+        else
+        {
+            uint32_t entry_number = p_r->cur_entry_index;
+            uint32_t first_chunk;
+
+            /* Previous entry with chunks and samples */
+            do
+            {
+                if (entry_number <= 1)
+                {
+                    /* Before the first sample */
+                    mp4d_atom_t atom = buffer_to_atom(&p_r->buffer);
+
+                    ASSURE( count == 0, MP4D_E_WRONG_ARGUMENT, ("stsc: Cannot rewind before the first sample") );
+
+                    return mp4d_stsc_init(p_r, &atom);
+                }
+                entry_number--;
+                first_chunk = stsc_load_entry(p_r, entry_number);
+            } while (first_chunk == p_r->next_first_chunk || p_r->cur_samples_per_chunk == 0);
+
+            p_r->cur_chunk = p_r->next_first_chunk - 1;
+        }
+        p_r->samples_consumed = p_r->cur_samples_per_chunk;
+    }
+
+    p_r->samples_consumed -= count;
 
     return MP4D_NO_ERROR;
 }
@@ -490,6 +789,36 @@ mp4d_co_get_next(co_reader_t *p_r, uint64_t *chunk_offset)
     return MP4D_NO_ERROR;
 }
 
+mp4d_error_t
+mp4d_co_skip(co_reader_t *p_r, uint32_t count)
+{
+    ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_r->chunk_offsets.p_data != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    ASSURE( count <= p_r->entry_count - p_r->cur_entry_index, MP4D_E_NEXT_SEGMENT,
+            ("stco/co64: out of entries (count = %" PRIu32 ")", p_r->entry_count) );
+
+    p_r->cur_entry_index += count;
+    mp4d_skip_bytes(&p_r->chunk_offsets, (uint64_t) count * (p_r->is_co64 ? 8 : 4));
+
+    return MP4D_NO_ERROR;
+}
+
+mp4d_error_t
+mp4d_co_rewind(co_reader_t *p_r, uint32_t count)
+{
+    ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_r->chunk_offsets.p_data != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    ASSURE( count <= p_r->cur_entry_index, MP4D_E_WRONG_ARGUMENT,
+            ("stco/co64: Cannot rewind %" PRIu32 " entries, at entry %" PRIu32, count, p_r->cur_entry_index) );
+
+    p_r->cur_entry_index -= count;
+    mp4d_seek(&p_r->chunk_offsets, 1 + 3 + 4 + (uint64_t) p_r->cur_entry_index * (p_r->is_co64 ? 8 : 4));
+
+    return MP4D_NO_ERROR;
+}
+
 /* end stco, co64 */
 
 /* begin stss */
@@ -529,22 +858,11 @@ mp4d_stss_init(stss_reader_t *p_r,
 }
 
 
-mp4d_error_t
-mp4d_stss_get_next(stss_reader_t *p_r,
-                   int * is_sync  /** [out] */
-    )
+/* Read entries until the next sync sample is not before the given sample */
+static mp4d_error_t
+stss_read_entries(stss_reader_t *p_r, uint32_t sample_number)
 {
-    ASSURE( is_sync != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
-
-    if (p_r->buffer.p_data == NULL)
-    {
-        *is_sync = 1;
-        return MP4D_NO_ERROR;
-    }
-
-    p_r->cur_sample_number++;
-
-    while (p_r->cur_sample_number > p_r->next_sync_sample)
+    while (sample_number > p_r->next_sync_sample)
     {
         if (p_r->entries_left > 0)
         {
@@ -564,52 +882,274 @@ mp4d_stss_get_next(stss_reader_t *p_r,
         }
     }
 
+    return MP4D_NO_ERROR;
+}
+
+mp4d_error_t
+mp4d_stss_get_next(stss_reader_t *p_r,
+                   int * is_sync  /** [out] */
+    )
+{
+    ASSURE( is_sync != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    if (p_r->buffer.p_data == NULL)
+    {
+        *is_sync = 1;
+        return MP4D_NO_ERROR;
+    }
+
+    p_r->cur_sample_number++;
+
+    CHECK( stss_read_entries(p_r, p_r->cur_sample_number) );
+
     *is_sync = (p_r->cur_sample_number == p_r->next_sync_sample);
     
     return MP4D_NO_ERROR;
 }
 
+mp4d_error_t
+mp4d_stss_skip(stss_reader_t *p_r, uint32_t count)
+{
+    ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    if (p_r->buffer.p_data == NULL)
+    {
+        return MP4D_NO_ERROR;
+    }
+
+    p_r->cur_sample_number += count;
+
+    return stss_read_entries(p_r, p_r->cur_sample_number);
+}
+
+mp4d_error_t
+mp4d_stss_peek_sync(stss_reader_t *p_r,
+                    uint32_t *p_sample_number)
+{
+    ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_sample_number != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    if (p_r->buffer.p_data == NULL)
+    {
+        /* cur_sample_number is not maintained without stss */
+        ASSURE( 0, MP4D_E_INFO_NOT_AVAIL, ("No stss, all samples are sync samples") );
+    }
+
+    CHECK( stss_read_entries(p_r, p_r->cur_sample_number + 1) );
+
+    *p_sample_number = p_r->next_sync_sample;
+
+    return MP4D_NO_ERROR;
+}
+
+mp4d_error_t
+mp4d_stss_rewind(stss_reader_t *p_r, uint32_t count)
+{
+    ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    if (p_r->buffer.p_data == NULL)
+    {
+        return MP4D_NO_ERROR;
+    }
+
+    ASSURE( count <= p_r->cur_sample_number, MP4D_E_WRONG_ARGUMENT,
+            ("stss: Cannot rewind %" PRIu32 " samples, at sample %" PRIu32, count, p_r->cur_sample_number) );
+
+    p_r->cur_sample_number -= count;
+
+    {
+        /* Entries read so far; the last one is next_sync_sample unless that is infinity */
+        uint32_t entries_read = p_r->count - p_r->entries_left;
+        uint32_t entry_index = entries_read;
+        uint32_t sample_number;
+
+        if (p_r->next_sync_sample != (uint32_t) -1 && entries_read > 0)
+        {
+            entry_index = entries_read - 1;
+        }
+
+        /* Step back to the first entry after the current sample */
+        while (entry_index > 0)
+        {
+            CHECK( mp4d_stss_get_entry(p_r, entry_index - 1, &sample_number) );
+            if (sample_number <= p_r->cur_sample_number)
+            {
+                break;
+            }
+            entry_index--;
+        }
+
+        if (entry_index < entries_read)
+        {
+            mp4d_seek(&p_r->buffer, 1 + 3 + 4 + (uint64_t) entry_index * 4);  /* version + flags + entry_count */
+            p_r->next_sync_sample = mp4d_read_u32(&p_r->buffer);
+            p_r->entries_left = p_r->count - entry_index - 1;
+        }
+    }
+
+    return MP4D_NO_ERROR;
+}
+
+mp4d_error_t
+mp4d_stss_get_entry(const stss_reader_t *p_r,
+                    uint32_t entry_index,
+                    uint32_t *p_sample_number)
+{
+    mp4d_buffer_t buffer;
+
+    ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_sample_number != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_r->buffer.p_data != NULL, MP4D_E_INFO_NOT_AVAIL, ("No stss, all samples are sync samples") );
+    ASSURE( entry_index < p_r->count, MP4D_E_WRONG_ARGUMENT,
+            ("stss: Entry %" PRIu32 " out of range (count is %" PRIu32 ")", entry_index, p_r->count) );
+
+    buffer = p_r->buffer;
+    mp4d_seek(&buffer, 1 + 3 + 4 + (uint64_t) entry_index * 4);
+    *p_sample_number = mp4d_read_u32(&buffer);
+
+    return MP4D_NO_ERROR;
+}
+
 /* end stss */
 
 /* begin elst */
+mp4d_error_t
+mp4d_elst_get_entry_count(const mp4d_atom_t *p_atom,
+                          uint32_t *p_count
+    )
+{
+    mp4d_buffer_t p;
+
+    ASSURE( p_atom != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_count != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    p = mp4d_atom_to_buffer(p_atom);
+    mp4d_skip_bytes(&p, 1 + 3);  /* version + flags */
+    *p_count = mp4d_read_u32(&p);
+
+    return mp4d_is_buffer_error(&p) ? MP4D_E_INVALID_ATOM : MP4D_NO_ERROR;
+}
+
 mp4d_error_t
 mp4d_elst_init(elst_reader_t *p_r,
                mp4d_atom_t *p_atom,
+               elst_entry_t *p_entries,
+               uint32_t max_entries,
                uint32_t media_time_scale,
                uint32_t movie_time_scale
     )
 {
+    mp4d_buffer_t p;
+    uint8_t version;
+    uint32_t entry_count;
+    uint64_t segment_start = 0;    /* movie time scale */
+    int64_t prev_media_time = -1;  /* Latest positive media time, or -1 for the initial entries */
+    int64_t max_end = -1;
+
     ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
     ASSURE( media_time_scale > 0, MP4D_E_WRONG_ARGUMENT, ("media_time_scale is 0") );
     ASSURE( movie_time_scale > 0, MP4D_E_WRONG_ARGUMENT, ("movie_time_scale_is 0") );
 
+    p_r->p_entries = NULL;
+    p_r->num_entries = 0;
+    p_r->end_error = MP4D_E_INFO_NOT_AVAIL;
+
     if (p_atom == NULL)
     {
-        p_r->buffer.p_data = NULL;
         return MP4D_NO_ERROR;
     }
 
-    p_r->media_ts = media_time_scale;
-    p_r->movie_ts = movie_time_scale;
-    p_r->buffer = mp4d_atom_to_buffer(p_atom);
-    p_r->version = mp4d_read_u8(&p_r->buffer);
-    ASSURE( p_r->version == 0 || p_r->version == 1, MP4D_E_UNSUPPRTED_FORMAT, 
-            ("Unknown elst version %" PRIu32, p_r->version) );
+    ASSURE( p_entries != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    p = mp4d_atom_to_buffer(p_atom);
+    version = mp4d_read_u8(&p);
+    ASSURE( version == 0 || version == 1, MP4D_E_UNSUPPRTED_FORMAT, 
+            ("Unknown elst version %" PRIu32, version) );
     {
-        uint32_t flags = mp4d_read_u24(&p_r->buffer);
+        uint32_t flags = mp4d_read_u24(&p);
         ASSURE( flags == 0, MP4D_E_UNSUPPRTED_FORMAT, ("Unknown elst flags %" PRIu32, flags) );
     }
 
-    p_r->entries_left = mp4d_read_u32(&p_r->buffer);
-    p_r->media_time = -1;
-    p_r->segment_start = 0;
-    p_r->segment_duration = 0;
+    entry_count = mp4d_read_u32(&p);
+    ASSURE( entry_count <= max_entries, MP4D_E_BUFFER_TOO_SMALL,
+            ("elst has %" PRIu32 " entries, table has room for %" PRIu32, entry_count, max_entries) );
+
+    p_r->p_entries = p_entries;
+
+    /* Entries which cannot be read end the table. Media times after them fail with
+       end_error, as if the entries were read when reaching them */
+    for (; entry_count > 0; entry_count--)
+    {
+        uint64_t segment_duration;
+        int64_t media_time;
+        int16_t media_rate;
+        uint16_t media_rate_fraction;
+
+        if (version == 1)
+        {
+            segment_duration = mp4d_read_u64(&p);
+            media_time = (int64_t) mp4d_read_u64(&p);
+        }
+        else
+        {
+            segment_duration = mp4d_read_u32(&p);
+            media_time = (int32_t) mp4d_read_u32(&p);
+        }
+        media_rate = (int16_t) mp4d_read_u16(&p);
+        media_rate_fraction = mp4d_read_u16(&p);
+
+        if (mp4d_is_buffer_error(&p))
+        {
+            p_r->end_error = MP4D_E_INVALID_ATOM;
+            break;
+        }
+        if (media_rate != 0 && media_rate != 1)
+        {
+            warning(("Unsupported media_rate = %" PRId16 " (expected 0 or 1)\n", media_rate));
+            p_r->end_error = MP4D_E_UNSUPPRTED_FORMAT;
+            break;
+        }
+        if (media_rate_fraction != 0)
+        {
+            warning(("media_rate_fraction must be zero, got %" PRIu16 "\n", media_rate_fraction));
+            p_r->end_error = MP4D_E_UNSUPPRTED_FORMAT;
+            break;
+        }
+        if (media_time < -1 || (media_time >= 0 && media_time < prev_media_time))
+        {
+            warning(("Unsupported media time = %" PRId64 ", previous media time = %" PRId64
+                     ", must be increasing\n", media_time, prev_media_time));
+            p_r->end_error = MP4D_E_UNSUPPRTED_FORMAT;
+            break;
+        }
+
+        if (media_time >= 0)
+        {
+            elst_entry_t *p_e = &p_entries[p_r->num_entries++];
+
+            p_e->media_time = media_time;
+            p_e->media_end = media_time + (int64_t) ((segment_duration * media_time_scale) / movie_time_scale);
+            p_e->presentation_time = (segment_start * media_time_scale) / movie_time_scale;
+            p_e->media_rate = media_rate;
+
+            /* A segment is found for the media times before its end, a dwell
+               for the media times up to its media_time */
+            if (media_rate == 1 ? p_e->media_end > max_end : media_time + 1 > max_end)
+            {
+                max_end = media_rate == 1 ? p_e->media_end : media_time + 1;
+            }
+            p_e->max_end = max_end;
+
+            prev_media_time = media_time;
+        }
+        segment_start += segment_duration;
+    }
 
     return MP4D_NO_ERROR;
 }
 
 mp4d_error_t
-mp4d_elst_get_presentation_time(elst_reader_t *p_r,
+mp4d_elst_get_presentation_time(const elst_reader_t *p_r,
                                 uint64_t media_time,
                                 uint32_t duration,
                                 int64_t *p_time,
@@ -617,14 +1157,15 @@ mp4d_elst_get_presentation_time(elst_reader_t *p_r,
                                 uint32_t *p_duration
     )
 {
-    int64_t prev_media_time = -1;  /* Latest positive media time, or -1 for the initial entries */
+    const elst_entry_t *p_e;
+    uint32_t lo, hi;
 
     ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
     ASSURE( p_time != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
     ASSURE( p_offset != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
     ASSURE( p_duration != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
 
-    if (p_r->buffer.p_data == NULL)
+    if (p_r->p_entries == NULL)
     {
         /* No elst */
         *p_time = media_time;
@@ -634,66 +1175,26 @@ mp4d_elst_get_presentation_time(elst_reader_t *p_r,
         return MP4D_NO_ERROR;
     }
 
-    if (media_time < p_r->media_time + (p_r->segment_duration * p_r->media_ts) / p_r->movie_ts)
+    /* The first segment which does not end at or before the requested media time,
+       max_end is increasing */
+    lo = 0;
+    hi = p_r->num_entries;
+    while (lo < hi)
     {
-        /* Rewind to beginning of elst */
-        mp4d_seek(&p_r->buffer, 1 + 3);  /* version + flags */
-
-        p_r->entries_left = mp4d_read_u32(&p_r->buffer);
-
-        p_r->media_time = -1;
-        p_r->segment_start = 0;
-        p_r->segment_duration = 0;
-    }
+        uint32_t mid = lo + (hi - lo) / 2;
 
-    /* Read next entry while entry is empty or end of entry is before the requested media time */
-    while (p_r->media_time == -1 || 
-           (p_r->media_rate == 1 && p_r->media_time + (p_r->segment_duration * p_r->media_ts) / p_r->movie_ts <= media_time) ||
-           (p_r->media_rate == 0 && p_r->media_time < (int64_t) media_time))
-    {
-        if (p_r->media_time > -1)
+        if (p_r->p_entries[mid].max_end > (int64_t) media_time)
         {
-            prev_media_time = p_r->media_time;
-        }
-
-        ASSURE( p_r->entries_left > 0, MP4D_E_INFO_NOT_AVAIL, 
-                ("No more elst entries for time=%" PRIu64 ", duration=%" PRIu32, media_time, duration) );
-
-        p_r->segment_start += p_r->segment_duration;
-
-        if (p_r->version == 1)
-        {
-            p_r->segment_duration = mp4d_read_u64(&p_r->buffer);
-            p_r->media_time = (int64_t) mp4d_read_u64(&p_r->buffer);
+            hi = mid;
         }
         else
         {
-            p_r->segment_duration = mp4d_read_u32(&p_r->buffer);
-            p_r->media_time = (int32_t) mp4d_read_u32(&p_r->buffer);
+            lo = mid + 1;
         }
-        p_r->media_rate = (int16_t) mp4d_read_u16(&p_r->buffer);
-        ASSURE( p_r->media_rate == 0 || p_r->media_rate == 1, MP4D_E_UNSUPPRTED_FORMAT,
-                ("Unsupported media_rate = %" PRIu32 " (expected 0 or 1)", p_r->media_rate) );
-        {
-            uint16_t media_rate_fraction = mp4d_read_u16(&p_r->buffer);
-            
-            ASSURE( media_rate_fraction == 0, MP4D_E_UNSUPPRTED_FORMAT,
-                    ("media_rate_fraction must be zero, got %" PRIu16, media_rate_fraction) );
-
-        }
-        
-        ASSURE( p_r->media_time >= -1, MP4D_E_UNSUPPRTED_FORMAT,
-                ("media_time must be >= -1, got %" PRId64, p_r->media_time) );
-
-        if (p_r->media_time >= 0)
-        {
-            ASSURE( p_r->media_time >= prev_media_time, MP4D_E_UNSUPPRTED_FORMAT,
-                    ("Unsupported media time = %" PRId64 ", previous media time = %" PRId64
-                     ", must be increasing", p_r->media_time, prev_media_time) );
-        }
-        
-        p_r->entries_left -= 1;
     }
+    ASSURE( lo < p_r->num_entries, p_r->end_error,
+            ("No more elst entries for time=%" PRIu64 ", duration=%" PRIu32, media_time, duration) );
+    p_e = &p_r->p_entries[lo];
 
     /* Current segment ends at media_time or later */
  
@@ -718,30 +1219,30 @@ mp4d_elst_get_presentation_time(elst_reader_t *p_r,
        segment:     |---|
     */
         
-    *p_time = ((p_r->segment_start * p_r->media_ts) / p_r->movie_ts + (media_time - p_r->media_time));
-    if (media_time + duration > p_r->media_time + (p_r->segment_duration * p_r->media_ts) / p_r->movie_ts)
+    *p_time = (int64_t) (p_e->presentation_time + (media_time - p_e->media_time));
+    if ((int64_t) (media_time + duration) > p_e->media_end)
     {
-        if ((int64_t) media_time >= p_r->media_time)
+        if ((int64_t) media_time >= p_e->media_time)
         {
             /* 1 */
             *p_offset = 0;
-            *p_duration = (uint32_t) ((p_r->segment_duration * p_r->media_ts) / p_r->movie_ts - (media_time - p_r->media_time));
+            *p_duration = (uint32_t) (p_e->media_end - (int64_t) media_time);
         }
         else
         {
             /* 4 */
-            *p_offset = (uint32_t) (p_r->media_time - media_time);
-            *p_duration = (uint32_t) ((p_r->segment_duration * p_r->media_ts) / p_r->movie_ts);
+            *p_offset = (uint32_t) (p_e->media_time - media_time);
+            *p_duration = (uint32_t) (p_e->media_end - p_e->media_time);
         }
     }
     else
     {
         /* 5 */
-        ASSURE( (int64_t) (media_time + duration) > p_r->media_time, MP4D_E_INFO_NOT_AVAIL,
+        ASSURE( (int64_t) (media_time + duration) > p_e->media_time, MP4D_E_INFO_NOT_AVAIL,
                 ("Sample CTS + duration (%" PRId64 ") must not be after current media_time (%" PRIu64 ")",
-                 media_time + duration, p_r->media_time) );
+                 media_time + duration, p_e->media_time) );
 
-        if ((int64_t) media_time >= p_r->media_time)
+        if ((int64_t) media_time >= p_e->media_time)
         {
             /* 2 */
             *p_offset = 0;
@@ -750,16 +1251,16 @@ mp4d_elst_get_presentation_time(elst_reader_t *p_r,
         else
         {
             /* 3 */
-            *p_offset = (uint32_t) (p_r->media_time - media_time);
+            *p_offset = (uint32_t) (p_e->media_time - media_time);
             *p_duration = duration - *p_offset;
         }
     }
 
-    if (p_r->media_rate == 0)
+    if (p_e->media_rate == 0)
     {
         ASSURE( 0, MP4D_E_UNSUPPRTED_FORMAT,
                 ("media_rate = %" PRId16 ", dwells are not supported",
-                 p_r->media_rate) );
+                 p_e->media_rate) );
         /* Is valid but we do not support dwells.
            The values just computed do not make sense
            if current entry is a dwell. */
@@ -810,6 +1311,37 @@ mp4d_sdtp_get_next(sdtp_reader_t *p_r, uint8_t *p_entry)
     return MP4D_NO_ERROR;
 }
 
+mp4d_error_t
+mp4d_sdtp_skip(sdtp_reader_t *p_r, uint32_t count)
+{
+    ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_r->buffer.p_data != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") ); /* not initialized */
+
+    ASSURE( count <= p_r->sample_count - p_r->next_sample_index, MP4D_E_NEXT_SEGMENT,
+            ("Out of sdtp samples (count = %" PRIu32 ")", p_r->sample_count) );
+
+    mp4d_skip_bytes(&p_r->buffer, count);
+
+    p_r->next_sample_index += count;
+
+    return MP4D_NO_ERROR;
+}
+
+mp4d_error_t
+mp4d_sdtp_rewind(sdtp_reader_t *p_r, uint32_t count)
+{
+    ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_r->buffer.p_data != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") ); /* not initialized */
+
+    ASSURE( count <= p_r->next_sample_index, MP4D_E_WRONG_ARGUMENT,
+            ("sdtp: Cannot rewind %" PRIu32 " samples, at sample %" PRIu32, count, p_r->next_sample_index) );
+
+    p_r->next_sample_index -= count;
+    mp4d_seek(&p_r->buffer, 1 + 3 + (uint64_t) p_r->next_sample_index);  /* version + flags */
+
+    return MP4D_NO_ERROR;
+}
+
 /* end sdtp */
 
 /* begin stdp */
@@ -844,9 +1376,40 @@ mp4d_stdp_get_next(stdp_reader_t *p_r, uint16_t *p_priority)
     ASSURE( p_r->next_sample_index < p_r->sample_count, MP4D_E_NEXT_SEGMENT,
             ("Out of stdp samples (count = %" PRIu32 ")", p_r->sample_count) );
 
-    *p_priority = mp4d_read_u16(&p_r->buffer);
+    *p_priority = mp4d_read_u16(&p_r->buffer);
+
+    p_r->next_sample_index++;
+
+    return MP4D_NO_ERROR;
+}
+
+mp4d_error_t
+mp4d_stdp_skip(stdp_reader_t *p_r, uint32_t count)
+{
+    ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_r->buffer.p_data != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") ); /* not initialized */
+
+    ASSURE( count <= p_r->sample_count - p_r->next_sample_index, MP4D_E_NEXT_SEGMENT,
+            ("Out of stdp samples (count = %" PRIu32 ")", p_r->sample_count) );
+
+    mp4d_skip_bytes(&p_r->buffer, (uint64_t) count * 2);
+
+    p_r->next_sample_index += count;
+
+    return MP4D_NO_ERROR;
+}
+
+mp4d_error_t
+mp4d_stdp_rewind(stdp_reader_t *p_r, uint32_t count)
+{
+    ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_r->buffer.p_data != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") ); /* not initialized */
+
+    ASSURE( count <= p_r->next_sample_index, MP4D_E_WRONG_ARGUMENT,
+            ("stdp: Cannot rewind %" PRIu32 " samples, at sample %" PRIu32, count, p_r->next_sample_index) );
 
-    p_r->next_sample_index++;
+    p_r->next_sample_index -= count;
+    mp4d_seek(&p_r->buffer, 1 + 3 + (uint64_t) p_r->next_sample_index * 2);  /* version + flags */
 
     return MP4D_NO_ERROR;
 }
@@ -906,6 +1469,22 @@ mp4d_trik_get_next(trik_reader_t *p_r, uint8_t *p_pic_type, uint8_t *p_dependenc
     return MP4D_NO_ERROR;
 }
 
+mp4d_error_t
+mp4d_trik_skip(trik_reader_t *p_r, uint32_t count)
+{
+    ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_r->sample_count > 0, MP4D_E_WRONG_ARGUMENT,
+          ("Have not got sample count yet (count = %" PRIu32 ")", p_r->sample_count) );
+    ASSURE( count <= p_r->sample_count - p_r->next_sample_index, MP4D_E_NEXT_SEGMENT,
+          ("Out of trick samples (count = %" PRIu32 ")", p_r->sample_count) );
+
+    mp4d_skip_bytes(&p_r->buffer, count);
+
+    p_r->next_sample_index += count;
+
+    return MP4D_NO_ERROR;
+}
+
 /* end trik */
 
 /* begin senc */
@@ -937,7 +1516,7 @@ mp4d_senc_get_next(senc_reader_t *p_r,
                           const uint8_t **p_encryp_info)
 {
     ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
-    ASSURE( ((iv_size == 8)||(iv_size == 16)),    MP4D_E_WRONG_ARGUMENT, ("illegal iv size") );
+    ASSURE( ((iv_size == 0)||(iv_size == 8)||(iv_size == 16)),    MP4D_E_WRONG_ARGUMENT, ("illegal iv size") ); /* 0: constant IV */
     ASSURE( init_vector != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
     ASSURE( subsample_count != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
     ASSURE( p_encryp_info != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
@@ -967,6 +1546,59 @@ mp4d_senc_get_next(senc_reader_t *p_r,
     return MP4D_NO_ERROR;
 }
 
+mp4d_error_t
+mp4d_senc_skip(senc_reader_t *p_r,
+               uint8_t iv_size,
+               uint32_t count)
+{
+    ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( ((iv_size == 0)||(iv_size == 8)||(iv_size == 16)),    MP4D_E_WRONG_ARGUMENT, ("illegal iv size") ); /* 0: constant IV */
+
+    if (p_r->flags == 2)
+    {
+        /* Entries have variable size */
+        uint32_t i;
+
+        for (i = 0; i < count; i++)
+        {
+            uint16_t subsample_count;
+
+            mp4d_skip_bytes(&p_r->buffer, iv_size);
+            subsample_count = mp4d_read_u16(&p_r->buffer);
+            mp4d_skip_bytes(&p_r->buffer, (uint64_t) subsample_count * (2 + 4));
+        }
+    }
+    else
+    {
+        mp4d_skip_bytes(&p_r->buffer, (uint64_t) count * iv_size);
+    }
+    p_r->next_sample_index += count;
+
+    return MP4D_NO_ERROR;
+}
+
+mp4d_error_t
+mp4d_senc_decode_subsamples(const uint8_t *p_encryp_info,
+                            uint16_t subsample_count,
+                            uint32_t *p_clear_bytes,
+                            uint32_t *p_protected_bytes)
+{
+    uint16_t i;
+
+    ASSURE( p_encryp_info != NULL || subsample_count == 0, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( (p_clear_bytes != NULL && p_protected_bytes != NULL) || subsample_count == 0,
+            MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    for (i = 0; i < subsample_count; i++, p_encryp_info += 6)
+    {
+        p_clear_bytes[i] = ((uint32_t) p_encryp_info[0] << 8) | p_encryp_info[1];
+        p_protected_bytes[i] = ((uint32_t) p_encryp_info[2] << 24) | ((uint32_t) p_encryp_info[3] << 16) |
+                               ((uint32_t) p_encryp_info[4] << 8) | p_encryp_info[5];
+    }
+
+    return MP4D_NO_ERROR;
+}
+
 /* end senc */
 
 /* begin padb */
@@ -1016,6 +1648,52 @@ mp4d_padb_get_next(padb_reader_t *p_r, uint8_t *p_entry)
     return MP4D_NO_ERROR;
 }
 
+mp4d_error_t
+mp4d_padb_skip(padb_reader_t *p_r, uint32_t count)
+{
+    ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_r->buffer.p_data != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") ); /* not initialized */
+
+    ASSURE( count <= p_r->sample_count - p_r->next_sample_index, MP4D_E_NEXT_SEGMENT,
+            ("Out of padb samples (count = %" PRIu32 ")", p_r->sample_count) );
+
+    {
+        /* Two samples per byte. Keep the last byte read, it may hold the next sample */
+        uint32_t bytes_read = (p_r->next_sample_index + 1) / 2;
+        uint32_t bytes_needed = (p_r->next_sample_index + count + 1) / 2;
+
+        if (bytes_needed > bytes_read)
+        {
+            mp4d_skip_bytes(&p_r->buffer, bytes_needed - bytes_read - 1);
+            p_r->current_entry = mp4d_read_u8(&p_r->buffer);
+        }
+    }
+    p_r->next_sample_index += count;
+
+    return MP4D_NO_ERROR;
+}
+
+mp4d_error_t
+mp4d_padb_rewind(padb_reader_t *p_r, uint32_t count)
+{
+    ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_r->buffer.p_data != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") ); /* not initialized */
+
+    ASSURE( count <= p_r->next_sample_index, MP4D_E_WRONG_ARGUMENT,
+            ("padb: Cannot rewind %" PRIu32 " samples, at sample %" PRIu32, count, p_r->next_sample_index) );
+
+    p_r->next_sample_index -= count;
+
+    /* Two samples per byte. If the next sample is the second half of a byte, re-read that byte */
+    mp4d_seek(&p_r->buffer, 1 + 3 + 4 + (uint64_t) p_r->next_sample_index / 2);  /* version + flags + sample_count */
+    if (p_r->next_sample_index & 1)
+    {
+        p_r->current_entry = mp4d_read_u8(&p_r->buffer);
+    }
+
+    return MP4D_NO_ERROR;
+}
+
 /* end padb */
 
 /* begin subs */
@@ -1049,6 +1727,13 @@ mp4d_subs_init(subs_reader_t * p_r,
     return MP4D_NO_ERROR;
 }
 
+/* Size of one subsample entry */
+static uint32_t
+subs_entry_size(const subs_reader_t *p_r)
+{
+    return (p_r->version == 1 ? 4 : 2) + 1 + 1 + 4;
+}
+
 mp4d_error_t
 mp4d_subs_get_next_count(subs_reader_t *p_r,
                          uint16_t *p_count
@@ -1072,21 +1757,8 @@ mp4d_subs_get_next_count(subs_reader_t *p_r,
         uint32_t sample_delta;
 
         /* Move past any subsamples which were not consumed by get_next_size() */
-        while (p_r->subsamples_left > 0)
-        {
-            if (p_r->version == 1)
-            {
-                mp4d_read_u32(&p_r->buffer);
-            }
-            else
-            {
-                mp4d_read_u16(&p_r->buffer);
-            }
-            mp4d_read_u8(&p_r->buffer);
-            mp4d_read_u8(&p_r->buffer);
-            mp4d_read_u32(&p_r->buffer);
-            p_r->subsamples_left--;
-        }
+        mp4d_skip_bytes(&p_r->buffer, (uint64_t) p_r->subsamples_left * subs_entry_size(p_r));
+        p_r->subsamples_left = 0;
 
         sample_delta = mp4d_read_u32(&p_r->buffer);       
         ASSURE( sample_delta > 0, MP4D_E_INVALID_ATOM,
@@ -1164,6 +1836,135 @@ mp4d_subs_get_next_size(subs_reader_t *p_r,
 
     return MP4D_NO_ERROR;
 }
+
+mp4d_error_t
+mp4d_subs_get_sizes(subs_reader_t *p_r,
+                    uint32_t sample_size,
+                    uint32_t count,
+                    uint32_t *p_sizes
+    )
+{
+    uint32_t entry_size;
+    uint32_t offset;
+    uint32_t i;
+
+    ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_sizes != NULL || count == 0, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    entry_size = subs_entry_size(p_r);
+    if (p_r->buffer.p_data == NULL || p_r->subsamples_left < count ||
+        p_r->buffer.size == (uint64_t) -1 || p_r->buffer.size < (uint64_t) count * entry_size)
+    {
+        /* Implicit subsample info, or a truncated box: one subsample at a time */
+        subs_reader_t start = *p_r;
+
+        for (i = 0; i < count; i++)
+        {
+            mp4d_error_t err = mp4d_subs_get_next_size(p_r, sample_size, &p_sizes[i], &offset);
+
+            if (err != MP4D_NO_ERROR)
+            {
+                *p_r = start;
+                return err;
+            }
+        }
+        return MP4D_NO_ERROR;
+    }
+
+    offset = p_r->current_offset;
+    if (p_r->version == 1)
+    {
+        const unsigned char *p = p_r->buffer.p_data;
+
+        for (i = 0; i < count; i++, p += entry_size)
+        {
+            ASSURE( offset < sample_size, MP4D_E_WRONG_ARGUMENT,
+                    ("No more subsamples (offset = %" PRIu32 ", sample_size = %" PRIu32 ")", offset, sample_size) );
+            p_sizes[i] = ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+            offset += p_sizes[i];
+        }
+    }
+    else
+    {
+        const unsigned char *p = p_r->buffer.p_data;
+
+        for (i = 0; i < count; i++, p += entry_size)
+        {
+            ASSURE( offset < sample_size, MP4D_E_WRONG_ARGUMENT,
+                    ("No more subsamples (offset = %" PRIu32 ", sample_size = %" PRIu32 ")", offset, sample_size) );
+            p_sizes[i] = ((uint32_t) p[0] << 8) | p[1];
+            offset += p_sizes[i];
+        }
+    }
+
+    mp4d_skip_bytes(&p_r->buffer, (uint64_t) count * entry_size);
+    p_r->current_offset = offset;
+    p_r->subsamples_left -= count;
+
+    return MP4D_NO_ERROR;
+}
+
+mp4d_error_t
+mp4d_subs_skip(subs_reader_t *p_r, uint32_t count)
+{
+    uint32_t last_sample;     /* number of the last skipped sample */
+    uint32_t pending;         /* subsample entries of the current entry, not yet read */
+
+    ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    if (count == 0)
+    {
+        return MP4D_NO_ERROR;
+    }
+
+    last_sample = p_r->next_sample_index + count;
+    p_r->next_sample_index = last_sample;
+    p_r->current_offset = 0;
+
+    if (p_r->buffer.p_data == NULL)
+    {
+        p_r->subsamples_left = 0;
+        return MP4D_NO_ERROR;
+    }
+
+    if (p_r->next_entry_sample_number > last_sample - count)
+    {
+        /* Current entry was not reached yet, none of its subsamples are read */
+        pending = p_r->next_entry_subsample_count;
+    }
+    else
+    {
+        pending = p_r->subsamples_left;
+    }
+
+    while (p_r->next_entry_sample_number < last_sample && p_r->entries_left > 0)
+    {
+        uint32_t sample_delta;
+
+        mp4d_skip_bytes(&p_r->buffer, (uint64_t) pending * subs_entry_size(p_r));
+
+        sample_delta = mp4d_read_u32(&p_r->buffer);       
+        ASSURE( sample_delta > 0, MP4D_E_INVALID_ATOM,
+                ("sample_delta is zero" ) );
+
+        p_r->next_entry_sample_number += sample_delta;
+        p_r->next_entry_subsample_count = mp4d_read_u16(&p_r->buffer);
+        p_r->entries_left--;
+
+        pending = p_r->next_entry_subsample_count;
+    }
+
+    if (p_r->next_entry_sample_number == last_sample)
+    {
+        p_r->subsamples_left = pending;
+    }
+    else
+    {
+        p_r->subsamples_left = 0;
+    }
+
+    return MP4D_NO_ERROR;
+}
 /* end subs */
 
 /* begin saiz */
@@ -1228,6 +2029,38 @@ mp4d_saiz_get_next_size(saiz_reader_t *p_r,
 
     return MP4D_NO_ERROR;
 }
+
+mp4d_error_t
+mp4d_saiz_skip(saiz_reader_t *p_r,
+               uint32_t count,
+               uint64_t *p_total_size
+    )
+{
+    ASSURE( p_r != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_total_size != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    /* Samples beyond the table have no aux information */
+    if (count > p_r->samples_left)
+    {
+        count = p_r->samples_left;
+    }
+    p_r->samples_left -= count;
+
+    if (p_r->default_sample_info_size > 0)
+    {
+        *p_total_size = (uint64_t) count * p_r->default_sample_info_size;
+    }
+    else
+    {
+        *p_total_size = 0;
+        while (count-- > 0)
+        {
+            *p_total_size += mp4d_read_u8(&p_r->buffer);
+        }
+    }
+
+    return MP4D_NO_ERROR;
+}
 /* end saiz */
 
 /* begin saio */
@@ -1294,3 +2127,231 @@ mp4d_saio_get_next(saio_reader_t *p_r,
     return MP4D_NO_ERROR;
 }
 /* end saio */
+
+/* begin trun */
+#define TRUN_READ_U32(p) \
+    (((uint32_t) (p)[0] << 24) | ((uint32_t) (p)[1] << 16) | ((uint32_t) (p)[2] << 8) | (uint32_t) (p)[3])
+
+/* Defines trun_decode_<D><S><F><O>_<V>() for the entries with sample_duration (D),
+   sample_size (S), sample_flags (F) and sample_composition_time_offset (O)
+   present or not, of trun version V. The conditions are constant, and are
+   removed by the compiler. */
+#define TRUN_DECODER(D, S, F, O, V)                                         \
+static void                                                                 \
+trun_decode_##D##S##F##O##_##V(const unsigned char *p_data,                 \
+                               const trun_entry_t *p_defaults,              \
+                               trun_entry_t *p_entries,                     \
+                               uint32_t count)                              \
+{                                                                           \
+    uint32_t i;                                                             \
+                                                                            \
+    for (i = 0; i < count; i++)                                             \
+    {                                                                       \
+        trun_entry_t *p_e = &p_entries[i];                                  \
+                                                                            \
+        *p_e = *p_defaults;                                                 \
+        if (D)                                                              \
+        {                                                                   \
+            p_e->duration = TRUN_READ_U32(p_data);                          \
+            p_data += 4;                                                    \
+        }                                                                   \
+        if (S)                                                              \
+        {                                                                   \
+            p_e->size = TRUN_READ_U32(p_data);                              \
+            p_data += 4;                                                    \
+        }                                                                   \
+        if (F)                                                              \
+        {                                                                   \
+            p_e->flags = TRUN_READ_U32(p_data);                             \
+            p_data += 4;                                                    \
+        }                                                                   \
+        if (O)                                                              \
+        {                                                                   \
+            uint32_t offset = TRUN_READ_U32(p_data);                        \
+                                                                            \
+            p_e->composition_offset = (V) ? (int64_t) (int32_t) offset      \
+                                          : (int64_t) offset;               \
+            p_data += 4;                                                    \
+        }                                                                   \
+    }                                                                       \
+}
+
+TRUN_DECODER(0, 0, 0, 0, 0)
+TRUN_DECODER(1, 0, 0, 0, 0)
+TRUN_DECODER(0, 1, 0, 0, 0)
+TRUN_DECODER(1, 1, 0, 0, 0)
+TRUN_DECODER(0, 0, 1, 0, 0)
+TRUN_DECODER(1, 0, 1, 0, 0)
+TRUN_DECODER(0, 1, 1, 0, 0)
+TRUN_DECODER(1, 1, 1, 0, 0)
+TRUN_DECODER(0, 0, 0, 1, 0)
+TRUN_DECODER(1, 0, 0, 1, 0)
+TRUN_DECODER(0, 1, 0, 1, 0)
+TRUN_DECODER(1, 1, 0, 1, 0)
+TRUN_DECODER(0, 0, 1, 1, 0)
+TRUN_DECODER(1, 0, 1, 1, 0)
+TRUN_DECODER(0, 1, 1, 1, 0)
+TRUN_DECODER(1, 1, 1, 1, 0)
+TRUN_DECODER(0, 0, 0, 1, 1)
+TRUN_DECODER(1, 0, 0, 1, 1)
+TRUN_DECODER(0, 1, 0, 1, 1)
+TRUN_DECODER(1, 1, 0, 1, 1)
+TRUN_DECODER(0, 0, 1, 1, 1)
+TRUN_DECODER(1, 0, 1, 1, 1)
+TRUN_DECODER(0, 1, 1, 1, 1)
+TRUN_DECODER(1, 1, 1, 1, 1)
+
+/* Indexed by (tr_flags >> 8) & 0xf, and the version */
+static void (* const trun_decoders[2][16])(const unsigned char *, const trun_entry_t *, trun_entry_t *, uint32_t) =
+{
+    {
+        trun_decode_0000_0, trun_decode_1000_0, trun_decode_0100_0, trun_decode_1100_0,
+        trun_decode_0010_0, trun_decode_1010_0, trun_decode_0110_0, trun_decode_1110_0,
+        trun_decode_0001_0, trun_decode_1001_0, trun_decode_0101_0, trun_decode_1101_0,
+        trun_decode_0011_0, trun_decode_1011_0, trun_decode_0111_0, trun_decode_1111_0
+    },
+    {
+        trun_decode_0000_0, trun_decode_1000_0, trun_decode_0100_0, trun_decode_1100_0,
+        trun_decode_0010_0, trun_decode_1010_0, trun_decode_0110_0, trun_decode_1110_0,
+        trun_decode_0001_1, trun_decode_1001_1, trun_decode_0101_1, trun_decode_1101_1,
+        trun_decode_0011_1, trun_decode_1011_1, trun_decode_0111_1, trun_decode_1111_1
+    }
+};
+
+mp4d_error_t
+mp4d_trun_decoder_init(trun_decoder_t *p_d,
+                       uint8_t version,
+                       uint32_t tr_flags,
+                       const trun_entry_t *p_defaults
+    )
+{
+    uint32_t fields = (tr_flags >> 8) & 0xf;
+
+    ASSURE( p_d != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_defaults != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( version == 0 || version == 1, MP4D_E_UNSUPPRTED_FORMAT, ("Unknown trun version %" PRIu32, version) );
+
+    p_d->decode = trun_decoders[version][fields];
+    p_d->entry_size = 4 * ((fields & 1) + ((fields >> 1) & 1) + ((fields >> 2) & 1) + ((fields >> 3) & 1));
+    p_d->defaults = *p_defaults;
+
+    return MP4D_NO_ERROR;
+}
+
+mp4d_error_t
+mp4d_trun_decode(const trun_decoder_t *p_d,
+                 const mp4d_buffer_t *p_entries,
+                 trun_entry_t *p_out,
+                 uint32_t count
+    )
+{
+    ASSURE( p_d != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_entries != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_out != NULL || count == 0, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_entries->size != (uint64_t) -1 &&
+            p_entries->size >= (uint64_t) count * p_d->entry_size, MP4D_E_BUFFER_TOO_SMALL,
+            ("Out of trun entries (need %" PRIu32 ")", count) );
+
+    p_d->decode(p_entries->p_data, &p_d->defaults, p_out, count);
+
+    return MP4D_NO_ERROR;
+}
+/* end trun */
+/* begin moof */
+mp4d_error_t
+mp4d_traf_get_track_ID(const mp4d_atom_t *p_traf,
+                       uint32_t *p_track_ID
+    )
+{
+    mp4d_atom_t traf;
+    mp4d_atom_t tfhd;
+    mp4d_buffer_t p;
+
+    ASSURE( p_traf != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_track_ID != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    traf = *p_traf;
+    ASSURE( mp4d_find_atom(&traf, "tfhd", 0, &tfhd) == MP4D_NO_ERROR, MP4D_E_UNSUPPRTED_FORMAT,
+            ("Missing traf:tfhd") );
+
+    p = mp4d_atom_to_buffer(&tfhd);
+    {
+        uint8_t version = mp4d_read_u8(&p);
+
+        mp4d_read_u24(&p); /* tf_flags */
+        *p_track_ID = mp4d_read_u32(&p);
+        ASSURE( version == 0, MP4D_E_UNSUPPRTED_FORMAT,
+                ("Unsupported tfhd version: %" PRIu8, version) );
+        ASSURE( p.size != (uint64_t) -1, MP4D_E_INVALID_ATOM, ("Short tfhd") );
+    }
+
+    return MP4D_NO_ERROR;
+}
+
+mp4d_error_t
+mp4d_moof_add_traf(mp4d_moof_t *p_moof,
+                   const mp4d_atom_t *p_traf
+    )
+{
+    uint32_t track_ID;
+
+    ASSURE( p_moof != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_traf != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    if (mp4d_traf_get_track_ID(p_traf, &track_ID) != MP4D_NO_ERROR)
+    {
+        track_ID = 0;
+    }
+
+    if (p_moof->num_traf < MP4D_MAX_TRAFS)
+    {
+        p_moof->traf[p_moof->num_traf].track_ID = track_ID;
+        p_moof->traf[p_moof->num_traf].atom = *p_traf;
+        p_moof->traf[p_moof->num_traf].atom.p_parent = NULL;  /* may not outlive the caller */
+    }
+    p_moof->num_traf++;
+
+    return MP4D_NO_ERROR;
+}
+
+mp4d_error_t
+mp4d_moof_find_traf(const mp4d_moof_t *p_moof,
+                    uint32_t track_ID,
+                    mp4d_atom_t *p_traf,
+                    uint32_t *p_count,
+                    uint32_t *p_preceding
+    )
+{
+    uint32_t i;
+
+    ASSURE( p_moof != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_traf != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_count != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_preceding != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    if (!p_moof->complete || p_moof->num_traf > MP4D_MAX_TRAFS)
+    {
+        return MP4D_E_INFO_NOT_AVAIL;
+    }
+
+    *p_count = 0;
+    *p_preceding = 0;
+    for (i = 0; i < p_moof->num_traf; i++)
+    {
+        if (p_moof->traf[i].track_ID == track_ID && track_ID != 0)
+        {
+            if (*p_count == 0)
+            {
+                *p_traf = p_moof->traf[i].atom;
+            }
+            (*p_count)++;
+        }
+        else if (*p_count == 0 && p_moof->traf[i].track_ID != 0)
+        {
+            (*p_preceding)++;
+        }
+    }
+
+    return MP4D_NO_ERROR;
+}
+/* end moof */
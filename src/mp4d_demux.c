@@ -564,14 +564,35 @@ mp4d_parse_schm
 static int
 mp4d_parse_encryption_entry
     (mp4d_buffer_t * p
+    ,uint8_t version
     ,mp4d_navigator_ptr_t p_nav
     )
 {
     mp4d_demuxer_ptr_t p_dmux = p_nav->p_data;
     if (p_dmux->curr.moov.p_trak) {
-        p_dmux->curr.moov.p_trak->crypt.info.method = mp4d_read_u24(p);
-        p_dmux->curr.moov.p_trak->crypt.info.iv_size = mp4d_read_u8(p);
-        mp4d_read(p, p_dmux->curr.moov.p_trak->crypt.info.key_id, 16);
+        mp4d_crypt_info_t *p_info = &p_dmux->curr.moov.p_trak->crypt.info;
+
+        if (version == 0) {
+            p_info->method = mp4d_read_u24(p);
+        }
+        else {
+            uint8_t pattern;
+
+            mp4d_read_u8(p); /* reserved */
+            pattern = mp4d_read_u8(p);
+            p_info->crypt_byte_block = pattern >> 4;
+            p_info->skip_byte_block = pattern & 0xf;
+            p_info->method = mp4d_read_u8(p);
+        }
+        p_info->iv_size = mp4d_read_u8(p);
+        mp4d_read(p, p_info->key_id, 16);
+        if (p_info->method == 1 && p_info->iv_size == 0) {
+            p_info->constant_iv_size = mp4d_read_u8(p);
+            if (p_info->constant_iv_size > 16) {
+                return MP4D_E_INVALID_ATOM;
+            }
+            mp4d_read(p, p_info->constant_iv, p_info->constant_iv_size);
+        }
     }
     
     return mp4d_is_buffer_error(p)?MP4D_E_INVALID_ATOM:MP4D_NO_ERROR;
@@ -590,8 +611,8 @@ mp4d_parse_tenc
     version = mp4d_read_u8(&p);
     flags = mp4d_read_u24(&p);
     
-    if (version==0) {
-        return mp4d_parse_encryption_entry(&p, p_nav);
+    if (version==0 || version==1) {
+        return mp4d_parse_encryption_entry(&p, version, p_nav);
     }
     else {
         return MP4D_E_UNSUPPRTED_FORMAT;
@@ -631,10 +652,12 @@ mp4d_read_crypt_data
     mp4d_parse_box(atom, p_nav);
     p_crypt_info->method = 0xff;
     if ((MP4D_FOURCC_EQ(p_trak->crypt.scheme_type, "cenc") && p_trak->crypt.scheme_version==0x00010000ul) ||
+        (MP4D_FOURCC_EQ(p_trak->crypt.scheme_type, "cbcs") && p_trak->crypt.scheme_version==0x00010000ul) ||
         (MP4D_FOURCC_EQ(p_trak->crypt.scheme_type, "piff") && p_trak->crypt.scheme_version==0x00010000ul) ||
         (MP4D_FOURCC_EQ(p_trak->crypt.scheme_type, "piff") && p_trak->crypt.scheme_version==0x00010001ul))
     {
         *p_crypt_info = p_trak->crypt.info;
+        MP4D_FOURCC_ASSIGN(p_crypt_info->scheme_type, p_trak->crypt.scheme_type);
     }
     
     return 0;
@@ -1037,6 +1060,39 @@ mp4d_parse_mfhd
     return 0;
 }
 
+static int
+mp4d_parse_moof
+    (mp4d_atom_t atom
+    ,mp4d_navigator_ptr_t p_nav
+    )
+{
+    mp4d_demuxer_ptr_t p_dmux = p_nav->p_data;
+    mp4d_error_t err;
+
+    err = mp4d_parse_box(atom, p_nav);
+    if (err) return err;
+
+    /* The traf index is only used when it covers all of the moof */
+    p_dmux->curr.moof.complete = 1;
+
+    return 0;
+}
+
+static int
+mp4d_parse_traf
+    (mp4d_atom_t atom
+    ,mp4d_navigator_ptr_t p_nav
+    )
+{
+    mp4d_demuxer_ptr_t p_dmux = p_nav->p_data;
+    mp4d_error_t err;
+
+    err = mp4d_moof_add_traf(&p_dmux->curr.moof, &atom);
+    if (err) return err;
+
+    return mp4d_parse_box(atom, p_nav);
+}
+
 static int
 mp4d_parse_tfra
     (mp4d_atom_t atom
@@ -1203,9 +1259,9 @@ static const mp4d_callback_t k_main_dispatcher_list[] =
     {"mvex", &mp4d_parse_box},
     {"mehd", &mp4d_parse_mehd},
 
-    {"moof", &mp4d_parse_box},
+    {"moof", &mp4d_parse_moof},
     {"mfhd", &mp4d_parse_mfhd},
-    {"traf", &mp4d_parse_box},
+    {"traf", &mp4d_parse_traf},
 
     /* metadata */
     {"udta", &mp4d_parse_udta},
@@ -2125,6 +2181,316 @@ mp4d_demuxer_get_id3v2_tag
 }
 
 
+/**************************************************
+    Push Interface
+**************************************************/
+
+static int
+pusher_is_streamed_box(const mp4d_pusher_ptr_t p_push)
+{
+    if (MP4D_FOURCC_EQ(p_push->box_type, "mdat") ||
+        MP4D_FOURCC_EQ(p_push->box_type, "free") ||
+        MP4D_FOURCC_EQ(p_push->box_type, "skip"))
+    {
+        return 1;
+    }
+    if (MP4D_FOURCC_EQ(p_push->box_type, "moov") ||
+        MP4D_FOURCC_EQ(p_push->box_type, "moof"))
+    {
+        return 0;
+    }
+    /* Pass through other boxes which do not fit into the buffer */
+    return p_push->box_size == 0 || p_push->box_size > p_push->buf_size;
+}
+
+/* Complete header in p_push->header: read box size and type */
+static int
+pusher_read_header(mp4d_pusher_ptr_t p_push)
+{
+    mp4d_buffer_t p = {p_push->header, p_push->header_fill, p_push->header};
+    uint32_t size32;
+
+    size32 = mp4d_read_u32(&p);
+    mp4d_read_fourcc(&p, p_push->box_type);
+    p_push->box_size = (size32 == 1) ? mp4d_read_u64(&p) : size32;
+
+    ASSURE( p_push->box_size == 0 || p_push->box_size >= p_push->header_size, MP4D_E_INVALID_ATOM,
+            ("Box size %" PRIu64 " smaller than its header", p_push->box_size) );
+
+    return MP4D_NO_ERROR;
+}
+
+/* Initialize the demuxer with a complete box and prepare the event */
+static int
+pusher_emit_box
+    (mp4d_pusher_ptr_t    p_push
+    ,const unsigned char *p_box
+    ,uint64_t             size
+    ,int                  is_eof
+    ,mp4d_push_event_t   *p_event
+    )
+{
+    uint64_t box_size;
+
+    CHECK( mp4d_demuxer_parse(p_push->p_dmux, p_box, size, is_eof, p_push->box_offset, &box_size) );
+
+    p_event->type = MP4D_PUSH_BOX;
+    MP4D_FOURCC_ASSIGN(p_event->box_type, p_push->box_type);
+    p_event->offset = p_push->box_offset;
+    p_event->size = size;
+    p_event->header_size = p_push->header_size;
+    p_event->p_data = p_box;
+
+    p_push->state = MP4D_PUSH_STATE_HEADER;
+    p_push->header_fill = 0;
+
+    return MP4D_NO_ERROR;
+}
+
+int
+mp4d_pusher_push
+    (mp4d_pusher_ptr_t    p_push
+    ,const unsigned char *p_chunk
+    ,uint64_t             size
+    ,int                  is_eof
+    ,uint64_t            *p_consumed
+    ,mp4d_push_event_t   *p_event
+    )
+{
+    uint64_t pos = 0;
+    uint64_t header_start = (uint64_t) -1;  /* Chunk position of a header collected in this call */
+    int err = MP4D_NO_ERROR;
+
+    ASSURE( p_push != NULL && p_consumed != NULL && p_event != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_chunk != NULL || size == 0, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    mp4d_memset(p_event, 0, sizeof(*p_event));
+
+    while (err == MP4D_NO_ERROR && p_event->type == MP4D_PUSH_NONE)
+    {
+        uint64_t n;
+
+        if (p_push->state == MP4D_PUSH_STATE_HEADER)
+        {
+            if (pos == size)
+            {
+                if (is_eof && p_push->header_fill != 0)
+                {
+                    err = MP4D_E_INVALID_ATOM;
+                }
+                break;
+            }
+            if (p_push->header_fill == 0)
+            {
+                p_push->box_offset = p_push->offset;
+                p_push->header_size = 8;
+                header_start = pos;
+            }
+
+            n = p_push->header_size - p_push->header_fill;
+            if (n > size - pos)
+            {
+                n = size - pos;
+            }
+            mp4d_memcpy(p_push->header + p_push->header_fill, p_chunk + pos, (size_t) n);
+            p_push->header_fill += (uint32_t) n;
+            pos += n;
+            p_push->offset += n;
+
+            if (p_push->header_fill == 8)
+            {
+                /* size and type are known, now extend to largesize and usertype */
+                if (p_push->header[0] == 0 && p_push->header[1] == 0 &&
+                    p_push->header[2] == 0 && p_push->header[3] == 1)
+                {
+                    p_push->header_size += 8;
+                }
+                if (mp4d_memcmp(p_push->header + 4, "uuid", 4) == 0)
+                {
+                    p_push->header_size += 16;
+                }
+            }
+            if (p_push->header_fill < p_push->header_size)
+            {
+                continue;
+            }
+
+            err = pusher_read_header(p_push);
+            if (err)
+            {
+                break;
+            }
+
+            if (pusher_is_streamed_box(p_push))
+            {
+                uint64_t box_size;
+
+                /* Makes the box header available through mp4d_demuxer_get_type()/_get_atom().
+                   The payload follows in data events, so the demuxer does not see all of it. */
+                err = mp4d_demuxer_parse(p_push->p_dmux, p_push->header, p_push->header_size, 0,
+                                         p_push->box_offset, &box_size);
+                if (err == MP4D_E_BUFFER_TOO_SMALL)
+                {
+                    err = MP4D_NO_ERROR;
+                }
+                if (err)
+                {
+                    break;
+                }
+
+                p_event->type = MP4D_PUSH_BOX;
+                MP4D_FOURCC_ASSIGN(p_event->box_type, p_push->box_type);
+                p_event->offset = p_push->box_offset;
+                p_event->size = p_push->box_size;
+                p_event->header_size = p_push->header_size;
+                p_event->is_streamed = 1;
+                p_event->p_data = p_push->header;
+
+                p_push->header_fill = 0;
+                p_push->remaining = p_push->box_size ? p_push->box_size - p_push->header_size : (uint64_t) -1;
+                p_push->state = p_push->remaining ? MP4D_PUSH_STATE_STREAM : MP4D_PUSH_STATE_HEADER;
+            }
+            else if (p_push->box_size > p_push->buf_size)
+            {
+                err = MP4D_E_BUFFER_TOO_SMALL;
+            }
+            else if (header_start != (uint64_t) -1 && p_push->box_size != 0 &&
+                     size - header_start >= p_push->box_size)
+            {
+                /* Complete box in the chunk, parse in place */
+                pos = header_start + p_push->box_size;
+                p_push->offset = p_push->box_offset + p_push->box_size;
+                err = pusher_emit_box(p_push, p_chunk + header_start, p_push->box_size, is_eof && pos == size, p_event);
+            }
+            else
+            {
+                mp4d_memcpy(p_push->p_buf, p_push->header, p_push->header_size);
+                p_push->buf_fill = p_push->header_size;
+                p_push->state = MP4D_PUSH_STATE_BUFFER;
+            }
+        }
+        else if (p_push->state == MP4D_PUSH_STATE_BUFFER)
+        {
+            uint64_t box_size = p_push->box_size ? p_push->box_size : p_push->buf_size;
+
+            n = box_size - p_push->buf_fill;
+            if (n > size - pos)
+            {
+                n = size - pos;
+            }
+            mp4d_memcpy(p_push->p_buf + p_push->buf_fill, p_chunk + pos, (size_t) n);
+            p_push->buf_fill += n;
+            pos += n;
+            p_push->offset += n;
+
+            if (p_push->box_size == 0)
+            {
+                /* Box extends to the end of the file */
+                if (is_eof && pos == size)
+                {
+                    err = pusher_emit_box(p_push, p_push->p_buf, p_push->buf_fill, 1, p_event);
+                }
+                else if (p_push->buf_fill == p_push->buf_size)
+                {
+                    err = MP4D_E_BUFFER_TOO_SMALL;
+                }
+                else
+                {
+                    break;
+                }
+            }
+            else if (p_push->buf_fill == p_push->box_size)
+            {
+                err = pusher_emit_box(p_push, p_push->p_buf, p_push->buf_fill, is_eof && pos == size, p_event);
+            }
+            else
+            {
+                if (is_eof && pos == size)
+                {
+                    /* Box truncated by the end of the file */
+                    err = MP4D_E_INVALID_ATOM;
+                }
+                break;
+            }
+        }
+        else
+        {
+            if (pos == size)
+            {
+                if (is_eof && p_push->box_size != 0)
+                {
+                    /* Streamed box truncated by the end of the file */
+                    err = MP4D_E_INVALID_ATOM;
+                }
+                break;
+            }
+            n = p_push->remaining;
+            if (n > size - pos)
+            {
+                n = size - pos;
+            }
+            p_event->type = MP4D_PUSH_DATA;
+            MP4D_FOURCC_ASSIGN(p_event->box_type, p_push->box_type);
+            p_event->offset = p_push->offset;
+            p_event->size = n;
+            p_event->p_data = p_chunk + pos;
+
+            pos += n;
+            p_push->offset += n;
+            if (p_push->box_size != 0)
+            {
+                p_push->remaining -= n;
+                if (p_push->remaining == 0)
+                {
+                    p_push->state = MP4D_PUSH_STATE_HEADER;
+                }
+            }
+        }
+    }
+
+    *p_consumed = pos;
+
+    return err;
+}
+
+int
+mp4d_pusher_query_mem
+    (uint64_t  max_box_size
+    ,uint64_t *p_static_mem_size
+    )
+{
+    ASSURE( p_static_mem_size != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    *p_static_mem_size = sizeof(struct mp4d_pusher_t_) + max_box_size;
+
+    return MP4D_NO_ERROR;
+}
+
+int
+mp4d_pusher_init
+    (mp4d_pusher_ptr_t  *p_pusher_ptr
+    ,mp4d_demuxer_ptr_t  p_dmux
+    ,uint64_t            max_box_size
+    ,void               *static_mem
+    )
+{
+    mp4d_pusher_ptr_t p_push;
+
+    ASSURE( p_pusher_ptr != NULL && p_dmux != NULL && static_mem != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    p_push = (mp4d_pusher_ptr_t) static_mem;
+    mp4d_memset(p_push, 0, sizeof(struct mp4d_pusher_t_));
+
+    p_push->p_dmux = p_dmux;
+    p_push->state = MP4D_PUSH_STATE_HEADER;
+    p_push->p_buf = (unsigned char *) (p_push + 1);
+    p_push->buf_size = max_box_size;
+
+    *p_pusher_ptr = p_push;
+    return MP4D_NO_ERROR;
+}
+
+
 /**************************************************
     Demuxer Initialization
 **************************************************/
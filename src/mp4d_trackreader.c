@@ -31,6 +31,12 @@
 #include <stddef.h>
 #include <assert.h>
 
+#define TRUN_BATCH_SIZE 16  /* trun entries decoded at a time */
+
+#if !MP4D_TRACKREADER_MOOV && !MP4D_TRACKREADER_MOOF
+#error "The trackreader needs MP4D_TRACKREADER_MOOV or MP4D_TRACKREADER_MOOF"
+#endif
+
 struct mp4d_trackreader_t_
 {
     uint32_t track_ID;                            /* 0 until initialized */
@@ -43,6 +49,7 @@ struct mp4d_trackreader_t_
 
     struct
     {
+#if MP4D_TRACKREADER_MOOV
         /* Sample position */
         stsc_reader_t stsc;
         co_reader_t co;    /* stco XOR co64 */
@@ -54,12 +61,15 @@ struct mp4d_trackreader_t_
         /* DTS, CTS */
         tts_reader_t stts;
         tts_reader_t ctts;
+#endif
 
-        /* Sample size */
+        /* Sample size, also the sample count without MP4D_TRACKREADER_MOOV */
         stsz_reader_t stz;  /* stsz XOR stz2 */
         
+#if MP4D_TRACKREADER_MOOV
         /* Sample sync */
         stss_reader_t stss;
+#endif
         
         /* Sample flags, also used for moof */
         sdtp_reader_t sdtp;
@@ -70,30 +80,29 @@ struct mp4d_trackreader_t_
     /* Edit list */
     elst_reader_t elst;
 
-    /* The elst atom has to be stored in the trackreader object because the client may not keep the
-     * moov buffer in memory when the elst atom is needed (at any later time, when reading a moof) */
-    struct
-    {
-        uint32_t version_and_flags;
-        uint32_t entry_count;
-        struct
-        {
-            uint64_t segment_duration;  /* reserve for worst case: version = 1 */
-            int64_t media_time;
-            int16_t media_rate_integer;
-            int16_t media_rate_fraction;
-        } entries[MP4D_MAX_EDITS];
-    } elst_atom;  /* The members of this struct are not used,
-                     except to reserve a block of memory of the right size */
+    /* The segments of the edit list have to be stored in the trackreader object because the client may not keep the
+     * moov buffer in memory when they are needed (at any later time, when reading a moof).
+     * Longer edit lists use the memory given to mp4d_trackreader_set_edit_mem() */
+    elst_entry_t elst_table[MP4D_MAX_EDITS];
+    elst_entry_t *p_edit_mem;    /* or NULL */
+    uint32_t max_edits;          /* entries of p_edit_mem */
+    uint32_t num_edits;          /* entries of the elst box of the moov */
 
     /* Sub-sample info */
     subs_reader_t subs;
 
+#if MP4D_TRACKREADER_CENC
     /* Sample aux info */
     saiz_reader_t saiz[MP4D_MAX_AUXDATA];
     saio_reader_t saio[MP4D_MAX_AUXDATA];
     uint8_t num_saiz, num_saio;
     uint64_t cur_aux_pos[MP4D_MAX_AUXDATA];
+    struct
+    {
+        uint64_t pos;
+        uint64_t size;
+        int valid;         /* (boolean) the aux info of the traf is contiguous */
+    } aux_range[MP4D_MAX_AUXDATA];  /* per saio, see mp4d_trackreader_get_aux_range() */
 
     /* Data required to decode piff 'senc' box */
     struct 
@@ -112,9 +121,19 @@ struct mp4d_trackreader_t_
         uint32_t override_algorithmID;
         uint8_t override_iv_size;
         uint8_t override_kid[16];
-       
+
+        /* Effective data of the fragment (override or default), see piff_senc_resolve() */
+        uint32_t algorithmID;
+        uint8_t iv_size;
+        uint8_t kid[16];
+        int fixed_entry_size;  /* (boolean) no subsample map, each entry is iv_size bytes */
+
     } piff_senc_reader;
+#else
+    int have_encryption;  /* (boolean) the segment has sample encryption boxes, which cannot be read */
+#endif
 
+#if MP4D_TRACKREADER_MOOF
     int have_trex;   /* boolean */
     struct 
     {
@@ -124,16 +143,21 @@ struct mp4d_trackreader_t_
         uint32_t default_sample_flags;
     } trex;
 
-    /* Data describing the current moof/trun. Does not change during sample iteration */
+    /* The traf of the current moof with matching track_ID, found once per moof */
     struct
     {
-        int num_traf;  /* Number of traf with matching track_ID,
-                          Need > 0, > 1 is unsupported */
-        uint32_t traf_number;  /* Number of non-matching (considering track_ID)
+        mp4d_atom_t atom;      /* The first matching traf */
+        uint32_t count;        /* Number of traf with matching track_ID,
+                                  Need > 0, > 1 is unsupported */
+        uint32_t preceding;    /* Number of non-matching (considering track_ID)
                                   traf boxes before the first matching
                                   traf box in moof. This is needed for the
                                   case when base_data_offset is not present. */
+    } traf;
 
+    /* Data describing the current moof/trun. Does not change during sample iteration */
+    struct
+    {
         int have_tfdt; /* boolean */
         uint64_t tfdt_baseMediaDecodeTime;
 
@@ -162,8 +186,10 @@ struct mp4d_trackreader_t_
         /*trick box info*/
         trik_reader_t trik;
 
+#if MP4D_TRACKREADER_CENC
         /*senc box info*/
         senc_reader_t senc;        
+#endif
     } moof;
 
     /* state variables used by moof_next_sample */
@@ -173,7 +199,31 @@ struct mp4d_trackreader_t_
         mp4d_buffer_t current_trun_sample;
         uint64_t cur_data_offset;
         uint32_t samples_left; /* in current trun */
+
+        /* Entries of the current trun, decoded ahead in batches by a decoder
+           for its tr_flags; not used if the trun is short, or lacks defaults */
+        int use_decoder;     /* boolean */
+        trun_decoder_t decoder;
+        trun_entry_t entries[TRUN_BATCH_SIZE];  /* from current_trun_sample */
+        uint32_t num_entries;
+        uint32_t next_entry;
+        int have_flag_boxes; /* boolean: sdtp, padb or stdp */
     } moof_iter;
+#endif
+
+    /* state variables used by mp4d_trackreader_prev_gop */
+    struct gop_state_t_
+    {
+        uint64_t start;        /* First sample of the last returned GOP, (uint64_t) -1 before the first call */
+        uint32_t stss_index;   /* moov: number of stss entries before 'start' */
+
+        /* Copies of the track reader at samples before 'start', in the memory given to
+           mp4d_trackreader_init() or mp4d_trackreader_set_gop_mem(); a stack in the order
+           of the samples, the last slot is kept for a copy at the GOP start to return */
+        struct mp4d_trackreader_t_ *p_checkpoints;  /* or NULL */
+        uint32_t max_checkpoints;
+        uint32_t num_checkpoints;
+    } gop;
 
     /* State which is retained between fragments */
     uint64_t cur_dts;  /* DTS since beginning of movie */
@@ -182,7 +232,9 @@ struct mp4d_trackreader_t_
 /**************************************************
     Constants
 **************************************************/
+#if MP4D_TRACKREADER_CENC
 static const uint32_t CENC = 1667591779;
+#endif
 
 /**************************************************
     Track reader callbacks
@@ -242,35 +294,32 @@ tr_parse_elst
 {
     mp4d_trackreader_ptr_t p_tr = p_nav->p_data;
 
-    if (p_tr->elst.buffer.p_data != NULL)
+    if (p_tr->elst.p_entries != NULL)
     {
         warning(("Multiple elst boxes found, using the last one\n"));
     }
 
-    if (atom.size <= (uint64_t) sizeof(p_tr->elst_atom))
-    {
-        mp4d_atom_t tmp;
-
-        memcpy(&p_tr->elst_atom, atom.p_data, (size_t) atom.size);
-
-        /* The elst reader needs an atom (with only .size and .p_data) as input */
-        tmp.p_data = (unsigned char *)&p_tr->elst_atom;
-        tmp.size = atom.size;
+    /* init_segment() fails if the table is too small */
+    CHECK( mp4d_elst_get_entry_count(&atom, &p_tr->num_edits) );
 
+    if (p_tr->num_edits > MP4D_MAX_EDITS && p_tr->p_edit_mem != NULL)
+    {
         return mp4d_elst_init(&p_tr->elst,
-                &tmp,
+                &atom,
+                p_tr->p_edit_mem,
+                p_tr->max_edits,
                 p_tr->media_time_scale,
                 p_tr->movie_time_scale
         );
     }
-    else
-    {
-        ASSURE( 0, MP4D_E_UNSUPPRTED_FORMAT,
-                ("Sorry, supports elst box of size <= %" PRIz " bytes (%d entries), found elst box of size %" PRIu64 " bytes",
-                        sizeof(p_tr->elst_atom),
-                        MP4D_MAX_EDITS,
-                        atom.size) );
-    }
+
+    return mp4d_elst_init(&p_tr->elst,
+            &atom,
+            p_tr->elst_table,
+            MP4D_MAX_EDITS,
+            p_tr->media_time_scale,
+            p_tr->movie_time_scale
+    );
 }
 
 static int
@@ -289,6 +338,7 @@ tr_parse_subs
                           &atom);
 }
 
+#if MP4D_TRACKREADER_CENC
 static int
 tr_parse_saiz
     (mp4d_atom_t atom
@@ -333,6 +383,40 @@ tr_parse_saio
                           &atom);
 }
 
+/** @brief resolve the effective PIFF 'senc' encryption data of the fragment
+
+    Called when the 'senc' box or the default ('tenc') data is set, so that
+    the per sample code needs neither the override flag nor the defaults.
+ */
+static void
+piff_senc_resolve(mp4d_trackreader_ptr_t p_tr)
+{
+    if (p_tr->piff_senc_reader.flags & 0x01)
+    {
+        p_tr->piff_senc_reader.algorithmID = p_tr->piff_senc_reader.override_algorithmID;
+        p_tr->piff_senc_reader.iv_size = p_tr->piff_senc_reader.override_iv_size;
+        memcpy(p_tr->piff_senc_reader.kid, p_tr->piff_senc_reader.override_kid, 16);
+    }
+    else
+    {
+        p_tr->piff_senc_reader.algorithmID = p_tr->piff_senc_reader.default_algorithmID;
+        p_tr->piff_senc_reader.iv_size = p_tr->piff_senc_reader.default_iv_size;
+        memcpy(p_tr->piff_senc_reader.kid, p_tr->piff_senc_reader.default_kid, 16);
+    }
+    p_tr->piff_senc_reader.fixed_entry_size = !(p_tr->piff_senc_reader.flags & 0x02);
+}
+
+/** @brief forget the PIFF 'senc' box of the previous fragment, keep the defaults */
+static void
+piff_senc_reset(mp4d_trackreader_ptr_t p_tr)
+{
+    mp4d_memset(&p_tr->piff_senc_reader.buffer, 0, sizeof(p_tr->piff_senc_reader.buffer));
+    p_tr->piff_senc_reader.version = 0;
+    p_tr->piff_senc_reader.flags = 0;
+    p_tr->piff_senc_reader.sampleCount = 0;
+    piff_senc_resolve(p_tr);
+}
+
 static int
 tr_parse_piff_senc
     (mp4d_atom_t atom
@@ -343,6 +427,13 @@ tr_parse_piff_senc
 
     /* Read the header of this UUID piff */
     mp4d_buffer_t* pBuffer = 0;
+
+    if (p_tr->piff_senc_reader.buffer.p_begin != NULL)
+    {
+        /* Parsed for the first trun of the traf: keep the position of the next sample */
+        return MP4D_NO_ERROR;
+    }
+
     p_tr->piff_senc_reader.buffer = mp4d_atom_to_buffer(&atom);
     pBuffer = &p_tr->piff_senc_reader.buffer;
     {
@@ -366,9 +457,32 @@ tr_parse_piff_senc
     /* Flag this as the beginning of the per sample data */
     p_tr->piff_senc_reader.buffer.p_begin = p_tr->piff_senc_reader.buffer.p_data;
 
+    piff_senc_resolve(p_tr);
+
     return mp4d_is_buffer_error(pBuffer) ? MP4D_E_INVALID_ATOM : MP4D_NO_ERROR;
 }
+#else
+/** @brief callback for the sample encryption boxes, which are not compiled in */
+static int
+tr_parse_not_compiled
+    (mp4d_atom_t atom
+    ,mp4d_navigator_ptr_t p_nav
+    )
+{
+    mp4d_trackreader_ptr_t p_tr = p_nav->p_data;
+
+    (void) atom;  /* without debug output */
+
+    /* The navigator ignores errors of the callbacks, init_segment() fails instead */
+    p_tr->have_encryption = 1;
+    ASSURE( 0, MP4D_E_UNSUPPRTED_FORMAT,
+            ("Cannot read %c%c%c%c box, trackreader built without MP4D_TRACKREADER_CENC",
+             atom.type[0], atom.type[1], atom.type[2], atom.type[3]) );
+    return MP4D_E_UNSUPPRTED_FORMAT;
+}
+#endif
 
+#if MP4D_TRACKREADER_MOOV
 static int
 tr_parse_stsc
     (mp4d_atom_t atom
@@ -433,6 +547,7 @@ tr_parse_ctts
     
     return mp4d_tts_init(&p_tr->moov.ctts, &atom, delta_encoded);
 }
+#endif
 
 static int
 tr_parse_stz
@@ -451,7 +566,7 @@ tr_parse_stz
     return mp4d_stsz_init(&p_tr->moov.stz, &atom, is_stz2);
 }
 
-
+#if MP4D_TRACKREADER_MOOV
 static int
 tr_parse_stss
     (mp4d_atom_t atom
@@ -467,6 +582,23 @@ tr_parse_stss
 
     return mp4d_stss_init(&p_tr->moov.stss, &atom);
 }
+#endif
+
+/** @brief number of samples of the moov, or of the current trun of the moof */
+static uint32_t
+segment_sample_count(mp4d_trackreader_ptr_t p_tr,
+                     int is_moov)
+{
+#if MP4D_TRACKREADER_MOOF
+    if (!is_moov)
+    {
+        return p_tr->moof.trun.sample_count;
+    }
+#else
+    (void) is_moov;
+#endif
+    return p_tr->moov.stz.sample_count;
+}
 
 static int
 tr_parse_sdtp
@@ -490,7 +622,7 @@ tr_parse_sdtp
 
     return mp4d_sdtp_init(&p_tr->moov.sdtp, 
                           &atom,
-                          is_moov ? p_tr->moov.stz.sample_count : p_tr->moof.trun.sample_count);
+                          segment_sample_count(p_tr, is_moov));
 }
 
 static int
@@ -500,6 +632,7 @@ tr_parse_sdtp_moov
 {
     return tr_parse_sdtp(atom, p_nav, 1);
 }
+#if MP4D_TRACKREADER_MOOF
 static int
 tr_parse_sdtp_moof
     (mp4d_atom_t atom
@@ -507,6 +640,7 @@ tr_parse_sdtp_moof
 {
     return tr_parse_sdtp(atom, p_nav, 0);
 }
+#endif
 
 static int
 tr_parse_stdp
@@ -527,9 +661,10 @@ tr_parse_stdp
 
     return mp4d_stdp_init(&p_tr->moov.stdp, 
                           &atom,
-                          is_moov ? p_tr->moov.stz.sample_count : p_tr->moof.trun.sample_count);
+                          segment_sample_count(p_tr, is_moov));
 }
 
+#if MP4D_TRACKREADER_MOOF
 static int
 tr_parse_trik
     (mp4d_atom_t atom
@@ -546,6 +681,7 @@ tr_parse_trik
     return mp4d_trik_init(&p_tr->moof.trik, &atom, p_tr->moof.trun.sample_count);
 }
 
+#if MP4D_TRACKREADER_CENC
 static int
 tr_parse_senc
     (mp4d_atom_t atom
@@ -561,6 +697,8 @@ tr_parse_senc
 
     return mp4d_senc_init(&p_tr->moof.senc, &atom);
 }
+#endif
+#endif
 
 static int
 tr_parse_stdp_moov
@@ -570,6 +708,7 @@ tr_parse_stdp_moov
 {
     return tr_parse_stdp(atom, p_nav, 1);
 }
+#if MP4D_TRACKREADER_MOOF
 static int
 tr_parse_stdp_moof
     (mp4d_atom_t atom
@@ -578,6 +717,7 @@ tr_parse_stdp_moof
 {
     return tr_parse_stdp(atom, p_nav, 0);
 }
+#endif
 
 static int
 tr_parse_padb(
@@ -594,6 +734,7 @@ tr_parse_padb(
     return mp4d_padb_init(&p_tr->moov.padb, &atom);
 }
 
+#if MP4D_TRACKREADER_MOOF
 /**
    @return MP4D_E_INFO_NOT_AVAIL if the track_ID does not match the requested track_ID
  */
@@ -618,17 +759,10 @@ tr_parse_tfhd
     
     if (track_ID != p_tr->track_ID)
     {
-        /* Count non-matches before first match */
-        if (p_tr->moof.num_traf == 0)
-        {
-            p_tr->moof.traf_number++;
-        }
-
         return MP4D_E_INFO_NOT_AVAIL;
     }
     else  /* matches track_ID */
     {
-        p_tr->moof.num_traf++;
         p_tr->moof.num_trun = 0;
         p_tr->moof.tfhd.tf_flags = tf_flags;
 
@@ -680,11 +814,6 @@ tr_parse_traf
 
         if (err == MP4D_E_INFO_NOT_AVAIL)
         {
-            /* Count non-matches before first match */
-            if (p_tr->moof.num_traf == 0)
-            {
-                p_tr->moof.traf_number++;
-            }
             return MP4D_NO_ERROR;
         }
         else if (err != MP4D_NO_ERROR)
@@ -789,6 +918,7 @@ tr_parse_trex
 
     return MP4D_NO_ERROR;
 }
+#endif
 
 
 static const mp4d_callback_t k_dispatcher_track_reader[] = 
@@ -801,30 +931,41 @@ static const mp4d_callback_t k_dispatcher_track_reader[] =
     {"minf", &mp4d_parse_box},
     {"stbl", &mp4d_parse_box},
 
+#if MP4D_TRACKREADER_MOOV
     {"stsc", &tr_parse_stsc},
     {"stco", &tr_parse_co},
     {"co64", &tr_parse_co},
 
     {"stts", &tr_parse_stts},
     {"ctts", &tr_parse_ctts},
+#endif
 
     {"stsz", &tr_parse_stz},
     {"stz2", &tr_parse_stz},
 
+#if MP4D_TRACKREADER_MOOV
     {"stss", &tr_parse_stss},
+#endif
 
     {"subs", &tr_parse_subs},
+#if MP4D_TRACKREADER_CENC
     {"saiz", &tr_parse_saiz},
     {"saio", &tr_parse_saio},
+#else
+    {"saiz", &tr_parse_not_compiled},
+    {"saio", &tr_parse_not_compiled},
+#endif
 
     /* sample flags */
     {"sdtp", &tr_parse_sdtp_moov},
     {"stdp", &tr_parse_stdp_moov},
     {"padb", &tr_parse_padb},
 
+#if MP4D_TRACKREADER_MOOF
     /* defaults for moof */ 
     {"mvex", &mp4d_parse_box},
     {"trex", &tr_parse_trex},
+#endif
 
     {"dumy", NULL}  /* sentinel */
 };
@@ -832,33 +973,48 @@ static const mp4d_callback_t k_dispatcher_track_reader[] =
 static const mp4d_callback_t k_uuid_dispatcher_track_reader[] = 
 {  
     /* sample encryption */
+#if MP4D_TRACKREADER_CENC
     {"\xA2\x39\x4F\x52\x5A\x9B\x4f\x14\xA2\x44\x6C\x42\x7C\x64\x8D\xF4", &tr_parse_piff_senc}, /* Microsoft 'senc'*/
+#else
+    {"\xA2\x39\x4F\x52\x5A\x9B\x4f\x14\xA2\x44\x6C\x42\x7C\x64\x8D\xF4", &tr_parse_not_compiled},
+#endif
     
     /* sentinel */
     {"dumy", NULL}
     
 };
 
+#if MP4D_TRACKREADER_MOOF
 static const mp4d_callback_t k_dispatcher_moof_reader[] =
 {
-    {"moof", &mp4d_parse_box},
     {"traf", &tr_parse_traf},
     {"tfdt", &tr_parse_tfdt},
     {"trun", &tr_parse_trun},
     {"subs", &tr_parse_subs},
+#if MP4D_TRACKREADER_CENC
     {"saiz", &tr_parse_saiz},
     {"saio", &tr_parse_saio},
+#else
+    {"saiz", &tr_parse_not_compiled},
+    {"saio", &tr_parse_not_compiled},
+#endif
 
     /* sample flags */
     {"sdtp", &tr_parse_sdtp_moof},
     {"stdp", &tr_parse_stdp_moof},
     {"padb", &tr_parse_padb},
     {"trik", &tr_parse_trik},
+#if MP4D_TRACKREADER_CENC
     {"senc", &tr_parse_senc},
+#else
+    {"senc", &tr_parse_not_compiled},
+#endif
 
     {"dumy", NULL}
 };
+#endif
 
+#if MP4D_TRACKREADER_MOOF
 /**
    Updates tfhd data incl. tf_flags with trex info not already available in tfhd
  */
@@ -893,6 +1049,7 @@ update_tfhd_with_trex(mp4d_trackreader_ptr_t p_tr)
     return MP4D_NO_ERROR;
 }
 
+#if MP4D_TRACKREADER_CENC
 /** @brief set the current sample aux offset, at the beginning of each trun
  *    
  *  This depends on the base_data_offset for the current traf.
@@ -919,8 +1076,174 @@ moof_set_aux_offset(mp4d_trackreader_ptr_t p_tr)
 }
 
 
+/** @brief resolve the byte range of the sample aux info of the traf, per saio
+
+    The aux info of all samples of the traf is contiguous if saio has one
+    offset (not one per trun), and its size is the sum of the saiz sizes.
+    Call at the beginning of the traf, before moof_set_aux_offset().
+ */
+static mp4d_error_t
+moof_set_aux_range(mp4d_trackreader_ptr_t p_tr)
+{
+    uint8_t i, j;
+
+    for (j = 0; j < p_tr->num_saio; j++)
+    {
+        p_tr->aux_range[j].valid = 0;
+        if (p_tr->saio[j].entries_left != 1)
+        {
+            continue;
+        }
+        for (i = 0; i < p_tr->num_saiz; i++)
+        {
+            if (p_tr->saiz[i].aux_info_type == p_tr->saio[j].aux_info_type)
+            {
+                saio_reader_t saio = p_tr->saio[j];
+                saiz_reader_t saiz = p_tr->saiz[i];
+                uint64_t offset;
+
+                CHECK( mp4d_saio_get_next(&saio, 0, &offset) );
+                CHECK( mp4d_saiz_skip(&saiz, saiz.samples_left, &p_tr->aux_range[j].size) );
+                p_tr->aux_range[j].pos = offset + p_tr->moof.tfhd.base_data_offset;
+                p_tr->aux_range[j].valid = 1;
+                break;
+            }
+        }
+    }
+
+    return MP4D_NO_ERROR;
+}
+#endif
+
+/** @brief Select the decoder of the entries of the current trun
+
+    The decoder is only used if every field of every sample is available,
+    from the trun entries or the defaults. Otherwise moof_next_sample()
+    reads the entries one by one and reports what is missing.
+ */
+static mp4d_error_t
+moof_init_decoder(mp4d_trackreader_ptr_t p_tr)
+{
+    uint32_t tr_flags = p_tr->moof.trun.tr_flags;
+    uint32_t tf_flags = p_tr->moof.tfhd.tf_flags;
+    trun_entry_t defaults;
+
+    p_tr->moof_iter.use_decoder = 0;
+    p_tr->moof_iter.num_entries = 0;
+    p_tr->moof_iter.next_entry = 0;
+    p_tr->moof_iter.have_flag_boxes = (p_tr->moov.sdtp.buffer.p_data != NULL ||
+                                       p_tr->moov.padb.buffer.p_data != NULL ||
+                                       p_tr->moov.stdp.buffer.p_data != NULL);
+
+    if ((!(tr_flags & 0x000100) && !(tf_flags & 0x000008)) ||
+        (!(tr_flags & 0x000200) && !(tf_flags & 0x000010)) ||
+        (!(tr_flags & 0x000400) && !(tf_flags & 0x000020) && p_tr->have_trex))
+    {
+        return MP4D_NO_ERROR;
+    }
+
+    defaults.duration = p_tr->moof.tfhd.default_sample_duration;
+    defaults.size = p_tr->moof.tfhd.default_sample_size;
+    defaults.flags = p_tr->moof.tfhd.default_sample_flags;
+    defaults.composition_offset = 0;
+    CHECK( mp4d_trun_decoder_init(&p_tr->moof_iter.decoder,
+                                  p_tr->moof.trun.version,
+                                  tr_flags,
+                                  &defaults) );
+
+    if (p_tr->moof_iter.current_trun_sample.size != (uint64_t) -1 &&
+        p_tr->moof_iter.current_trun_sample.size >=
+            (uint64_t) p_tr->moof.trun.sample_count * p_tr->moof_iter.decoder.entry_size)
+    {
+        p_tr->moof_iter.use_decoder = 1;
+    }
+
+    return MP4D_NO_ERROR;
+}
+
+/** @brief Decode the next batch of entries of the current trun
+ */
+static mp4d_error_t
+moof_decode_entries(mp4d_trackreader_ptr_t p_tr)
+{
+    uint32_t count = p_tr->moof_iter.samples_left;
+
+    if (count > TRUN_BATCH_SIZE)
+    {
+        count = TRUN_BATCH_SIZE;
+    }
+    CHECK( mp4d_trun_decode(&p_tr->moof_iter.decoder,
+                            &p_tr->moof_iter.current_trun_sample,
+                            p_tr->moof_iter.entries,
+                            count) );
+
+    if (p_tr->moof_iter.samples_left == p_tr->moof.trun.sample_count &&
+        (p_tr->moof.trun.tr_flags & (0x000004 | 0x000400)) == 0x000004)
+    {
+        p_tr->moof_iter.entries[0].flags = p_tr->moof.trun.first_sample_flags;
+    }
+    p_tr->moof_iter.num_entries = count;
+    p_tr->moof_iter.next_entry = 0;
+
+    return MP4D_NO_ERROR;
+}
+
+/** @brief Finds the traf with matching track_ID in the moof
+
+    Uses the traf index of the demuxer, if it has parsed this moof.
+    Otherwise reads the tfhd of each traf in the moof (but no other boxes).
+ */
+static mp4d_error_t
+find_traf(mp4d_trackreader_ptr_t p_tr,
+          const struct mp4d_demuxer_t_ *p_demuxer)
+{
+    mp4d_buffer_t p;
+    mp4d_atom_t child;
+
+    if (p_demuxer != NULL &&
+        MP4D_FOURCC_EQ(p_demuxer->atom.type, "moof") &&
+        p_demuxer->atom.p_data == p_tr->atom.p_data &&
+        mp4d_moof_find_traf(&p_demuxer->curr.moof,
+                            p_tr->track_ID,
+                            &p_tr->traf.atom,
+                            &p_tr->traf.count,
+                            &p_tr->traf.preceding) == MP4D_NO_ERROR)
+    {
+        return MP4D_NO_ERROR;
+    }
+
+    p_tr->traf.count = 0;
+    p_tr->traf.preceding = 0;
+    p = mp4d_atom_to_buffer(&p_tr->atom);
+    while (mp4d_bytes_left(&p))
+    {
+        uint32_t track_ID;
+
+        CHECK( mp4d_next_atom(&p, NULL, &child) );
+        if (!MP4D_FOURCC_EQ(child.type, "traf") ||
+            mp4d_traf_get_track_ID(&child, &track_ID) != MP4D_NO_ERROR)
+        {
+            continue;
+        }
+
+        if (track_ID == p_tr->track_ID)
+        {
+            if (p_tr->traf.count == 0)
+            {
+                p_tr->traf.atom = child;
+            }
+            p_tr->traf.count++;
+        }
+        else if (p_tr->traf.count == 0)
+        {
+            p_tr->traf.preceding++;
+        }
+    }
+
+    return MP4D_NO_ERROR;
+}
 
-/** @brief Parses a moof
+/** @brief Parses the traf of the track
 
     trun_index: requested trun, counting from zero
  */
@@ -930,26 +1253,25 @@ get_next_trun(mp4d_trackreader_ptr_t p_tr,
 {
     struct mp4d_navigator_t_ nav;
 
-    /* Parse only moof and child boxes */
+    /* Parse only traf and child boxes */
     mp4d_navigator_init(&nav, 
         k_dispatcher_moof_reader, 
         k_uuid_dispatcher_track_reader, 
         p_tr);
 
-    /* Reset memory. Set counters (num_traf, traf_number) to zero */
     mp4d_memset(&p_tr->moof, 0, sizeof(p_tr->moof));
     p_tr->moof_iter.current_trun = trun_index;
     
-    CHECK( mp4d_parse_box(p_tr->atom, &nav) );
-    
-    ASSURE( p_tr->moof.num_traf > 0,
+    ASSURE( p_tr->traf.count > 0,
                 MP4D_E_TRACK_NOT_FOUND,
                 ("Missing moof:traf for track_ID %d", p_tr->track_ID) );
     
-    ASSURE( p_tr->moof.num_traf == 1,
+    ASSURE( p_tr->traf.count == 1,
                 MP4D_E_UNSUPPRTED_FORMAT,
                 ("Too many (%" PRIu32 ") moof:traf for track_ID %" PRIu32 ", need 1",
-                 p_tr->moof.num_traf, p_tr->track_ID)) ;  /* >1 legal but unsupported */
+                 p_tr->traf.count, p_tr->track_ID)) ;  /* >1 legal but unsupported */
+
+    CHECK( tr_parse_traf(p_tr->traf.atom, &nav) );
     
     if (p_tr->have_trex)
     {
@@ -964,9 +1286,12 @@ get_next_trun(mp4d_trackreader_ptr_t p_tr,
     debug(("default_sample_flags = %" PRIu32 "\n", p_tr->moof.tfhd.default_sample_flags));
     
     p_tr->moof_iter.samples_left = p_tr->moof.trun.sample_count;
+
+    CHECK( moof_init_decoder(p_tr) );
     
     return MP4D_NO_ERROR;
 }
+#endif
 
 /**
     @brief read sample aux info, only CENC encryption
@@ -980,6 +1305,7 @@ get_sample_aux(mp4d_trackreader_ptr_t p_tr,
     uint8_t i;
     int numAux = 0;
  
+#if MP4D_TRACKREADER_CENC
     for (i = 0; i < p_tr->num_saiz; i++)
     {
         p_sample->auxdata[i].datatype = p_tr->saiz[i].aux_info_type;
@@ -1021,9 +1347,7 @@ get_sample_aux(mp4d_trackreader_ptr_t p_tr,
     if (p_tr->piff_senc_reader.buffer.size > 0)
     {
         uint32_t piffAuxIndex = numAux++;
-        uint8_t ivSize;
-        mp4d_buffer_t buffer;
-        uint8_t bufferSize;
+        uint32_t bufferSize = p_tr->piff_senc_reader.iv_size;
 
         ASSURE(numAux < MP4D_MAX_AUXDATA, MP4D_E_UNSUPPRTED_FORMAT,
             ("Too much Aux data, unable to deliver PIFF SENC data") );
@@ -1031,26 +1355,17 @@ get_sample_aux(mp4d_trackreader_ptr_t p_tr,
         /* Work out the size of this data and give it to the user */
         p_sample->auxdata[piffAuxIndex].datatype = 0x70696666; /* piff */
         p_sample->auxdata[piffAuxIndex].pos = (uint64_t)(intptr_t)p_tr->piff_senc_reader.buffer.p_data;
-        
-        /* Work out IV size: */
-        ivSize = p_tr->piff_senc_reader.default_iv_size;
-        if (p_tr->piff_senc_reader.flags & 0x01)
-            ivSize = p_tr->piff_senc_reader.override_iv_size;
 
-        /* Work out the size of this data:*/
-        bufferSize = ivSize;
-        
-        /* make a temporary buffer to read ahead a little with*/
-        buffer = p_tr->piff_senc_reader.buffer;
-        mp4d_skip_bytes(&buffer, ivSize);
-
-        if (p_tr->piff_senc_reader.flags & 0x02)
+        if (!p_tr->piff_senc_reader.fixed_entry_size)
         {
-            uint16_t numEntries = mp4d_read_u16(&buffer);
-            uint32_t subSampleDataSize = numEntries * 6;
-            mp4d_skip_bytes(&buffer, subSampleDataSize);
+            /* IV, then the subsample count: read ahead a little */
+            mp4d_buffer_t buffer = p_tr->piff_senc_reader.buffer;
+            uint16_t numEntries;
 
-            bufferSize += 2 + subSampleDataSize;
+            mp4d_skip_bytes(&buffer, bufferSize);
+            numEntries = mp4d_read_u16(&buffer);
+
+            bufferSize += 2 + numEntries * 6;
         }
 
         p_sample->auxdata[piffAuxIndex].size = bufferSize;
@@ -1058,6 +1373,9 @@ get_sample_aux(mp4d_trackreader_ptr_t p_tr,
         /* Push the buffer's data forward */
         mp4d_skip_bytes(&p_tr->piff_senc_reader.buffer, bufferSize);
     }
+#else
+    (void) p_tr;
+#endif
 
     for (i = numAux; i < MP4D_MAX_AUXDATA; i++)
     {
@@ -1067,51 +1385,123 @@ get_sample_aux(mp4d_trackreader_ptr_t p_tr,
     return MP4D_NO_ERROR;
 }
 
-static int
-moof_next_sample(mp4d_trackreader_ptr_t p_tr,
-                 mp4d_sampleref_t * sample_ptr_out)
+#if MP4D_TRACKREADER_MOOF
+/** @brief Move to the first sample of the next trun
+ */
+static mp4d_error_t
+moof_next_trun(mp4d_trackreader_ptr_t p_tr)
 {
-    uint32_t sample_duration;
+    ASSURE( p_tr->moof_iter.current_trun + 1 < p_tr->moof.num_trun, MP4D_E_NEXT_SEGMENT,
+            ("track_ID %" PRIu32 ": Out of trun(s) (after %" PRIu32 " trun(s))", 
+             p_tr->track_ID, p_tr->moof.num_trun) );
 
-    if (p_tr->moof_iter.current_trun == 0 && 
-         p_tr->moof_iter.samples_left == p_tr->moof.trun.sample_count)
+    CHECK( get_next_trun(p_tr, p_tr->moof_iter.current_trun + 1) );
+
+    if (p_tr->moof.trun.tr_flags & 0x000001)
     {
-        sample_ptr_out->is_first_sample_in_segment = 1;
+        p_tr->moof_iter.cur_data_offset = p_tr->moof.tfhd.base_data_offset + p_tr->moof.trun.data_offset;
     }
     else
     {
-        sample_ptr_out->is_first_sample_in_segment = 0;
+        /* Data for this trun starts where the data for the previous trun ended. */
     }
 
-    while (p_tr->moof_iter.samples_left == 0)
+#if MP4D_TRACKREADER_CENC
+    CHECK( moof_set_aux_offset(p_tr) );
+#endif
+
+    return MP4D_NO_ERROR;
+}
+#endif
+
+/**
+    @brief skip sample aux info of 'count' samples
+
+    Same as calling get_sample_aux() 'count' times, but only the
+    running aux info offsets are kept up to date.
+ */
+static mp4d_error_t
+skip_sample_aux(mp4d_trackreader_ptr_t p_tr,
+                uint32_t count)
+{
+#if MP4D_TRACKREADER_CENC
+    uint8_t i;
+
+    for (i = 0; i < p_tr->num_saiz; i++)
     {
-        ASSURE( p_tr->moof_iter.current_trun + 1 < p_tr->moof.num_trun, MP4D_E_NEXT_SEGMENT,
-                ("track_ID %" PRIu32 ": Out of trun(s) (after %" PRIu32 " trun(s))", 
-                 p_tr->track_ID, p_tr->moof.num_trun) );
+        uint64_t total_size;
 
-        CHECK( get_next_trun(p_tr, p_tr->moof_iter.current_trun + 1) );
+        CHECK( mp4d_saiz_skip(&p_tr->saiz[i], count, &total_size) );
 
-        if (p_tr->moof.trun.tr_flags & 0x000001)
+        if (total_size > 0)
         {
-            p_tr->moof_iter.cur_data_offset = p_tr->moof.tfhd.base_data_offset + p_tr->moof.trun.data_offset;
+            uint8_t j;
+            int found = 0;
+
+            for (j = 0; j < p_tr->num_saio; j++)
+            {
+                if (p_tr->saio[j].aux_info_type == p_tr->saiz[i].aux_info_type)
+                {
+                    p_tr->cur_aux_pos[j] += total_size;
+                    found = 1;
+                    break;
+                }
+            }
+            ASSURE( found, MP4D_E_UNSUPPRTED_FORMAT,
+                        ("Missing saio box for saiz with aux_info_type = %d", p_tr->saiz[i].aux_info_type) );
         }
-        else
+    }
+
+    if (p_tr->piff_senc_reader.buffer.size > 0)
+    {
+        ASSURE(p_tr->num_saiz + 1 < MP4D_MAX_AUXDATA, MP4D_E_UNSUPPRTED_FORMAT,
+            ("Too much Aux data, unable to deliver PIFF SENC data") );
+
+        if (p_tr->piff_senc_reader.fixed_entry_size)
         {
-            /* Data for this trun starts where the data for the previous trun ended. */
+            mp4d_skip_bytes(&p_tr->piff_senc_reader.buffer,
+                            (uint64_t)count * p_tr->piff_senc_reader.iv_size);
         }
+        else
+        {
+            uint32_t k;
 
-        CHECK( moof_set_aux_offset(p_tr) );
+            for (k = 0; k < count; k++)
+            {
+                uint16_t numEntries;
+
+                mp4d_skip_bytes(&p_tr->piff_senc_reader.buffer, p_tr->piff_senc_reader.iv_size);
+                numEntries = mp4d_read_u16(&p_tr->piff_senc_reader.buffer);
+                mp4d_skip_bytes(&p_tr->piff_senc_reader.buffer, numEntries * 6);
+            }
+        }
     }
+#else
+    (void) p_tr;
+    (void) count;
+#endif
 
-    /* DTS */
-    sample_ptr_out->dts = p_tr->cur_dts;
+    return MP4D_NO_ERROR;
+}
+
+#if MP4D_TRACKREADER_MOOF
+/** @brief Read the trun entry of the next sample, testing the flags
+
+    Used if the trun has no decoder, see moof_init_decoder().
+ */
+static mp4d_error_t
+moof_read_entry(mp4d_trackreader_ptr_t p_tr,
+                mp4d_sampleref_t *sample_ptr_out,
+                uint32_t *p_duration)
+{
+    /* duration */
     if (p_tr->moof.trun.tr_flags & 0x000100)
     {
-        sample_duration = mp4d_read_u32(&p_tr->moof_iter.current_trun_sample);
+        *p_duration = mp4d_read_u32(&p_tr->moof_iter.current_trun_sample);
     }
     else if (p_tr->moof.tfhd.tf_flags & 0x000008)
     {
-        sample_duration = p_tr->moof.tfhd.default_sample_duration;
+        *p_duration = p_tr->moof.tfhd.default_sample_duration;
     }
     else
     {
@@ -1136,11 +1526,7 @@ moof_next_sample(mp4d_trackreader_ptr_t p_tr,
                      "from moof:traf:tfhd or from moov:mvex:trex") );
     }
 
-    /* pos */
-    sample_ptr_out->pos = p_tr->moof_iter.cur_data_offset;
-    p_tr->moof_iter.cur_data_offset += sample_ptr_out->size;
-
-    /* flags. boxes (sdtp, padb, stdp) take precedence of sample_flags */
+    /* flags */
     if (p_tr->moof.trun.tr_flags & 0x000400)
     {
         /* trun */
@@ -1164,35 +1550,6 @@ moof_next_sample(mp4d_trackreader_ptr_t p_tr,
                      "from moof:traf:tfhd or from moov:mvex:trex") );
     }
 
-    /* flags - sdtp */
-    if (p_tr->moov.sdtp.buffer.p_data != NULL)
-    {
-        /* Write sdtp flags from bit 20 */
-        uint8_t sdtp_flags;
-
-        CHECK( mp4d_sdtp_get_next(&p_tr->moov.sdtp, &sdtp_flags) );
-        sample_ptr_out->flags &= 0xf00fffff;       /* 1111 0000 0000 1111 1111 1111 1111 1111 */
-        sample_ptr_out->flags |= sdtp_flags << (3 + 1 + 16);
-    }
-    /* flags - padb */
-    if (p_tr->moov.padb.buffer.p_data != NULL)
-    {
-        uint8_t sample_padding_value; /* 3 bits */
-        CHECK( mp4d_padb_get_next(&p_tr->moov.padb, &sample_padding_value) );
-
-        sample_ptr_out->flags &= 0xfff1ffff;       /* 1111 1111 1111 0001 1111 1111 1111 1111 */
-        sample_ptr_out->flags |= (sample_padding_value & 0x7) << (1 + 16);
-    }
-    /* flags - stdp */
-    if (p_tr->moov.stdp.buffer.p_data != NULL)
-    {
-        uint16_t sample_degradation_priority;  /* 16 bits */
-
-        CHECK( mp4d_stdp_get_next(&p_tr->moov.stdp, &sample_degradation_priority) );
-        sample_ptr_out->flags &= 0xffff0000;
-        sample_ptr_out->flags |= sample_degradation_priority;
-    }
-
     /* CTS */
     if (p_tr->moof.trun.tr_flags & 0x000800)
     {
@@ -1210,25 +1567,109 @@ moof_next_sample(mp4d_trackreader_ptr_t p_tr,
         sample_ptr_out->cts = sample_ptr_out->dts;
     }
 
-    /* sample description index */
-    if (p_tr->moof.tfhd.tf_flags & 0x000002)
+    return MP4D_NO_ERROR;
+}
+
+static int
+moof_next_sample(mp4d_trackreader_ptr_t p_tr,
+                 mp4d_sampleref_t * sample_ptr_out)
+{
+    uint32_t sample_duration;
+
+    if (p_tr->moof_iter.current_trun == 0 && 
+         p_tr->moof_iter.samples_left == p_tr->moof.trun.sample_count)
     {
-        sample_ptr_out->sample_description_index = p_tr->moof.tfhd.sample_description_index;
+        sample_ptr_out->is_first_sample_in_segment = 1;
     }
     else
     {
-        /* For reasons of PIFF playback, assume that the sample description index is 1, if not in tfhd (
-         *  and not in moov:mvex:trex which is not available in PIFF */
-        if (0)
-        {
-            ASSURE( 0, MP4D_E_INFO_NOT_AVAIL,
-                    ("Sample description index is not available from moof:traf:tfhd "
-                     "or from moov:mvex:trex") );
-        }
-        else
-        {
-            sample_ptr_out->sample_description_index = 1;
-        }
+        sample_ptr_out->is_first_sample_in_segment = 0;
+    }
+
+    while (p_tr->moof_iter.samples_left == 0)
+    {
+        CHECK( moof_next_trun(p_tr) );
+    }
+
+    /* DTS, size, flags, CTS */
+    sample_ptr_out->dts = p_tr->cur_dts;
+    if (p_tr->moof_iter.use_decoder)
+    {
+        const trun_entry_t *p_entry;
+
+        if (p_tr->moof_iter.next_entry == p_tr->moof_iter.num_entries)
+        {
+            CHECK( moof_decode_entries(p_tr) );
+        }
+        p_entry = &p_tr->moof_iter.entries[p_tr->moof_iter.next_entry++];
+        mp4d_skip_bytes(&p_tr->moof_iter.current_trun_sample, p_tr->moof_iter.decoder.entry_size);
+
+        sample_duration = p_entry->duration;
+        sample_ptr_out->size = p_entry->size;
+        sample_ptr_out->flags = p_entry->flags;
+        sample_ptr_out->cts = sample_ptr_out->dts + (uint64_t) p_entry->composition_offset;
+    }
+    else
+    {
+        CHECK( moof_read_entry(p_tr, sample_ptr_out, &sample_duration) );
+    }
+
+    /* pos */
+    sample_ptr_out->pos = p_tr->moof_iter.cur_data_offset;
+    p_tr->moof_iter.cur_data_offset += sample_ptr_out->size;
+
+    /* flags. boxes (sdtp, padb, stdp) take precedence of sample_flags */
+    if (p_tr->moof_iter.have_flag_boxes)
+    {
+        /* flags - sdtp */
+        if (p_tr->moov.sdtp.buffer.p_data != NULL)
+        {
+            /* Write sdtp flags from bit 20 */
+            uint8_t sdtp_flags;
+
+            CHECK( mp4d_sdtp_get_next(&p_tr->moov.sdtp, &sdtp_flags) );
+            sample_ptr_out->flags &= 0xf00fffff;       /* 1111 0000 0000 1111 1111 1111 1111 1111 */
+            sample_ptr_out->flags |= sdtp_flags << (3 + 1 + 16);
+        }
+        /* flags - padb */
+        if (p_tr->moov.padb.buffer.p_data != NULL)
+        {
+            uint8_t sample_padding_value; /* 3 bits */
+            CHECK( mp4d_padb_get_next(&p_tr->moov.padb, &sample_padding_value) );
+
+            sample_ptr_out->flags &= 0xfff1ffff;       /* 1111 1111 1111 0001 1111 1111 1111 1111 */
+            sample_ptr_out->flags |= (sample_padding_value & 0x7) << (1 + 16);
+        }
+        /* flags - stdp */
+        if (p_tr->moov.stdp.buffer.p_data != NULL)
+        {
+            uint16_t sample_degradation_priority;  /* 16 bits */
+
+            CHECK( mp4d_stdp_get_next(&p_tr->moov.stdp, &sample_degradation_priority) );
+            sample_ptr_out->flags &= 0xffff0000;
+            sample_ptr_out->flags |= sample_degradation_priority;
+        }
+    }
+
+    /* sample description index */
+    if (p_tr->moof.tfhd.tf_flags & 0x000002)
+    {
+        sample_ptr_out->sample_description_index = p_tr->moof.tfhd.sample_description_index;
+    }
+    else
+    {
+        /* For reasons of PIFF playback, assume that the sample description index is 1, if not in tfhd (
+         *  and not in moov:mvex:trex which is not available in PIFF */
+        if (0)
+        {
+            ASSURE( 0, MP4D_E_INFO_NOT_AVAIL,
+                    ("Sample description index is not available from moof:traf:tfhd "
+                     "or from moov:mvex:trex") );
+        }
+        else
+        {
+            sample_ptr_out->sample_description_index = 1;
+        }
     }
 
     /* trik box*/
@@ -1249,6 +1690,8 @@ moof_next_sample(mp4d_trackreader_ptr_t p_tr,
 
     /* senc box*/
     {
+        mp4d_memset(sample_ptr_out->sencdata.iv, 0, sizeof(sample_ptr_out->sencdata.iv));
+#if MP4D_TRACKREADER_CENC
         if (p_tr->moof.senc.buffer.p_data != NULL)
         {
             CHECK(mp4d_senc_get_next(&p_tr->moof.senc,                
@@ -1259,6 +1702,7 @@ moof_next_sample(mp4d_trackreader_ptr_t p_tr,
                                      ));
         }
         else
+#endif
         {
             /* No senc box; Maybe it's not encrypted traf,or it's not a CFF file.*/
             sample_ptr_out->sencdata.subsample_count= 0;
@@ -1300,58 +1744,177 @@ moof_next_sample(mp4d_trackreader_ptr_t p_tr,
     return MP4D_NO_ERROR;
 }
 
-int
-mp4d_trackreader_get_track_ID
-(
-    mp4d_trackreader_ptr_t p_tr,
-    uint32_t *track_ID          /**< [out] */
-)
+/** @brief Skip samples in the current moof
+
+    Sums trun sample durations and sizes instead of decoding each sample.
+ */
+static mp4d_error_t
+moof_skip(mp4d_trackreader_ptr_t p_tr,
+          uint64_t count)
 {
-    ASSURE( p_tr != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
-    ASSURE( track_ID != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    while (count > 0)
+    {
+        uint32_t step;
+        uint64_t duration_sum = 0;
+        uint64_t size_sum = 0;
+        uint32_t tr_flags;
 
-    *track_ID = p_tr->track_ID;
+        while (p_tr->moof_iter.samples_left == 0)
+        {
+            CHECK( moof_next_trun(p_tr) );
+        }
 
-    return MP4D_NO_ERROR;
-}
+        step = p_tr->moof_iter.samples_left;
+        if (count < step)
+        {
+            step = (uint32_t) count;
+        }
 
-int
-mp4d_trackreader_get_time_scale
-(
-    mp4d_trackreader_ptr_t p_tr,
-    uint32_t *movie_time_scale,         /**< [out] */
-    uint32_t *media_time_scale          /**< [out] */
-    )
-{
-    ASSURE( p_tr != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
-    ASSURE( movie_time_scale != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
-    ASSURE( media_time_scale != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+        /* trun entries */
+        tr_flags = p_tr->moof.trun.tr_flags;
+        {
+            uint32_t tail_size = 0;  /* size of the entry fields after duration and size */
 
-    *movie_time_scale = p_tr->movie_time_scale;
-    *media_time_scale = p_tr->media_time_scale;
+            if (tr_flags & 0x000400)
+            {
+                tail_size += 4;
+            }
+            if (tr_flags & 0x000800)
+            {
+                tail_size += 4;
+            }
+
+            if (tr_flags & (0x000100 | 0x000200))
+            {
+                uint32_t i;
+
+                for (i = 0; i < step; i++)
+                {
+                    if (tr_flags & 0x000100)
+                    {
+                        duration_sum += mp4d_read_u32(&p_tr->moof_iter.current_trun_sample);
+                    }
+                    if (tr_flags & 0x000200)
+                    {
+                        size_sum += mp4d_read_u32(&p_tr->moof_iter.current_trun_sample);
+                    }
+                    mp4d_skip_bytes(&p_tr->moof_iter.current_trun_sample, tail_size);
+                }
+            }
+            else
+            {
+                mp4d_skip_bytes(&p_tr->moof_iter.current_trun_sample, (uint64_t) step * tail_size);
+            }
+        }
+
+        if (!(tr_flags & 0x000100))
+        {
+            ASSURE( p_tr->moof.tfhd.tf_flags & 0x000008, MP4D_E_INFO_NOT_AVAIL, 
+                    ("Sample DTS is not available from moof:traf:trun or "
+                     "from moof:traf:tfhd or from moov:mvex:trex") );
+
+            duration_sum = (uint64_t) step * p_tr->moof.tfhd.default_sample_duration;
+        }
+        if (!(tr_flags & 0x000200))
+        {
+            ASSURE( p_tr->moof.tfhd.tf_flags & 0x000010, MP4D_E_INFO_NOT_AVAIL,
+                    ("Sample size is not available from moof:traf:trun or "
+                     "from moof:traf:tfhd or from moov:mvex:trex") );
+
+            size_sum = (uint64_t) step * p_tr->moof.tfhd.default_sample_size;
+        }
+
+        /* flags - sdtp, padb, stdp */
+        if (p_tr->moov.sdtp.buffer.p_data != NULL)
+        {
+            CHECK( mp4d_sdtp_skip(&p_tr->moov.sdtp, step) );
+        }
+        if (p_tr->moov.padb.buffer.p_data != NULL)
+        {
+            CHECK( mp4d_padb_skip(&p_tr->moov.padb, step) );
+        }
+        if (p_tr->moov.stdp.buffer.p_data != NULL)
+        {
+            CHECK( mp4d_stdp_skip(&p_tr->moov.stdp, step) );
+        }
+
+        /* trik, senc */
+        if (p_tr->moof.trik.buffer.p_data != NULL)
+        {
+            CHECK( mp4d_trik_skip(&p_tr->moof.trik, step) );
+        }
+#if MP4D_TRACKREADER_CENC
+        if (p_tr->moof.senc.buffer.p_data != NULL)
+        {
+            CHECK( mp4d_senc_skip(&p_tr->moof.senc,
+                                  p_tr->piff_senc_reader.default_iv_size,
+                                  step) );
+        }
+#endif
+
+        CHECK( mp4d_subs_skip(&p_tr->subs, step) );
+        CHECK( skip_sample_aux(p_tr, step) );
+
+        p_tr->moof_iter.cur_data_offset += size_sum;
+        p_tr->cur_dts += duration_sum;
+        p_tr->moof_iter.samples_left -= step;
+        count -= step;
+    }
+
+    /* The decoded entries (if any) are behind current_trun_sample now */
+    p_tr->moof_iter.num_entries = 0;
+    p_tr->moof_iter.next_entry = 0;
 
     return MP4D_NO_ERROR;
 }
+#endif
 
-
-int
-mp4d_trackreader_next_sample 
-(
-    mp4d_trackreader_ptr_t p_tr,   /**<  */
-    mp4d_sampleref_t *sample_ptr_out   /**<  */
-)
+#if MP4D_TRACKREADER_MOOV
+/** @brief (boolean) the moov has sample aux info, which cannot be read backwards
+ */
+static int
+moov_have_sample_aux(mp4d_trackreader_ptr_t p_tr)
 {
-    uint32_t sample_duration;
+#if MP4D_TRACKREADER_CENC
+    return p_tr->num_saiz > 0 || p_tr->num_saio > 0;
+#else
+    (void) p_tr;
+    return 0;
+#endif
+}
 
-    ASSURE( p_tr != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
-    ASSURE( sample_ptr_out != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );   
+/** @brief start the sample aux info of a chunk in the moov, at the offset in saio
+ */
+static mp4d_error_t
+moov_start_chunk_aux(mp4d_trackreader_ptr_t p_tr)
+{
+#if MP4D_TRACKREADER_CENC
+    uint8_t i;
 
-    if (MP4D_FOURCC_EQ(p_tr->atom.type, "moof"))
+    for (i = 0; i < p_tr->num_saio; i++)
     {
-        return moof_next_sample(p_tr, sample_ptr_out);
+        CHECK( mp4d_saio_get_next(&p_tr->saio[i],
+                                  p_tr->cur_aux_pos[i],
+                                  &p_tr->cur_aux_pos[i])
+            );
     }
+#else
+    (void) p_tr;
+#endif
 
-    assert( MP4D_FOURCC_EQ(p_tr->atom.type, "moov") );
+    return MP4D_NO_ERROR;
+}
+
+/** @brief Read the next sample of the moov from the sample tables
+ */
+static int
+moov_next_sample(mp4d_trackreader_ptr_t p_tr,
+                 mp4d_sampleref_t *sample_ptr_out)
+{
+    uint32_t sample_duration;
+
+    /* No senc box in moov, the encryption data is in the sample aux info */
+    mp4d_memset(&sample_ptr_out->sencdata, 0, sizeof(sample_ptr_out->sencdata));
 
     /* Sample DTS */
     CHECK( mp4d_tts_get_stts_next(&p_tr->moov.stts, 
@@ -1473,19 +2036,11 @@ mp4d_trackreader_next_sample
         sample_ptr_out->samples_per_chunk = p_tr->moov.stsc.cur_samples_per_chunk;
         if (sample_index_in_chunk == 0)
         {
-            uint8_t i;
-
             /* Sample offset = chunk offset */
             CHECK( mp4d_co_get_next(&p_tr->moov.co, &sample_ptr_out->pos) );
 
             /* Reset sample aux info offset */
-            for (i = 0; i < p_tr->num_saio; i++)
-            {
-                CHECK( mp4d_saio_get_next(&p_tr->saio[i],
-                                          p_tr->cur_aux_pos[i],
-                                          &p_tr->cur_aux_pos[i])
-                    );
-            }
+            CHECK( moov_start_chunk_aux(p_tr) );
         }
         else
         {
@@ -1521,41 +2076,576 @@ mp4d_trackreader_next_sample
     CHECK( mp4d_subs_get_next_count(&p_tr->subs,
                                     &sample_ptr_out->num_subsamples) );
 
-    p_tr->cur_dts = sample_ptr_out->dts;
+    p_tr->cur_dts = sample_ptr_out->dts;
+
+    CHECK( get_sample_aux(p_tr, sample_ptr_out) );
+
+    /* picture type and dependency level */
+    {
+            sample_ptr_out->pic_type = 0;              /* no trik box in moov, set 0 means unknown. */
+            sample_ptr_out->dependency_level = 0;      /* no trik box in moov, set 0 means unknown. */
+    }
+    
+    return MP4D_NO_ERROR;
+}
+
+/** @brief Skip samples in the moov
+
+    Jumps over stts/ctts entries and whole chunks. Only the sizes of the
+    samples which precede the last skipped sample in its chunk are read.
+ */
+static mp4d_error_t
+moov_skip(mp4d_trackreader_ptr_t p_tr,
+          uint64_t count)
+{
+    ASSURE( count <= p_tr->moov.stz.sample_count - p_tr->moov.stz.next_sample_index, MP4D_E_NEXT_SEGMENT,
+            ("track_ID %" PRIu32 ": Cannot skip %" PRIu64 " samples, %" PRIu32 " left",
+             p_tr->track_ID, count, p_tr->moov.stz.sample_count - p_tr->moov.stz.next_sample_index) );
+
+    while (count > 0)
+    {
+        uint32_t step = (uint32_t) count;
+        uint32_t chunks_started;
+        uint32_t last_chunk_samples;  /* skipped samples in the chunk of the last skipped sample */
+        uint64_t pos;
+        uint32_t size;
+
+#if MP4D_TRACKREADER_CENC
+        if (p_tr->num_saio > 0)
+        {
+            /* Aux info offsets are reset per chunk, do not skip beyond the current chunk */
+            uint32_t chunk_samples_left = p_tr->moov.stsc.cur_samples_per_chunk - p_tr->moov.stsc.samples_consumed;
+
+            if (chunk_samples_left == 0)
+            {
+                chunk_samples_left = 1;  /* enter the next chunk */
+            }
+            if (step > chunk_samples_left)
+            {
+                step = chunk_samples_left;
+            }
+        }
+#endif
+
+        /* DTS, CTS */
+        CHECK( mp4d_tts_skip(&p_tr->moov.stts, step) );
+        if (p_tr->moov.ctts.buffer.p_data != NULL)
+        {
+            CHECK( mp4d_tts_skip(&p_tr->moov.ctts, step) );
+        }
+
+        /* Sample flags */
+        CHECK( mp4d_stss_skip(&p_tr->moov.stss, step) );
+        if (p_tr->moov.sdtp.buffer.p_data != NULL)
+        {
+            CHECK( mp4d_sdtp_skip(&p_tr->moov.sdtp, step) );
+        }
+        if (p_tr->moov.stdp.buffer.p_data != NULL)
+        {
+            CHECK( mp4d_stdp_skip(&p_tr->moov.stdp, step) );
+        }
+        if (p_tr->moov.padb.buffer.p_data != NULL)
+        {
+            CHECK( mp4d_padb_skip(&p_tr->moov.padb, step) );
+        }
+
+        /* Sample position, and aux offset */
+        CHECK( mp4d_stsc_skip(&p_tr->moov.stsc, step, &chunks_started) );
+        if (chunks_started > 0)
+        {
+            CHECK( mp4d_co_skip(&p_tr->moov.co, chunks_started - 1) );
+            CHECK( mp4d_co_get_next(&p_tr->moov.co, &pos) );
+            last_chunk_samples = p_tr->moov.stsc.samples_consumed;
+
+            /* Only one chunk is started if there are saio boxes */
+            CHECK( moov_start_chunk_aux(p_tr) );
+        }
+        else
+        {
+            pos = p_tr->moov.cur_sample_pos + p_tr->moov.cur_sample_size;
+            last_chunk_samples = step;
+        }
+
+        CHECK( mp4d_stsz_skip(&p_tr->moov.stz, step - last_chunk_samples) );
+        if (p_tr->moov.stz.sample_size != 0)
+        {
+            CHECK( mp4d_stsz_skip(&p_tr->moov.stz, last_chunk_samples) );
+            size = p_tr->moov.stz.sample_size;
+            pos += (uint64_t) (last_chunk_samples - 1) * size;
+        }
+        else
+        {
+            uint32_t i;
+
+            for (i = 0; i < last_chunk_samples; i++)
+            {
+                if (i > 0)
+                {
+                    pos += size;
+                }
+                CHECK( mp4d_stsz_get_next(&p_tr->moov.stz, &size) );
+            }
+        }
+        p_tr->moov.cur_sample_pos  = pos;
+        p_tr->moov.cur_sample_size = size;
+
+        /* subsample */
+        CHECK( mp4d_subs_skip(&p_tr->subs, step) );
+
+        /* sample aux */
+        CHECK( skip_sample_aux(p_tr, step) );
+
+        p_tr->cur_dts = p_tr->moov.stts.cur_dts;
+        count -= step;
+    }
+
+    return MP4D_NO_ERROR;
+}
+#else
+/** @brief Without MP4D_TRACKREADER_MOOV, a moov has no samples (see init_segment())
+ */
+static int
+moov_next_sample(mp4d_trackreader_ptr_t p_tr,
+                 mp4d_sampleref_t *sample_ptr_out)
+{
+    (void) p_tr;
+    (void) sample_ptr_out;
+    ASSURE( 0, MP4D_E_NEXT_SEGMENT, ("track_ID %" PRIu32 ": No samples in moov", p_tr->track_ID) );
+    return MP4D_E_NEXT_SEGMENT;
+}
+
+static mp4d_error_t
+moov_skip(mp4d_trackreader_ptr_t p_tr,
+          uint64_t count)
+{
+    (void) p_tr;
+    ASSURE( count == 0, MP4D_E_NEXT_SEGMENT,
+            ("track_ID %" PRIu32 ": Cannot skip %" PRIu64 " samples, no samples in moov", p_tr->track_ID, count) );
+    return MP4D_NO_ERROR;
+}
+#endif
+
+#if MP4D_TRACKREADER_MOOF
+/** @brief Find the next sync sample in the current trun
+
+    Only reads the sample flags (trun, sdtp) and the picture type (trik).
+    Sync samples are I-samples (sample_depends_on == 2) and I/P pictures
+    signaled in trik, the same as used by seek_to().
+
+    *p_index is set to the number of samples before the sync sample,
+    or to moof_iter.samples_left if the trun has no more sync samples.
+ */
+static mp4d_error_t
+moof_find_sync_sample(mp4d_trackreader_ptr_t p_tr,
+                      uint32_t *p_index)
+{
+    uint32_t tr_flags = p_tr->moof.trun.tr_flags;
+    uint32_t flags_offset = 0;  /* of sample_flags in trun entry */
+    uint32_t tail_size = 0;     /* of trun entry after sample_flags */
+    mp4d_buffer_t trun_entries = p_tr->moof_iter.current_trun_sample;
+    mp4d_buffer_t sdtp = p_tr->moov.sdtp.buffer;
+    mp4d_buffer_t trik = p_tr->moof.trik.buffer;
+    uint32_t i;
+
+    if (tr_flags & 0x000100)
+    {
+        flags_offset += 4;
+    }
+    if (tr_flags & 0x000200)
+    {
+        flags_offset += 4;
+    }
+    if (tr_flags & 0x000800)
+    {
+        tail_size += 4;
+    }
+
+    for (i = 0; i < p_tr->moof_iter.samples_left; i++)
+    {
+        uint32_t flags;
+        uint8_t pic_type = 0;
+
+        if (tr_flags & 0x000400)
+        {
+            mp4d_skip_bytes(&trun_entries, flags_offset);
+            flags = mp4d_read_u32(&trun_entries);
+            mp4d_skip_bytes(&trun_entries, tail_size);
+        }
+        else if (i == 0 &&
+                 p_tr->moof_iter.samples_left == p_tr->moof.trun.sample_count &&
+                 tr_flags & 0x000004)
+        {
+            flags = p_tr->moof.trun.first_sample_flags;
+        }
+        else if ((p_tr->moof.tfhd.tf_flags & 0x000020)||(p_tr->have_trex == 0))
+        {
+            flags = p_tr->moof.tfhd.default_sample_flags;
+        }
+        else
+        {
+            ASSURE( 0, MP4D_E_INFO_NOT_AVAIL,
+                        ("Sample flags are not available from moof:traf:trun or "
+                         "from moof:traf:tfhd or from moov:mvex:trex") );
+        }
+
+        if (sdtp.p_data != NULL)
+        {
+            flags &= 0xf00fffff;
+            flags |= mp4d_read_u8(&sdtp) << (3 + 1 + 16);
+        }
+        if (trik.p_data != NULL)
+        {
+            pic_type = mp4d_read_u8(&trik) >> 6;
+        }
+
+        if (((flags >> 24) & 0x3) == 2 || pic_type == 1 || pic_type == 2)
+        {
+            break;
+        }
+    }
+
+    *p_index = i;
+
+    return MP4D_NO_ERROR;
+}
+#endif
+
+#if MP4D_TRACKREADER_MOOV
+/** @brief Move back 'count' samples in the moov
+
+    Steps backwards through the stts/ctts entries, whole chunks and the
+    sync sample table, the reverse of moov_skip().
+ */
+static mp4d_error_t
+moov_rewind(mp4d_trackreader_ptr_t p_tr,
+            uint32_t count)
+{
+    uint32_t samples_in_chunk;
+
+    ASSURE( count <= p_tr->moov.stz.next_sample_index, MP4D_E_WRONG_ARGUMENT,
+            ("track_ID %" PRIu32 ": Cannot rewind %" PRIu32 " samples, at sample %" PRIu32,
+             p_tr->track_ID, count, p_tr->moov.stz.next_sample_index) );
+
+    /* DTS, CTS */
+    CHECK( mp4d_tts_rewind(&p_tr->moov.stts, count) );
+    if (p_tr->moov.ctts.buffer.p_data != NULL)
+    {
+        CHECK( mp4d_tts_rewind(&p_tr->moov.ctts, count) );
+    }
+
+    /* Sample flags */
+    CHECK( mp4d_stss_rewind(&p_tr->moov.stss, count) );
+    if (p_tr->moov.sdtp.buffer.p_data != NULL)
+    {
+        CHECK( mp4d_sdtp_rewind(&p_tr->moov.sdtp, count) );
+    }
+    if (p_tr->moov.stdp.buffer.p_data != NULL)
+    {
+        CHECK( mp4d_stdp_rewind(&p_tr->moov.stdp, count) );
+    }
+    if (p_tr->moov.padb.buffer.p_data != NULL)
+    {
+        CHECK( mp4d_padb_rewind(&p_tr->moov.padb, count) );
+    }
+
+    /* Sample position */
+    CHECK( mp4d_stsc_rewind(&p_tr->moov.stsc, count) );
+    if (count == p_tr->moov.stz.next_sample_index)
+    {
+        /* Back to the first sample */
+        CHECK( mp4d_co_rewind(&p_tr->moov.co, p_tr->moov.co.cur_entry_index) );
+        CHECK( mp4d_stsz_rewind(&p_tr->moov.stz, count) );
+        p_tr->moov.cur_sample_pos = 0;
+        p_tr->moov.cur_sample_size = 0;
+        p_tr->cur_dts = p_tr->abs_time_offset;
+
+        return MP4D_NO_ERROR;
+    }
+
+    /* The chunk of the new current sample is the last chunk read from stco/co64,
+       read the sizes of its samples up to the new current sample */
+    samples_in_chunk = p_tr->moov.stsc.samples_consumed;
+    {
+        uint64_t pos;
+        uint32_t size = 0;
+        uint32_t i;
+
+        ASSURE( p_tr->moov.co.cur_entry_index >= p_tr->moov.stsc.cur_chunk - 1, MP4D_E_UNSUPPRTED_FORMAT,
+                ("track_ID %" PRIu32 ": stsc and stco/co64 out of sync", p_tr->track_ID) );
+
+        CHECK( mp4d_co_rewind(&p_tr->moov.co, p_tr->moov.co.cur_entry_index - (p_tr->moov.stsc.cur_chunk - 1)) );
+        CHECK( mp4d_co_get_next(&p_tr->moov.co, &pos) );
+
+        CHECK( mp4d_stsz_rewind(&p_tr->moov.stz, count + samples_in_chunk) );
+        for (i = 0; i < samples_in_chunk; i++)
+        {
+            if (i > 0)
+            {
+                pos += size;
+            }
+            CHECK( mp4d_stsz_get_next(&p_tr->moov.stz, &size) );
+        }
+        p_tr->moov.cur_sample_pos  = pos;
+        p_tr->moov.cur_sample_size = size;
+    }
+
+    p_tr->cur_dts = p_tr->moov.stts.cur_dts;
+
+    return MP4D_NO_ERROR;
+}
+#endif
+
+int
+mp4d_trackreader_get_track_ID
+(
+    mp4d_trackreader_ptr_t p_tr,
+    uint32_t *track_ID          /**< [out] */
+)
+{
+    ASSURE( p_tr != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( track_ID != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    *track_ID = p_tr->track_ID;
+
+    return MP4D_NO_ERROR;
+}
+
+int
+mp4d_trackreader_get_time_scale
+(
+    mp4d_trackreader_ptr_t p_tr,
+    uint32_t *movie_time_scale,         /**< [out] */
+    uint32_t *media_time_scale          /**< [out] */
+    )
+{
+    ASSURE( p_tr != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( movie_time_scale != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( media_time_scale != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    *movie_time_scale = p_tr->movie_time_scale;
+    *media_time_scale = p_tr->media_time_scale;
+
+    return MP4D_NO_ERROR;
+}
+
+
+int
+mp4d_trackreader_next_sample 
+(
+    mp4d_trackreader_ptr_t p_tr,   /**<  */
+    mp4d_sampleref_t *sample_ptr_out   /**<  */
+)
+{
+    ASSURE( p_tr != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( sample_ptr_out != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );   
+
+#if MP4D_TRACKREADER_MOOF
+    if (MP4D_FOURCC_EQ(p_tr->atom.type, "moof"))
+    {
+        return moof_next_sample(p_tr, sample_ptr_out);
+    }
+#endif
+
+    assert( MP4D_FOURCC_EQ(p_tr->atom.type, "moov") );
+
+    return moov_next_sample(p_tr, sample_ptr_out);
+}
+
+int
+mp4d_trackreader_next_subsample
+(
+    mp4d_trackreader_ptr_t p_tr,
+    const mp4d_sampleref_t *p_sample,
+    uint64_t *p_offset,
+    uint32_t *p_size
+)
+{
+    uint32_t offset_in_sample;
+
+    ASSURE( p_tr != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_sample != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_offset != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_size != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    
+    CHECK( mp4d_subs_get_next_size(&p_tr->subs,
+                                   p_sample->size,
+                                   p_size,
+                                   &offset_in_sample) );
+
+    *p_offset = p_sample->pos + offset_in_sample;
+
+    return MP4D_NO_ERROR;
+}
+
+int
+mp4d_trackreader_get_subsamples
+(
+    mp4d_trackreader_ptr_t p_tr,
+    const mp4d_sampleref_t *p_sample,
+    uint32_t *p_mem,
+    uint32_t mem_entries,
+    mp4d_subsample_map_t *p_map
+)
+{
+    uint32_t num_subsamples;
+    uint32_t num_crypt_entries;
+
+    ASSURE( p_tr != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_sample != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_mem != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_map != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    num_subsamples = p_sample->num_subsamples;
+    num_crypt_entries = p_sample->sencdata.subsample_count;
+    ASSURE( mem_entries >= MP4D_SUBSAMPLE_MAP_ENTRIES(p_sample), MP4D_E_BUFFER_TOO_SMALL,
+            ("Subsample map needs %" PRIu32 " entries, have %" PRIu32,
+             MP4D_SUBSAMPLE_MAP_ENTRIES(p_sample), mem_entries) );
+#if MP4D_TRACKREADER_MOOF && MP4D_TRACKREADER_CENC
+    /* The entries were read past the end of the 'senc' box */
+    ASSURE( num_crypt_entries == 0 || p_tr->moof.senc.buffer.size != (uint64_t) -1, MP4D_E_INVALID_ATOM,
+            ("Truncated senc box") );
+#endif
+
+    CHECK( mp4d_subs_get_sizes(&p_tr->subs, p_sample->size, num_subsamples, p_mem) );
+    CHECK( mp4d_senc_decode_subsamples(p_sample->sencdata.ClearEncryptBytes,
+                                       (uint16_t) num_crypt_entries,
+                                       p_mem + num_subsamples,
+                                       p_mem + num_subsamples + num_crypt_entries) );
+
+    p_map->num_subsamples = num_subsamples;
+    p_map->size = p_mem;
+    p_map->num_crypt_entries = num_crypt_entries;
+    p_map->clear_bytes = p_mem + num_subsamples;
+    p_map->protected_bytes = p_mem + num_subsamples + num_crypt_entries;
+
+    return MP4D_NO_ERROR;
+}
+
+int
+mp4d_trackreader_skip
+(
+    mp4d_trackreader_ptr_t p_tr,
+    uint64_t count
+)
+{
+    ASSURE( p_tr != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+#if MP4D_TRACKREADER_MOOF
+    if (MP4D_FOURCC_EQ(p_tr->atom.type, "moof"))
+    {
+        return moof_skip(p_tr, count);
+    }
+#endif
+
+    assert( MP4D_FOURCC_EQ(p_tr->atom.type, "moov") );
+
+    return moov_skip(p_tr, count);
+}
+
+int
+mp4d_trackreader_peek_samples
+(
+    mp4d_trackreader_ptr_t p_tr,
+    void *scratch_mem,
+    mp4d_sampleref_t *samples,
+    uint32_t max_count,
+    uint32_t *p_count
+)
+{
+    /* The copy shares the segment buffers and the edit list with p_tr,
+       which next_sample() does not modify */
+    mp4d_trackreader_ptr_t p_peek = (mp4d_trackreader_ptr_t) scratch_mem;
+
+    ASSURE( p_tr != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( scratch_mem != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( samples != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_count != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    memcpy(p_peek, p_tr, sizeof(*p_peek));
+
+    *p_count = 0;
+    while (*p_count < max_count)
+    {
+        int err = mp4d_trackreader_next_sample(p_peek, &samples[*p_count]);
+
+        if (err == MP4D_E_NEXT_SEGMENT)
+        {
+            break;
+        }
+        CHECK( err );
+        (*p_count)++;
+    }
+
+    return MP4D_NO_ERROR;
+}
+
+int
+mp4d_trackreader_next_sync_sample
+(
+    mp4d_trackreader_ptr_t p_tr,
+    mp4d_sampleref_t *sample_ptr_out
+)
+{
+    ASSURE( p_tr != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( sample_ptr_out != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+#if MP4D_TRACKREADER_MOOF
+    if (MP4D_FOURCC_EQ(p_tr->atom.type, "moof"))
+    {
+        while (1)
+        {
+            uint32_t index;
+
+            while (p_tr->moof_iter.samples_left == 0)
+            {
+                CHECK( moof_next_trun(p_tr) );
+            }
+
+            CHECK( moof_find_sync_sample(p_tr, &index) );
+            CHECK( moof_skip(p_tr, index) );
+
+            if (p_tr->moof_iter.samples_left > 0)
+            {
+                break;
+            }
+        }
+    }
+    else
+#endif
+    {
+        assert( MP4D_FOURCC_EQ(p_tr->atom.type, "moov") );
+
+#if MP4D_TRACKREADER_MOOV
+        if (p_tr->moov.stss.buffer.p_data != NULL)
+        {
+            uint32_t sync_sample;  /* counting from one */
+
+            CHECK( mp4d_stss_peek_sync(&p_tr->moov.stss, &sync_sample) );
 
-    CHECK( get_sample_aux(p_tr, sample_ptr_out) );
+            ASSURE( sync_sample != (uint32_t) -1, MP4D_E_NEXT_SEGMENT,
+                    ("track_ID %" PRIu32 ": No more sync samples", p_tr->track_ID) );
 
-    /* picture type and dependency level */
-    {
-            sample_ptr_out->pic_type = 0;              /* no trik box in moov, set 0 means unknown. */
-            sample_ptr_out->dependency_level = 0;      /* no trik box in moov, set 0 means unknown. */
+            CHECK( moov_skip(p_tr, sync_sample - 1 - p_tr->moov.stss.cur_sample_number) );
+        }
+        /* else: all samples are sync samples */
+#endif
     }
-    
-    return MP4D_NO_ERROR;
+
+    return mp4d_trackreader_next_sample(p_tr, sample_ptr_out);
 }
 
 int
-mp4d_trackreader_next_subsample
+mp4d_trackreader_next_sync_sample_at
 (
     mp4d_trackreader_ptr_t p_tr,
-    const mp4d_sampleref_t *p_sample,
-    uint64_t *p_offset,
-    uint32_t *p_size
+    int64_t time_stamp,
+    mp4d_sampleref_t *sample_ptr_out
 )
 {
-    uint32_t offset_in_sample;
-
-    ASSURE( p_tr != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
-    ASSURE( p_sample != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
-    ASSURE( p_offset != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
-    ASSURE( p_size != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
-    
-    CHECK( mp4d_subs_get_next_size(&p_tr->subs,
-                                   p_sample->size,
-                                   p_size,
-                                   &offset_in_sample) );
-
-    *p_offset = p_sample->pos + offset_in_sample;
+    do
+    {
+        CHECK( mp4d_trackreader_next_sync_sample(p_tr, sample_ptr_out) );
+    } while (sample_ptr_out->pts < time_stamp);
 
     return MP4D_NO_ERROR;
 }
@@ -1568,8 +2658,14 @@ mp4d_trackreader_get_stss_count
     unsigned char **stts_content
     )
 {
+#if MP4D_TRACKREADER_MOOV
     *count = p_tr->moov.stss.count;
     *stts_content = p_tr->moov.stss.stts_content;
+#else
+    (void) p_tr;
+    *count = 0;
+    *stts_content = NULL;
+#endif
 
     return 0;
 }
@@ -1594,28 +2690,46 @@ init_segment(mp4d_trackreader_ptr_t p_tr)
         /* Reset all data pointers to NULL */
         mp4d_memset(&p_tr->moov, 0, sizeof(p_tr->moov));
         mp4d_memset(&p_tr->elst, 0, sizeof(p_tr->elst));
+        p_tr->num_edits = 0;
         mp4d_memset(&p_tr->subs, 0, sizeof(p_tr->subs));
+#if MP4D_TRACKREADER_MOOF
         mp4d_memset(&p_tr->trex, 0, sizeof(p_tr->trex));
         p_tr->have_trex = 0;
+#endif
+#if MP4D_TRACKREADER_CENC
         p_tr->num_saiz = 0;
         p_tr->num_saio = 0;
+        piff_senc_reset(p_tr);
+#else
+        p_tr->have_encryption = 0;
+#endif
 
         CHECK( mp4d_parse_box(p_tr->atom, &nav) );
+#if !MP4D_TRACKREADER_CENC
+        ASSURE( !p_tr->have_encryption, MP4D_E_UNSUPPRTED_FORMAT,
+                ("track_ID %" PRIu32 ": Cannot read encrypted samples, "
+                 "trackreader built without MP4D_TRACKREADER_CENC", p_tr->track_ID) );
+#endif
 
+#if MP4D_TRACKREADER_MOOV
         debug(("stts at %p\n", p_tr->moov.stts.buffer.p_data));
         debug(("ctts at %p\n", p_tr->moov.ctts.buffer.p_data));
         debug(("stsz/stz2 at %p\n", p_tr->moov.stz.buffer.p_data));
         debug(("stsc at %p\n", p_tr->moov.stsc.buffer.p_data));
         debug(("stco/co64 at %p\n", p_tr->moov.co.chunk_offsets.p_data));
         debug(("stss at %p\n", p_tr->moov.stss.buffer.p_data));
-        debug(("elst at %p\n", p_tr->elst.buffer.p_data));
+#endif
+        debug(("elst at %p\n", (void *) p_tr->elst.p_entries));
         debug(("subs at %p\n", p_tr->subs.buffer.p_data));
+#if MP4D_TRACKREADER_CENC
         debug(("number of saiz: %d\n", p_tr->num_saiz));
         debug(("number of saio: %d\n", p_tr->num_saio));
+#endif
         debug(("sdtp at %p\n", p_tr->moov.sdtp.buffer.p_data));
         debug(("stdp at %p\n", p_tr->moov.stdp.buffer.p_data));
         debug(("padb at %p\n", p_tr->moov.padb.buffer.p_data));
 
+#if MP4D_TRACKREADER_MOOV
         ASSURE( p_tr->moov.stts.buffer.p_data != NULL, MP4D_E_INFO_NOT_AVAIL,
                     ("Missing mandatory box 'stts'") );
         /* CTS defaults to 0 if ctts not present */
@@ -1633,11 +2747,23 @@ init_segment(mp4d_trackreader_ptr_t p_tr)
         {
             CHECK( mp4d_stss_init(&p_tr->moov.stss, NULL) );
         }
-
-        if (p_tr->elst.buffer.p_data == NULL)
+#else
+        ASSURE( p_tr->moov.stz.sample_count == 0, MP4D_E_UNSUPPRTED_FORMAT,
+                ("track_ID %" PRIu32 ": Cannot read %" PRIu32 " samples in moov, "
+                 "trackreader built without MP4D_TRACKREADER_MOOV", p_tr->track_ID, p_tr->moov.stz.sample_count) );
+#endif
+
+        ASSURE( p_tr->num_edits <= MP4D_MAX_EDITS ||
+                (p_tr->p_edit_mem != NULL && p_tr->num_edits <= p_tr->max_edits), MP4D_E_BUFFER_TOO_SMALL,
+                ("track_ID %" PRIu32 ": elst has %" PRIu32 " edits, see mp4d_trackreader_set_edit_mem()",
+                 p_tr->track_ID, p_tr->num_edits) );
+
+        if (p_tr->elst.p_entries == NULL)
         {
             CHECK( mp4d_elst_init(&p_tr->elst,
                                   NULL,
+                                  NULL,
+                                  0,
                                   p_tr->media_time_scale,
                                   p_tr->movie_time_scale) );
         }
@@ -1651,16 +2777,27 @@ init_segment(mp4d_trackreader_ptr_t p_tr)
         /* stdp may be non-present */
         /* padb may be non-present */
     }
+#if MP4D_TRACKREADER_MOOF
     else if (MP4D_FOURCC_EQ(p_tr->atom.type, "moof"))
     {
         /* reset once per moof, not per trun */
         mp4d_memset(&p_tr->subs, 0, sizeof(p_tr->subs));
         mp4d_memset(&p_tr->moov, 0, sizeof(p_tr->moov)); /* sdtp, stdp, padb */
 
+#if MP4D_TRACKREADER_CENC
         p_tr->num_saiz = 0;
         p_tr->num_saio = 0;        
+        piff_senc_reset(p_tr);
+#else
+        p_tr->have_encryption = 0;
+#endif
 
         CHECK( get_next_trun(p_tr, 0) );
+#if !MP4D_TRACKREADER_CENC
+        ASSURE( !p_tr->have_encryption, MP4D_E_UNSUPPRTED_FORMAT,
+                ("track_ID %" PRIu32 ": Cannot read encrypted samples, "
+                 "trackreader built without MP4D_TRACKREADER_CENC", p_tr->track_ID) );
+#endif
 
         if (p_tr->subs.buffer.p_data == NULL)
         {
@@ -1674,7 +2811,7 @@ init_segment(mp4d_trackreader_ptr_t p_tr)
         }
         else
         {
-            if (p_tr->moof.traf_number > 0)
+            if (p_tr->traf.preceding > 0)
             {
                 /* Not the first traf in moof, default-base-is-moof must be set */
                 ASSURE(p_tr->moof.tfhd.tf_flags & 0x020000,
@@ -1682,7 +2819,7 @@ init_segment(mp4d_trackreader_ptr_t p_tr)
                            ("track_ID %d: Sorry, base-data-offset-present is zero, and traf is not "
                             "the first in moof (but number %d) and default-base-is-moof is zero. Not supported",
                             p_tr->track_ID,
-                            p_tr->moof.traf_number + 1) );
+                            p_tr->traf.preceding + 1) );
                 /* Without default-base-is-moof, we would need to read all samples
                    from previous traf boxes, in order to get the base_data_offset for
                    this traf (which is the end of the previous traf's samples) */
@@ -1703,7 +2840,7 @@ init_segment(mp4d_trackreader_ptr_t p_tr)
             p_tr->moof_iter.cur_data_offset = p_tr->moof.tfhd.base_data_offset + p_tr->moof.trun.data_offset;
         }
 
-        if (!p_tr->moof.trun.data_offset && !p_tr->moof.traf_number)
+        if (!p_tr->moof.trun.data_offset && !p_tr->traf.preceding)
         {
             p_tr->moof_iter.cur_data_offset = p_tr->atom_offset + p_tr->atom.size + 16;
         }
@@ -1721,8 +2858,12 @@ init_segment(mp4d_trackreader_ptr_t p_tr)
             p_tr->cur_dts = p_tr->abs_time_offset;
         }
 
+#if MP4D_TRACKREADER_CENC
+        CHECK( moof_set_aux_range(p_tr) );
         CHECK( moof_set_aux_offset(p_tr) );
+#endif
     }
+#endif
     else
     {
         ASSURE( 0, MP4D_E_UNSUPPRTED_FORMAT,
@@ -1736,6 +2877,351 @@ init_segment(mp4d_trackreader_ptr_t p_tr)
     return MP4D_NO_ERROR;
 }
 
+/** @brief Position the track reader before the sample with the given index in the segment
+
+    Moves forward with the skip functions. A moov is rewound in place, unless
+    subs or sample aux info are present, which cannot be read backwards; then,
+    and for a moof, the segment is re-initialized and skipped from the start.
+ */
+static mp4d_error_t
+goto_sample(mp4d_trackreader_ptr_t p_tr,
+            uint64_t sample_index)
+{
+#if MP4D_TRACKREADER_MOOV
+    if (MP4D_FOURCC_EQ(p_tr->atom.type, "moov"))
+    {
+        uint32_t cur_index = p_tr->moov.stz.next_sample_index;
+
+        if (sample_index >= cur_index)
+        {
+            return moov_skip(p_tr, sample_index - cur_index);
+        }
+        if (p_tr->subs.buffer.p_data == NULL && !moov_have_sample_aux(p_tr))
+        {
+            return moov_rewind(p_tr, cur_index - (uint32_t) sample_index);
+        }
+    }
+#endif
+
+    CHECK( init_segment(p_tr) );
+
+#if MP4D_TRACKREADER_MOOF
+    if (MP4D_FOURCC_EQ(p_tr->atom.type, "moof"))
+    {
+        return moof_skip(p_tr, sample_index);
+    }
+#endif
+
+    return moov_skip(p_tr, sample_index);
+}
+
+/** @brief Copy the track reader, positioned at sample_index, into checkpoint i
+ */
+static void
+gop_checkpoint_save(mp4d_trackreader_ptr_t p_tr,
+                    uint32_t i,
+                    uint64_t sample_index)
+{
+    mp4d_trackreader_ptr_t p_checkpoint = &p_tr->gop.p_checkpoints[i];
+
+    assert( i < p_tr->gop.max_checkpoints );
+
+    mp4d_memcpy(p_checkpoint, p_tr, sizeof(*p_checkpoint));
+    p_checkpoint->gop.start = sample_index;
+}
+
+/** @brief Go back to checkpoint i
+
+    Restores all of the track reader but its GOP state.
+ */
+static uint64_t
+gop_checkpoint_load(mp4d_trackreader_ptr_t p_tr,
+                    uint32_t i)
+{
+    struct gop_state_t_ gop = p_tr->gop;
+    uint64_t sample_index;
+
+    assert( i < gop.max_checkpoints );
+
+    mp4d_memcpy(p_tr, &gop.p_checkpoints[i], sizeof(*p_tr));
+    sample_index = p_tr->gop.start;
+    p_tr->gop = gop;
+
+    return sample_index;
+}
+
+/** @brief Position the track reader at the latest checkpoint before sample_index, or at the start of the segment
+
+    The checkpoints at or after sample_index are dropped; going backwards, they are not needed again.
+    *p_loaded is set if a checkpoint was used.
+ */
+static mp4d_error_t
+gop_checkpoint_goto(mp4d_trackreader_ptr_t p_tr,
+                    uint64_t sample_index,
+                    uint64_t *p_position,
+                    int *p_loaded)
+{
+    while (p_tr->gop.num_checkpoints > 0 &&
+           p_tr->gop.p_checkpoints[p_tr->gop.num_checkpoints - 1].gop.start >= sample_index)
+    {
+        p_tr->gop.num_checkpoints--;
+    }
+
+    *p_loaded = p_tr->gop.num_checkpoints > 0;
+    if (*p_loaded)
+    {
+        *p_position = gop_checkpoint_load(p_tr, p_tr->gop.num_checkpoints - 1);
+        return MP4D_NO_ERROR;
+    }
+
+    *p_position = 0;
+    return init_segment(p_tr);
+}
+
+/** @brief Get the next sample at which to keep a checkpoint on the way to end
+
+    Spreads the free checkpoints evenly over the samples between the latest
+    checkpoint and end, keeping the last slot free. So the way back to the
+    start of the segment is split in as many parts as there is memory for.
+    Returns end if there is no free checkpoint.
+ */
+static uint64_t
+gop_checkpoint_next(mp4d_trackreader_ptr_t p_tr,
+                    uint64_t end)
+{
+    uint32_t num = p_tr->gop.num_checkpoints;
+    uint64_t last = 0;
+
+    if (p_tr->gop.max_checkpoints < num + 2)
+    {
+        return end;
+    }
+    if (num > 0)
+    {
+        last = p_tr->gop.p_checkpoints[num - 1].gop.start;
+    }
+    if (last + 1 >= end)
+    {
+        return end;
+    }
+
+    /* At least one sample after the latest checkpoint */
+    return last + 1 + (end - last - 1) / (p_tr->gop.max_checkpoints - num);
+}
+
+#if MP4D_TRACKREADER_MOOV
+/** @brief Position the track reader at gop_start in a moov that cannot be rewound
+
+    Skips forward from the latest checkpoint before gop_start, and keeps
+    checkpoints on the way, see gop_checkpoint_next().
+ */
+static mp4d_error_t
+moov_goto_gop_start(mp4d_trackreader_ptr_t p_tr,
+                    uint64_t gop_start)
+{
+    uint64_t sample_index;
+    int loaded;
+
+    CHECK( gop_checkpoint_goto(p_tr, gop_start + 1, &sample_index, &loaded) );
+
+    while (sample_index < gop_start)
+    {
+        uint64_t next = gop_checkpoint_next(p_tr, gop_start);
+
+        if (next <= sample_index || next > gop_start)
+        {
+            next = gop_start;
+        }
+        CHECK( moov_skip(p_tr, next - sample_index) );
+        sample_index = next;
+        if (sample_index < gop_start)
+        {
+            gop_checkpoint_save(p_tr, p_tr->gop.num_checkpoints, sample_index);
+            p_tr->gop.num_checkpoints++;
+        }
+    }
+
+    return MP4D_NO_ERROR;
+}
+#endif
+
+#if MP4D_TRACKREADER_MOOF
+/** @brief Find the GOP before the given sample in the moof, and position the track reader at its start
+
+    Reads the sample flags of the truns from the latest checkpoint before gop_end,
+    and keeps checkpoints at GOP starts on the way, see gop_checkpoint_next().
+    The last free checkpoint holds a copy at the latest GOP start found.
+    If gop_end is (uint64_t) -1 it is set to the number of samples in the moof;
+    then no checkpoints are kept, as the way back is not known yet.
+ */
+static mp4d_error_t
+moof_goto_prev_gop(mp4d_trackreader_ptr_t p_tr,
+                   uint64_t *p_gop_start,
+                   uint64_t *p_gop_end)
+{
+    uint64_t sample_index;
+    uint64_t gop_start;
+    uint64_t next;
+    uint32_t copy;      /* checkpoint at gop_start, or max_checkpoints if none */
+    int loaded;
+
+    CHECK( gop_checkpoint_goto(p_tr, *p_gop_end, &sample_index, &loaded) );
+    gop_start = sample_index;
+    copy = p_tr->gop.max_checkpoints;
+    if (loaded)
+    {
+        /* The checkpoint is at a GOP start, continue after it */
+        copy = p_tr->gop.num_checkpoints - 1;
+        CHECK( moof_skip(p_tr, 1) );
+        sample_index++;
+    }
+    next = gop_checkpoint_next(p_tr, *p_gop_end);
+
+    while (1)
+    {
+        uint32_t index;
+
+        if (p_tr->moof_iter.samples_left == 0)
+        {
+            if (p_tr->moof_iter.current_trun + 1 >= p_tr->moof.num_trun)
+            {
+                break;
+            }
+            CHECK( moof_next_trun(p_tr) );
+            continue;
+        }
+
+        CHECK( moof_find_sync_sample(p_tr, &index) );
+        if (sample_index + index >= *p_gop_end)
+        {
+            break;
+        }
+        if (index < p_tr->moof_iter.samples_left)
+        {
+            /* Found a sync sample, continue after it */
+            CHECK( moof_skip(p_tr, index) );
+            sample_index += index;
+            gop_start = sample_index;
+
+            copy = p_tr->gop.num_checkpoints;
+            if (copy < p_tr->gop.max_checkpoints)
+            {
+                gop_checkpoint_save(p_tr, copy, gop_start);
+                if (gop_start >= next)
+                {
+                    p_tr->gop.num_checkpoints++;
+                    next = gop_checkpoint_next(p_tr, *p_gop_end);
+                }
+            }
+            index = 1;
+        }
+        CHECK( moof_skip(p_tr, index) );
+        sample_index += index;
+    }
+
+    if (*p_gop_end == (uint64_t) -1)
+    {
+        *p_gop_end = sample_index;
+    }
+    *p_gop_start = gop_start;
+
+    if (copy < p_tr->gop.max_checkpoints)
+    {
+        gop_checkpoint_load(p_tr, copy);
+        return MP4D_NO_ERROR;
+    }
+    return goto_sample(p_tr, gop_start);
+}
+#endif
+
+int
+mp4d_trackreader_prev_gop
+(
+    mp4d_trackreader_ptr_t p_tr,
+    uint32_t *p_num_samples
+)
+{
+    uint64_t gop_start;
+    uint64_t gop_end;
+
+    ASSURE( p_tr != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( p_num_samples != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    gop_end = p_tr->gop.start;
+
+#if MP4D_TRACKREADER_MOOF
+    if (MP4D_FOURCC_EQ(p_tr->atom.type, "moof"))
+    {
+        CHECK( moof_goto_prev_gop(p_tr, &gop_start, &gop_end) );
+        ASSURE( gop_end > 0, MP4D_E_PREV_SEGMENT,
+                ("track_ID %" PRIu32 ": No more GOPs in this segment", p_tr->track_ID) );
+
+        p_tr->gop.start = gop_start;
+        *p_num_samples = (uint32_t) (gop_end - gop_start);
+
+        return MP4D_NO_ERROR;
+    }
+    else
+#endif
+    {
+        assert( MP4D_FOURCC_EQ(p_tr->atom.type, "moov") );
+
+        if (gop_end == (uint64_t) -1)
+        {
+            /* First call, start with the last GOP */
+            gop_end = p_tr->moov.stz.sample_count;
+#if MP4D_TRACKREADER_MOOV
+            p_tr->gop.stss_index = p_tr->moov.stss.count;
+#endif
+        }
+        ASSURE( gop_end > 0, MP4D_E_PREV_SEGMENT,
+                ("track_ID %" PRIu32 ": No more GOPs in this segment", p_tr->track_ID) );
+
+#if MP4D_TRACKREADER_MOOV
+        if (p_tr->moov.stss.buffer.p_data != NULL)
+        {
+            /* Last sync sample before the end of the GOP. Samples before the first sync sample
+               form a GOP of their own */
+            gop_start = 0;
+            while (p_tr->gop.stss_index > 0)
+            {
+                uint32_t sync_sample;  /* counting from one */
+
+                CHECK( mp4d_stss_get_entry(&p_tr->moov.stss, p_tr->gop.stss_index - 1, &sync_sample) );
+                p_tr->gop.stss_index--;
+                if (sync_sample > 0 && sync_sample - 1 < gop_end)
+                {
+                    gop_start = sync_sample - 1;
+                    break;
+                }
+            }
+        }
+        else
+#endif
+        {
+            /* All samples are sync samples */
+            gop_start = gop_end - 1;
+        }
+    }
+
+#if MP4D_TRACKREADER_MOOV
+    if (p_tr->gop.max_checkpoints > 0 &&
+        (p_tr->subs.buffer.p_data != NULL || moov_have_sample_aux(p_tr)))
+    {
+        CHECK( moov_goto_gop_start(p_tr, gop_start) );
+    }
+    else
+#endif
+    {
+        CHECK( goto_sample(p_tr, gop_start) );
+    }
+
+    p_tr->gop.start = gop_start;
+    *p_num_samples = (uint32_t) (gop_end - gop_start);
+
+    return MP4D_NO_ERROR;
+}
+
 int
 mp4d_trackreader_seek_to 
 (
@@ -1759,7 +3245,7 @@ mp4d_trackreader_seek_to
 
         Uses brute force algorithm for now:
             - 1st linear search from the beginning until first sample which is too late.
-            - 2nd linear search from the beginning, two samples less (so that next call of next_sample() returns the sync sample)
+            - 2nd pass skips from the beginning to before the sync sample (so that next call of next_sample() returns the sync sample)
 
         To improve on this:
             - See description in ISO spec descriptive index.
@@ -1803,14 +3289,8 @@ mp4d_trackreader_seek_to
 
         seek_sample_index -= 1;  /* Now in range 0, ... */
 
-        /* Move to before seek sample (using brute force) */
-        {
-            uint64_t i;
-            for (i = 0; i < seek_sample_index; i++)
-            {
-                CHECK( mp4d_trackreader_next_sample(p_tr, &sample) );
-            }
-        }
+        /* Move to before seek sample */
+        CHECK( mp4d_trackreader_skip(p_tr, seek_sample_index) );
         /* Next call to next_sample will return the seek sample */
     }
 
@@ -1869,9 +3349,22 @@ mp4d_trackreader_init_segment
     }
     p_tr->atom = p_demuxer->atom;
     p_tr->atom_offset = p_demuxer->atom_offset;
+    p_tr->gop.start = (uint64_t) -1;
+    p_tr->gop.num_checkpoints = 0;
 
     {
-        mp4d_error_t err = init_segment(p_tr);
+        mp4d_error_t err = MP4D_NO_ERROR;
+
+#if MP4D_TRACKREADER_MOOF
+        if (MP4D_FOURCC_EQ(p_tr->atom.type, "moof"))
+        {
+            err = find_traf(p_tr, p_demuxer);
+        }
+#endif
+        if (err == MP4D_NO_ERROR)
+        {
+            err = init_segment(p_tr);
+        }
 
         if (err != MP4D_NO_ERROR)
         {
@@ -1910,7 +3403,7 @@ mp4d_trackreader_query_mem
     ASSURE( dynamic_mem_size != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
     ASSURE( static_mem_size != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
 
-    *dynamic_mem_size = 0;
+    *dynamic_mem_size = (uint64_t) MP4D_TRACKREADER_GOP_CHECKPOINTS * sizeof(struct mp4d_trackreader_t_);
     *static_mem_size = sizeof(struct mp4d_trackreader_t_);
 
     return 0;
@@ -1926,12 +3419,77 @@ mp4d_trackreader_init
 {
     ASSURE( p_tr != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
     ASSURE( static_mem != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
-    (void) dynamic_mem; /* unused */
 
     *p_tr = static_mem;
     mp4d_memset(*p_tr, 0, sizeof(**p_tr));
 
-    return 0;
+    /* GOP checkpoints of mp4d_trackreader_prev_gop() */
+    return mp4d_trackreader_set_gop_mem(*p_tr, dynamic_mem,
+                                        (uint64_t) MP4D_TRACKREADER_GOP_CHECKPOINTS * sizeof(**p_tr));
+}
+
+int
+mp4d_trackreader_query_edit_mem
+(
+    mp4d_trackreader_ptr_t p_tr,
+    uint64_t *edit_mem_size
+)
+{
+    ASSURE( p_tr != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+    ASSURE( edit_mem_size != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    *edit_mem_size = 0;
+    if (p_tr->num_edits > MP4D_MAX_EDITS)
+    {
+        *edit_mem_size = (uint64_t) p_tr->num_edits * sizeof(elst_entry_t);
+    }
+
+    return MP4D_NO_ERROR;
+}
+
+int
+mp4d_trackreader_set_edit_mem
+(
+    mp4d_trackreader_ptr_t p_tr,
+    void *edit_mem,
+    uint64_t edit_mem_size
+)
+{
+    ASSURE( p_tr != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    p_tr->p_edit_mem = edit_mem;
+    p_tr->max_edits = 0;
+    if (edit_mem != NULL)
+    {
+        uint64_t max_edits = edit_mem_size / sizeof(elst_entry_t);
+
+        p_tr->max_edits = max_edits > (uint32_t) -1 ? (uint32_t) -1 : (uint32_t) max_edits;
+    }
+
+    return MP4D_NO_ERROR;
+}
+
+int
+mp4d_trackreader_set_gop_mem
+(
+    mp4d_trackreader_ptr_t p_tr,
+    void *gop_mem,
+    uint64_t gop_mem_size
+)
+{
+    ASSURE( p_tr != NULL, MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    p_tr->gop.p_checkpoints = gop_mem;
+    p_tr->gop.max_checkpoints = 0;
+    p_tr->gop.num_checkpoints = 0;
+    if (gop_mem != NULL)
+    {
+        uint64_t max_checkpoints = gop_mem_size / sizeof(struct mp4d_trackreader_t_);
+
+        p_tr->gop.max_checkpoints = max_checkpoints > (uint32_t) -1 ? (uint32_t) -1 : (uint32_t) max_checkpoints;
+    }
+
+    return MP4D_NO_ERROR;
 }
 
 int
@@ -1941,10 +3499,19 @@ mp4d_trackreader_set_tenc(
     uint8_t default_iv_size,
     uint8_t* default_kid)
 {
+#if MP4D_TRACKREADER_CENC
     /* Copy this data into the piff senc reader data */
     p_tr->piff_senc_reader.default_algorithmID = default_algorithmID;
     p_tr->piff_senc_reader.default_iv_size = default_iv_size;
     memcpy(p_tr->piff_senc_reader.default_kid, default_kid, 16);
+    piff_senc_resolve(p_tr);
+#else
+    /* No PIFF 'senc' to apply the defaults to */
+    (void) p_tr;
+    (void) default_algorithmID;
+    (void) default_iv_size;
+    (void) default_kid;
+#endif
 
     return 0;
 }
@@ -1956,20 +3523,64 @@ mp4d_trackreader_get_cur_tenc(
     uint8_t* iv_size,
     uint8_t* kid)
 {
-    /* copy this data back out */
-    
-    if (p_tr->piff_senc_reader.flags & 0x01)
+#if MP4D_TRACKREADER_CENC
+    /* copy this data back out, resolved for the current fragment */
+    *algorithmID = p_tr->piff_senc_reader.algorithmID;
+    *iv_size = p_tr->piff_senc_reader.iv_size;
+    memcpy(kid, p_tr->piff_senc_reader.kid, 16);
+
+    return 0;
+#else
+    (void) p_tr;
+    (void) algorithmID;
+    (void) iv_size;
+    (void) kid;
+
+    return MP4D_E_INFO_NOT_AVAIL;
+#endif
+}
+
+int
+mp4d_trackreader_get_aux_range(
+    mp4d_trackreader_ptr_t p_tr,
+    uint32_t aux_info_type,
+    uint64_t *p_pos,
+    uint64_t *p_size,
+    const unsigned char **pp_data)
+{
+#if MP4D_TRACKREADER_CENC
+    uint8_t j;
+#endif
+
+    ASSURE( p_tr != NULL && p_pos != NULL && p_size != NULL && pp_data != NULL,
+            MP4D_E_WRONG_ARGUMENT, ("Null input") );
+
+    if (!MP4D_FOURCC_EQ(p_tr->atom.type, "moof"))
     {
-        *algorithmID = p_tr->piff_senc_reader.override_algorithmID;
-        *iv_size = p_tr->piff_senc_reader.override_iv_size;
-        memcpy(kid, p_tr->piff_senc_reader.override_kid, 16);
+        return MP4D_E_INFO_NOT_AVAIL;
     }
-    else
+#if MP4D_TRACKREADER_CENC
+    for (j = 0; j < p_tr->num_saio; j++)
     {
-        *algorithmID = p_tr->piff_senc_reader.default_algorithmID;
-        *iv_size = p_tr->piff_senc_reader.default_iv_size;
-        memcpy(kid, p_tr->piff_senc_reader.default_kid, 16);
+        if (p_tr->saio[j].aux_info_type == aux_info_type && p_tr->aux_range[j].valid)
+        {
+            const uint64_t moof_begin = p_tr->atom_offset + p_tr->atom.header;  /* payload */
+
+            *p_pos = p_tr->aux_range[j].pos;
+            *p_size = p_tr->aux_range[j].size;
+            *pp_data = NULL;
+            if (*p_pos >= moof_begin && *p_pos - moof_begin <= p_tr->atom.size &&
+                *p_size <= p_tr->atom.size - (*p_pos - moof_begin))
+            {
+                /* e.g. the sample data of 'senc' */
+                *pp_data = p_tr->atom.p_data + (*p_pos - moof_begin);
+            }
+            return MP4D_NO_ERROR;
+        }
     }
+#else
+    (void) aux_info_type;
+#endif
 
-    return 0;
+    return MP4D_E_INFO_NOT_AVAIL;
 }
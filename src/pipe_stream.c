@@ -0,0 +1,746 @@
+/************************************************************************************************************
+ * Copyright (c) 2017, Dolby Laboratories Inc.
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ *    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+ *    promote products derived from this software without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ ************************************************************************************************************/
+#include "pipe_stream.h"
+
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#ifdef _MSC_VER
+#include <io.h>
+#define STDIN_FILENO 0
+#else
+#include <unistd.h>
+#endif
+
+/** @brief A top-level box read from the source */
+typedef struct
+{
+    uint64_t offset;      /* file position */
+    uint64_t size;        /* bytes received */
+    uint64_t box_size;    /* expected size, 0 if the box extends to the end of the file */
+    size_t data_size;     /* bytes allocated */
+    unsigned char *data;
+} pipe_unit_t;
+
+typedef struct pipe_stream_ *pipe_stream_t;
+
+struct pipe_source_t_
+{
+    int fd;
+    char *path;
+    int refs;                   /* owner and streams */
+
+    mp4d_pusher_ptr_t p_push;
+    void *p_push_mem;
+    mp4d_demuxer_ptr_t p_dmux;  /* used by the push parser */
+    void *p_dmux_static_mem;
+    void *p_dmux_dynamic_mem;
+
+    unsigned char *chunk;
+    size_t chunk_size;
+    size_t chunk_fill;
+    size_t chunk_rpos;
+    int is_eof;
+
+    /* Units are numbered in file order. The units before the first 'moof'
+       are kept in header[], later units in units[] until all streams have passed them. */
+    pipe_unit_t *header;
+    uint32_t num_header;
+    uint32_t max_header;
+    pipe_unit_t *units;         /* units[i] is unit number first_unit + i */
+    uint32_t num_units;
+    uint32_t max_units;
+    uint32_t first_unit;
+    uint32_t num_read;          /* total number of units read */
+    int have_moof;
+    int chunked;                /* Streamed boxes are provided while they are received */
+    int last_partial;           /* The last unit read is a streamed box still being received */
+
+    pipe_stream_t *streams;     /* streams which hold back the release of units */
+    uint32_t num_streams;
+    uint32_t max_streams;
+
+    mp4d_ftyp_info_t ftyp;
+    unsigned char *compat_brands;
+};
+
+/** @brief pipe_stream implementation of the mp4_source API */
+struct pipe_stream_
+{
+    struct fragment_reader_t_ base;
+
+    pipe_source_t src;
+    uint32_t next_unit;         /* number of the unit returned by the next call to next_atom() */
+    int header_only;
+};
+
+static const size_t PIPE_SOURCE_READ_SIZE = 64*1024;
+static const uint64_t PIPE_SOURCE_MAX_BOX_SIZE = 16*1024*1024;
+
+static pipe_unit_t *
+source_unit(pipe_source_t src, uint32_t n)
+{
+    if (n < src->num_header)
+    {
+        return &src->header[n];
+    }
+    if (n < src->first_unit || n - src->first_unit >= src->num_units)
+    {
+        return NULL;  /* released, or not read yet */
+    }
+    return &src->units[n - src->first_unit];
+}
+
+static int
+unit_is_moof(const pipe_unit_t *p_unit)
+{
+    return p_unit->size >= 8 && MP4D_FOURCC_EQ(p_unit->data + 4, "moof");
+}
+
+static int
+unit_append(pipe_unit_t *p_unit, const unsigned char *p_data, uint64_t size)
+{
+    int err = 0;
+
+    if (p_unit->size + size > p_unit->data_size)
+    {
+        /* Size is known except for a box that extends to the end of the file */
+        size_t alloc_size = (size_t) (p_unit->box_size > 0 ? p_unit->box_size : 2 * (p_unit->size + size));
+
+        p_unit->data = realloc(p_unit->data, alloc_size);
+        ASSURE( p_unit->data != NULL, ("Failed to allocate %" PRIz " bytes", alloc_size) );
+        p_unit->data_size = alloc_size;
+    }
+    memcpy(p_unit->data + p_unit->size, p_data, (size_t) size);
+    p_unit->size += size;
+
+cleanup:
+    return err;
+}
+
+/** @brief Get the next push parser event, reading more input as needed
+ *  @return 0: event available
+ *          1: unexpected error
+ *          2: end of input
+ */
+static int
+source_next_event(pipe_source_t src, mp4d_push_event_t *p_ev)
+{
+    int err = 0;
+
+    for (;;)
+    {
+        uint64_t consumed;
+        int64_t bytes_read;
+        int rv = mp4d_pusher_push(src->p_push,
+                                  src->chunk + src->chunk_rpos,
+                                  src->chunk_fill - src->chunk_rpos,
+                                  src->is_eof,
+                                  &consumed,
+                                  p_ev);
+
+        ASSURE( rv == MP4D_NO_ERROR, ("Invalid or truncated box in '%s' (%d)", src->path, rv) );
+        src->chunk_rpos += (size_t) consumed;
+
+        if (p_ev->type != MP4D_PUSH_NONE)
+        {
+            break;
+        }
+        if (src->is_eof)
+        {
+            return 2;
+        }
+
+#ifdef _MSC_VER
+        bytes_read = _read(src->fd, src->chunk, (unsigned int) src->chunk_size);
+#else
+        do
+        {
+            bytes_read = read(src->fd, src->chunk, src->chunk_size);
+        } while (bytes_read < 0 && errno == EINTR);
+#endif
+        ASSURE( bytes_read >= 0, ("Failed to read from '%s'", src->path) );
+
+        src->chunk_fill = (size_t) bytes_read;
+        src->chunk_rpos = 0;
+        src->is_eof = (bytes_read == 0);
+    }
+
+cleanup:
+    return err;
+}
+
+/** @brief Read the next top-level box from the input
+ *  @return 0: unit added
+ *          1: unexpected error
+ *          2: end of input
+ */
+/** @brief Receive more data of the last unit, a streamed box still being received
+ *  @return 0: data added
+ *          1: unexpected error
+ *          2: end of input
+ */
+static int
+source_continue_unit(pipe_source_t src)
+{
+    int err = 0;
+    pipe_unit_t *p_unit = (pipe_unit_t *) source_unit(src, src->num_read - 1);
+    mp4d_push_event_t ev;
+    int err_next = source_next_event(src, &ev);
+
+    if (err_next == 2 && p_unit->box_size == 0)
+    {
+        /* Box which extends to the end of the file */
+        src->last_partial = 0;
+        return 2;
+    }
+    ASSURE( err_next != 2, ("'%s' ends within a box", src->path) );
+    if (err_next != 0)
+    {
+        return err_next;
+    }
+    ASSURE( ev.type == MP4D_PUSH_DATA, ("Unexpected box @%" PRIu64 " within a box", ev.offset) );
+
+    CHECK( unit_append(p_unit, ev.p_data, ev.size) );
+    if (p_unit->box_size != 0 && p_unit->size == p_unit->box_size)
+    {
+        src->last_partial = 0;
+    }
+
+cleanup:
+    return err;
+}
+
+static int
+source_read_unit(pipe_source_t src)
+{
+    int err = 0;
+    pipe_unit_t unit;
+    pipe_unit_t *p_dst;
+    int partial = 0;
+
+    while (src->last_partial)
+    {
+        int err_next = source_continue_unit(src);
+
+        if (err_next != 0)
+        {
+            return err_next;
+        }
+    }
+
+    memset(&unit, 0, sizeof(unit));
+
+    for (;;)
+    {
+        mp4d_push_event_t ev;
+        int err_next = source_next_event(src, &ev);
+
+        if (err_next == 2 && unit.data != NULL && unit.box_size == 0)
+        {
+            /* Box which extends to the end of the file */
+            break;
+        }
+        ASSURE( err_next != 2 || unit.data == NULL, ("'%s' ends within a box", src->path) );
+        if (err_next != 0)
+        {
+            return err_next;
+        }
+
+        if (ev.type == MP4D_PUSH_BOX)
+        {
+            unit.offset = ev.offset;
+            unit.box_size = ev.size;
+            if (!ev.is_streamed)
+            {
+                CHECK( unit_append(&unit, ev.p_data, ev.size) );
+                break;
+            }
+            CHECK( unit_append(&unit, ev.p_data, ev.header_size) );
+            if (src->chunked && unit.size != unit.box_size)
+            {
+                /* Provide the box now, its data is received by load() */
+                partial = 1;
+                break;
+            }
+        }
+        else
+        {
+            CHECK( unit_append(&unit, ev.p_data, ev.size) );
+        }
+        if (unit.box_size != 0 && unit.size == unit.box_size)
+        {
+            break;
+        }
+    }
+
+    if (!src->have_moof && unit_is_moof(&unit))
+    {
+        src->have_moof = 1;
+        src->first_unit = src->num_header;
+    }
+
+    if (!src->have_moof)
+    {
+        if (src->num_header == src->max_header)
+        {
+            src->max_header = 2 * src->max_header + 4;
+            src->header = realloc(src->header, src->max_header * sizeof(*src->header));
+            ASSURE( src->header != NULL, ("Allocation error") );
+        }
+        p_dst = &src->header[src->num_header++];
+    }
+    else
+    {
+        if (src->num_units == src->max_units)
+        {
+            src->max_units = 2 * src->max_units + 4;
+            src->units = realloc(src->units, src->max_units * sizeof(*src->units));
+            ASSURE( src->units != NULL, ("Allocation error") );
+        }
+        p_dst = &src->units[src->num_units++];
+    }
+    *p_dst = unit;
+    unit.data = NULL;
+    src->num_read++;
+    src->last_partial = partial;
+
+cleanup:
+    free(unit.data);
+    return err;
+}
+
+/* Release the units all streams have moved past */
+static void
+source_trim(pipe_source_t src)
+{
+    uint32_t min_unit = UINT32_MAX;
+    uint32_t i;
+
+    if (src->num_streams == 0)
+    {
+        /* Keep everything for streams created later */
+        return;
+    }
+    for (i = 0; i < src->num_streams; i++)
+    {
+        /* The current unit of each stream is still in use */
+        uint32_t curr = src->streams[i]->next_unit > 0 ? src->streams[i]->next_unit - 1 : 0;
+
+        if (curr < min_unit)
+        {
+            min_unit = curr;
+        }
+    }
+
+    i = 0;
+    while (i < src->num_units && src->first_unit + i < min_unit)
+    {
+        free(src->units[i].data);
+        i++;
+    }
+    if (i > 0)
+    {
+        memmove(src->units, src->units + i, (src->num_units - i) * sizeof(*src->units));
+        src->num_units -= i;
+        src->first_unit += i;
+    }
+}
+
+static void
+source_destroy(pipe_source_t src)
+{
+    uint32_t i;
+
+    if (src->fd >= 0 && src->fd != STDIN_FILENO)
+    {
+#ifdef _MSC_VER
+        _close(src->fd);
+#else
+        close(src->fd);
+#endif
+    }
+    for (i = 0; i < src->num_header; i++)
+    {
+        free(src->header[i].data);
+    }
+    for (i = 0; i < src->num_units; i++)
+    {
+        free(src->units[i].data);
+    }
+    free(src->header);
+    free(src->units);
+    free(src->streams);
+    free(src->chunk);
+    free(src->p_push_mem);
+    free(src->p_dmux_static_mem);
+    free(src->p_dmux_dynamic_mem);
+    free(src->compat_brands);
+    free(src->path);
+    free(src);
+}
+
+void
+pipe_source_release(pipe_source_t src)
+{
+    if (src != NULL && --src->refs == 0)
+    {
+        source_destroy(src);
+    }
+}
+
+int
+pipe_source_new(pipe_source_t *p_src,
+                const char *path)
+{
+    int err = 0;
+    pipe_source_t src = malloc(sizeof(*src));
+
+    ASSURE( src != NULL, ("Allocation error") );
+    memset(src, 0, sizeof(*src));
+    src->fd = -1;
+    src->refs = 1;
+
+    src->path = string_dup(path);
+    ASSURE( src->path != NULL, ("Allocation error") );
+
+    {
+        uint64_t static_mem_size, dyn_mem_size;
+
+        CHECK( mp4d_demuxer_query_mem(&static_mem_size, &dyn_mem_size) );
+        src->p_dmux_static_mem = malloc((size_t) static_mem_size);
+        src->p_dmux_dynamic_mem = malloc((size_t) dyn_mem_size);
+        ASSURE( src->p_dmux_static_mem != NULL && src->p_dmux_dynamic_mem != NULL, ("Allocation error") );
+        CHECK( mp4d_demuxer_init(&src->p_dmux, src->p_dmux_static_mem, src->p_dmux_dynamic_mem) );
+
+        CHECK( mp4d_pusher_query_mem(PIPE_SOURCE_MAX_BOX_SIZE, &static_mem_size) );
+        ASSURE( (uint64_t) (size_t) static_mem_size == static_mem_size, ("Cannot allocate %" PRIu64 " bytes of memory", static_mem_size) );
+        src->p_push_mem = malloc((size_t) static_mem_size);
+        ASSURE( src->p_push_mem != NULL, ("Allocation error") );
+        CHECK( mp4d_pusher_init(&src->p_push, src->p_dmux, PIPE_SOURCE_MAX_BOX_SIZE, src->p_push_mem) );
+    }
+
+    src->chunk_size = PIPE_SOURCE_READ_SIZE;
+    src->chunk = malloc(src->chunk_size);
+    ASSURE( src->chunk != NULL, ("Allocation error") );
+
+    if (strcmp(path, "-") == 0)
+    {
+        src->fd = STDIN_FILENO;
+#ifdef _MSC_VER
+        _setmode(src->fd, _O_BINARY);
+#endif
+    }
+    else
+    {
+#ifdef _MSC_VER
+        src->fd = _open(path, _O_RDONLY | _O_BINARY);
+#else
+        src->fd = open(path, O_RDONLY);
+#endif
+    }
+    ASSURE( src->fd >= 0, ("Failed to open input file '%s'", path) );
+
+    /* File type from the first box */
+    {
+        int err_next = source_read_unit(src);
+        const pipe_unit_t *p_unit;
+        uint64_t box_size;
+
+        ASSURE( err_next != 2, ("Found no boxes in %s", path) );
+        ASSURE( err_next == 0, ("Unexpected error %d when reading first box from %s", err_next, path) );
+        p_unit = source_unit(src, 0);
+
+        if (MP4D_FOURCC_EQ(p_unit->data + 4, "ftyp"))
+        {
+            CHECK( mp4d_demuxer_parse(src->p_dmux, p_unit->data, p_unit->size, 0, p_unit->offset, &box_size) );
+            CHECK( mp4d_demuxer_get_ftyp_info(src->p_dmux, &src->ftyp) );
+
+            src->compat_brands = (unsigned char*)malloc(4 * src->ftyp.num_compat_brands + 1);
+            ASSURE( src->compat_brands != NULL, ("malloc failure") );
+            memcpy(src->compat_brands, src->ftyp.compat_brands, 4 * src->ftyp.num_compat_brands);
+
+            src->ftyp.compat_brands = src->compat_brands;
+        }
+        else
+        {
+            /* Assume Quicktime, see file_stream_new() */
+            src->ftyp.num_compat_brands = 1;
+            src->compat_brands = (unsigned char*)malloc(4);
+            ASSURE( src->compat_brands != NULL, ("malloc failure") );
+            memcpy(src->compat_brands, "qt  ", 4);
+
+            src->ftyp.compat_brands = src->compat_brands;
+            memcpy(src->ftyp.major_brand, src->ftyp.compat_brands, 4);
+            src->ftyp.minor_version = 0;
+        }
+    }
+
+    *p_src = src;
+cleanup:
+    if (err && src != NULL)
+    {
+        source_destroy(src);
+    }
+    return err;
+}
+
+int
+pipe_source_set_chunked(pipe_source_t src)
+{
+    src->chunked = 1;
+
+    return 0;
+}
+
+static int
+pipe_stream_next_atom(fragment_reader_t s)
+{
+    pipe_stream_t ps = (pipe_stream_t) s;
+    pipe_source_t src = ps->src;
+    const pipe_unit_t *p_unit;
+    uint64_t box_size;
+    int err = 0;
+
+    while (ps->next_unit >= src->num_read)
+    {
+        int err_next = source_read_unit(src);
+
+        if (err_next != 0)
+        {
+            return err_next;
+        }
+    }
+
+    p_unit = source_unit(src, ps->next_unit);
+    ASSURE( p_unit != NULL, ("Box #%" PRIu32 " of '%s' was already released", ps->next_unit, src->path) );
+    if (ps->header_only && ps->next_unit >= src->num_header)
+    {
+        /* Fragments are only available to streams which hold them back */
+        return 2;
+    }
+
+    if (src->last_partial && ps->next_unit + 1 == src->num_read)
+    {
+        /* Streamed box still being received, only the header is parsed */
+        int rv = mp4d_demuxer_parse(s->p_dmux, p_unit->data, p_unit->size, 0, p_unit->offset, &box_size);
+
+        ASSURE( rv == MP4D_NO_ERROR || rv == MP4D_E_BUFFER_TOO_SMALL,
+                ("Failed to parse box header @%" PRIu64 " (%d)", p_unit->offset, rv) );
+    }
+    else
+    {
+        CHECK( mp4d_demuxer_parse(s->p_dmux, p_unit->data, p_unit->size,
+                                  src->is_eof && ps->next_unit + 1 == src->num_read,
+                                  p_unit->offset, &box_size) );
+    }
+    ps->next_unit++;
+
+    source_trim(src);
+
+cleanup:
+    return err;
+}
+
+/* Forward-only: stay at the current moov/moof, or move to the next one */
+static int
+pipe_stream_seek(fragment_reader_t s,
+                 uint32_t track_ID,
+                 uint64_t seek_time,
+                 uint64_t *out_time)
+{
+    int err = 0;
+    pipe_stream_t ps = (pipe_stream_t) s;
+    mp4d_fourcc_t type;
+
+    (void) track_ID;
+    (void) seek_time;
+
+    if (ps->next_unit > 0)
+    {
+        CHECK( mp4d_demuxer_get_type(s->p_dmux, &type) );
+    }
+    while (ps->next_unit == 0 ||
+           (!MP4D_FOURCC_EQ(type, "moov") && !MP4D_FOURCC_EQ(type, "moof")))
+    {
+        CHECK( fragment_reader_next_atom(s) );
+        CHECK( mp4d_demuxer_get_type(s->p_dmux, &type) );
+    }
+
+    *out_time = 0;
+
+cleanup:
+    return err;
+}
+
+static int
+pipe_stream_load(fragment_reader_t s, uint64_t position, uint32_t size, unsigned char *p_buffer)
+{
+    pipe_stream_t ps = (pipe_stream_t) s;
+    pipe_source_t src = ps->src;
+    uint32_t n = 0;
+    int err = 0;
+
+    for (;;)
+    {
+        const pipe_unit_t *p_unit;
+
+        if (n == src->num_read)
+        {
+            int err_next = source_read_unit(src);
+
+            ASSURE( err_next != 2, ("Reading %" PRIu32 " bytes @%" PRIu64 " failed: end of input", size, position) );
+            CHECK( err_next );
+        }
+
+        p_unit = source_unit(src, n);
+        if (p_unit != NULL && src->last_partial && n + 1 == src->num_read && position >= p_unit->offset &&
+            (p_unit->box_size == 0 || position + size <= p_unit->offset + p_unit->box_size))
+        {
+            /* Wait only until the requested bytes of the streamed box have arrived */
+            while (src->last_partial && position + size > p_unit->offset + p_unit->size)
+            {
+                int err_next = source_continue_unit(src);
+
+                ASSURE( err_next != 2, ("Reading %" PRIu32 " bytes @%" PRIu64 " failed: end of input", size, position) );
+                CHECK( err_next );
+            }
+        }
+        if (p_unit != NULL &&
+            position >= p_unit->offset && position + size <= p_unit->offset + p_unit->size)
+        {
+            memcpy(p_buffer, p_unit->data + (position - p_unit->offset), size);
+            break;
+        }
+        n++;
+        if (n >= src->num_header && n < src->first_unit)
+        {
+            /* Skip the released units */
+            n = src->first_unit;
+        }
+    }
+
+cleanup:
+    return err;
+}
+
+static int
+pipe_stream_get_offset(fragment_reader_t s, uint64_t *offset)
+{
+    int err = 0;
+    pipe_stream_t ps = (pipe_stream_t) s;
+    const pipe_unit_t *p_unit;
+
+    ASSURE( offset != NULL, ("Null input") );
+    ASSURE( ps->next_unit > 0, ("No current box") );
+    p_unit = source_unit(ps->src, ps->next_unit - 1);
+    ASSURE( p_unit != NULL, ("Current box was released") );
+    *offset = p_unit->offset;
+
+cleanup:
+    return err;
+}
+
+static int
+pipe_stream_get_type(fragment_reader_t s, mp4d_ftyp_info_t *p_type)
+{
+    pipe_stream_t ps = (pipe_stream_t) s;
+
+    *p_type = ps->src->ftyp;
+
+    return 0;
+}
+
+static void
+pipe_stream_destroy(fragment_reader_t s)
+{
+    pipe_stream_t ps = (pipe_stream_t) s;
+
+    if (ps != NULL)
+    {
+        pipe_source_t src = ps->src;
+        uint32_t i;
+
+        for (i = 0; i < src->num_streams; i++)
+        {
+            if (src->streams[i] == ps)
+            {
+                src->streams[i] = src->streams[--src->num_streams];
+                break;
+            }
+        }
+        pipe_source_release(src);
+
+        fragment_reader_deinit(s);
+        free(s);
+    }
+}
+
+int
+pipe_stream_new(fragment_reader_t *p_s,
+                pipe_source_t src,
+                int header_only)
+{
+    int err = 0;
+    pipe_stream_t ps = malloc(sizeof(*ps));
+    fragment_reader_t s;
+
+    ASSURE( ps != NULL, ("Allocation error") );
+    s = &ps->base;
+    CHECK( fragment_reader_init(s) );
+
+    ps->src = src;
+    ps->next_unit = 0;
+    ps->header_only = header_only;
+
+    s->next_atom = pipe_stream_next_atom;
+    s->seek = pipe_stream_seek;
+    s->destroy = pipe_stream_destroy;
+    s->load = pipe_stream_load;
+    s->get_offset = pipe_stream_get_offset;
+    s->get_type = pipe_stream_get_type;
+
+    if (!header_only)
+    {
+        ASSURE( !src->have_moof || src->first_unit == src->num_header,
+                ("Cannot add a stream after fragments of '%s' were released", src->path) );
+
+        if (src->num_streams == src->max_streams)
+        {
+            src->max_streams = 2 * src->max_streams + 4;
+            src->streams = realloc(src->streams, src->max_streams * sizeof(*src->streams));
+            ASSURE( src->streams != NULL, ("Allocation error") );
+        }
+        src->streams[src->num_streams++] = ps;
+    }
+    src->refs++;
+
+    *p_s = s;
+cleanup:
+    return err;
+}
@@ -28,6 +28,12 @@
 #include <string.h>
 #include <assert.h>
 
+/* Load buffer per sample of the queue depth. Larger samples get their own buffer. */
+#define PLAYER_LOAD_SIZE_PER_SAMPLE (256 * 1024)
+
+/* Samples loaded ahead per decryption thread, without async loads */
+#define PLAYER_DECRYPT_SAMPLES_PER_THREAD 4
+
 #ifndef _MSC_VER
 #pragma GCC diagnostic ignored "-Wunused-but-set-variable"
 #pragma GCC diagnostic ignored "-Wunused-parameter"
@@ -35,18 +41,203 @@
 #pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
 #endif
 
+/**
+ * @brief collect the IV, the subsample map and the decryptor of an encrypted sample
+ *
+ * From the 'cenc' sample auxiliary information ('saiz', 'saio'), the PIFF
+ * 'senc' box (aux info in memory), or else the 'senc' box of the fragment.
+ * The decryptor is the one of the sample entry, unless the PIFF 'senc' box
+ * overrides its AlgorithmID and KID: AlgorithmID 0 means the samples of
+ * the fragment are clear, another KID selects the decryptor of its key.
+ */
+static int
+get_sample_crypt(stream_t *p_s,
+                 key_store_t key_store,
+                 const mp4d_sampleref_t *p_sample,
+                 const mp4d_subsample_map_t *p_subsamples,
+                 const struct sample_entry_t_ *p_entry,
+                 sample_crypt_t *p_crypt,   /**< [out] */
+                 decryptor_t *p_decryptor   /**< [out] NULL: output the sample as is */
+    )
+{
+    int err = 0;
+    uint32_t i;
+
+    *p_decryptor = p_entry->decryptor;
+
+    for (i = 0; i < MP4D_MAX_AUXDATA; i++)
+    {
+        const mp4d_auxref_t *p_aux = &p_sample->auxdata[i];
+
+        if (p_aux->size == 0)
+        {
+            continue;
+        }
+        if (p_aux->datatype == 0x70696666) /* piff: pos is the address of the aux info */
+        {
+            mp4d_crypt_info_t info = p_entry->crypt_info;
+            uint8_t iv_size;
+
+            CHECK( stream_get_cur_tenc(p_s, &info.method, &iv_size, info.key_id) );
+            if (info.method == 0)
+            {
+                *p_decryptor = NULL;
+                goto cleanup;
+            }
+            if (info.method != p_entry->crypt_info.method ||
+                memcmp(info.key_id, p_entry->crypt_info.key_id, sizeof(info.key_id)) != 0)
+            {
+                info.iv_size = iv_size;
+                CHECK( key_store_get_decryptor(key_store, &info, p_decryptor) );
+                ASSURE( *p_decryptor != NULL,
+                        ("No key for the KID of the 'senc' box of a fragment of track_ID %" PRIu32, p_s->track_ID) );
+            }
+            CHECK( sample_crypt_parse_aux(p_crypt, (const unsigned char *) (intptr_t) p_aux->pos, p_aux->size, iv_size) );
+            goto cleanup;
+        }
+        if (p_aux->datatype == 0x63656e63 || p_aux->datatype == 0x63626373) /* cenc, cbcs */
+        {
+            const unsigned char *p_data;
+
+            CHECK( stream_get_aux(p_s, p_aux, &p_data) );
+            CHECK( sample_crypt_parse_aux(p_crypt, p_data, p_aux->size, p_entry->iv_size) );
+            goto cleanup;
+        }
+    }
+
+    CHECK( sample_crypt_set_map(p_crypt, p_sample->sencdata.iv, p_entry->iv_size, p_subsamples) );
+
+cleanup:
+    return err;
+}
+
+/**
+ * @brief decrypt a loaded sample in place, and account for the throughput
+ */
+static int
+decrypt_sample(player_t p_d,
+               decryptor_t decryptor,
+               const sample_crypt_t *p_crypt,
+               unsigned char *p_data,
+               uint32_t size
+    )
+{
+    int err = 0;
+    double start = clock_seconds();
+
+    CHECK( decryptor_decrypt(decryptor, p_crypt, p_data, size) );
+
+    p_d->decrypt_seconds += clock_seconds() - start;
+    p_d->decrypted_bytes += size;
+
+cleanup:
+    return err;
+}
+
+/** @brief decryptor of the sample entry of a sample, or NULL if the sample is output as is */
+static const struct sample_entry_t_ *
+find_decryptor(const mp4d_sampleref_t *p_sample,
+               const struct sample_entry_t_ *sample_entries,
+               uint32_t num_sample_entries
+    )
+{
+    const uint32_t sdi = p_sample->sample_description_index;
+
+    if (sdi == 0 || sdi > num_sample_entries || sample_entries[sdi - 1].decryptor == NULL)
+    {
+        return NULL;
+    }
+    return &sample_entries[sdi - 1];
+}
+
+/**
+ * @brief warn about the first encrypted sample of a sample entry which has no decryptor
+ *
+ * The samples of a sample entry which is not protected by default ('tenc')
+ * are output as is, also if their 'cenc' or 'cbcs' aux info shows that
+ * they are encrypted.
+ */
+static void
+check_encrypted(const stream_t *p_s,
+                const mp4d_sampleref_t *p_sample,
+                struct sample_entry_t_ *sample_entries,
+                uint32_t num_sample_entries
+    )
+{
+    const uint32_t sdi = p_sample->sample_description_index;
+    uint32_t i;
+
+    if (sdi == 0 || sdi > num_sample_entries || !sample_entries[sdi - 1].warn_encrypted)
+    {
+        return;
+    }
+    for (i = 0; i < MP4D_MAX_AUXDATA; i++)
+    {
+        const mp4d_auxref_t *p_aux = &p_sample->auxdata[i];
+
+        if (p_aux->size > 0 && (p_aux->datatype == 0x63656e63 || p_aux->datatype == 0x63626373)) /* cenc, cbcs */
+        {
+            warning("Encrypted samples of sample entry %" PRIu32 " of track_ID %" PRIu32
+                    ", which is not protected by default ('tenc'), are output encrypted\n",
+                    sdi, p_s->track_ID);
+            sample_entries[sdi - 1].warn_encrypted = 0;
+            return;
+        }
+    }
+}
+
 /**
  * @brief load sample into memory, decrypt if encrypted
+ *
+ * A clear sample which the source holds in memory is not copied.
  */
 static int
-load_sample(stream_t *p_s,
+load_sample(player_t p_d,
+            uint32_t stream_index,
             const mp4d_sampleref_t *p_sample,
-            struct sample_entry_t_ *sample_entries,
-            uint32_t num_sample_entries,
-            unsigned char *p_data                  /**< [out] */
+            const mp4d_subsample_map_t *p_subsamples,
+            const unsigned char **pp_data          /**< [out] in the source, or in the buffer of the stream */
     )
 {
-    return fragment_reader_load(p_s->fragments, p_sample->pos, p_sample->size, p_data);
+    int err = 0;
+    stream_t *p_s = &p_d->streams[stream_index].stream;
+    const struct sample_entry_t_ *p_entry = find_decryptor(p_sample,
+                                                          p_d->streams[stream_index].sample_entries,
+                                                          p_d->streams[stream_index].num_sample_entries);
+    decryptor_t decryptor = NULL;
+
+    check_encrypted(p_s, p_sample, p_d->streams[stream_index].sample_entries, p_d->streams[stream_index].num_sample_entries);
+    if (p_entry != NULL)
+    {
+        CHECK( get_sample_crypt(p_s, p_d->key_store, p_sample, p_subsamples, p_entry,
+                                &p_d->streams[stream_index].crypt, &decryptor) );
+    }
+
+    if (decryptor == NULL &&
+        fragment_reader_get_data(p_s->fragments, p_sample->pos, p_sample->size, pp_data) == 0)
+    {
+        goto cleanup;
+    }
+
+    if (p_d->streams[stream_index].data_size < p_sample->size)
+    {
+        unsigned char *data = realloc(p_d->streams[stream_index].data, p_sample->size);
+
+        ASSURE( data != NULL, ("Failed to allocate %" PRIu32 " bytes", p_sample->size) );
+        p_d->streams[stream_index].data = data;
+        p_d->streams[stream_index].data_size = p_sample->size;
+    }
+    CHECK( fragment_reader_load(p_s->fragments, p_sample->pos, p_sample->size, p_d->streams[stream_index].data) );
+
+    if (decryptor != NULL)
+    {
+        CHECK( decrypt_sample(p_d, decryptor, &p_d->streams[stream_index].crypt,
+                              p_d->streams[stream_index].data, p_sample->size) );
+    }
+    *pp_data = p_d->streams[stream_index].data;
+
+cleanup:
+    return err;
 }
 
 /** Considers all active tracks. Returns the sample with minimum evaluation,
@@ -93,6 +284,7 @@ next_sample(player_t p_d,
                     if (err == 2) 
                     {
                         p_d->streams[i].end_of_track = 1;
+                        err = 0;
                     }
                     else 
                     {
@@ -134,34 +326,377 @@ next_sample(player_t p_d,
     *track_ID = p_d->streams[min_i].stream.track_ID;
     *stream_name = p_d->streams[min_i].stream.name;
 
-    /* Fill subsample info */
-    if (p_d->streams[min_i].stream.size_subsample < (*sample)->num_subsamples)
+    p_d->streams[min_i].stream.have_sample = 0;
+
+cleanup:
+    return err;
+}
+
+/**
+ * @brief decode the subsample map of the sample returned by next_sample(), into memory grown as needed
+ *
+ * Must be called once per sample, before the next sample of the stream.
+ */
+static int
+get_subsamples(stream_t *p_s,
+               const mp4d_sampleref_t *p_sample,
+               uint32_t **pp_mem,             /**< [in,out] memory of the map */
+               uint32_t *p_mem_entries,       /**< [in,out] allocated entries */
+               mp4d_subsample_map_t *p_map    /**< [out] */
+    )
+{
+    int err = 0;
+    uint32_t entries = MP4D_SUBSAMPLE_MAP_ENTRIES(p_sample);
+
+    if (*p_mem_entries < entries)
     {
-        p_d->streams[min_i].stream.size_subsample = (*sample)->num_subsamples;
-        p_d->streams[min_i].stream.subsample_pos = realloc(p_d->streams[min_i].stream.subsample_pos, (*sample)->num_subsamples * sizeof(uint64_t));
-        p_d->streams[min_i].stream.subsample_size = realloc(p_d->streams[min_i].stream.subsample_size, (*sample)->num_subsamples * sizeof(uint32_t));
+        uint32_t *p_mem = realloc(*pp_mem, entries * sizeof(*p_mem));
 
-        ASSURE( p_d->streams[min_i].stream.subsample_pos != NULL, ("Allocation error") );
-        ASSURE( p_d->streams[min_i].stream.subsample_size != NULL, ("Allocation error") );
+        ASSURE( p_mem != NULL, ("Allocation error") );
+        *pp_mem = p_mem;
+        *p_mem_entries = entries;
     }
+    CHECK( mp4d_trackreader_get_subsamples(p_s->p_tr, p_sample, *pp_mem, *p_mem_entries, p_map) );
+
+cleanup:
+    return err;
+}
 
+/** @return index of the stream receiving the samples of a track, num_streams if none
+ */
+static uint32_t
+find_stream(player_t p_d,
+            uint32_t track_ID,
+            const char *name
+    )
+{
+    uint32_t i;
+
+    for (i = 0; i < p_d->num_streams; i++)
     {
-        uint32_t i;
-        for (i = 0; i < (*sample)->num_subsamples; i++)
+        /* Match with name before track_ID, if name is non-NULL
+         * (essentail for MPEG-DASH where track_IDs are not unique) */
+        if ((name != NULL && strcmp(name, p_d->streams[i].stream.name) == 0) ||
+            (name == NULL && p_d->streams[i].stream.track_ID == track_ID))
         {
-            CHECK( mp4d_trackreader_next_subsample(p_d->streams[min_i].stream.p_tr,
-                                                   *sample,
-                                                   &p_d->streams[min_i].stream.subsample_pos[i],
-                                                   &p_d->streams[min_i].stream.subsample_size[i]));
+            break;
         }
     }
+    return i;
+}
 
-    p_d->streams[min_i].stream.have_sample = 0;
+/** @brief bookkeeping for the sample returned by next_sample()
+ */
+static void
+sample_selected(player_t p_d,
+                uint32_t track_ID,
+                const mp4d_sampleref_t *sample
+    )
+{
+    if (!sample->dts) 
+    {
+        mp4d_trackreader_get_stss_count(p_d->streams->stream.p_tr, &(p_d->streams->stream.stss_count), &(p_d->streams->stream.stss_buf));
+    }
+    logout(LOG_VERBOSE_LVL_INFO,"Track_ID %d sample's DTS: %lld CTS: %lld PTS: %lld \n", track_ID, sample->dts, sample->cts, sample->pts);
+}
+
+/**
+ * @brief push a loaded sample to the subscribers of a stream
+ */
+static int
+output_sample(player_t p_d,
+              uint32_t stream_index,
+              const mp4d_sampleref_t *sample,
+              const unsigned char *p_data,
+              const mp4d_subsample_map_t *p_subsamples
+    )
+{
+    int err = 0;
+    uint32_t j;
+
+    for (j = 0; p_d->streams[stream_index].sink[j] != NULL; j++)
+    {
+        es_sink_t sink = p_d->streams[stream_index].sink[j];
+        uint32_t k;
+        uint32_t offset = 0;
+
+        if (sample->num_subsamples == 1)
+        {
+            CHECK( sink_sample_ready(sink, sample, p_data) );
+        }
+        else if (sample->num_subsamples > 1)
+        {
+            for (k = 0; k < sample->num_subsamples; k++)
+            {
+                if (sink->subsample_ready != NULL)
+                {
+                    CHECK( sink_subsample_ready(
+                               k,
+                               sink,
+                               sample,
+                               p_data + offset,
+                               sample->pos + offset,
+                               p_subsamples->size[k]) );
+                }
+                offset += p_subsamples->size[k];
+            }
+        }
+        else
+        {
+             ASSURE(sample->num_subsamples < 1 , ("Not valid subsample number!") );
+        }
+    }
 
 cleanup:
     return err;
 }
 
+/** A sample whose payload is loaded ahead of its output */
+struct pending_sample_t_
+{
+    mp4d_sampleref_t sample;
+    uint32_t stream_index;
+    mp4d_subsample_map_t subsamples;
+    uint32_t *subsample_mem;   /* of subsamples */
+    uint32_t subsample_mem_entries;
+    decryptor_t decryptor;     /* NULL if not decrypted */
+    sample_crypt_t crypt;      /* IV and subsample map, if decrypted */
+    decrypt_pool_t pool;       /* decrypting after the load, or NULL */
+    decrypt_job_t job;         /* of the pool */
+
+    unsigned char *data;       /* payload, in load_buffer or heap */
+    size_t buffer_used;        /* bytes taken from load_buffer, including a skipped end */
+    unsigned char *heap;       /* for payloads larger than load_buffer */
+    size_t heap_size;
+
+    int loaded;                /* (boolean) read finished */
+    int err;                   /* of the read */
+};
+
+static void
+on_sample_loaded(void *p_user, int err)
+{
+    struct pending_sample_t_ *p = p_user;
+
+    p->err = err;
+    p->loaded = 1;
+
+    if (err == 0 && p->decryptor != NULL && p->pool != NULL)
+    {
+        p->job.decryptor = p->decryptor;
+        p->job.p_crypt = &p->crypt;
+        p->job.p_data = p->data;
+        p->job.size = p->sample.size;
+        decrypt_pool_submit(p->pool, &p->job);
+    }
+}
+
+/** @brief take the payload buffer of a sample from load_buffer
+ *
+ * The buffer is used as a ring, and released in the same order.
+ * A payload does not wrap around the end of the buffer.
+ *
+ * @return 0: ok, 1: not enough space until older samples are output
+ */
+static int
+take_load_buffer(player_t p_d,
+                 size_t *p_write,   /**< [in,out] offset of the next payload */
+                 size_t *p_used,    /**< [in,out] bytes taken */
+                 struct pending_sample_t_ *p
+    )
+{
+    size_t total = p_d->load_buffer_size;
+    size_t size = p->sample.size;
+    size_t skip = 0;
+    size_t read;
+
+    if (*p_used == 0)
+    {
+        *p_write = 0;
+    }
+    if (size > total - *p_used)
+    {
+        return 1;
+    }
+
+    read = (*p_write + total - *p_used) % total;  /* offset of the oldest payload */
+    if (*p_write >= read)
+    {
+        if (size > total - *p_write)
+        {
+            if (size > read)
+            {
+                return 1;
+            }
+            skip = total - *p_write;
+            *p_write = 0;
+        }
+    }
+    else if (size > read - *p_write)
+    {
+        return 1;
+    }
+
+    p->data = p_d->load_buffer + *p_write;
+    p->buffer_used = skip + size;
+    *p_write += size;
+    *p_used += skip + size;
+
+    return 0;
+}
+
+/**
+ * @brief play like play(), with sample payloads loaded ahead through p_d->async_loads
+ *
+ * Without async loads, the samples are loaded when queued, to be decrypted
+ * by p_d->decrypt_pool while the next ones are loaded.
+ */
+static int
+play_ahead(player_t p_d,
+           unsigned int *active_track
+    )
+{
+    int err = 0;
+    int ns_err = 0;
+    mp4d_sampleref_t *sample = NULL;  /* returned by next_sample(), not queued yet */
+    uint32_t stream_index = 0;
+    uint32_t head = 0;                /* oldest pending sample */
+    uint32_t num_pending = 0;
+    size_t write = 0;
+    size_t used = 0;
+
+    for (;;)
+    {
+        /* Queue the reads of the next samples */
+        while (ns_err == 0 && num_pending < p_d->queue_depth)
+        {
+            struct pending_sample_t_ *p = &p_d->pending[(head + num_pending) % p_d->queue_depth];
+
+            if (sample == NULL)
+            {
+                uint32_t track_ID;
+                const char *name;
+
+                ns_err = next_sample(p_d, &track_ID, &name, &sample, active_track);
+                if (ns_err != 0)
+                {
+                    sample = NULL;
+                    break;
+                }
+                sample_selected(p_d, track_ID, sample);
+
+                stream_index = find_stream(p_d, track_ID, name);
+                if (stream_index == p_d->num_streams)
+                {
+                    sample = NULL;
+                    continue;
+                }
+            }
+
+            p->sample = *sample;
+            if (sample->size > p_d->load_buffer_size)
+            {
+                if (p->heap_size < sample->size)
+                {
+                    free(p->heap);
+                    p->heap_size = 0;
+                    p->heap = malloc(sample->size);
+                    ASSURE( p->heap != NULL, ("Allocation error") );
+                    p->heap_size = sample->size;
+                }
+                p->data = p->heap;
+                p->buffer_used = 0;
+            }
+            else if (take_load_buffer(p_d, &write, &used, p) != 0)
+            {
+                break;  /* Output older samples first */
+            }
+
+            p->stream_index = stream_index;
+            CHECK( get_subsamples(&p_d->streams[stream_index].stream, sample,
+                                  &p->subsample_mem, &p->subsample_mem_entries, &p->subsamples) );
+
+            /* The aux info of the sample is only available until the next fragment */
+            {
+                const struct sample_entry_t_ *p_entry = find_decryptor(sample,
+                                                                      p_d->streams[stream_index].sample_entries,
+                                                                      p_d->streams[stream_index].num_sample_entries);
+                check_encrypted(&p_d->streams[stream_index].stream, sample,
+                                p_d->streams[stream_index].sample_entries, p_d->streams[stream_index].num_sample_entries);
+                p->decryptor = NULL;
+                if (p_entry != NULL)
+                {
+                    CHECK( get_sample_crypt(&p_d->streams[stream_index].stream, p_d->key_store, sample, &p->subsamples,
+                                            p_entry, &p->crypt, &p->decryptor) );
+                }
+                p->pool = p_d->decrypt_pool;
+            }
+
+            p->loaded = 0;
+            p->err = 0;
+            num_pending++;
+            sample = NULL;
+            if (p_d->async_loads != NULL)
+            {
+                CHECK( async_reader_load(p_d->async_loads, p->sample.pos, p->sample.size, p->data, on_sample_loaded, p) );
+            }
+            else
+            {
+                on_sample_loaded(p, fragment_reader_load(p_d->streams[stream_index].stream.fragments,
+                                                         p->sample.pos, p->sample.size, p->data));
+            }
+        }
+
+        if (num_pending == 0)
+        {
+            break;
+        }
+
+        /* Output the oldest sample when loaded */
+        {
+            struct pending_sample_t_ *p = &p_d->pending[head];
+
+            while (!p->loaded)
+            {
+                CHECK( async_reader_process(p_d->async_loads, 1) );
+            }
+            ASSURE( p->err == 0, ("Failed to load %" PRIu32 " bytes @%" PRIu64, p->sample.size, p->sample.pos) );
+
+            if (p->decryptor != NULL)
+            {
+                if (p->pool != NULL)
+                {
+                    CHECK( decrypt_pool_wait(p->pool, &p->job) );
+                }
+                else
+                {
+                    CHECK( decrypt_sample(p_d, p->decryptor, &p->crypt, p->data, p->sample.size) );
+                }
+            }
+
+            CHECK( output_sample(p_d, p->stream_index, &p->sample, p->data, &p->subsamples) );
+
+            used -= p->buffer_used;
+            head = (head + 1) % p_d->queue_depth;
+            num_pending--;
+        }
+    }
+
+    ASSURE( ns_err == 2, ("Unexpected error (%d) when getting next sample", ns_err));
+
+cleanup:
+    /* The reads and decryptions in progress write to the pending samples */
+    if (p_d->async_loads != NULL)
+    {
+        async_reader_wait_all(p_d->async_loads);
+    }
+    if (p_d->decrypt_pool != NULL)
+    {
+        decrypt_pool_wait_all(p_d->decrypt_pool);
+    }
+    return err;
+}
+
 /**
  * @brief play until stop time reached, or end of fragment if single fragment
  */
@@ -183,6 +718,11 @@ play(player_t p_d,
         active_track[index] = 1;
     }
 
+    if (p_d->async_loads != NULL || p_d->decrypt_pool != NULL)
+    {
+        return play_ahead(p_d, active_track);
+    }
+
     do
     {
         mp4d_sampleref_t * sample;
@@ -194,66 +734,26 @@ play(player_t p_d,
         ns_err = next_sample(p_d, &track_ID, &name, &sample, active_track);
         if (ns_err == 0)
         {
-            if (!sample->dts) 
-            {
-                mp4d_trackreader_get_stss_count(p_d->streams->stream.p_tr, &(p_d->streams->stream.stss_count), &(p_d->streams->stream.stss_buf));
-            }
-            logout(LOG_VERBOSE_LVL_INFO,"Track_ID %d sample's DTS: %lld CTS: %lld PTS: %lld \n", track_ID, sample->dts, sample->cts, sample->pts);
+            sample_selected(p_d, track_ID, sample);
             /* Push sample to subscribers of this track_ID */
-            for (i = 0; i < p_d->num_streams; i++)
+            i = find_stream(p_d, track_ID, name);
+            if (i < p_d->num_streams)
             {
-                /* Match with name before track_ID, if name is non-NULL
-                 * (essentail for MPEG-DASH where track_IDs are not unique) */
-                if ((name != NULL && strcmp(name, p_d->streams[i].stream.name) == 0) ||
-                    (name == NULL && p_d->streams[i].stream.track_ID == track_ID))
-                {
-                    uint32_t j;
+                const unsigned char *p_data;
 
-                    if (p_d->streams[i].data_size < sample->size)
-                    {
-                        p_d->streams[i].data = realloc(p_d->streams[i].data, sample->size);
-                    }
+                CHECK( get_subsamples(&p_d->streams[i].stream,
+                                      sample,
+                                      &p_d->streams[i].stream.subsample_mem,
+                                      &p_d->streams[i].stream.subsample_mem_entries,
+                                      &p_d->streams[i].stream.subsamples) );
 
-                    CHECK( load_sample(&p_d->streams[i].stream,
-                                       sample,
-                                       p_d->streams[i].sample_entries,
-                                       p_d->streams[i].num_sample_entries,
-                                       p_d->streams[i].data) );
+                CHECK( load_sample(p_d, i, sample, &p_d->streams[i].stream.subsamples, &p_data) );
 
-                    for (j = 0; p_d->streams[i].sink[j] != NULL; j++)
-                    {
-                        es_sink_t sink = p_d->streams[i].sink[j];
-                        uint32_t k;
-                        unsigned char *subsample_payload = p_d->streams[i].data;
-
-                        if (sample->num_subsamples == 1)
-                        {
-                            CHECK( sink_sample_ready(sink, sample, p_d->streams[i].data) );
-                        }
-                        else if (sample->num_subsamples > 1)
-                        {
-                            for (k = 0; k < sample->num_subsamples; k++)
-                            {
-                                if (sink->subsample_ready != NULL)
-                                {
-                                    CHECK( sink_subsample_ready(
-                                               k,
-                                               sink,
-                                               sample,
-                                               subsample_payload,
-                                               p_d->streams[i].stream.subsample_pos[k],
-                                               p_d->streams[i].stream.subsample_size[k]) );
-                                }
-                                subsample_payload += p_d->streams[i].stream.subsample_size[k];
-                            }
-                        }
-                        else
-                        {
-                             ASSURE(sample->num_subsamples < 1 , ("Not valid subsample number!") );
-                        }
-                    }
-                    break;
-                }
+                CHECK( output_sample(p_d,
+                                     i,
+                                     sample,
+                                     p_data,
+                                     &p_d->streams[i].stream.subsamples) );
             }
         }
 
@@ -306,12 +806,46 @@ player_new(player_t *p_d)
     (*p_d)->streams = NULL;
     (*p_d)->num_streams = 0;
 
-    (*p_d)->decrypt_info.num_keys = 0;
     (*p_d)->decrypt_info.keys = NULL;
+    (*p_d)->decrypt_info.num_keys = 0;
+    (*p_d)->key_store = NULL;
+
+    (*p_d)->async_loads = NULL;
+    (*p_d)->queue_depth = 0;
+    (*p_d)->pending = NULL;
+    (*p_d)->load_buffer = NULL;
+    (*p_d)->load_buffer_size = 0;
+
+    (*p_d)->prefetch_count = 0;
+
+    (*p_d)->decrypt_pool = NULL;
+    (*p_d)->decrypted_bytes = 0;
+    (*p_d)->decrypt_seconds = 0;
+
+    CHECK( key_store_new(&(*p_d)->key_store) );
 cleanup:
     return err;
 }
 
+/** @brief free the load ahead buffers */
+static void
+free_pending(player_t d)
+{
+    uint32_t i;
+
+    for (i = 0; d->pending != NULL && i < d->queue_depth; i++)
+    {
+        free(d->pending[i].subsample_mem);
+        free(d->pending[i].heap);
+        sample_crypt_free(&d->pending[i].crypt);
+    }
+    free(d->pending);
+    d->pending = NULL;
+    free(d->load_buffer);
+    d->load_buffer = NULL;
+    d->load_buffer_size = 0;
+}
+
 int
 player_destroy(player_t *p_d)
 {
@@ -320,13 +854,43 @@ player_destroy(player_t *p_d)
         player_t d = *p_d;
         uint32_t i;
 
-        free(d->decrypt_info.keys);
+        uint64_t bytes = d->decrypted_bytes;
+        double busy_seconds = d->decrypt_seconds;
+        double seconds = d->decrypt_seconds;
+        uint32_t num_threads = 1;
+
+        if (d->decrypt_pool != NULL)
+        {
+            uint64_t pool_bytes;
+            double pool_busy_seconds, pool_seconds;
+
+            decrypt_pool_get_stats(d->decrypt_pool, &pool_bytes, &pool_busy_seconds, &pool_seconds);
+            bytes += pool_bytes;
+            busy_seconds += pool_busy_seconds;
+            seconds += pool_seconds;
+            num_threads = decrypt_pool_get_num_threads(d->decrypt_pool);
+            decrypt_pool_destroy(&d->decrypt_pool);
+        }
+        if (bytes > 0)
+        {
+            logout(LOG_VERBOSE_LVL_COMPACT,
+                   "Decrypted %.2f MB in %.4f s on %" PRIu32 " thread(s): %.1f MB/s, %.1f MB/s per core (%s)\n",
+                   bytes / 1e6,
+                   seconds,
+                   num_threads,
+                   seconds > 0 ? bytes / 1e6 / seconds : 0.0,
+                   busy_seconds > 0 ? bytes / 1e6 / busy_seconds : 0.0,
+                   decryptor_implementation());
+        }
+
+        free_pending(d);
 
         for (i = 0; i < d->num_streams; i++)
         {
             uint32_t j;
 
             free(d->streams[i].sample_entries);
+            sample_crypt_free(&d->streams[i].crypt);
 
             stream_deinit(&d->streams[i].stream);
 
@@ -337,6 +901,8 @@ player_destroy(player_t *p_d)
             free(d->streams[i].data);
         }
         free(d->streams);
+        free(d->decrypt_info.keys);
+        key_store_destroy(&d->key_store);
 
         free(d);
     }
@@ -344,6 +910,164 @@ player_destroy(player_t *p_d)
     return 0;
 }
 
+/** @brief allocate the load ahead buffers for queue_depth samples */
+static int
+alloc_pending(player_t p_d,
+              uint32_t queue_depth
+    )
+{
+    int err = 0;
+
+    ASSURE( queue_depth > 0, ("Queue depth must be positive") );
+
+    p_d->pending = calloc(queue_depth, sizeof(*p_d->pending));
+    ASSURE( p_d->pending != NULL, ("Allocation error") );
+    p_d->queue_depth = queue_depth;
+
+    p_d->load_buffer_size = (size_t) queue_depth * PLAYER_LOAD_SIZE_PER_SAMPLE;
+    p_d->load_buffer = malloc(p_d->load_buffer_size);
+    ASSURE( p_d->load_buffer != NULL, ("Failed to allocate %" PRIz " bytes", p_d->load_buffer_size) );
+
+cleanup:
+    return err;
+}
+
+int
+player_set_async_loads(player_t p_d,
+                       async_reader_t r,
+                       uint32_t queue_depth)
+{
+    int err = 0;
+
+    if (p_d->async_loads != NULL)
+    {
+        CHECK( async_reader_register_buffer(p_d->async_loads, NULL, 0) );
+    }
+    free_pending(p_d);
+    p_d->async_loads = NULL;
+    p_d->queue_depth = 0;
+
+    if (r == NULL)
+    {
+        if (p_d->decrypt_pool != NULL)
+        {
+            CHECK( alloc_pending(p_d, PLAYER_DECRYPT_SAMPLES_PER_THREAD * decrypt_pool_get_num_threads(p_d->decrypt_pool)) );
+        }
+        goto cleanup;
+    }
+    CHECK( alloc_pending(p_d, queue_depth) );
+
+    CHECK( async_reader_register_buffer(r, p_d->load_buffer, p_d->load_buffer_size) );
+    p_d->async_loads = r;
+
+cleanup:
+    if (err)
+    {
+        free_pending(p_d);
+        p_d->queue_depth = 0;
+    }
+    return err;
+}
+
+int
+player_set_decrypt_threads(player_t p_d,
+                           uint32_t num_threads)
+{
+    int err = 0;
+
+    decrypt_pool_destroy(&p_d->decrypt_pool);
+    if (p_d->async_loads == NULL)
+    {
+        free_pending(p_d);
+        p_d->queue_depth = 0;
+    }
+    if (num_threads == 0)
+    {
+        goto cleanup;
+    }
+
+    CHECK( decrypt_pool_new(&p_d->decrypt_pool, num_threads) );
+    if (decrypt_pool_get_num_threads(p_d->decrypt_pool) == 0)
+    {
+        logout(LOG_VERBOSE_LVL_INFO, "No decryption threads in this build, decrypting in the playing thread\n");
+        decrypt_pool_destroy(&p_d->decrypt_pool);
+        goto cleanup;
+    }
+    if (p_d->async_loads == NULL)
+    {
+        CHECK( alloc_pending(p_d, PLAYER_DECRYPT_SAMPLES_PER_THREAD * num_threads) );
+    }
+
+cleanup:
+    if (err)
+    {
+        decrypt_pool_destroy(&p_d->decrypt_pool);
+    }
+    return err;
+}
+
+int
+player_set_prefetch(player_t p_d,
+                    uint32_t num_samples)
+{
+    int err = 0;
+    uint32_t i;
+
+    p_d->prefetch_count = num_samples;
+    for (i = 0; i < p_d->num_streams; i++)
+    {
+        CHECK( stream_set_prefetch(&p_d->streams[i].stream, num_samples) );
+    }
+
+cleanup:
+    return err;
+}
+
+int
+player_add_key(player_t p_d,
+               const unsigned char key_id[16],
+               const unsigned char key[16]
+    )
+{
+    return key_store_add(p_d->key_store, key_id, key);
+}
+
+/**
+ * @brief set up the decryption of an encrypted sample entry
+ *
+ * The trackreader needs the IV size of 'tenc' to read the 'senc' box, also
+ * when the samples are not decrypted.
+ */
+static int
+set_decryptor(player_t p_d,
+              stream_t *p_s,
+              struct sample_entry_t_ *p_entry,
+              mp4d_crypt_info_t *p_crypt,
+              uint32_t decrypt_flag
+    )
+{
+    int err = 0;
+
+    p_entry->iv_size = p_crypt->iv_size;
+    p_entry->crypt_info = *p_crypt;
+    CHECK( stream_set_tenc(p_s, p_crypt->method, p_crypt->iv_size, p_crypt->key_id) );
+
+    if (!decrypt_flag)
+    {
+        goto cleanup;
+    }
+    CHECK( key_store_get_decryptor(p_d->key_store, p_crypt, &p_entry->decryptor) );
+    if (p_entry->decryptor != NULL)
+    {
+        goto cleanup;
+    }
+    warning("No key for the KID of sample entry %" PRIu32 " of track_ID %" PRIu32 ", output encrypted\n",
+            p_entry->index, p_s->track_ID);
+
+cleanup:
+    return err;
+}
+
 int
 player_set_track(player_t p_d,
                  uint32_t track_ID,
@@ -352,13 +1076,19 @@ player_set_track(player_t p_d,
                  movie_t p_movie,
                  fragment_reader_t mp4_source,
                  es_sink_t sink,
-                 uint32_t polarssl_flag)
+                 uint32_t decrypt_flag)
 {
     int err = 0;
     uint32_t i, j;
     int have_track = 0;
     char *name = NULL;  /* For track_ID = 0 */
 
+    /* Keys set in the deprecated decrypt_info, adding a key again does nothing */
+    for (i = 0; i < p_d->decrypt_info.num_keys; i++)
+    {
+        CHECK( player_add_key(p_d, p_d->decrypt_info.keys[i].id, p_d->decrypt_info.keys[i].key) );
+    }
+
     /* If track is not already enabled, create trackreader and sample entries for it */
     for (i = 0; i < p_d->num_streams; i++)
     {
@@ -387,6 +1117,11 @@ player_set_track(player_t p_d,
 
         p_d->streams[i].data = NULL;
         p_d->streams[i].data_size = 0;
+        sample_crypt_init(&p_d->streams[i].crypt);
+        p_d->streams[i].sample_entries = NULL;
+        p_d->streams[i].num_sample_entries = 0;
+        p_d->streams[i].movie = p_movie;
+        p_d->streams[i].bit_rate = bit_rate;
 
         CHECK( p_movie->get_movie_info(p_movie, &movie_info) );
         p_d->movie_time_scale = movie_info.time_scale;
@@ -409,6 +1144,7 @@ player_set_track(player_t p_d,
         }
 
         ASSURE( found, ("Could not find stream information for track_ID = %" PRIu32, track_ID) );
+        p_d->streams[i].stream_num = stream_index;
 
         CHECK( stream_init(&p_d->streams[i].stream,
                                 mp4_source,
@@ -417,16 +1153,15 @@ player_set_track(player_t p_d,
                                 movie_info.time_scale,
                                 stream_info.time_scale)
             );
+        CHECK( stream_set_prefetch(&p_d->streams[i].stream, p_d->prefetch_count) );
 
         p_d->streams[i].end_of_track = 0;
 
         /* Create decryptors for each encrypted sample description index */
-        p_d->streams[i].sample_entries = NULL;
+        p_d->streams[i].sample_entries = calloc(stream_info.num_dsi, sizeof(*p_d->streams[i].sample_entries));
+        ASSURE( p_d->streams[i].sample_entries != NULL || stream_info.num_dsi == 0, ("Allocation failure") );
         p_d->streams[i].num_sample_entries = stream_info.num_dsi;
 
-        p_d->streams[i].sample_entries = malloc(stream_info.num_dsi * sizeof(*p_d->streams[i].sample_entries));
-        ASSURE( p_d->streams[i].sample_entries != NULL, ("Allocation failure") );
-
         for (j = 0; j < stream_info.num_dsi; j++)
         {
             mp4d_crypt_info_t *p_crypt = NULL;
@@ -455,6 +1190,20 @@ player_set_track(player_t p_d,
                 p_d->streams[i].sample_entries[j].index = j + 1;
                 p_crypt = NULL;
             }
+
+            if (p_crypt != NULL && p_crypt->method != 0 && p_crypt->method != 0xff)
+            {
+                CHECK( set_decryptor(p_d, &p_d->streams[i].stream, &p_d->streams[i].sample_entries[j], p_crypt, decrypt_flag) );
+            }
+            else if (p_crypt != NULL && p_crypt->method == 0xff && decrypt_flag)
+            {
+                warning("Unsupported protection scheme of sample entry %" PRIu32 " of track_ID %" PRIu32 ", output encrypted\n",
+                        j + 1, p_d->streams[i].stream.track_ID);
+            }
+            else if (p_crypt != NULL && decrypt_flag)
+            {
+                p_d->streams[i].sample_entries[j].warn_encrypted = 1;
+            }
         } /* for each sample description */
     } /* if !have_track */
 
@@ -553,14 +1302,41 @@ cleanup:
 }
 
 int
-player_play_time_range(player_t p_d,
-                       float *start_time,
-                       float *stop_time)
+player_play_keyframes(player_t p_d,
+                      float interval)
 {
     int err = 0;
-    int single_fragment = 0;
+    uint32_t i;
 
-    ASSURE( start_time != NULL, ("Missing start time") );
+    ASSURE( interval > 0, ("Key frame interval (%f s) must be positive", interval) );
+
+    for (i = 0; i < p_d->num_streams; i++)
+    {
+        stream_t *p_s = &p_d->streams[i].stream;
+        float sync_interval = interval * p_s->media_time_scale;
+
+        ASSURE( sync_interval >= 1.0f && sync_interval < (float) (uint64_t) -1,
+                ("Key frame interval (%f s) is out of range", interval) );
+        p_s->sync_interval = (uint64_t) sync_interval;
+        p_s->next_sync_pts = 0;
+    }
+
+    p_d->stop_time = (uint64_t) -1; /* infinity */
+    p_d->eval_sample = get_sample_offset;
+
+    CHECK( play(p_d, 0) );
+cleanup:
+    return err;
+}
+
+/** @brief Set the stop time of the player, NULL for infinity
+ */
+static int
+set_stop_time(player_t p_d,
+              float *stop_time  /**< in seconds */
+    )
+{
+    int err = 0;
 
     if (stop_time != NULL)
     {
@@ -573,6 +1349,22 @@ player_play_time_range(player_t p_d,
     {
         p_d->stop_time = (uint64_t) -1; /* infinity */
     }
+
+cleanup:
+    return err;
+}
+
+int
+player_play_time_range(player_t p_d,
+                       float *start_time,
+                       float *stop_time)
+{
+    int err = 0;
+    int single_fragment = 0;
+
+    ASSURE( start_time != NULL, ("Missing start time") );
+
+    CHECK( set_stop_time(p_d, stop_time) );
     p_d->eval_sample = get_sample_pts;
 
     CHECK( player_seek(p_d, *start_time) );
@@ -581,3 +1373,220 @@ player_play_time_range(player_t p_d,
 cleanup:
     return err;
 }
+
+/** @brief Append a byte range, extending the last range if they overlap or are adjacent
+ */
+static int
+add_byte_range(byte_range_t **p_ranges,
+               uint32_t *p_num_ranges,
+               uint32_t *p_max_ranges,
+               uint64_t offset,
+               uint64_t size)
+{
+    int err = 0;
+
+    if (size == 0)
+    {
+        return 0;
+    }
+
+    if (*p_num_ranges > 0)
+    {
+        byte_range_t *last = &(*p_ranges)[*p_num_ranges - 1];
+
+        if (offset >= last->offset && offset <= last->offset + last->size)
+        {
+            if (offset + size > last->offset + last->size)
+            {
+                last->size = offset + size - last->offset;
+            }
+            return 0;
+        }
+    }
+
+    if (*p_num_ranges == *p_max_ranges)
+    {
+        *p_max_ranges = 2 * *p_max_ranges + 16;
+        *p_ranges = realloc(*p_ranges, *p_max_ranges * sizeof(**p_ranges));
+        ASSURE( *p_ranges != NULL, ("Allocation failure") );
+    }
+    (*p_ranges)[*p_num_ranges].offset = offset;
+    (*p_ranges)[*p_num_ranges].size = size;
+    (*p_num_ranges)++;
+
+cleanup:
+    return err;
+}
+
+static int
+compare_byte_ranges(const void *p_a, const void *p_b)
+{
+    const byte_range_t *a = p_a;
+    const byte_range_t *b = p_b;
+
+    return (a->offset > b->offset) - (a->offset < b->offset);
+}
+
+/** @brief Sort byte ranges by offset, and merge overlapping or adjacent ranges
+ */
+static void
+merge_byte_ranges(byte_range_t *ranges,
+                  uint32_t *p_num_ranges)
+{
+    uint32_t i, n = 0;
+
+    if (*p_num_ranges == 0)
+    {
+        return;
+    }
+
+    qsort(ranges, *p_num_ranges, sizeof(*ranges), compare_byte_ranges);
+
+    for (i = 1; i < *p_num_ranges; i++)
+    {
+        if (ranges[i].offset <= ranges[n].offset + ranges[n].size)
+        {
+            if (ranges[i].offset + ranges[i].size > ranges[n].offset + ranges[n].size)
+            {
+                ranges[n].size = ranges[i].offset + ranges[i].size - ranges[n].offset;
+            }
+        }
+        else
+        {
+            n++;
+            ranges[n] = ranges[i];
+        }
+    }
+    *p_num_ranges = n + 1;
+}
+
+/** @brief byte ranges being planned, see record_read() */
+typedef struct
+{
+    byte_range_t *ranges;
+    uint32_t num_ranges;
+    uint32_t max_ranges;
+    int err;              /* of the first failed add_byte_range() */
+} plan_t;
+
+/** @brief fragment_reader_t::on_read callback, which adds the range read to the plan
+ */
+static void
+record_read(void *p_user, uint64_t position, uint64_t size)
+{
+    plan_t *p_plan = (plan_t *) p_user;
+
+    if (p_plan->err == 0)
+    {
+        p_plan->err = add_byte_range(&p_plan->ranges, &p_plan->num_ranges, &p_plan->max_ranges, position, size);
+    }
+}
+
+int
+player_plan_time_range(player_t p_d,
+                       float *start_time,
+                       float *stop_time,
+                       byte_range_t **p_ranges,
+                       uint32_t *p_num_ranges)
+{
+    int err = 0;
+    int ns_err;
+    unsigned int active_track[255+32+1];
+    stream_t *streams = NULL;    /* of the player, while the streams of the plan take their place */
+    int *end_of_track = NULL;    /* of the player streams */
+    uint32_t num_swapped = 0;
+    uint64_t player_stop_time = p_d->stop_time;
+    uint64_t (*player_eval_sample)(const mp4d_sampleref_t *, uint32_t) = p_d->eval_sample;
+    int player_single_fragment = p_d->single_fragment;
+    plan_t plan = {NULL, 0, 0, 0};
+    uint32_t i;
+
+    ASSURE( start_time != NULL, ("Missing start time") );
+    ASSURE( p_ranges != NULL && p_num_ranges != NULL, ("Null pointer") );
+
+    streams = malloc((p_d->num_streams + 1) * sizeof(*streams));
+    end_of_track = malloc((p_d->num_streams + 1) * sizeof(*end_of_track));
+    ASSURE( streams != NULL && end_of_track != NULL, ("Allocation failure") );
+
+    /* Walk the samples on new readers, which report what they read, and keep the player position */
+    for (i = 0; i < p_d->num_streams; i++)
+    {
+        stream_t *p_s = &p_d->streams[i].stream;
+        fragment_reader_t source = NULL;
+
+        CHECK( p_d->streams[i].movie->fragment_stream_new(p_d->streams[i].movie,
+                                                          p_d->streams[i].stream_num,
+                                                          p_s->name,
+                                                          p_d->streams[i].bit_rate,
+                                                          &source) );
+        fragment_reader_set_read_callback(source, record_read, &plan);
+
+        streams[i] = *p_s;
+        end_of_track[i] = p_d->streams[i].end_of_track;
+        num_swapped++;
+
+        /* The stream owns the source, also if this fails */
+        CHECK( stream_init(p_s, source, streams[i].track_ID, streams[i].name,
+                           streams[i].movie_time_scale, streams[i].media_time_scale) );
+        p_s->subtitle_track_flag = streams[i].subtitle_track_flag;
+        active_track[i] = 1;
+    }
+
+    CHECK( set_stop_time(p_d, stop_time) );
+    p_d->eval_sample = get_sample_offset;
+    p_d->single_fragment = 0;
+
+    CHECK( player_seek(p_d, *start_time) );
+
+    do
+    {
+        mp4d_sampleref_t *sample;
+        uint32_t track_ID;
+        const char *name;
+
+        ns_err = next_sample(p_d, &track_ID, &name, &sample, active_track);
+        if (ns_err == 0)
+        {
+            uint32_t k;
+
+            CHECK( add_byte_range(&plan.ranges, &plan.num_ranges, &plan.max_ranges, sample->pos, sample->size) );
+
+            for (k = 0; k < MP4D_MAX_AUXDATA; k++)
+            {
+                /* PIFF senc data is inside the moof, its pos is a memory address */
+                if (sample->auxdata[k].size > 0 && sample->auxdata[k].datatype != 0x70696666)
+                {
+                    CHECK( add_byte_range(&plan.ranges, &plan.num_ranges, &plan.max_ranges,
+                                          sample->auxdata[k].pos, sample->auxdata[k].size) );
+                }
+            }
+        }
+    } while (ns_err == 0);
+
+    ASSURE( ns_err == 2, ("Unexpected error (%d) when getting next sample", ns_err));
+    CHECK( plan.err );
+
+    merge_byte_ranges(plan.ranges, &plan.num_ranges);
+
+    logout(LOG_VERBOSE_LVL_INFO, "Planned %" PRIu32 " byte ranges\n", plan.num_ranges);
+
+    *p_ranges = plan.ranges;
+    *p_num_ranges = plan.num_ranges;
+    plan.ranges = NULL;
+
+cleanup:
+    for (i = 0; i < num_swapped; i++)
+    {
+        stream_deinit(&p_d->streams[i].stream);
+        p_d->streams[i].stream = streams[i];
+        p_d->streams[i].end_of_track = end_of_track[i];
+    }
+    p_d->stop_time = player_stop_time;
+    p_d->eval_sample = player_eval_sample;
+    p_d->single_fragment = player_single_fragment;
+
+    free(plan.ranges);
+    free(end_of_track);
+    free(streams);
+    return err;
+}
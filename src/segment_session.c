@@ -0,0 +1,1120 @@
+/************************************************************************************************************
+ * Copyright (c) 2017, Dolby Laboratories Inc.
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ *    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+ *    promote products derived from this software without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ ************************************************************************************************************/
+#include "segment_session.h"
+
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifndef _MSC_VER
+#define SEGMENT_USE_THREADS
+#include <pthread.h>
+#endif
+
+typedef struct
+{
+    char *path;                     /* of a file segment (owned), or NULL */
+    uint64_t file_offset;           /* of the first byte in the file */
+    const unsigned char *p_data;    /* of a segment in memory, or NULL */
+    uint64_t size;
+    uint64_t position;              /* of the first byte */
+
+    unsigned char *loaded;          /* file segment read by the prefetcher (owned), or NULL */
+    int loading;                    /* being read by the prefetcher */
+    int load_failed;                /* streams read the file themselves, and report the error */
+} session_segment_t;
+
+typedef struct segment_stream_ *segment_stream_t;
+
+struct segment_session_t_
+{
+    int refs;                       /* owner, streams and movies */
+
+    session_segment_t *segments;    /* init segment, then media segments */
+    uint32_t num_segments;
+    uint32_t max_segments;
+
+    unsigned char *init_data;       /* init segment read from a file */
+    fragment_reader_t header;       /* at the 'moov' of the init segment */
+    mp4d_ftyp_info_t ftyp;
+
+    segment_stream_t *streams;      /* which hold back the release of prefetched segments */
+    uint32_t num_streams;
+    uint32_t max_streams;
+
+    uint32_t prefetch_count;        /* segments to keep loaded from the first segment of the streams */
+    uint32_t first_loaded;          /* segments before this have no prefetched data */
+#ifdef SEGMENT_USE_THREADS
+    pthread_t thread;
+    int have_thread;
+    int stop;
+    pthread_mutex_t lock;           /* of the prefetch state, and the current segment of the streams */
+    pthread_cond_t cond;
+#endif
+};
+
+/** @brief segment_stream implementation of the mp4_source API */
+struct segment_stream_
+{
+    struct fragment_reader_t_ base;
+
+    segment_session_t session;
+    int init_only;          /* The header stream of the session: reads the init segment only,
+                               and holds no reference to the session */
+
+    uint32_t segment;       /* index of the segment containing the next box */
+    uint64_t segment_pos;   /* position of the next box in that segment */
+    uint64_t atom_offset;   /* position of the current box */
+
+    FILE *file;             /* of file_segment, if open */
+    uint32_t file_segment;
+
+    unsigned char *box;     /* current box of a file segment, referenced by p_dmux */
+    size_t box_size;        /* bytes allocated */
+};
+
+/* Enough for a box header with a 64-bit size */
+#define SEGMENT_STREAM_HEADER_SIZE 16
+
+static
+int file_seek(FILE *stream,
+              uint64_t offset   /* offset relative to beginning of file (i.e. SEEK_SET is implied) */
+    )
+{
+#ifdef _MSC_VER
+        return _fseeki64(stream, offset, SEEK_SET);
+#else  /* posix */
+        return fseeko(stream, offset, SEEK_SET);
+#endif
+}
+
+static int
+path_size(const char *path, uint64_t *p_size)
+{
+#ifdef _MSC_VER
+    struct _stati64 st;
+
+    if (_stati64(path, &st) != 0)
+    {
+        return 1;
+    }
+#else
+    struct stat st;
+
+    if (stat(path, &st) != 0)
+    {
+        return 1;
+    }
+#endif
+    *p_size = (uint64_t) st.st_size;
+    return 0;
+}
+
+/* Find the segment containing the byte at position */
+static int
+find_segment(segment_session_t session, uint64_t position, uint32_t *p_index)
+{
+    uint32_t lo = 0;
+    uint32_t hi = session->num_segments;
+
+    /* Binary search for the last segment starting at or before position */
+    while (hi - lo > 1)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (session->segments[mid].position <= position)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    if (session->num_segments == 0 ||
+        position - session->segments[lo].position >= session->segments[lo].size)
+    {
+        return 1;
+    }
+    *p_index = lo;
+    return 0;
+}
+
+static void
+session_lock(segment_session_t session)
+{
+#ifdef SEGMENT_USE_THREADS
+    pthread_mutex_lock(&session->lock);
+#else
+    (void) session;
+#endif
+}
+
+static void
+session_unlock(segment_session_t session)
+{
+#ifdef SEGMENT_USE_THREADS
+    pthread_mutex_unlock(&session->lock);
+#else
+    (void) session;
+#endif
+}
+
+/* Wake up the prefetcher, with the lock held */
+static void
+session_signal(segment_session_t session)
+{
+#ifdef SEGMENT_USE_THREADS
+    pthread_cond_broadcast(&session->cond);
+#else
+    (void) session;
+#endif
+}
+
+#ifdef SEGMENT_USE_THREADS
+/* First segment which a stream may still read from */
+static uint32_t
+first_segment(segment_session_t session)
+{
+    uint32_t first = session->num_streams > 0 ? session->num_segments : 0;
+    uint32_t i;
+
+    for (i = 0; i < session->num_streams; i++)
+    {
+        if (session->streams[i]->segment < first)
+        {
+            first = session->streams[i]->segment;
+        }
+    }
+    return first;
+}
+
+/* Next file segment to load, within prefetch_count segments from first */
+static int
+next_to_load(segment_session_t session, uint32_t first, uint32_t *p_index)
+{
+    uint32_t end = session->num_segments;
+    uint32_t i;
+
+    if (session->prefetch_count < end - first)
+    {
+        end = first + session->prefetch_count;
+    }
+    for (i = first; i < end; i++)
+    {
+        const session_segment_t *p_seg = &session->segments[i];
+
+        if (p_seg->path != NULL && p_seg->loaded == NULL && !p_seg->loading && !p_seg->load_failed)
+        {
+            *p_index = i;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Free the loaded segments which all streams have moved past */
+static void
+release_loaded(segment_session_t session, uint32_t first)
+{
+    while (session->first_loaded < first)
+    {
+        session_segment_t *p_seg = &session->segments[session->first_loaded];
+
+        if (!p_seg->loading)
+        {
+            free(p_seg->loaded);
+            p_seg->loaded = NULL;
+        }
+        session->first_loaded++;
+    }
+}
+
+static void *
+prefetch_main(void *arg)
+{
+    segment_session_t session = arg;
+    FILE *file = NULL;
+    const char *file_path = NULL;   /* of file */
+
+    pthread_mutex_lock(&session->lock);
+    while (!session->stop)
+    {
+        uint32_t first = first_segment(session);
+        uint32_t index;
+        session_segment_t seg;
+        unsigned char *data = NULL;
+
+        release_loaded(session, first);
+        if (next_to_load(session, first, &index) != 0)
+        {
+            pthread_cond_wait(&session->cond, &session->lock);
+            continue;
+        }
+        session->segments[index].loading = 1;
+        seg = session->segments[index];
+        pthread_mutex_unlock(&session->lock);
+
+        /* The path is owned by the segment, and freed after this thread has stopped */
+        if (file == NULL || strcmp(file_path, seg.path) != 0)
+        {
+            if (file != NULL)
+            {
+                fclose(file);
+            }
+            file = fopen(seg.path, "rb");
+            file_path = seg.path;
+        }
+        if (file != NULL && (size_t) seg.size == seg.size)
+        {
+            data = malloc((size_t) seg.size);
+        }
+        if (data != NULL &&
+            (file_seek(file, seg.file_offset) != 0 ||
+             fread(data, 1, (size_t) seg.size, file) != seg.size))
+        {
+            free(data);
+            data = NULL;
+        }
+
+        pthread_mutex_lock(&session->lock);
+        session->segments[index].loading = 0;
+        session->segments[index].loaded = data;
+        session->segments[index].load_failed = (data == NULL);
+        if (data != NULL && index < session->first_loaded)
+        {
+            session->first_loaded = index;  /* after a seek back */
+        }
+    }
+    pthread_mutex_unlock(&session->lock);
+
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+    return NULL;
+}
+#endif
+
+/* Prefetched data of a file segment, or NULL */
+static const unsigned char *
+loaded_data(segment_session_t session, uint32_t index)
+{
+    const unsigned char *p_data;
+
+    session_lock(session);
+    p_data = session->segments[index].loaded;
+    session_unlock(session);
+
+    return p_data;
+}
+
+/* Move a stream to the start of a segment */
+static void
+set_segment(segment_stream_t ss, uint32_t index)
+{
+    session_lock(ss->session);
+    ss->segment = index;
+    ss->segment_pos = 0;
+    session_signal(ss->session);
+    session_unlock(ss->session);
+}
+
+/* Read from a segment, at an offset relative to its first byte */
+static int
+read_segment(segment_stream_t ss,
+             uint32_t index,
+             uint64_t offset,
+             size_t size,
+             unsigned char *p_buffer)
+{
+    int err = 0;
+    const session_segment_t *p_seg = &ss->session->segments[index];
+    const unsigned char *p_data = p_seg->p_data;
+
+    if (p_data == NULL)
+    {
+        /* Copied with the lock held: the prefetcher frees segments behind the streams */
+        session_lock(ss->session);
+        if (p_seg->loaded != NULL)
+        {
+            memcpy(p_buffer, p_seg->loaded + offset, size);
+            p_data = p_seg->loaded;
+        }
+        session_unlock(ss->session);
+        if (p_data != NULL)
+        {
+            return 0;
+        }
+    }
+    else
+    {
+        memcpy(p_buffer, p_data + offset, size);
+        return 0;
+    }
+
+    if (ss->file == NULL || ss->file_segment != index)
+    {
+        if (ss->file != NULL)
+        {
+            fclose(ss->file);
+        }
+        ss->file = fopen(p_seg->path, "rb");
+        ASSURE( ss->file != NULL, ("Failed to open segment '%s'", p_seg->path) );
+        ss->file_segment = index;
+    }
+    ASSURE( file_seek(ss->file, p_seg->file_offset + offset) == 0,
+            ("Seek to %" PRIu64 " of '%s' failed", p_seg->file_offset + offset, p_seg->path) );
+    ASSURE( fread(p_buffer, 1, size, ss->file) == size,
+            ("Failed to read %" PRIz " bytes @%" PRIu64 " of '%s'", size, p_seg->file_offset + offset, p_seg->path) );
+
+cleanup:
+    return err;
+}
+
+/* Read size bytes at the next box of the current (file) segment */
+static int
+read_box(segment_stream_t ss, uint64_t size)
+{
+    int err = 0;
+
+    ASSURE( (size_t) size == size, ("Box @%" PRIu64 " is too big (size = %" PRIu64 ")",
+                                    ss->session->segments[ss->segment].position + ss->segment_pos, size) );
+    if (size > ss->box_size)
+    {
+        unsigned char *box = realloc(ss->box, (size_t) size);
+
+        ASSURE( box != NULL, ("Failed to allocate %" PRIu64 " bytes", size) );
+        ss->box = box;
+        ss->box_size = (size_t) size;
+    }
+    CHECK( read_segment(ss, ss->segment, ss->segment_pos, (size_t) size, ss->box) );
+
+cleanup:
+    return err;
+}
+
+static int
+segment_stream_load(fragment_reader_t s, uint64_t position, uint32_t size, unsigned char *p_buffer)
+{
+    int err = 0;
+    segment_stream_t ss = (segment_stream_t) s;
+    const session_segment_t *p_seg;
+    uint32_t index;
+
+    ASSURE( find_segment(ss->session, position, &index) == 0,
+            ("Position %" PRIu64 " is not in the segments", position) );
+    p_seg = &ss->session->segments[index];
+    ASSURE( position + size <= p_seg->position + p_seg->size,
+            ("Reading %" PRIu32 " bytes @%" PRIu64 " failed: crosses the end of segment %" PRIu32, size, position, index) );
+
+    CHECK( read_segment(ss, index, position - p_seg->position, size, p_buffer) );
+
+cleanup:
+    return err;
+}
+
+/* Samples of the segments added as buffers, without copying */
+static int
+segment_stream_get_data(fragment_reader_t s, uint64_t position, uint32_t size, const unsigned char **pp_data)
+{
+    segment_stream_t ss = (segment_stream_t) s;
+    const session_segment_t *p_seg;
+    uint32_t index;
+
+    if (find_segment(ss->session, position, &index) != 0)
+    {
+        return 1;
+    }
+    p_seg = &ss->session->segments[index];
+    if (p_seg->p_data == NULL || position + size > p_seg->position + p_seg->size)
+    {
+        return 1;  /* a file segment, prefetched or not: load() it */
+    }
+    *pp_data = p_seg->p_data + (position - p_seg->position);
+
+    return 0;
+}
+
+static int
+segment_stream_next_atom(fragment_reader_t s)
+{
+    segment_stream_t ss = (segment_stream_t) s;
+    segment_session_t session = ss->session;
+    uint32_t num_segments = session->num_segments;
+    const session_segment_t *p_seg;
+    const unsigned char *p_data;
+    uint64_t position;
+    uint64_t left;
+    uint64_t atom_size;
+    mp4d_error_t rv;
+    int err = 0;
+
+    if (ss->init_only && num_segments > 1)
+    {
+        num_segments = 1;
+    }
+
+    /* Skip to the next segment which has data left */
+    while (ss->segment < num_segments &&
+           ss->segment_pos == session->segments[ss->segment].size)
+    {
+        if (ss->segment + 1 == num_segments)
+        {
+            return 2;
+        }
+        set_segment(ss, ss->segment + 1);
+    }
+    if (ss->segment >= num_segments)
+    {
+        return 2;
+    }
+
+    p_seg = &session->segments[ss->segment];
+    position = p_seg->position + ss->segment_pos;
+    left = p_seg->size - ss->segment_pos;
+
+    /* A loaded segment is not released while the stream is in it */
+    p_data = p_seg->p_data;
+    if (p_data == NULL)
+    {
+        p_data = loaded_data(session, ss->segment);
+    }
+
+    if (p_data != NULL)
+    {
+        rv = mp4d_demuxer_parse(s->p_dmux,
+                                p_data + ss->segment_pos,
+                                left,
+                                1,  /* a box of size 0 extends to the end of the segment */
+                                position,
+                                &atom_size);
+    }
+    else
+    {
+        /* Read the box header first: media data is not read until it is loaded */
+        uint64_t size = left < SEGMENT_STREAM_HEADER_SIZE ? left : SEGMENT_STREAM_HEADER_SIZE;
+        int to_end;
+
+        CHECK( read_box(ss, size) );
+        rv = mp4d_demuxer_parse(s->p_dmux, ss->box, size, size == left, position, &atom_size);
+
+        /* A box of size 0 extends to the end of the segment */
+        to_end = size >= 4 && ss->box[0] == 0 && ss->box[1] == 0 && ss->box[2] == 0 && ss->box[3] == 0;
+        if (rv == MP4D_E_BUFFER_TOO_SMALL)
+        {
+            mp4d_fourcc_t type;
+
+            if (to_end)
+            {
+                atom_size = left;
+            }
+            CHECK( mp4d_demuxer_get_type(s->p_dmux, &type) );
+            if (atom_size <= left)
+            {
+                if (MP4D_FOURCC_EQ(type, "mdat") ||
+                    MP4D_FOURCC_EQ(type, "free") ||
+                    MP4D_FOURCC_EQ(type, "skip"))
+                {
+                    rv = MP4D_NO_ERROR;
+                }
+                else
+                {
+                    CHECK( read_box(ss, atom_size) );
+                    rv = mp4d_demuxer_parse(s->p_dmux, ss->box, atom_size, atom_size == left, position, &atom_size);
+                }
+            }
+        }
+    }
+    ASSURE( rv != MP4D_E_BUFFER_TOO_SMALL,
+            ("Box @%" PRIu64 " crosses the end of segment %" PRIu32, position, ss->segment) );
+    ASSURE( rv == MP4D_NO_ERROR, ("Failed (%d) to parse box @%" PRIu64, rv, position) );
+
+    ss->atom_offset = position;
+    ss->segment_pos += atom_size;
+
+cleanup:
+    return err;
+}
+
+static int
+segment_stream_seek(fragment_reader_t s,
+                    uint32_t track_ID,
+                    uint64_t seek_time,
+                    uint64_t *out_time)
+{
+    int err = 0;
+    segment_stream_t ss = (segment_stream_t) s;
+    mp4d_fourcc_t type;
+
+    (void) track_ID;
+    (void) seek_time;
+
+    /* The init segment has the only 'moov' */
+    set_segment(ss, 0);
+    do
+    {
+        CHECK( fragment_reader_next_atom(s) );
+        CHECK( mp4d_demuxer_get_type(s->p_dmux, &type) );
+    } while (!MP4D_FOURCC_EQ(type, "moov"));
+
+    *out_time = 0;
+
+cleanup:
+    return err;
+}
+
+static int
+segment_stream_get_offset(fragment_reader_t s, uint64_t *offset)
+{
+    int err = 0;
+    segment_stream_t ss = (segment_stream_t) s;
+
+    ASSURE( offset != NULL, ("Null input") );
+    *offset = ss->atom_offset;
+
+cleanup:
+    return err;
+}
+
+static int
+segment_stream_get_type(fragment_reader_t s, mp4d_ftyp_info_t *p_type)
+{
+    int err = 0;
+    segment_stream_t ss = (segment_stream_t) s;
+
+    ASSURE( ss->session->header != NULL, ("No init segment") );
+    *p_type = ss->session->ftyp;
+
+cleanup:
+    return err;
+}
+
+static void
+segment_stream_destroy(fragment_reader_t s)
+{
+    segment_stream_t ss = (segment_stream_t) s;
+
+    if (ss != NULL)
+    {
+        if (ss->file != NULL)
+        {
+            fclose(ss->file);
+        }
+        if (!ss->init_only)
+        {
+            segment_session_t session = ss->session;
+            uint32_t i;
+
+            session_lock(session);
+            for (i = 0; i < session->num_streams; i++)
+            {
+                if (session->streams[i] == ss)
+                {
+                    session->streams[i] = session->streams[--session->num_streams];
+                    break;
+                }
+            }
+            session_signal(session);
+            session_unlock(session);
+            segment_session_release(session);
+        }
+        free(ss->box);
+        fragment_reader_deinit(s);
+        free(ss);
+    }
+}
+
+static int
+stream_new(fragment_reader_t *p_s,
+           segment_session_t session,
+           int init_only)
+{
+    int err = 0;
+    segment_stream_t ss = malloc(sizeof(*ss));
+    fragment_reader_t s;
+
+    ASSURE( ss != NULL, ("Allocation error") );
+    memset(ss, 0, sizeof(*ss));
+    s = &ss->base;
+    CHECK( fragment_reader_init(s) );
+
+    ss->session = session;
+    ss->init_only = init_only;
+
+    s->next_atom = segment_stream_next_atom;
+    s->seek = segment_stream_seek;
+    s->destroy = segment_stream_destroy;
+    s->load = segment_stream_load;
+    s->get_offset = segment_stream_get_offset;
+    s->get_type = segment_stream_get_type;
+    s->get_data = segment_stream_get_data;
+
+    *p_s = s;
+cleanup:
+    if (err && ss != NULL)
+    {
+        free(ss);
+    }
+    return err;
+}
+
+int
+segment_stream_new(fragment_reader_t *p_s,
+                   segment_session_t session)
+{
+    int err = 0;
+
+    ASSURE( session->header != NULL, ("No init segment") );
+
+    session_lock(session);
+    if (session->num_streams == session->max_streams)
+    {
+        segment_stream_t *streams;
+
+        session->max_streams = 2 * session->max_streams + 4;
+        streams = realloc(session->streams, session->max_streams * sizeof(*streams));
+        if (streams == NULL)
+        {
+            session_unlock(session);
+        }
+        ASSURE( streams != NULL, ("Allocation error") );
+        session->streams = streams;
+    }
+    session_unlock(session);
+
+    CHECK( stream_new(p_s, session, 0) );
+    session->refs++;
+
+    session_lock(session);
+    session->streams[session->num_streams++] = (segment_stream_t) *p_s;
+    session_signal(session);
+    session_unlock(session);
+
+cleanup:
+    return err;
+}
+
+/* Parse the init segment: file type, and the 'moov' kept by the header stream */
+static int
+read_init(segment_session_t session)
+{
+    int err = 0;
+    fragment_reader_t s = NULL;
+    mp4d_fourcc_t type;
+    int have_ftyp = 0;
+
+    CHECK( stream_new(&s, session, 1) );
+    do
+    {
+        int err_next = fragment_reader_next_atom(s);
+
+        ASSURE( err_next != 2, ("Missing 'moov' box in the init segment") );
+        CHECK( err_next );
+        CHECK( mp4d_demuxer_get_type(s->p_dmux, &type) );
+        if (MP4D_FOURCC_EQ(type, "ftyp") && !have_ftyp)
+        {
+            /* compatible_brands point into the init segment */
+            CHECK( mp4d_demuxer_get_ftyp_info(s->p_dmux, &session->ftyp) );
+            have_ftyp = 1;
+        }
+    } while (!MP4D_FOURCC_EQ(type, "moov"));
+
+    if (!have_ftyp)
+    {
+        /* Assume Quicktime, see file_stream_new() */
+        session->ftyp.num_compat_brands = 1;
+        session->ftyp.compat_brands = (const unsigned char *) "qt  ";
+        memcpy(session->ftyp.major_brand, session->ftyp.compat_brands, 4);
+        session->ftyp.minor_version = 0;
+    }
+
+    session->header = s;
+    s = NULL;
+
+cleanup:
+    if (s != NULL)
+    {
+        fragment_reader_destroy(s);
+    }
+    return err;
+}
+
+static int
+add_segment(segment_session_t session,
+            const char *path,
+            uint64_t file_offset,
+            const unsigned char *p_data,
+            uint64_t size)
+{
+    int err = 0;
+    session_segment_t seg;
+
+    ASSURE( size > 0, ("Empty segment") );
+
+    memset(&seg, 0, sizeof(seg));
+    seg.file_offset = file_offset;
+    seg.p_data = p_data;
+    seg.size = size;
+    if (path != NULL)
+    {
+        seg.path = string_dup(path);
+        ASSURE( seg.path != NULL, ("Allocation error") );
+    }
+
+    /* The prefetcher may be reading the segments */
+    session_lock(session);
+    if (session->num_segments == session->max_segments)
+    {
+        session_segment_t *segments = realloc(session->segments, (2 * session->max_segments + 4) * sizeof(*segments));
+
+        if (segments == NULL)
+        {
+            session_unlock(session);
+            free(seg.path);
+        }
+        ASSURE( segments != NULL, ("Allocation error") );
+        session->segments = segments;
+        session->max_segments = 2 * session->max_segments + 4;
+    }
+    if (session->num_segments > 0)
+    {
+        const session_segment_t *p_last = &session->segments[session->num_segments - 1];
+
+        seg.position = p_last->position + p_last->size;
+    }
+    session->segments[session->num_segments++] = seg;
+    session_signal(session);
+    session_unlock(session);
+
+    if (session->num_segments == 1)
+    {
+        err = read_init(session);
+        if (err)
+        {
+            free(seg.path);
+            session->num_segments = 0;
+        }
+    }
+
+cleanup:
+    return err;
+}
+
+int
+segment_session_add_buffer(segment_session_t session,
+                           const unsigned char *p_data,
+                           uint64_t size)
+{
+    int err = 0;
+
+    ASSURE( p_data != NULL, ("Null input") );
+    CHECK( add_segment(session, NULL, 0, p_data, size) );
+
+cleanup:
+    return err;
+}
+
+int
+segment_session_add_file_range(segment_session_t session,
+                               const char *path,
+                               uint64_t offset,
+                               uint64_t size)
+{
+    int err = 0;
+    FILE *file = NULL;
+
+    if (session->num_segments > 0)
+    {
+        CHECK( add_segment(session, path, offset, NULL, size) );
+        goto cleanup;
+    }
+
+    /* Keep the init segment in memory, its boxes are referenced by all streams */
+    ASSURE( (size_t) size == size, ("Init segment '%s' is too big (size = %" PRIu64 ")", path, size) );
+    session->init_data = malloc(size > 0 ? (size_t) size : 1);
+    ASSURE( session->init_data != NULL, ("Failed to allocate %" PRIu64 " bytes", size) );
+    file = fopen(path, "rb");
+    ASSURE( file != NULL, ("Failed to open segment '%s'", path) );
+    ASSURE( file_seek(file, offset) == 0 && fread(session->init_data, 1, (size_t) size, file) == size,
+            ("Failed to read init segment '%s'", path) );
+    CHECK( add_segment(session, NULL, 0, session->init_data, size) );
+
+cleanup:
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+    if (err && session->num_segments == 0)
+    {
+        free(session->init_data);
+        session->init_data = NULL;
+    }
+    return err;
+}
+
+int
+segment_session_add_file(segment_session_t session,
+                         const char *path)
+{
+    int err = 0;
+    uint64_t size;
+
+    ASSURE( path_size(path, &size) == 0, ("Failed to open segment '%s'", path) );
+    CHECK( segment_session_add_file_range(session, path, 0, size) );
+
+cleanup:
+    return err;
+}
+
+int
+segment_session_set_prefetch(segment_session_t session,
+                             uint32_t count)
+{
+    int err = 0;
+
+    session_lock(session);
+    session->prefetch_count = count;
+    session_signal(session);
+    session_unlock(session);
+
+#ifdef SEGMENT_USE_THREADS
+    if (count > 0 && !session->have_thread)
+    {
+        ASSURE( pthread_create(&session->thread, NULL, prefetch_main, session) == 0,
+                ("Failed to start the segment prefetcher") );
+        session->have_thread = 1;
+    }
+#endif
+
+cleanup:
+    return err;
+}
+
+void
+segment_session_release(segment_session_t session)
+{
+    if (session != NULL && --session->refs == 0)
+    {
+        uint32_t i;
+
+#ifdef SEGMENT_USE_THREADS
+        if (session->have_thread)
+        {
+            pthread_mutex_lock(&session->lock);
+            session->stop = 1;
+            pthread_cond_broadcast(&session->cond);
+            pthread_mutex_unlock(&session->lock);
+            pthread_join(session->thread, NULL);
+        }
+        pthread_mutex_destroy(&session->lock);
+        pthread_cond_destroy(&session->cond);
+#endif
+        if (session->header != NULL)
+        {
+            fragment_reader_destroy(session->header);
+        }
+        for (i = 0; i < session->num_segments; i++)
+        {
+            free(session->segments[i].path);
+            free(session->segments[i].loaded);
+        }
+        free(session->segments);
+        free(session->streams);
+        free(session->init_data);
+        free(session);
+    }
+}
+
+int
+segment_session_new(segment_session_t *p_session)
+{
+    int err = 0;
+    segment_session_t session = malloc(sizeof(*session));
+
+    ASSURE( session != NULL, ("Allocation error") );
+    memset(session, 0, sizeof(*session));
+    session->refs = 1;
+#ifdef SEGMENT_USE_THREADS
+    if (pthread_mutex_init(&session->lock, NULL) != 0)
+    {
+        free(session);
+        session = NULL;
+    }
+    else if (pthread_cond_init(&session->cond, NULL) != 0)
+    {
+        pthread_mutex_destroy(&session->lock);
+        free(session);
+        session = NULL;
+    }
+    ASSURE( session != NULL, ("Failed to create the session lock") );
+#endif
+
+    *p_session = session;
+cleanup:
+    return err;
+}
+
+/* movie_t implementation, from the init segment */
+
+typedef struct
+{
+    struct movie_t_ base;
+
+    segment_session_t session;
+} *segment_movie_t;
+
+static void
+segment_movie_destroy(movie_t p_movie)
+{
+    segment_movie_t p_sm = (segment_movie_t) p_movie;
+
+    if (p_sm != NULL)
+    {
+        segment_session_release(p_sm->session);
+        free(p_sm);
+    }
+}
+
+static int
+segment_movie_get_movie_info(movie_t p_movie,
+                             mp4d_movie_info_t *p_movie_info
+                             )
+{
+    int err = 0;
+    segment_movie_t p_sm = (segment_movie_t) p_movie;
+
+    CHECK( mp4d_demuxer_get_movie_info(p_sm->session->header->p_dmux, p_movie_info) );
+
+cleanup:
+    return err;
+}
+
+static int
+segment_movie_get_stream_info(movie_t p_movie,
+                              uint32_t stream_num,
+                              uint32_t bit_rate,   /* not used */
+                              mp4d_stream_info_t *p_stream_info,
+                              char **stream_name
+    )
+{
+    int err = 0;
+    segment_movie_t p_sm = (segment_movie_t) p_movie;
+
+    (void)bit_rate;
+
+    *stream_name = NULL;
+    CHECK( mp4d_demuxer_get_stream_info(p_sm->session->header->p_dmux, stream_num, p_stream_info) );
+
+cleanup:
+    return err;
+}
+
+static int
+segment_movie_get_sampleentry(movie_t p_movie,
+                              uint32_t stream_num,
+                              uint32_t bit_rate,   /* not used */
+                              uint32_t sample_description_index,
+                              mp4d_sampleentry_t *p_sampleentry
+                              )
+{
+    int err = 0;
+    segment_movie_t p_sm = (segment_movie_t) p_movie;
+
+    (void)bit_rate;
+
+    CHECK( mp4d_demuxer_get_sampleentry(p_sm->session->header->p_dmux, stream_num, sample_description_index, p_sampleentry) );
+
+cleanup:
+    return err;
+}
+
+static int
+segment_movie_get_bitrate(movie_t p_movie,
+                          uint32_t stream_num,
+                          uint32_t index,
+                          uint32_t *p_bitrate
+                          )
+{
+    (void)p_movie;
+    (void)stream_num;
+
+    if (index == 0)
+    {
+        *p_bitrate = 0;
+        return 0;
+    }
+    else
+    {
+        /* out of bit rates */
+        return 2;
+    }
+}
+
+static int
+segment_movie_fragment_stream_new(movie_t p_movie,
+                                  uint32_t stream_num,
+                                  const char *stream_name,
+                                  uint32_t bitrate,
+                                  fragment_reader_t *p_source
+                                  )
+{
+    segment_movie_t p_sm = (segment_movie_t) p_movie;
+
+    (void) bitrate;
+    (void) stream_num;
+    (void) stream_name;
+
+    return segment_stream_new(p_source, p_sm->session);
+}
+
+int
+segment_movie_new(segment_session_t session,
+                  movie_t *p_movie)
+{
+    int err = 0;
+    segment_movie_t p_sm = NULL;
+
+    ASSURE( session->header != NULL, ("No init segment") );
+    p_sm = malloc(sizeof(*p_sm));
+    ASSURE( p_sm != NULL, ("malloc failure") );
+
+    p_sm->session = session;
+    session->refs++;
+
+    p_sm->base.destroy = segment_movie_destroy;
+    p_sm->base.get_movie_info = segment_movie_get_movie_info;
+    p_sm->base.get_stream_info = segment_movie_get_stream_info;
+    p_sm->base.get_sampleentry = segment_movie_get_sampleentry;
+    p_sm->base.get_bitrate = segment_movie_get_bitrate;
+    p_sm->base.fragment_stream_new = segment_movie_fragment_stream_new;
+
+    *p_movie = &p_sm->base;
+cleanup:
+    return err;
+}
@@ -32,6 +32,12 @@
 #pragma GCC diagnostic ignored "-Wunused-parameter"
 #endif
 
+/* Gap (in bytes) up to which the byte ranges of a look ahead are merged into one hint */
+#define STREAM_PREFETCH_MAX_GAP (64 * 1024)
+
+/* Sample aux info of a fragment up to this size is loaded at once, see stream_get_aux() */
+#define STREAM_MAX_AUX_RANGE (1024 * 1024)
+
 int
 stream_init(stream_t *p_s,
             fragment_reader_t source,
@@ -50,13 +56,23 @@ stream_init(stream_t *p_s,
 
     p_s->p_static_mem = NULL;
     p_s->p_dynamic_mem = NULL;
+    p_s->p_edit_mem = NULL;
 
     p_s->have_sample = 0;
 
-    p_s->subsample_pos = NULL;
-    p_s->subsample_size = NULL;
-    p_s->size_subsample = 0;
+    p_s->subsample_mem = NULL;
+    p_s->subsample_mem_entries = 0;
     p_s->subtitle_track_flag = 0;
+    p_s->sync_interval = 0;
+    p_s->next_sync_pts = 0;
+    p_s->prefetch_count = 0;
+    p_s->prefetch_left = 0;
+    p_s->p_peek_mem = NULL;
+    p_s->peek_samples = NULL;
+    p_s->aux_buffer = NULL;
+    p_s->aux_buffer_size = 0;
+    p_s->aux_pos = 0;
+    p_s->aux_size = 0;
 
     p_s->fragments = source;
     p_s->have_fragment = 0; /* Before getting first fragment */
@@ -76,6 +92,7 @@ stream_init(stream_t *p_s,
 
         p_s->p_static_mem = malloc((size_t) static_mem_size);
         p_s->p_dynamic_mem = malloc((size_t) dyn_mem_size);
+        ASSURE( p_s->p_static_mem != NULL && (p_s->p_dynamic_mem != NULL || dyn_mem_size == 0), ("Allocation error") );
 
         CHECK( mp4d_trackreader_init(&(p_s->p_tr),
                                      p_s->p_static_mem,
@@ -112,9 +129,13 @@ stream_deinit(stream_t *p_s)
         free(p_s->name);
         free(p_s->p_static_mem);
         free(p_s->p_dynamic_mem);
+        free(p_s->p_edit_mem);
 
-        free(p_s->subsample_pos);
-        free(p_s->subsample_size);
+        free(p_s->subsample_mem);
+
+        free(p_s->p_peek_mem);
+        free(p_s->peek_samples);
+        free(p_s->aux_buffer);
 
         if (p_s->fragments != NULL)
         {
@@ -123,6 +144,168 @@ stream_deinit(stream_t *p_s)
     }
 }
 
+int
+stream_set_prefetch(stream_t *p_s,
+                    uint32_t num_samples)
+{
+    int err = 0;
+    uint64_t static_mem_size, dyn_mem_size;
+
+    free(p_s->p_peek_mem);
+    free(p_s->peek_samples);
+    p_s->p_peek_mem = NULL;
+    p_s->peek_samples = NULL;
+    p_s->prefetch_count = 0;
+    p_s->prefetch_left = 0;
+
+    if (num_samples == 0)
+    {
+        goto cleanup;
+    }
+
+    CHECK( mp4d_trackreader_query_mem(&static_mem_size,
+                                      &dyn_mem_size) );
+    ASSURE( (uint64_t) (size_t) static_mem_size == static_mem_size, ("Cannot allocate %" PRIu64 " bytes of memory", static_mem_size) );
+
+    p_s->p_peek_mem = malloc((size_t) static_mem_size);
+    p_s->peek_samples = malloc(num_samples * sizeof(*p_s->peek_samples));
+    ASSURE( p_s->p_peek_mem != NULL && p_s->peek_samples != NULL, ("Allocation error") );
+
+    p_s->prefetch_count = num_samples;
+
+cleanup:
+    return err;
+}
+
+/** @brief extend the byte range [*p_start, *p_end) if the given range is close, otherwise pass it to the source and start a new one
+ */
+static void
+prefetch_range(stream_t *p_s,
+               uint64_t *p_start,
+               uint64_t *p_end,
+               uint64_t position,
+               uint64_t size
+    )
+{
+    if (size == 0)
+    {
+        return;
+    }
+    if (*p_end > *p_start &&
+        position >= *p_start &&
+        position <= *p_end + STREAM_PREFETCH_MAX_GAP)
+    {
+        if (position + size > *p_end)
+        {
+            *p_end = position + size;
+        }
+        return;
+    }
+    if (*p_end > *p_start)
+    {
+        fragment_reader_prefetch(p_s->fragments, *p_start, *p_end - *p_start);
+    }
+    *p_start = position;
+    *p_end = position + size;
+}
+
+/** @brief hint the byte ranges of the next samples, see stream_set_prefetch()
+ */
+static void
+prefetch_next(stream_t *p_s)
+{
+    uint32_t count = 0;
+    uint32_t i;
+    uint64_t start = 0, end = 0;          /* sample data */
+    uint64_t aux_start = 0, aux_end = 0;  /* aux info */
+
+    if (p_s->prefetch_count == 0 || p_s->sync_interval > 0)
+    {
+        return;
+    }
+    if (p_s->prefetch_left > 0)
+    {
+        p_s->prefetch_left--;
+        return;
+    }
+
+    if (mp4d_trackreader_peek_samples(p_s->p_tr, p_s->p_peek_mem,
+                                      p_s->peek_samples, p_s->prefetch_count, &count) != MP4D_NO_ERROR)
+    {
+        /* Only a hint. next_sample() reports the error */
+        count = 0;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        const mp4d_sampleref_t *p_sample = &p_s->peek_samples[i];
+        uint32_t j;
+
+        prefetch_range(p_s, &start, &end, p_sample->pos, p_sample->size);
+        for (j = 0; j < MP4D_MAX_AUXDATA; j++)
+        {
+            prefetch_range(p_s, &aux_start, &aux_end, p_sample->auxdata[j].pos, p_sample->auxdata[j].size);
+        }
+    }
+    if (end > start)
+    {
+        fragment_reader_prefetch(p_s->fragments, start, end - start);
+    }
+    if (aux_end > aux_start)
+    {
+        fragment_reader_prefetch(p_s->fragments, aux_start, aux_end - aux_start);
+    }
+
+    /* At the end of the fragment, all its samples were hinted */
+    p_s->prefetch_left = (count < p_s->prefetch_count) ? count : count / 2;
+}
+
+/** @brief initialize the trackreader with the current fragment
+
+    Edit lists longer than the trackreader holds are given memory, and the
+    fragment is read again.
+ */
+static mp4d_error_t
+trackreader_init_segment(stream_t *p_s,
+                         const uint64_t *abs_time_offs
+    )
+{
+    mp4d_error_t err_tr = mp4d_trackreader_init_segment(p_s->p_tr,
+                                                        p_s->fragments->p_dmux,
+                                                        p_s->track_ID,
+                                                        p_s->movie_time_scale,
+                                                        p_s->media_time_scale,
+                                                        abs_time_offs);
+
+    if (err_tr == MP4D_E_BUFFER_TOO_SMALL)
+    {
+        uint64_t size;
+        void *p_mem;
+
+        if (mp4d_trackreader_query_edit_mem(p_s->p_tr, &size) != MP4D_NO_ERROR ||
+            size == 0 || (uint64_t) (size_t) size != size)
+        {
+            return err_tr;
+        }
+        p_mem = realloc(p_s->p_edit_mem, (size_t) size);
+        if (p_mem == NULL)
+        {
+            return err_tr;
+        }
+        p_s->p_edit_mem = p_mem;
+        mp4d_trackreader_set_edit_mem(p_s->p_tr, p_mem, size);
+
+        err_tr = mp4d_trackreader_init_segment(p_s->p_tr,
+                                               p_s->fragments->p_dmux,
+                                               p_s->track_ID,
+                                               p_s->movie_time_scale,
+                                               p_s->media_time_scale,
+                                               abs_time_offs);
+    }
+
+    return err_tr;
+}
+
 int
 stream_seek(stream_t *p_s,
             uint64_t seek_time,  /**< movie time scale */
@@ -152,22 +335,12 @@ stream_seek(stream_t *p_s,
             while (err_tr == MP4D_E_TRACK_NOT_FOUND)
             {
                 p_s->track_ID++;
-                err_tr = mp4d_trackreader_init_segment(p_s->p_tr,
-                        p_s->fragments->p_dmux,
-                        p_s->track_ID,
-                        p_s->movie_time_scale,
-                        p_s->media_time_scale,
-                        NULL);
+                err_tr = trackreader_init_segment(p_s, NULL);
             }
         }
         else
         {
-            CHECK( mp4d_trackreader_init_segment(p_s->p_tr,
-                    p_s->fragments->p_dmux,
-                    p_s->track_ID,
-                    p_s->movie_time_scale,
-                    p_s->media_time_scale,
-                    NULL) );
+            CHECK( trackreader_init_segment(p_s, NULL) );
         }
         p_s->have_fragment = 1;
     }
@@ -175,6 +348,7 @@ stream_seek(stream_t *p_s,
     p_s->sample.presentation_duration = 0;
     p_s->sample.pts = 0;
     p_s->have_sample = 0;
+    p_s->prefetch_left = 0;  /* Look ahead from the new position */
 
     /* Try to seek in the current moov/moof */
     CHECK( mp4d_demuxer_get_type(p_s->fragments->p_dmux, &type));
@@ -211,12 +385,7 @@ stream_seek(stream_t *p_s,
 
     do
     {
-        err_seek = mp4d_trackreader_init_segment(p_s->p_tr,
-                                                 p_s->fragments->p_dmux,
-                                                 p_s->track_ID,
-                                                 p_s->movie_time_scale,
-                                                 p_s->media_time_scale,
-                                                 &offset_time);
+        err_seek = trackreader_init_segment(p_s, &offset_time);
 
         ASSURE( err_seek == MP4D_NO_ERROR || err_seek == MP4D_E_TRACK_NOT_FOUND,
                 ("Error %d while initializing trackreader", err_seek) );
@@ -286,9 +455,21 @@ cleanup:
     return err;
 }
 
-int
-stream_next_sample(stream_t *p_s,
-                   int single_fragment   /* Stay within one fragment? */
+/** @brief get the next sample, or the next sync sample from next_sync_pts if sync_interval is set
+ */
+static mp4d_error_t
+trackreader_next(stream_t *p_s)
+{
+    if (p_s->sync_interval > 0)
+    {
+        return mp4d_trackreader_next_sync_sample_at(p_s->p_tr, p_s->next_sync_pts, &p_s->sample);
+    }
+    return mp4d_trackreader_next_sample(p_s->p_tr, &p_s->sample);
+}
+
+static int
+stream_fill(stream_t *p_s,
+            int single_fragment   /* Stay within one fragment? */
     )
 {
     int err = 0;
@@ -300,8 +481,7 @@ stream_next_sample(stream_t *p_s,
     }
     else
     {
-        err_tr = mp4d_trackreader_next_sample(p_s->p_tr,
-                &p_s->sample);
+        err_tr = trackreader_next(p_s);
 
         ASSURE( err_tr == MP4D_NO_ERROR || err_tr == MP4D_E_NEXT_SEGMENT,
                 ("Failed (%d) to get the next sample", err_tr) );
@@ -356,12 +536,7 @@ stream_next_sample(stream_t *p_s,
             while (err_tr == MP4D_E_TRACK_NOT_FOUND)
             {
                 p_s->track_ID++;
-                err_tr = mp4d_trackreader_init_segment(p_s->p_tr,
-                        p_s->fragments->p_dmux,
-                        p_s->track_ID,
-                        p_s->movie_time_scale,
-                        p_s->media_time_scale,
-                        NULL);
+                err_tr = trackreader_init_segment(p_s, NULL);
                 /* danger of infinite loop here e.g. if the fragment contains no tracks.
                  * Could be avoided by having a get_available_track_IDs() library method
                  */
@@ -369,12 +544,7 @@ stream_next_sample(stream_t *p_s,
         }
         else
         {
-            err_tr = mp4d_trackreader_init_segment(p_s->p_tr,
-                    p_s->fragments->p_dmux,
-                    p_s->track_ID,
-                    p_s->movie_time_scale,
-                    p_s->media_time_scale,
-                    NULL);
+            err_tr = trackreader_init_segment(p_s, NULL);
         }
 
         ASSURE( err_tr == MP4D_NO_ERROR || err_tr == MP4D_E_TRACK_NOT_FOUND,
@@ -382,8 +552,7 @@ stream_next_sample(stream_t *p_s,
 
         if (err_tr == MP4D_NO_ERROR)
         {
-            err_tr = mp4d_trackreader_next_sample(p_s->p_tr,
-                                                  &p_s->sample);
+            err_tr = trackreader_next(p_s);
 
             ASSURE( err_tr == MP4D_NO_ERROR || err_tr == MP4D_E_NEXT_SEGMENT,
                     ("Failed (%d) to get the next sample", err_tr));
@@ -395,11 +564,34 @@ stream_next_sample(stream_t *p_s,
     }
 
     p_s->have_sample = 1;
+    prefetch_next(p_s);
 
 cleanup:
     return err;
 }
 
+int
+stream_next_sample(stream_t *p_s,
+                   int single_fragment   /* Stay within one fragment? */
+    )
+{
+    int err = 0;
+
+    /* The trackreader skips the sync samples before next_sync_pts */
+    p_s->have_sample = 0;
+    err = stream_fill(p_s, single_fragment);
+
+    if (err == 0 && p_s->have_sample && p_s->sync_interval > 0)
+    {
+        /* Only sync samples of the next interval */
+        uint64_t pts = p_s->sample.pts > 0 ? (uint64_t) p_s->sample.pts : 0;
+
+        p_s->next_sync_pts = (int64_t) ((pts / p_s->sync_interval + 1) * p_s->sync_interval);
+    }
+
+    return err;
+}
+
 int
 subtitle_next_sample(stream_t *p_s,
                    int single_fragment   /* Stay within one fragment? */
@@ -414,12 +606,7 @@ subtitle_next_sample(stream_t *p_s,
          &offset_time) );
    if (offset_time ==  (uint64_t)(p_s->sample.pts + p_s->sample.presentation_duration))
    {
-        err_tr = mp4d_trackreader_init_segment(p_s->p_tr,
-                                                p_s->fragments->p_dmux,
-                                                p_s->track_ID,
-                                                p_s->movie_time_scale,
-                                                p_s->media_time_scale,
-                                                &offset_time);
+        err_tr = trackreader_init_segment(p_s, &offset_time);
         ASSURE( err_tr == MP4D_NO_ERROR, ("should no error"));
 
         err_tr = mp4d_trackreader_next_sample(p_s->p_tr,
@@ -434,6 +621,68 @@ cleanup:
     return 0;
 }
 
+/** @brief load a byte range of the fragments into aux_buffer */
+static int
+load_aux(stream_t *p_s,
+         uint64_t pos,
+         uint64_t size
+    )
+{
+    int err = 0;
+
+    p_s->aux_size = 0;
+    if (p_s->aux_buffer_size < size)
+    {
+        free(p_s->aux_buffer);
+        p_s->aux_buffer_size = 0;
+        p_s->aux_buffer = malloc((size_t) size);
+        ASSURE( p_s->aux_buffer != NULL, ("Allocation error") );
+        p_s->aux_buffer_size = (size_t) size;
+    }
+    CHECK( fragment_reader_load(p_s->fragments, pos, (uint32_t) size, p_s->aux_buffer) );
+    p_s->aux_pos = pos;
+    p_s->aux_size = size;
+
+cleanup:
+    return err;
+}
+
+int
+stream_get_aux(stream_t *p_s,
+               const mp4d_auxref_t *p_aux,
+               const unsigned char **pp_data)
+{
+    int err = 0;
+    uint64_t range_pos, range_size;
+    const unsigned char *p_range;
+
+    if (p_aux->pos < p_s->aux_pos || p_aux->pos - p_s->aux_pos + p_aux->size > p_s->aux_size)
+    {
+        if (mp4d_trackreader_get_aux_range(p_s->p_tr, p_aux->datatype, &range_pos, &range_size, &p_range) == 0 &&
+            p_aux->pos >= range_pos && p_aux->pos - range_pos + p_aux->size <= range_size)
+        {
+            if (p_range != NULL)
+            {
+                *pp_data = p_range + (p_aux->pos - range_pos);
+                goto cleanup;
+            }
+            if (range_size <= STREAM_MAX_AUX_RANGE)
+            {
+                CHECK( load_aux(p_s, range_pos, range_size) );
+            }
+        }
+        if (p_aux->pos < p_s->aux_pos || p_aux->pos - p_s->aux_pos + p_aux->size > p_s->aux_size)
+        {
+            /* Not contiguous, or too large */
+            CHECK( load_aux(p_s, p_aux->pos, p_aux->size) );
+        }
+    }
+    *pp_data = p_s->aux_buffer + (p_aux->pos - p_s->aux_pos);
+
+cleanup:
+    return err;
+}
+
 int
 stream_set_tenc(
     stream_t *p_s,
@@ -29,6 +29,12 @@
 #include <stdio.h>
 #include <string.h>
 
+#ifdef _MSC_VER
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
 #ifdef _MSC_VER
 const char DIRECTORY_SEPARATOR = '\\';
 #else
@@ -78,3 +84,19 @@ char *string_dup(const char *s)
     }
         return t;
 }
+
+double clock_seconds(void)
+{
+#ifdef _MSC_VER
+    LARGE_INTEGER frequency, counter;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double) counter.QuadPart / frequency.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
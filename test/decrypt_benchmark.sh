@@ -0,0 +1,73 @@
+#!/bin/sh
+#
+# Measures the sample decryption throughput of mp4demuxer on an encrypted
+# ('cenc' or 'cbcs') input: on the demuxing thread, and on a pool of
+# decryption threads (--decrypt-threads N).
+#
+# Usage: decrypt_benchmark.sh <mp4demuxer> <input.mp4> <KID:key[,KID:key...]> [thread counts] [runs]
+#
+# e.g.   decrypt_benchmark.sh make/mp4demuxer/linux_amd64/mp4demuxer_release enc.mp4 \
+#            101112131415161718191a1b1c1d1e1f:000102030405060708090a0b0c0d0e0f "1 2 4 8" 5
+#
+# For each thread count, the best run is reported: the decryption throughput
+# (bytes over the time during which samples were being decrypted), the
+# throughput per core, and the wall clock time of the run. The AES
+# implementation (AES-NI or portable) is reported by mp4demuxer. The
+# elementary streams of all runs are compared with the run without threads.
+
+set -e
+
+if [ $# -lt 3 ]; then
+    sed -n '3,16p' "$0" | sed 's/^# \{0,1\}//'
+    exit 1
+fi
+
+demuxer=$1
+input=$2
+keys=$3
+threads=${4:-"1 2 4 8"}
+runs=${5:-3}
+
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+
+# run <threads>: prints the report of the run with the best decryption throughput
+run() {
+    best=
+    line=
+    i=0
+    while [ $i -lt "$runs" ]; do
+        rm -rf "$out/$1"
+        mkdir -p "$out/$1"
+        start=$(date +%s.%N)
+        "$demuxer" --input-file "$input" --output-folder "$out/$1" --decryption-keys "$keys" \
+            --decrypt-threads "$1" > "$out/log" 2>&1
+        end=$(date +%s.%N)
+        report=$(grep "Decrypted" "$out/log" || true)
+        if [ -z "$report" ]; then
+            echo "No sample decrypted (not encrypted, or no key for its KID):"
+            cat "$out/log"
+            exit 1
+        fi
+        rate=$(echo "$report" | sed 's/.*: \([0-9.]*\) MB\/s,.*/\1/')
+        if [ -z "$best" ] || awk -v r="$rate" -v b="$best" 'BEGIN { exit !(r > b) }'; then
+            best=$rate
+            line=$(echo "$report" | sed 's/^\[DEMUX\]: //')
+            wall=$(awk -v s="$start" -v e="$end" 'BEGIN { print e - s }')
+        fi
+        i=$((i + 1))
+    done
+    printf "threads %-3s %s, run %.3f s" "$1" "$line" "$wall"
+}
+
+run 0
+echo
+for n in $threads; do
+    run "$n"
+    if diff -r "$out/0" "$out/$n" > /dev/null; then
+        echo
+    else
+        echo "  OUTPUT DIFFERS"
+    fi
+done
+echo "(best of $runs runs)"
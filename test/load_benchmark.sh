@@ -0,0 +1,78 @@
+#!/bin/sh
+#
+# Compares the sample payload loading of mp4demuxer: one blocking read per
+# sample (stdio), batches of non-blocking reads (--queue-depth N), and
+# blocking reads with read-ahead hints (--prefetch N).
+#
+# Usage: load_benchmark.sh <mp4demuxer> <input.mp4> [queue depths] [runs] [prefetch counts]
+#
+# e.g.   load_benchmark.sh make/mp4demuxer/linux_amd64/mp4demuxer_release big.mp4 "4 16 64" 3 "16 64"
+#
+# The input should be large (compared to the page cache) for the results to
+# show the I/O. If /proc/sys/vm/drop_caches is writable (root), the page
+# cache is dropped before each run, so that every run reads from the disk.
+# The elementary streams of all runs are compared with the stdio run.
+
+set -e
+
+if [ $# -lt 2 ]; then
+    sed -n '3,14p' "$0" | sed 's/^# \{0,1\}//'
+    exit 1
+fi
+
+demuxer=$1
+input=$2
+depths=${3:-"1 4 16 64"}
+runs=${4:-3}
+prefetches=${5:-"64"}
+
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+
+drop_caches() {
+    sync
+    if [ -w /proc/sys/vm/drop_caches ]; then
+        echo 3 > /proc/sys/vm/drop_caches
+        cold="cold"
+    else
+        cold="warm"
+    fi
+}
+
+# run <name> [options]: prints the best wall clock time (in seconds) of the runs
+run() {
+    name=$1
+    shift
+    best=
+    i=0
+    while [ $i -lt "$runs" ]; do
+        rm -rf "$out/$name"
+        mkdir -p "$out/$name"
+        drop_caches
+        start=$(date +%s.%N)
+        "$demuxer" --input-file "$input" --output-folder "$out/$name" "$@" > "$out/$name.log" 2>&1
+        end=$(date +%s.%N)
+        best=$(awk -v s="$start" -v e="$end" -v b="$best" 'BEGIN { t = e - s; if (b == "" || t < b) b = t; print b }')
+        i=$((i + 1))
+    done
+    printf "%-16s %8.3f s (%s cache, best of %d)" "$name" "$best" "$cold" "$runs"
+}
+
+run stdio
+echo
+for depth in $depths; do
+    run "queue-depth-$depth" --queue-depth "$depth"
+    if diff -r "$out/stdio" "$out/queue-depth-$depth" > /dev/null; then
+        echo
+    else
+        echo "  OUTPUT DIFFERS"
+    fi
+done
+for count in $prefetches; do
+    run "prefetch-$count" --prefetch "$count"
+    if diff -r "$out/stdio" "$out/prefetch-$count" > /dev/null; then
+        echo
+    else
+        echo "  OUTPUT DIFFERS"
+    fi
+done
@@ -0,0 +1,1038 @@
+/************************************************************************************************************
+ * Copyright (c) 2017, Dolby Laboratories Inc.
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ *    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+ *    promote products derived from this software without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ ************************************************************************************************************/
+
+/**
+ * @file
+ * @brief Player unit tests
+ *
+ * The movies are written to memory, and played from a segment session.
+ * The decryptors are checked against the NIST SP800-38A AES-128 vectors.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "player.h"
+#include "segment_session.h"
+#include "mem_stream.h"
+#include "decryptor.h"
+
+#include "mp4d_unittest.h"
+#include "mp4d_unittest_writer.h"
+
+#define expect(expr)                                                 \
+do {                                                                 \
+    int expect_expr = (expr);                                        \
+                                                                     \
+    TEST_UPDATE(!expect_expr, nfailed, ntests);                      \
+    if (!expect_expr)                                                \
+    {                                                                \
+        fprintf(stderr, "Expect failed: %d: %s\n", __LINE__, #expr); \
+    }                                                                \
+} while(0)
+
+/* The movies have 25 fps video tracks, with a sync sample every gop samples */
+#define TIME_SCALE 1000
+#define SAMPLE_DURATION 40
+
+typedef struct
+{
+    uint32_t track_ID;
+    uint32_t num_samples;
+    uint32_t gop;
+} test_track_t;
+
+static uint32_t
+sample_size(const test_track_t *p_track, uint32_t sample)
+{
+    return 16 + (p_track->track_ID * 3 + sample) % 7;
+}
+
+static void
+write_sample(buffer_t *buffer, const test_track_t *p_track, uint32_t sample)
+{
+    uint32_t size = sample_size(p_track, sample);
+    uint32_t i;
+
+    for (i = 0; i < size; i++)
+    {
+        write_u8(buffer, (uint8_t) (p_track->track_ID * 16 + sample + i));
+    }
+}
+
+static void
+write_mvhd(buffer_t *buffer, uint32_t duration, uint32_t next_track_ID)
+{
+    size_t box = full_box_begin(buffer, "mvhd", 0, 0);
+
+    write_u32(buffer, 0);           /* creation time */
+    write_u32(buffer, 0);           /* modification time */
+    write_u32(buffer, TIME_SCALE);
+    write_u32(buffer, duration);
+    write_u32(buffer, 0x10000);     /* rate */
+    write_u16(buffer, 0x100);       /* volume */
+    write_bytes(buffer, NULL, 10);
+    write_matrix(buffer);
+    write_bytes(buffer, NULL, 24);
+    write_u32(buffer, next_track_ID);
+    box_end(buffer, box);
+}
+
+static void
+write_avc1(buffer_t *buffer)
+{
+    static const unsigned char sps[] = {0x67, 0x64, 0x00, 0x1f, 0xac, 0xd9, 0x40, 0x50, 0x05, 0xbb, 0x01, 0x10};
+    static const unsigned char pps[] = {0x68, 0xeb, 0xe3, 0xcb, 0x22, 0xc0};
+    size_t box = box_begin(buffer, "avc1");
+    size_t avcc;
+
+    write_bytes(buffer, NULL, 6);
+    write_u16(buffer, 1);           /* data reference index */
+    write_bytes(buffer, NULL, 16);
+    write_u16(buffer, 640);
+    write_u16(buffer, 360);
+    write_u32(buffer, 0x00480000);  /* resolution */
+    write_u32(buffer, 0x00480000);
+    write_u32(buffer, 0);
+    write_u16(buffer, 1);           /* frame count */
+    write_bytes(buffer, NULL, 32);  /* compressor name */
+    write_u16(buffer, 0x18);        /* depth */
+    write_u16(buffer, 0xffff);
+
+    avcc = box_begin(buffer, "avcC");
+    write_u8(buffer, 1);
+    write_u8(buffer, 0x64);
+    write_u8(buffer, 0);
+    write_u8(buffer, 0x1f);
+    write_u8(buffer, 0xff);
+    write_u8(buffer, 0xe1);
+    write_u16(buffer, sizeof(sps));
+    write_bytes(buffer, sps, sizeof(sps));
+    write_u8(buffer, 1);
+    write_u16(buffer, sizeof(pps));
+    write_bytes(buffer, pps, sizeof(pps));
+    box_end(buffer, avcc);
+
+    box_end(buffer, box);
+}
+
+
+/* trak of a flat movie, with all samples in one chunk, or of a fragmented movie, with empty sample tables */
+static void
+write_trak(buffer_t *buffer, const test_track_t *p_track, uint32_t chunk_offset, int fragmented)
+{
+    uint32_t num_samples = fragmented ? 0 : p_track->num_samples;
+    uint32_t duration = num_samples * SAMPLE_DURATION;
+    size_t trak = box_begin(buffer, "trak");
+    size_t box, mdia, minf, dinf, stbl;
+    uint32_t i;
+
+    box = full_box_begin(buffer, "tkhd", 0, 7);
+    write_u32(buffer, 0);           /* creation time */
+    write_u32(buffer, 0);           /* modification time */
+    write_u32(buffer, p_track->track_ID);
+    write_u32(buffer, 0);
+    write_u32(buffer, duration);
+    write_bytes(buffer, NULL, 16);
+    write_matrix(buffer);
+    write_u32(buffer, 640 << 16);
+    write_u32(buffer, 360 << 16);
+    box_end(buffer, box);
+
+    mdia = box_begin(buffer, "mdia");
+    box = full_box_begin(buffer, "mdhd", 0, 0);
+    write_u32(buffer, 0);           /* creation time */
+    write_u32(buffer, 0);           /* modification time */
+    write_u32(buffer, TIME_SCALE);
+    write_u32(buffer, duration);
+    write_u16(buffer, 0x55c4);      /* language */
+    write_u16(buffer, 0);
+    box_end(buffer, box);
+
+    box = full_box_begin(buffer, "hdlr", 0, 0);
+    write_u32(buffer, 0);
+    write_fourcc(buffer, "vide");
+    write_bytes(buffer, NULL, 12);
+    write_bytes(buffer, "video", 6);
+    box_end(buffer, box);
+
+    minf = box_begin(buffer, "minf");
+    box = full_box_begin(buffer, "vmhd", 0, 1);
+    write_bytes(buffer, NULL, 8);
+    box_end(buffer, box);
+    dinf = box_begin(buffer, "dinf");
+    box = full_box_begin(buffer, "dref", 0, 0);
+    write_u32(buffer, 1);
+    box_end(buffer, full_box_begin(buffer, "url ", 0, 1));
+    box_end(buffer, box);
+    box_end(buffer, dinf);
+
+    stbl = box_begin(buffer, "stbl");
+    box = full_box_begin(buffer, "stsd", 0, 0);
+    write_u32(buffer, 1);
+    write_avc1(buffer);
+    box_end(buffer, box);
+
+    box = full_box_begin(buffer, "stts", 0, 0);
+    if (fragmented)
+    {
+        write_u32(buffer, 0);
+    }
+    else
+    {
+        write_u32(buffer, 1);
+        write_u32(buffer, num_samples);
+        write_u32(buffer, SAMPLE_DURATION);
+    }
+    box_end(buffer, box);
+
+    if (!fragmented)
+    {
+        box = full_box_begin(buffer, "stss", 0, 0);
+        write_u32(buffer, (num_samples + p_track->gop - 1) / p_track->gop);
+        for (i = 0; i < num_samples; i += p_track->gop)
+        {
+            write_u32(buffer, i + 1);
+        }
+        box_end(buffer, box);
+    }
+
+    box = full_box_begin(buffer, "stsc", 0, 0);
+    if (fragmented)
+    {
+        write_u32(buffer, 0);
+    }
+    else
+    {
+        write_u32(buffer, 1);
+        write_u32(buffer, 1);       /* first chunk */
+        write_u32(buffer, num_samples);
+        write_u32(buffer, 1);       /* sample description index */
+    }
+    box_end(buffer, box);
+
+    box = full_box_begin(buffer, "stsz", 0, 0);
+    write_u32(buffer, 0);
+    write_u32(buffer, num_samples);
+    for (i = 0; i < num_samples; i++)
+    {
+        write_u32(buffer, sample_size(p_track, i));
+    }
+    box_end(buffer, box);
+
+    box = full_box_begin(buffer, "stco", 0, 0);
+    write_u32(buffer, fragmented ? 0 : 1);
+    if (!fragmented)
+    {
+        write_u32(buffer, chunk_offset);
+    }
+    box_end(buffer, box);
+
+    box_end(buffer, stbl);
+    box_end(buffer, minf);
+    box_end(buffer, mdia);
+    box_end(buffer, trak);
+}
+
+static void
+write_ftyp(buffer_t *buffer)
+{
+    size_t box = box_begin(buffer, "ftyp");
+
+    write_fourcc(buffer, "isom");
+    write_u32(buffer, 0);
+    write_bytes(buffer, "isomavc1", 8);
+    box_end(buffer, box);
+}
+
+/* Flat movie: ftyp, moov, and an mdat with a chunk per track */
+static void
+write_flat_movie(buffer_t *buffer, const test_track_t *tracks, uint32_t num_tracks)
+{
+    uint32_t duration = 0;
+    uint32_t chunk_offset = 0;
+    size_t moov_pos, moov;
+    size_t mdat;
+    uint32_t i, j;
+
+    for (i = 0; i < num_tracks; i++)
+    {
+        if (tracks[i].num_samples * SAMPLE_DURATION > duration)
+        {
+            duration = tracks[i].num_samples * SAMPLE_DURATION;
+        }
+    }
+
+    write_ftyp(buffer);
+
+    /* Written twice: once to get the size of the moov, which does not depend on the chunk offsets */
+    moov_pos = buffer->size;
+    for (j = 0; j < 2; j++)
+    {
+        buffer->size = moov_pos;
+        moov = box_begin(buffer, "moov");
+        write_mvhd(buffer, duration, num_tracks + 1);
+        for (i = 0; i < num_tracks; i++)
+        {
+            uint32_t k;
+
+            write_trak(buffer, &tracks[i], chunk_offset, 0);
+            for (k = 0; k < tracks[i].num_samples; k++)
+            {
+                chunk_offset += sample_size(&tracks[i], k);
+            }
+        }
+        box_end(buffer, moov);
+        chunk_offset = (uint32_t) buffer->size + 8;
+    }
+
+    mdat = box_begin(buffer, "mdat");
+    for (i = 0; i < num_tracks; i++)
+    {
+        for (j = 0; j < tracks[i].num_samples; j++)
+        {
+            write_sample(buffer, &tracks[i], j);
+        }
+    }
+    box_end(buffer, mdat);
+}
+
+/* Fragmented movie of a single track: ftyp, moov, and a moof and mdat per fragment */
+static void
+write_fragmented_movie(buffer_t *buffer, const test_track_t *p_track, uint32_t samples_per_fragment)
+{
+    size_t moov, mvex, moof, traf, trun, mdat, box;
+    uint32_t first, num, i;
+
+    write_ftyp(buffer);
+
+    moov = box_begin(buffer, "moov");
+    write_mvhd(buffer, 0, p_track->track_ID + 1);
+    write_trak(buffer, p_track, 0, 1);
+    mvex = box_begin(buffer, "mvex");
+    box = full_box_begin(buffer, "trex", 0, 0);
+    write_u32(buffer, p_track->track_ID);
+    write_u32(buffer, 1);           /* sample description index */
+    write_u32(buffer, SAMPLE_DURATION);
+    write_u32(buffer, 0);           /* sample size */
+    write_u32(buffer, 0x00010000);  /* sample flags: non-sync */
+    box_end(buffer, box);
+    box_end(buffer, mvex);
+    box_end(buffer, moov);
+
+    for (first = 0; first < p_track->num_samples; first += num)
+    {
+        num = p_track->num_samples - first;
+        if (num > samples_per_fragment)
+        {
+            num = samples_per_fragment;
+        }
+
+        moof = box_begin(buffer, "moof");
+        box = full_box_begin(buffer, "mfhd", 0, 0);
+        write_u32(buffer, first / samples_per_fragment + 1);
+        box_end(buffer, box);
+
+        traf = box_begin(buffer, "traf");
+        box = full_box_begin(buffer, "tfhd", 0, 0x020000);  /* default base is moof */
+        write_u32(buffer, p_track->track_ID);
+        box_end(buffer, box);
+        box = full_box_begin(buffer, "tfdt", 1, 0);
+        write_u64(buffer, (uint64_t) first * SAMPLE_DURATION);
+        box_end(buffer, box);
+
+        trun = full_box_begin(buffer, "trun", 0, 0x601);    /* data offset, sample size and flags */
+        write_u32(buffer, num);
+        write_u32(buffer, 0);           /* data offset, set below */
+        for (i = first; i < first + num; i++)
+        {
+            write_u32(buffer, sample_size(p_track, i));
+            write_u32(buffer, i % p_track->gop == 0 ? 0x02000000 : 0x00010000);
+        }
+        box_end(buffer, trun);
+        box_end(buffer, traf);
+        box_end(buffer, moof);
+        put_u32(buffer->p_data + trun + 16, (uint32_t) (buffer->size - moof + 8));
+
+        mdat = box_begin(buffer, "mdat");
+        for (i = first; i < first + num; i++)
+        {
+            write_sample(buffer, p_track, i);
+        }
+        box_end(buffer, mdat);
+    }
+}
+
+/* Sink which checks and counts the samples of a track */
+typedef struct
+{
+    struct es_sink_t_ base;
+
+    const test_track_t *p_track;
+    uint32_t first_sample;          /* of the played time range */
+    uint32_t num_samples;
+    uint32_t num_errors;
+    const buffer_t *p_movie;
+    uint32_t num_in_movie;          /* samples output from the movie buffer, not copied */
+    int64_t *p_pts;                 /* if set, the pts of the output sync samples, which need not be consecutive */
+} test_sink_t;
+
+static int
+test_sink_sample_entry(es_sink_t sink, const mp4d_sampleentry_t *p_entry)
+{
+    (void) sink;
+    (void) p_entry;
+    return 0;
+}
+
+static int
+test_sink_sample_ready(es_sink_t sink, const mp4d_sampleref_t *p_sample, const unsigned char *payload)
+{
+    test_sink_t *p_sink = (test_sink_t *) sink;
+    uint32_t sample = p_sink->first_sample + p_sink->num_samples;
+    buffer_t expected;
+
+    if (p_sink->p_pts != NULL)
+    {
+        sample = (uint32_t) (p_sample->dts / SAMPLE_DURATION);
+        p_sink->p_pts[p_sink->num_samples] = p_sample->pts;
+        if (sample % p_sink->p_track->gop != 0)
+        {
+            p_sink->num_errors++;
+        }
+    }
+    buffer_init(&expected);
+    write_sample(&expected, p_sink->p_track, sample);
+    if (p_sample->size != expected.size || memcmp(payload, expected.p_data, expected.size) != 0 ||
+        p_sample->dts != (uint64_t) sample * SAMPLE_DURATION)
+    {
+        p_sink->num_errors++;
+    }
+    p_sink->num_samples++;
+    if (p_sink->p_movie != NULL &&
+        (uintptr_t) payload >= (uintptr_t) p_sink->p_movie->p_data &&
+        (uintptr_t) (payload + p_sample->size) <= (uintptr_t) (p_sink->p_movie->p_data + p_sink->p_movie->size))
+    {
+        p_sink->num_in_movie++;
+    }
+    free(expected.p_data);
+
+    return 0;
+}
+
+static int
+test_sink_subsample_ready(uint32_t subsample_index,
+                          es_sink_t sink,
+                          const mp4d_sampleref_t *p_sample,
+                          const unsigned char *payload,
+                          uint64_t offset,
+                          uint32_t size)
+{
+    (void) offset;
+    (void) size;
+    return subsample_index == 0 ? test_sink_sample_ready(sink, p_sample, payload) : 0;
+}
+
+static void
+test_sink_init(test_sink_t *p_sink, const test_track_t *p_track)
+{
+    memset(p_sink, 0, sizeof(*p_sink));
+    p_sink->base.sample_entry = test_sink_sample_entry;
+    p_sink->base.sample_ready = test_sink_sample_ready;
+    p_sink->base.subsample_ready = test_sink_subsample_ready;
+    p_sink->p_track = p_track;
+}
+
+#define MAX_TEST_TRACKS 4
+
+/* Player of all tracks of a movie in memory */
+typedef struct
+{
+    segment_session_t session;
+    movie_t movie;
+    player_t player;
+    test_sink_t sinks[MAX_TEST_TRACKS];
+} test_player_t;
+
+static int
+test_player_new(test_player_t *p_p, const buffer_t *p_movie, const test_track_t *tracks, uint32_t num_tracks)
+{
+    uint32_t i;
+
+    memset(p_p, 0, sizeof(*p_p));
+    if (segment_session_new(&p_p->session) != 0 ||
+        segment_session_add_buffer(p_p->session, p_movie->p_data, p_movie->size) != 0 ||
+        segment_movie_new(p_p->session, &p_p->movie) != 0 ||
+        player_new(&p_p->player) != 0)
+    {
+        return 1;
+    }
+    for (i = 0; i < num_tracks; i++)
+    {
+        fragment_reader_t source;
+
+        test_sink_init(&p_p->sinks[i], &tracks[i]);
+        p_p->sinks[i].p_movie = p_movie;
+        if (p_p->movie->fragment_stream_new(p_p->movie, i, NULL, 0, &source) != 0 ||
+            player_set_track(p_p->player, tracks[i].track_ID, NULL, 0, p_p->movie, source, &p_p->sinks[i].base, 0) != 0)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void
+test_player_destroy(test_player_t *p_p)
+{
+    player_destroy(&p_p->player);
+    if (p_p->movie != NULL)
+    {
+        p_p->movie->destroy(p_p->movie);
+    }
+    if (p_p->session != NULL)
+    {
+        segment_session_release(p_p->session);
+    }
+}
+
+static int nfailed = 0;
+static int ntests = 0;
+
+/* When a track has ended, the samples of the other tracks are still played */
+static void
+test_play_tracks_of_different_length(void)
+{
+    static const test_track_t tracks[2] = {{1, 12, 6}, {2, 30, 10}};
+    buffer_t movie;
+    test_player_t p;
+    float start_time = 0;
+    uint32_t i;
+
+    buffer_init(&movie);
+    write_flat_movie(&movie, tracks, 2);
+
+    expect( test_player_new(&p, &movie, tracks, 2) == 0 );
+    expect( player_play_time_range(p.player, &start_time, NULL) == 0 );
+    for (i = 0; i < 2; i++)
+    {
+        expect( p.sinks[i].num_samples == tracks[i].num_samples );
+        expect( p.sinks[i].num_errors == 0 );
+    }
+
+    test_player_destroy(&p);
+    free(movie.p_data);
+}
+
+static uint32_t
+get_u32(const unsigned char *p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+/* mem_stream parses the boxes of the appended segments in place */
+static void
+test_mem_stream(void)
+{
+    static const test_track_t track = {1, 30, 10};
+    static const char *types[] = {"ftyp", "moov", "moof", "mdat", "moof", "mdat", "moof", "mdat"};
+    buffer_t movie;
+    fragment_reader_t s = NULL;
+    size_t init_size;
+    uint64_t offset = 0;
+    uint32_t i;
+
+    buffer_init(&movie);
+    write_fragmented_movie(&movie, &track, 10);
+    init_size = get_u32(movie.p_data);
+    init_size += get_u32(movie.p_data + init_size);
+
+    expect( mem_stream_new(&s) == 0 );
+    expect( mem_stream_append(s, movie.p_data, init_size) == 0 );
+    for (i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+    {
+        mp4d_fourcc_t type;
+        uint64_t atom_offset;
+        const unsigned char *p_data = NULL;
+        unsigned char header[8];
+
+        if (i == 2)
+        {
+            /* end of the init segment, until the media segment is appended */
+            expect( fragment_reader_next_atom(s) == 2 );
+            expect( mem_stream_append(s, movie.p_data + init_size, movie.size - init_size) == 0 );
+        }
+        expect( fragment_reader_next_atom(s) == 0 );
+        expect( mp4d_demuxer_get_type(s->p_dmux, &type) == MP4D_NO_ERROR );
+        expect( MP4D_FOURCC_EQ(type, types[i]) );
+        expect( fragment_reader_get_offset(s, &atom_offset) == 0 );
+        expect( atom_offset == offset );
+
+        /* no copy */
+        expect( fragment_reader_get_data(s, offset, 8, &p_data) == 0 );
+        expect( p_data == movie.p_data + offset );
+        expect( fragment_reader_load(s, offset, 8, header) == 0 );
+        expect( memcmp(header, movie.p_data + offset, 8) == 0 );
+
+        offset += get_u32(movie.p_data + offset);
+    }
+    expect( fragment_reader_next_atom(s) == 2 );
+    expect( offset == movie.size );
+
+    fragment_reader_destroy(s);
+    free(movie.p_data);
+}
+
+/* Samples in memory are output without copying them, from a segment session or a mem_stream */
+static void
+test_play_from_memory(void)
+{
+    static const test_track_t track = {1, 30, 10};
+    buffer_t movie;
+    test_player_t p;
+    fragment_reader_t source = NULL;
+    float start_time = 0;
+
+    buffer_init(&movie);
+    write_fragmented_movie(&movie, &track, 10);
+
+    expect( test_player_new(&p, &movie, &track, 1) == 0 );
+    expect( player_play_time_range(p.player, &start_time, NULL) == 0 );
+    expect( p.sinks[0].num_samples == track.num_samples );
+    expect( p.sinks[0].num_errors == 0 );
+    expect( p.sinks[0].num_in_movie == track.num_samples );
+    test_player_destroy(&p);
+
+    /* the movie of the session, the samples of a mem_stream */
+    memset(&p, 0, sizeof(p));
+    expect( segment_session_new(&p.session) == 0 );
+    expect( segment_session_add_buffer(p.session, movie.p_data, movie.size) == 0 );
+    expect( segment_movie_new(p.session, &p.movie) == 0 );
+    expect( player_new(&p.player) == 0 );
+    test_sink_init(&p.sinks[0], &track);
+    p.sinks[0].p_movie = &movie;
+    expect( mem_stream_new(&source) == 0 );
+    expect( mem_stream_append(source, movie.p_data, movie.size) == 0 );
+    expect( player_set_track(p.player, track.track_ID, NULL, 0, p.movie, source, &p.sinks[0].base, 0) == 0 );
+    start_time = 0;
+    expect( player_play_time_range(p.player, &start_time, NULL) == 0 );
+    expect( p.sinks[0].num_samples == track.num_samples );
+    expect( p.sinks[0].num_errors == 0 );
+    expect( p.sinks[0].num_in_movie == track.num_samples );
+    test_player_destroy(&p);
+
+    free(movie.p_data);
+}
+
+/* A copy of the movie with only the planned byte ranges plays the time range as the movie does,
+   and planning does not move the player */
+static void
+test_plan_time_range(void)
+{
+    static const test_track_t track = {1, 100, 12};
+    int fragmented;
+
+    for (fragmented = 0; fragmented < 2; fragmented++)
+    {
+        buffer_t movie, sparse;
+        test_player_t p;
+        byte_range_t *ranges = NULL;
+        uint32_t num_ranges = 0;
+        float start_time = 1.2f;
+        float stop_time = 2.5f;
+        uint32_t num_samples;
+        uint32_t i;
+
+        buffer_init(&movie);
+        if (fragmented)
+        {
+            write_fragmented_movie(&movie, &track, 24);
+        }
+        else
+        {
+            write_flat_movie(&movie, &track, 1);
+        }
+
+        expect( test_player_new(&p, &movie, &track, 1) == 0 );
+        expect( player_plan_time_range(p.player, &start_time, &stop_time, &ranges, &num_ranges) == 0 );
+
+        /* the player position is kept */
+        expect( player_play_fragments(p.player, 0) == 0 );
+        expect( p.sinks[0].num_samples == track.num_samples );
+        expect( p.sinks[0].num_errors == 0 );
+        test_player_destroy(&p);
+
+        /* the first range holds the ftyp and moov boxes */
+        expect( num_ranges > 0 );
+        expect( num_ranges == 0 || (ranges[0].offset == 0 && ranges[0].size >= 8) );
+
+        buffer_init(&sparse);
+        write_bytes(&sparse, NULL, movie.size);
+        for (i = 0; i < num_ranges; i++)
+        {
+            expect( ranges[i].offset + ranges[i].size <= movie.size );
+            if (ranges[i].offset + ranges[i].size <= movie.size)
+            {
+                memcpy(sparse.p_data + ranges[i].offset, movie.p_data + ranges[i].offset, (size_t) ranges[i].size);
+            }
+        }
+        free(ranges);
+
+        /* played from the sync sample preceding the start time */
+        start_time = 1.2f;
+        expect( test_player_new(&p, &movie, &track, 1) == 0 );
+        p.sinks[0].first_sample = 24;
+        expect( player_play_time_range(p.player, &start_time, &stop_time) == 0 );
+        num_samples = p.sinks[0].num_samples;
+        expect( num_samples > 0 );
+        expect( p.sinks[0].num_errors == 0 );
+        test_player_destroy(&p);
+
+        start_time = 1.2f;
+        expect( test_player_new(&p, &sparse, &track, 1) == 0 );
+        p.sinks[0].first_sample = 24;
+        expect( player_play_time_range(p.player, &start_time, &stop_time) == 0 );
+        expect( p.sinks[0].num_samples == num_samples );
+        expect( p.sinks[0].num_errors == 0 );
+        test_player_destroy(&p);
+
+        free(sparse.p_data);
+        free(movie.p_data);
+    }
+}
+
+/* The first sync sample of every interval is played, from flat and fragmented movies */
+static void
+test_play_keyframes(void)
+{
+    static const test_track_t track = {1, 100, 5};
+    static const float intervals[] = {0.5f, 0.2f, 1.3f, 10.0f};
+    int fragmented;
+    uint32_t k;
+
+    for (fragmented = 0; fragmented < 2; fragmented++)
+    {
+        buffer_t movie;
+
+        buffer_init(&movie);
+        if (fragmented)
+        {
+            write_fragmented_movie(&movie, &track, 24);
+        }
+        else
+        {
+            write_flat_movie(&movie, &track, 1);
+        }
+
+        for (k = 0; k < sizeof(intervals) / sizeof(intervals[0]); k++)
+        {
+            uint64_t interval = (uint64_t) (intervals[k] * TIME_SCALE);
+            int64_t pts[100];
+            int64_t next_pts = 0;
+            uint32_t num_expected = 0;
+            test_player_t p;
+            uint32_t i;
+
+            expect( test_player_new(&p, &movie, &track, 1) == 0 );
+            p.sinks[0].p_pts = pts;
+            expect( player_play_keyframes(p.player, intervals[k]) == 0 );
+            expect( p.sinks[0].num_errors == 0 );
+
+            for (i = 0; i < track.num_samples; i += track.gop)
+            {
+                int64_t t = (int64_t) i * SAMPLE_DURATION;
+
+                if (t >= next_pts)
+                {
+                    expect( num_expected < p.sinks[0].num_samples && pts[num_expected] == t );
+                    num_expected++;
+                    next_pts = (t / (int64_t) interval + 1) * (int64_t) interval;
+                }
+            }
+            expect( p.sinks[0].num_samples == num_expected );
+            test_player_destroy(&p);
+        }
+        free(movie.p_data);
+    }
+}
+
+/* NIST SP800-38A, F.2.1 (CBC-AES128) and F.5.1 (CTR-AES128) */
+static const char *kat_key = "2b7e151628aed2a6abf7158809cf4f3c";
+static const char *kat_plain =
+    "6bc1bee22e409f96e93d7e117393172a" "ae2d8a571e03ac9c9eb76fac45af8e51"
+    "30c81c46a35ce411e5fbc1191a0a52ef" "f69f2445df4f9b17ad2b417be66c3710";
+static const char *kat_cbc_iv = "000102030405060708090a0b0c0d0e0f";
+static const char *kat_cbc =
+    "7649abac8119b246cee98e9b12e9197d" "5086cb9b507219ee95db113a917678b2"
+    "73bed6b8e3c1743b7116e69e22229516" "3ff1caa1681fac09120eca307586e1a7";
+static const char *kat_ctr_iv = "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+static const char *kat_ctr =
+    "874d6191b620e3261bef6864990db6ce" "9806f66b7970fdff8617187bb9fffdff"
+    "5ae4df3edbd5d35e5b4f09020db03eab" "1e031dda2fbe03d1792170a0f3009cee";
+
+static void
+from_hex(unsigned char *p, const char *hex)
+{
+    unsigned int byte;
+
+    for (; hex[0] != '\0' && sscanf(hex, "%2x", &byte) == 1; hex += 2)
+    {
+        *p++ = (unsigned char) byte;
+    }
+}
+
+static decryptor_t
+kat_decryptor(const char *scheme, uint8_t crypt_byte_block, uint8_t skip_byte_block, const char *constant_iv)
+{
+    mp4d_crypt_info_t info;
+    unsigned char key[16];
+    decryptor_t d = NULL;
+
+    memset(&info, 0, sizeof(info));
+    info.method = 1;
+    memcpy(info.scheme_type, scheme, 4);
+    info.crypt_byte_block = crypt_byte_block;
+    info.skip_byte_block = skip_byte_block;
+    if (constant_iv != NULL)
+    {
+        info.constant_iv_size = 16;
+        from_hex(info.constant_iv, constant_iv);
+    }
+    from_hex(key, kat_key);
+    expect( decryptor_new(&d, &info, key) == 0 );
+    return d;
+}
+
+/* Subsample map of (clear bytes, protected bytes) pairs */
+static void
+kat_subsamples(sample_crypt_t *p_crypt, const uint32_t *pairs, uint32_t num_subsamples)
+{
+    unsigned char entries[6 * 8];
+    unsigned char iv[16];
+    uint32_t i;
+
+    memcpy(iv, p_crypt->iv, sizeof(iv));
+    for (i = 0; i < num_subsamples; i++)
+    {
+        entries[6 * i + 0] = (unsigned char) (pairs[2 * i] >> 8);
+        entries[6 * i + 1] = (unsigned char) pairs[2 * i];
+        entries[6 * i + 2] = (unsigned char) (pairs[2 * i + 1] >> 24);
+        entries[6 * i + 3] = (unsigned char) (pairs[2 * i + 1] >> 16);
+        entries[6 * i + 4] = (unsigned char) (pairs[2 * i + 1] >> 8);
+        entries[6 * i + 5] = (unsigned char) pairs[2 * i + 1];
+    }
+    expect( sample_crypt_set(p_crypt, iv, p_crypt->iv_size, entries, num_subsamples) == 0 );
+}
+
+/* 'cenc': one AES-CTR stream over the protected bytes of all subsamples */
+static void
+test_decrypt_ctr(void)
+{
+    static const uint32_t subsamples[] = {3, 5,  2, 20,  0, 0,  7, 39};
+    unsigned char plain[64], cipher[64], data[128], expected[128];
+    decryptor_t d = kat_decryptor("cenc", 0, 0, NULL);
+    sample_crypt_t crypt;
+    uint32_t size, pos, k, i;
+
+    from_hex(plain, kat_plain);
+    from_hex(cipher, kat_ctr);
+    sample_crypt_init(&crypt);
+    crypt.iv_size = 16;
+    from_hex(crypt.iv, kat_ctr_iv);
+
+    /* whole sample, and a sample ending in a partial block */
+    for (size = 64; size >= 40; size -= 24)
+    {
+        memcpy(data, cipher, size);
+        expect( decryptor_decrypt(d, &crypt, data, size) == 0 );
+        expect( memcmp(data, plain, size) == 0 );
+    }
+
+    /* the keystream carries over the subsamples, and the bytes after them are clear */
+    for (i = 0, pos = 0, k = 0; i < 4; i++)
+    {
+        memset(data + pos, 0xc0 + i, subsamples[2 * i]);
+        memset(expected + pos, 0xc0 + i, subsamples[2 * i]);
+        pos += subsamples[2 * i];
+        memcpy(data + pos, cipher + k, subsamples[2 * i + 1]);
+        memcpy(expected + pos, plain + k, subsamples[2 * i + 1]);
+        pos += subsamples[2 * i + 1];
+        k += subsamples[2 * i + 1];
+    }
+    memset(data + pos, 0xee, 9);
+    memset(expected + pos, 0xee, 9);
+    kat_subsamples(&crypt, subsamples, 4);
+    expect( decryptor_decrypt(d, &crypt, data, pos + 9) == 0 );
+    expect( memcmp(data, expected, pos + 9) == 0 );
+
+    sample_crypt_free(&crypt);
+    decryptor_destroy(&d);
+}
+
+/* 'cbcs' 0:0: AES-CBC over the whole blocks of each subsample, a partial block at the end is clear */
+static void
+test_decrypt_cbc(void)
+{
+    static const uint32_t subsamples[] = {5, 64 + 7,  2, 32 + 1};
+    unsigned char plain[64], cipher[64], data[128], expected[128];
+    decryptor_t d = kat_decryptor("cbcs", 0, 0, NULL);
+    sample_crypt_t crypt;
+
+    from_hex(plain, kat_plain);
+    from_hex(cipher, kat_cbc);
+    sample_crypt_init(&crypt);
+    crypt.iv_size = 16;
+    from_hex(crypt.iv, kat_cbc_iv);
+
+    memcpy(data, cipher, 64);
+    memset(data + 64, 0xee, 7);
+    memcpy(expected, plain, 64);
+    memset(expected + 64, 0xee, 7);
+    expect( decryptor_decrypt(d, &crypt, data, 64 + 7) == 0 );
+    expect( memcmp(data, expected, 64 + 7) == 0 );
+
+    /* the chain restarts from the IV in each subsample */
+    memset(data, 0xc0, 5);
+    memcpy(data + 5, cipher, 64);
+    memset(data + 5 + 64, 0xee, 7);
+    memset(data + 76, 0xc1, 2);
+    memcpy(data + 78, cipher, 32);
+    memset(data + 110, 0xee, 1);
+    memcpy(expected, data, 111);
+    memcpy(expected + 5, plain, 64);
+    memcpy(expected + 78, plain, 32);
+    kat_subsamples(&crypt, subsamples, 2);
+    expect( decryptor_decrypt(d, &crypt, data, 111) == 0 );
+    expect( memcmp(data, expected, 111) == 0 );
+
+    sample_crypt_free(&crypt);
+    decryptor_destroy(&d);
+}
+
+/* 'cbcs' 1:9 with a constant IV: the chain skips the clear blocks of the pattern */
+static void
+test_decrypt_cbcs_pattern(void)
+{
+    static const uint32_t subsamples[] = {4, 16 * 12 + 5,  2, 16 + 3};
+    unsigned char plain[64], cipher[64], data[256], expected[256];
+    decryptor_t d = kat_decryptor("cbcs", 1, 9, kat_cbc_iv);
+    sample_crypt_t crypt;
+    uint32_t i;
+
+    from_hex(plain, kat_plain);
+    from_hex(cipher, kat_cbc);
+    sample_crypt_init(&crypt);
+
+    for (i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (unsigned char) i;
+    }
+    /* blocks 0 and 10 of the first subsample, and block 0 of the second, are encrypted */
+    memcpy(data + 4, cipher, 16);
+    memcpy(data + 4 + 16 * 10, cipher + 16, 16);
+    memcpy(data + 4 + 16 * 12 + 5 + 2, cipher, 16);
+    memcpy(expected, data, sizeof(data));
+    memcpy(expected + 4, plain, 16);
+    memcpy(expected + 4 + 16 * 10, plain + 16, 16);
+    memcpy(expected + 4 + 16 * 12 + 5 + 2, plain, 16);
+
+    kat_subsamples(&crypt, subsamples, 2);
+    expect( decryptor_decrypt(d, &crypt, data, 4 + 16 * 12 + 5 + 2 + 16 + 3) == 0 );
+    expect( memcmp(data, expected, sizeof(data)) == 0 );
+
+    sample_crypt_free(&crypt);
+    decryptor_destroy(&d);
+}
+
+/* Samples longer than a batch of blocks: CTR in odd-sized subsamples, CBC one block at a time (pattern 1:0) */
+static void
+test_decrypt_batches(void)
+{
+    unsigned char whole[1000], split[1000];
+    decryptor_t d = NULL, d_split = NULL;
+    sample_crypt_t crypt;
+    uint32_t pairs[2 * 8];
+    uint32_t i, s;
+
+    for (i = 0; i < 8; i++)
+    {
+        pairs[2 * i] = 0;
+        pairs[2 * i + 1] = 1 + 37 * i;
+    }
+    pairs[2 * 7 + 1] = sizeof(whole) - (7 + 37 * 21);
+
+    for (s = 0; s < 2; s++)
+    {
+        if (s == 0)
+        {
+            d = kat_decryptor("cenc", 0, 0, NULL);
+            d_split = kat_decryptor("cenc", 0, 0, NULL);
+        }
+        else
+        {
+            d = kat_decryptor("cbcs", 0, 0, NULL);
+            d_split = kat_decryptor("cbcs", 1, 0, NULL);
+        }
+        for (i = 0; i < sizeof(whole); i++)
+        {
+            whole[i] = (unsigned char) (i * 7);
+        }
+        memcpy(split, whole, sizeof(whole));
+        sample_crypt_init(&crypt);
+        crypt.iv_size = 16;
+        from_hex(crypt.iv, kat_ctr_iv);
+
+        expect( decryptor_decrypt(d, &crypt, whole, sizeof(whole)) == 0 );
+        if (s == 0)
+        {
+            kat_subsamples(&crypt, pairs, 8);
+        }
+        expect( decryptor_decrypt(d_split, &crypt, split, sizeof(split)) == 0 );
+        expect( memcmp(whole, split, sizeof(whole)) == 0 );
+
+        sample_crypt_free(&crypt);
+        decryptor_destroy(&d);
+        decryptor_destroy(&d_split);
+    }
+}
+
+int main(void)
+{
+    TEST_START("Player");
+    printf("AES: %s\n", decryptor_implementation());
+
+    test_play_tracks_of_different_length();
+    test_plan_time_range();
+    test_mem_stream();
+    test_play_from_memory();
+    test_play_keyframes();
+    test_decrypt_ctr();
+    test_decrypt_cbc();
+    test_decrypt_cbcs_pattern();
+    test_decrypt_batches();
+
+    TEST_END(nfailed, ntests);
+}
@@ -35,6 +35,7 @@
 #include "mp4d_box_read.h"
 
 #include "mp4d_unittest.h"
+#include "mp4d_unittest_writer.h"
 
 #define expect(expr)                                                 \
 do {                                                                 \
@@ -47,86 +48,6 @@ do {                                                                 \
     }                                                                \
 } while(0)
 
-/* API to write an an atom */
-typedef struct
-{
-    unsigned char *p_data;
-    size_t size;
-    size_t alloc;
-} buffer_t;
-
-static
-void buffer_init(buffer_t *buffer)
-{
-    buffer->p_data = NULL;
-    buffer->size = 0;
-    buffer->alloc = 0;
-}
-
-static
-void buffer_grow(buffer_t *buffer, size_t size)
-{
-    buffer->size += size;
-    while (buffer->size > buffer->alloc)
-    {
-        buffer->alloc *= 2;
-        buffer->alloc += 1;
-        buffer->p_data = realloc(buffer->p_data, buffer->alloc);
-    }
-}
-static
-void write_u64(buffer_t *buffer, uint64_t u)
-{
-    buffer_grow(buffer, sizeof(u));
-
-    buffer->p_data[buffer->size - 1] = (u>>0) & 0xFF;
-    buffer->p_data[buffer->size - 2] = (u>>8) & 0xFF;
-    buffer->p_data[buffer->size - 3] = (u>>16) & 0xFF;
-    buffer->p_data[buffer->size - 4] = (u>>24) & 0xFF;
-    buffer->p_data[buffer->size - 5] = (u>>32) & 0xFF;
-    buffer->p_data[buffer->size - 6] = (u>>40) & 0xFF;
-    buffer->p_data[buffer->size - 7] = (u>>48) & 0xFF;
-    buffer->p_data[buffer->size - 8] = (u>>56) & 0xFF;
-}
-
-static
-void write_u32(buffer_t *buffer, uint32_t u)
-{
-    buffer_grow(buffer, sizeof(u));
-
-    buffer->p_data[buffer->size - 1] = (u>>0) & 0xFF;
-    buffer->p_data[buffer->size - 2] = (u>>8) & 0xFF;
-    buffer->p_data[buffer->size - 3] = (u>>16) & 0xFF;
-    buffer->p_data[buffer->size - 4] = (u>>24) & 0xFF;
-}
-
-static
-void write_u24(buffer_t *buffer, uint32_t u)
-{
-    buffer_grow(buffer, 3);
-
-    buffer->p_data[buffer->size - 1] = (u>>0) & 0xFF;
-    buffer->p_data[buffer->size - 2] = (u>>8) & 0xFF;
-    buffer->p_data[buffer->size - 3] = (u>>16) & 0xFF;
-}
-
-static
-void write_u16(buffer_t *buffer, uint16_t u)
-{
-    buffer_grow(buffer, sizeof(u));
-
-    buffer->p_data[buffer->size - 1] = (u>>0) & 0xFF;
-    buffer->p_data[buffer->size - 2] = (u>>8) & 0xFF;
-}
-
-static
-void write_u8(buffer_t *buffer, uint8_t u)
-{
-    buffer_grow(buffer, sizeof(u));
-
-    buffer->p_data[buffer->size - 1] = u;
-}
-
 static
 void write_32(buffer_t *buffer, int32_t i)
 {
@@ -536,6 +457,155 @@ test_tts_seek_next(void)
     free(tts.p_data);
 }
 
+static void
+test_tts_skip(void)
+{
+    uint64_t dts[] = {0, 10, 20, 30, 33, 36, 336, 337, 338};
+    uint32_t cts[] = {5, 5, 5, 0, 0, 7, 1, 1, 2};
+    uint32_t n = sizeof(dts) / sizeof(*dts);
+    buffer_t stts, ctts;
+
+    buffer_init(&stts);
+    write_u8(&stts, 0);  /* version */
+    write_u24(&stts, 0);  /* flags */
+    write_u32(&stts, 5);  /* entry count */
+    write_u32(&stts, 3); write_u32(&stts, 10);  /* sample count, sample value */
+    write_u32(&stts, 2); write_u32(&stts, 3);
+    write_u32(&stts, 0); write_u32(&stts, 12);  /* empty entry */
+    write_u32(&stts, 1); write_u32(&stts, 300);
+    write_u32(&stts, 3); write_u32(&stts, 1);
+
+    buffer_init(&ctts);
+    write_u8(&ctts, 0);  /* version */
+    write_u24(&ctts, 0);  /* flags */
+    write_u32(&ctts, 5);  /* entry count */
+    write_u32(&ctts, 3); write_u32(&ctts, 5);
+    write_u32(&ctts, 2); write_u32(&ctts, 0);
+    write_u32(&ctts, 1); write_u32(&ctts, 7);
+    write_u32(&ctts, 2); write_u32(&ctts, 1);
+    write_u32(&ctts, 1); write_u32(&ctts, 2);
+
+    {
+        tts_reader_t rd, rc;
+        mp4d_atom_t atom_d = wrap_buffer(&stts);
+        mp4d_atom_t atom_c = wrap_buffer(&ctts);
+        uint32_t first, count;
+
+        for (first = 0; first < n; first++)
+        {
+            for (count = 0; first + count <= n; count++)
+            {
+                uint64_t ts;
+                uint32_t duration, offset, i;
+
+                expect( mp4d_tts_init(&rd, &atom_d, 1) == MP4D_NO_ERROR );
+                expect( mp4d_tts_init(&rc, &atom_c, 0) == MP4D_NO_ERROR );
+
+                for (i = 0; i < first; i++)
+                {
+                    expect( mp4d_tts_get_stts_next(&rd, &ts, &duration) == MP4D_NO_ERROR );
+                    expect( mp4d_tts_get_ctts_next(&rc, &offset) == MP4D_NO_ERROR );
+                }
+                expect( mp4d_tts_skip(&rd, count) == MP4D_NO_ERROR );
+                expect( mp4d_tts_skip(&rc, count) == MP4D_NO_ERROR );
+                if (first + count > 0)
+                {
+                    expect( rd.cur_dts == dts[first + count - 1] );
+                }
+                if (first + count == n)
+                {
+                    expect( mp4d_tts_get_stts_next(&rd, &ts, &duration) == MP4D_E_NEXT_SEGMENT );
+                    continue;
+                }
+                expect( mp4d_tts_get_stts_next(&rd, &ts, &duration) == MP4D_NO_ERROR );
+                expect( ts == dts[first + count] );
+                expect( mp4d_tts_get_ctts_next(&rc, &offset) == MP4D_NO_ERROR );
+                expect( offset == cts[first + count] );
+            }
+        }
+        expect( mp4d_tts_init(&rd, &atom_d, 1) == MP4D_NO_ERROR );
+        expect( mp4d_tts_skip(&rd, n + 1) == MP4D_E_NEXT_SEGMENT );
+    }
+
+    free(stts.p_data);
+    free(ctts.p_data);
+}
+
+static void
+test_tts_rewind(void)
+{
+    uint64_t dts[] = {0, 10, 20, 30, 33, 36, 336, 337, 338};
+    uint32_t cts[] = {5, 5, 5, 0, 0, 7, 1, 1, 2};
+    uint32_t n = sizeof(dts) / sizeof(*dts);
+    buffer_t stts, ctts;
+
+    buffer_init(&stts);
+    write_u8(&stts, 0);  /* version */
+    write_u24(&stts, 0);  /* flags */
+    write_u32(&stts, 5);  /* entry count */
+    write_u32(&stts, 3); write_u32(&stts, 10);  /* sample count, sample value */
+    write_u32(&stts, 2); write_u32(&stts, 3);
+    write_u32(&stts, 0); write_u32(&stts, 12);  /* empty entry */
+    write_u32(&stts, 1); write_u32(&stts, 300);
+    write_u32(&stts, 3); write_u32(&stts, 1);
+
+    buffer_init(&ctts);
+    write_u8(&ctts, 0);  /* version */
+    write_u24(&ctts, 0);  /* flags */
+    write_u32(&ctts, 5);  /* entry count */
+    write_u32(&ctts, 3); write_u32(&ctts, 5);
+    write_u32(&ctts, 2); write_u32(&ctts, 0);
+    write_u32(&ctts, 1); write_u32(&ctts, 7);
+    write_u32(&ctts, 2); write_u32(&ctts, 1);
+    write_u32(&ctts, 1); write_u32(&ctts, 2);
+
+    {
+        tts_reader_t rd, rc;
+        mp4d_atom_t atom_d = wrap_buffer(&stts);
+        mp4d_atom_t atom_c = wrap_buffer(&ctts);
+        uint32_t last, count;
+
+        for (last = 0; last <= n; last++)
+        {
+            for (count = 0; count <= last; count++)
+            {
+                uint64_t ts;
+                uint32_t duration, offset, i;
+
+                expect( mp4d_tts_init(&rd, &atom_d, 1) == MP4D_NO_ERROR );
+                expect( mp4d_tts_init(&rc, &atom_c, 0) == MP4D_NO_ERROR );
+
+                for (i = 0; i < last; i++)
+                {
+                    expect( mp4d_tts_get_stts_next(&rd, &ts, &duration) == MP4D_NO_ERROR );
+                    expect( mp4d_tts_get_ctts_next(&rc, &offset) == MP4D_NO_ERROR );
+                }
+                expect( mp4d_tts_rewind(&rd, count) == MP4D_NO_ERROR );
+                expect( mp4d_tts_rewind(&rc, count) == MP4D_NO_ERROR );
+                if (last - count > 0)
+                {
+                    expect( rd.cur_dts == dts[last - count - 1] );
+                }
+
+                /* Read again up to the end */
+                for (i = last - count; i < n; i++)
+                {
+                    expect( mp4d_tts_get_stts_next(&rd, &ts, &duration) == MP4D_NO_ERROR );
+                    expect( ts == dts[i] );
+                    expect( mp4d_tts_get_ctts_next(&rc, &offset) == MP4D_NO_ERROR );
+                    expect( offset == cts[i] );
+                }
+                expect( mp4d_tts_get_stts_next(&rd, &ts, &duration) == MP4D_E_NEXT_SEGMENT );
+            }
+        }
+        expect( mp4d_tts_init(&rd, &atom_d, 1) == MP4D_NO_ERROR );
+        expect( mp4d_tts_rewind(&rd, 1) == MP4D_E_WRONG_ARGUMENT );
+    }
+
+    free(stts.p_data);
+    free(ctts.p_data);
+}
+
 static void
 test_tts_first_empty(void)
 {
@@ -976,6 +1046,98 @@ test_stz2_16(void)
     free(stsz.p_data);
 }
 
+static void
+test_stz2_4_skip(void)
+{
+    buffer_t stsz;
+    buffer_init(&stsz);
+
+    write_u8(&stsz, 0);  /* version */
+    write_u24(&stsz, 0);  /* flags */
+    write_u24(&stsz, 0);  /* reserved */
+    write_u8(&stsz, 4);   /* field size */
+
+    write_u32(&stsz, 5);  /* sample count */
+
+    write_u8(&stsz, (11 << 4) + 12);  /* size */
+    write_u8(&stsz, (13 << 4) + 4);  /* size */
+    write_u8(&stsz, 6 << 4);       /* size */
+    {
+        stsz_reader_t r;
+        mp4d_atom_t atom = wrap_buffer(&stsz);
+        uint32_t sizes [] = {11, 12, 13, 4, 6};
+        uint32_t first, count, size;
+
+        for (first = 0; first < 5; first++)
+        {
+            for (count = 0; first + count < 5; count++)
+            {
+                uint32_t i;
+
+                expect( mp4d_stsz_init(&r, &atom, 1) == MP4D_NO_ERROR );
+                for (i = 0; i < first; i++)
+                {
+                    expect( mp4d_stsz_get_next(&r, &size) == MP4D_NO_ERROR );
+                }
+                expect( mp4d_stsz_skip(&r, count) == MP4D_NO_ERROR );
+                expect( mp4d_stsz_get_next(&r, &size) == MP4D_NO_ERROR );
+                expect( size == sizes[first + count] );
+            }
+        }
+        expect( mp4d_stsz_init(&r, &atom, 1) == MP4D_NO_ERROR );
+        expect( mp4d_stsz_skip(&r, 6) == MP4D_E_NEXT_SEGMENT );
+    }
+    free(stsz.p_data);
+}
+
+static void
+test_stz2_4_rewind(void)
+{
+    buffer_t stsz;
+    buffer_init(&stsz);
+
+    write_u8(&stsz, 0);  /* version */
+    write_u24(&stsz, 0);  /* flags */
+    write_u24(&stsz, 0);  /* reserved */
+    write_u8(&stsz, 4);   /* field size */
+
+    write_u32(&stsz, 5);  /* sample count */
+
+    write_u8(&stsz, (11 << 4) + 12);  /* size */
+    write_u8(&stsz, (13 << 4) + 4);  /* size */
+    write_u8(&stsz, 6 << 4);       /* size */
+    {
+        stsz_reader_t r;
+        mp4d_atom_t atom = wrap_buffer(&stsz);
+        uint32_t sizes [] = {11, 12, 13, 4, 6};
+        uint32_t last, count, size;
+
+        for (last = 0; last <= 5; last++)
+        {
+            for (count = 0; count <= last; count++)
+            {
+                uint32_t i;
+
+                expect( mp4d_stsz_init(&r, &atom, 1) == MP4D_NO_ERROR );
+                for (i = 0; i < last; i++)
+                {
+                    expect( mp4d_stsz_get_next(&r, &size) == MP4D_NO_ERROR );
+                }
+                expect( mp4d_stsz_rewind(&r, count) == MP4D_NO_ERROR );
+                for (i = last - count; i < 5; i++)
+                {
+                    expect( mp4d_stsz_get_next(&r, &size) == MP4D_NO_ERROR );
+                    expect( size == sizes[i] );
+                }
+                expect( mp4d_stsz_get_next(&r, &size) == MP4D_E_NEXT_SEGMENT );
+            }
+        }
+        expect( mp4d_stsz_init(&r, &atom, 1) == MP4D_NO_ERROR );
+        expect( mp4d_stsz_rewind(&r, 1) == MP4D_E_WRONG_ARGUMENT );
+    }
+    free(stsz.p_data);
+}
+
 static void
 test_stsc_not_init(void)
 {
@@ -1201,6 +1363,149 @@ test_stsc_multiple_with_empty(void)
     free(stsc.p_data);
 }
 
+static void
+test_stsc_skip(void)
+{
+    buffer_t stsc;
+    buffer_init(&stsc);
+
+    write_u8(&stsc, 0);  /* version */
+    write_u24(&stsc, 0);  /* flags */
+    write_u32(&stsc, 4);  /* entry count */
+
+    write_u32(&stsc, 1);  /* first chunk */
+    write_u32(&stsc, 2);  /* samples per chunk */
+    write_u32(&stsc, 10);  /* sample description index */
+
+    write_u32(&stsc, 2);  /* first chunk */
+    write_u32(&stsc, 1);  /* samples per chunk */
+    write_u32(&stsc, 12);  /* sample description index */
+
+    write_u32(&stsc, 4);  /* first chunk */
+    write_u32(&stsc, 2);  /* samples per chunk */
+    write_u32(&stsc, 15);  /* sample description index */
+
+    write_u32(&stsc, 6);  /* first chunk */
+    write_u32(&stsc, 3);  /* samples per chunk */
+    write_u32(&stsc, 2);  /* sample description index */
+
+    {
+        struct
+        {
+            uint32_t ci, sdi, si;
+        } samples[] = {{1, 10, 0}, {1, 10, 1},
+                       {2, 12, 0}, {3, 12, 0},
+                       {4, 15, 0}, {4, 15, 1}, {5, 15, 0}, {5, 15, 1},
+                       {6, 2, 0}, {6, 2, 1}, {6, 2, 2}, {7, 2, 0}, {7, 2, 1}, {7, 2, 2}, {8, 2, 0}};
+        uint32_t n = sizeof(samples) / sizeof(*samples);
+        stsc_reader_t r;
+        mp4d_atom_t atom = wrap_buffer(&stsc);
+        uint32_t first, count;
+
+        for (first = 0; first < n; first++)
+        {
+            for (count = 0; first + count < n; count++)
+            {
+                uint32_t ci, sdi, si, i, chunks;
+                uint32_t prev_chunk = 0;
+
+                expect( mp4d_stsc_init(&r, &atom) == MP4D_NO_ERROR );
+                for (i = 0; i < first; i++)
+                {
+                    expect( mp4d_stsc_get_next(&r, &ci, &sdi, &si) == MP4D_NO_ERROR );
+                    prev_chunk = ci;
+                }
+                expect( mp4d_stsc_skip(&r, count, &chunks) == MP4D_NO_ERROR );
+                if (count > 0)
+                {
+                    expect( chunks == samples[first + count - 1].ci - prev_chunk );
+                    expect( r.samples_consumed == samples[first + count - 1].si + 1 );
+                }
+                expect( mp4d_stsc_get_next(&r, &ci, &sdi, &si) == MP4D_NO_ERROR );
+                expect( ci == samples[first + count].ci &&
+                        sdi == samples[first + count].sdi &&
+                        si == samples[first + count].si );
+            }
+        }
+    }
+    free(stsc.p_data);
+}
+
+static void
+test_stsc_rewind(void)
+{
+    buffer_t stsc;
+    buffer_init(&stsc);
+
+    write_u8(&stsc, 0);  /* version */
+    write_u24(&stsc, 0);  /* flags */
+    write_u32(&stsc, 5);  /* entry count */
+
+    write_u32(&stsc, 1);  /* first chunk */
+    write_u32(&stsc, 2);  /* samples per chunk */
+    write_u32(&stsc, 10);  /* sample description index */
+
+    write_u32(&stsc, 2);  /* first chunk */
+    write_u32(&stsc, 1);  /* samples per chunk */
+    write_u32(&stsc, 12);  /* sample description index */
+
+    write_u32(&stsc, 4);  /* first chunk */
+    write_u32(&stsc, 0);  /* samples per chunk (empty entry) */
+    write_u32(&stsc, 13);  /* sample description index */
+
+    write_u32(&stsc, 5);  /* first chunk */
+    write_u32(&stsc, 2);  /* samples per chunk */
+    write_u32(&stsc, 15);  /* sample description index */
+
+    write_u32(&stsc, 7);  /* first chunk */
+    write_u32(&stsc, 3);  /* samples per chunk */
+    write_u32(&stsc, 2);  /* sample description index */
+
+    {
+        struct
+        {
+            uint32_t ci, sdi, si;
+        } samples[] = {{1, 10, 0}, {1, 10, 1},
+                       {2, 12, 0}, {3, 12, 0},
+                       {5, 15, 0}, {5, 15, 1}, {6, 15, 0}, {6, 15, 1},
+                       {7, 2, 0}, {7, 2, 1}, {7, 2, 2}, {8, 2, 0}, {8, 2, 1}, {8, 2, 2}, {9, 2, 0}};
+        uint32_t n = sizeof(samples) / sizeof(*samples);
+        stsc_reader_t r;
+        mp4d_atom_t atom = wrap_buffer(&stsc);
+        uint32_t last, count;
+
+        for (last = 0; last <= n; last++)
+        {
+            for (count = 0; count <= last; count++)
+            {
+                uint32_t ci, sdi, si, i;
+
+                expect( mp4d_stsc_init(&r, &atom) == MP4D_NO_ERROR );
+                for (i = 0; i < last; i++)
+                {
+                    expect( mp4d_stsc_get_next(&r, &ci, &sdi, &si) == MP4D_NO_ERROR );
+                }
+                expect( mp4d_stsc_rewind(&r, count) == MP4D_NO_ERROR );
+                if (last - count > 0)
+                {
+                    expect( r.cur_chunk == samples[last - count - 1].ci );
+                    expect( r.samples_consumed == samples[last - count - 1].si + 1 );
+                }
+                for (i = last - count; i < n; i++)
+                {
+                    expect( mp4d_stsc_get_next(&r, &ci, &sdi, &si) == MP4D_NO_ERROR );
+                    expect( ci == samples[i].ci &&
+                            sdi == samples[i].sdi &&
+                            si == samples[i].si );
+                }
+            }
+        }
+        expect( mp4d_stsc_init(&r, &atom) == MP4D_NO_ERROR );
+        expect( mp4d_stsc_rewind(&r, 1) == MP4D_E_WRONG_ARGUMENT );
+    }
+    free(stsc.p_data);
+}
+
 static void
 test_stsc_first_chunk_not_ascending(void)
 {
@@ -1507,53 +1812,147 @@ test_stss_multiple(void)
 }
 
 static void
-test_stss_all(void)
+test_stss_peek_sync(void)
 {
     buffer_t stss;
     buffer_init(&stss);
 
     write_u8(&stss, 0); /* version */
     write_u24(&stss, 0); /* flags */
-    write_u32(&stss, 4); /* entry count */
+    write_u32(&stss, 3); /* entry count */
 
-    write_u32(&stss, 1); 
     write_u32(&stss, 2); 
     write_u32(&stss, 3); 
-    write_u32(&stss, 4); 
+    write_u32(&stss, 5); 
 
     {
         stss_reader_t r;
         int is_sync;
+        uint32_t sync_sample;
         mp4d_atom_t atom = wrap_buffer(&stss);
 
         expect( mp4d_stss_init(&r, &atom) == MP4D_NO_ERROR );
+        expect( mp4d_stss_peek_sync(&r, &sync_sample) == MP4D_NO_ERROR ); expect( sync_sample == 2 );
+        expect( mp4d_stss_peek_sync(&r, &sync_sample) == MP4D_NO_ERROR ); expect( sync_sample == 2 );
+        expect( mp4d_stss_get_next(&r, &is_sync) == MP4D_NO_ERROR ); expect( !is_sync );
         expect( mp4d_stss_get_next(&r, &is_sync) == MP4D_NO_ERROR ); expect( is_sync );
+        expect( mp4d_stss_peek_sync(&r, &sync_sample) == MP4D_NO_ERROR ); expect( sync_sample == 3 );
+        expect( mp4d_stss_skip(&r, 1) == MP4D_NO_ERROR );
+        expect( mp4d_stss_peek_sync(&r, &sync_sample) == MP4D_NO_ERROR ); expect( sync_sample == 5 );
+        expect( mp4d_stss_skip(&r, 1) == MP4D_NO_ERROR );
         expect( mp4d_stss_get_next(&r, &is_sync) == MP4D_NO_ERROR ); expect( is_sync );
-        expect( mp4d_stss_get_next(&r, &is_sync) == MP4D_NO_ERROR ); expect( is_sync );
-        expect( mp4d_stss_get_next(&r, &is_sync) == MP4D_NO_ERROR ); expect( is_sync );
-        expect( mp4d_stss_get_next(&r, &is_sync) == MP4D_NO_ERROR ); expect( !is_sync );
+        expect( mp4d_stss_peek_sync(&r, &sync_sample) == MP4D_NO_ERROR ); expect( sync_sample == (uint32_t) -1 );
         expect( mp4d_stss_get_next(&r, &is_sync) == MP4D_NO_ERROR ); expect( !is_sync );
+
+        expect( mp4d_stss_init(&r, NULL) == MP4D_NO_ERROR );
+        expect( mp4d_stss_peek_sync(&r, &sync_sample) == MP4D_E_INFO_NOT_AVAIL );
     }
 
     free(stss.p_data);
 }
 
 static void
-test_elst_empty(void)
+test_stss_rewind(void)
 {
-    buffer_t elst;
-    buffer_init(&elst);
+    buffer_t stss;
+    buffer_init(&stss);
 
-    write_u8(&elst, 0); /* version */
-    write_u24(&elst, 0); /* flags */
-    write_u32(&elst, 0); /* entry count */
-    {
+    write_u8(&stss, 0); /* version */
+    write_u24(&stss, 0); /* flags */
+    write_u32(&stss, 3); /* entry count */
+
+    write_u32(&stss, 2); 
+    write_u32(&stss, 3); 
+    write_u32(&stss, 5); 
+
+    {
+        int sync[] = {0, 1, 1, 0, 1, 0, 0};
+        uint32_t n = sizeof(sync) / sizeof(*sync);
+        stss_reader_t r;
+        mp4d_atom_t atom = wrap_buffer(&stss);
+        uint32_t last, count, sync_sample;
+
+        for (last = 0; last <= n; last++)
+        {
+            for (count = 0; count <= last; count++)
+            {
+                int is_sync;
+                uint32_t i;
+
+                expect( mp4d_stss_init(&r, &atom) == MP4D_NO_ERROR );
+                for (i = 0; i < last; i++)
+                {
+                    expect( mp4d_stss_get_next(&r, &is_sync) == MP4D_NO_ERROR );
+                }
+                expect( mp4d_stss_rewind(&r, count) == MP4D_NO_ERROR );
+                for (i = last - count; i < n; i++)
+                {
+                    expect( mp4d_stss_get_next(&r, &is_sync) == MP4D_NO_ERROR );
+                    expect( is_sync == sync[i] );
+                }
+            }
+        }
+
+        expect( mp4d_stss_get_entry(&r, 0, &sync_sample) == MP4D_NO_ERROR ); expect( sync_sample == 2 );
+        expect( mp4d_stss_get_entry(&r, 2, &sync_sample) == MP4D_NO_ERROR ); expect( sync_sample == 5 );
+        expect( mp4d_stss_get_entry(&r, 3, &sync_sample) == MP4D_E_WRONG_ARGUMENT );
+
+        expect( mp4d_stss_init(&r, NULL) == MP4D_NO_ERROR );
+        expect( mp4d_stss_get_entry(&r, 0, &sync_sample) == MP4D_E_INFO_NOT_AVAIL );
+    }
+
+    free(stss.p_data);
+}
+
+static void
+test_stss_all(void)
+{
+    buffer_t stss;
+    buffer_init(&stss);
+
+    write_u8(&stss, 0); /* version */
+    write_u24(&stss, 0); /* flags */
+    write_u32(&stss, 4); /* entry count */
+
+    write_u32(&stss, 1); 
+    write_u32(&stss, 2); 
+    write_u32(&stss, 3); 
+    write_u32(&stss, 4); 
+
+    {
+        stss_reader_t r;
+        int is_sync;
+        mp4d_atom_t atom = wrap_buffer(&stss);
+
+        expect( mp4d_stss_init(&r, &atom) == MP4D_NO_ERROR );
+        expect( mp4d_stss_get_next(&r, &is_sync) == MP4D_NO_ERROR ); expect( is_sync );
+        expect( mp4d_stss_get_next(&r, &is_sync) == MP4D_NO_ERROR ); expect( is_sync );
+        expect( mp4d_stss_get_next(&r, &is_sync) == MP4D_NO_ERROR ); expect( is_sync );
+        expect( mp4d_stss_get_next(&r, &is_sync) == MP4D_NO_ERROR ); expect( is_sync );
+        expect( mp4d_stss_get_next(&r, &is_sync) == MP4D_NO_ERROR ); expect( !is_sync );
+        expect( mp4d_stss_get_next(&r, &is_sync) == MP4D_NO_ERROR ); expect( !is_sync );
+    }
+
+    free(stss.p_data);
+}
+
+static void
+test_elst_empty(void)
+{
+    buffer_t elst;
+    buffer_init(&elst);
+
+    write_u8(&elst, 0); /* version */
+    write_u24(&elst, 0); /* flags */
+    write_u32(&elst, 0); /* entry count */
+    {
         elst_reader_t r;
+        elst_entry_t entries[4];
         mp4d_atom_t atom = wrap_buffer(&elst);
         int64_t pt;
         uint32_t off, dur;
 
-        expect( mp4d_elst_init(&r, &atom, 1, 1) == MP4D_NO_ERROR );
+        expect( mp4d_elst_init(&r, &atom, entries, 4, 1, 1) == MP4D_NO_ERROR );
         expect( mp4d_elst_get_presentation_time(&r, 0, 1, &pt, &off, &dur) == MP4D_E_INFO_NOT_AVAIL );
     }
 
@@ -1576,11 +1975,12 @@ test_elst_one_entry_1(void)
     write_16(&elst, 0);   /* 0 */
     {
         elst_reader_t r;
+        elst_entry_t entries[4];
         mp4d_atom_t atom = wrap_buffer(&elst);
         int64_t pt;
         uint32_t off, dur;
 
-        expect( mp4d_elst_init(&r, &atom, 1, 1) == MP4D_NO_ERROR );
+        expect( mp4d_elst_init(&r, &atom, entries, 4, 1, 1) == MP4D_NO_ERROR );
         expect( mp4d_elst_get_presentation_time(&r, 0, 1, &pt, &off, &dur) == MP4D_NO_ERROR ); expect( pt == 0 && off == 0 && dur == 1 );
         expect( mp4d_elst_get_presentation_time(&r, 0, 10, &pt, &off, &dur) == MP4D_NO_ERROR ); expect( pt == 0 && off == 0 && dur == 10 );
         expect( mp4d_elst_get_presentation_time(&r, 0, 11, &pt, &off, &dur) == MP4D_NO_ERROR ); expect( pt == 0 && off == 0 && dur == 10 );
@@ -1608,11 +2008,12 @@ test_elst_one_entry_2(void)
     write_16(&elst, 0);   /* 0 */
     {
         elst_reader_t r;
+        elst_entry_t entries[4];
         mp4d_atom_t atom = wrap_buffer(&elst);
         int64_t pt;
         uint32_t off, dur;
 
-        expect( mp4d_elst_init(&r, &atom, 1, 1) == MP4D_NO_ERROR );
+        expect( mp4d_elst_init(&r, &atom, entries, 4, 1, 1) == MP4D_NO_ERROR );
         expect( mp4d_elst_get_presentation_time(&r, 1000, 1000, &pt, &off, &dur) == MP4D_NO_ERROR );
         expect( mp4d_elst_get_presentation_time(&r, 9000, 1000, &pt, &off, &dur) == MP4D_NO_ERROR );
         expect( mp4d_elst_get_presentation_time(&r, 17000, 1000, &pt, &off, &dur) == MP4D_NO_ERROR );
@@ -1639,11 +2040,12 @@ test_elst_one_entry_offset(void)
     write_16(&elst, 0);   /* 0 */
     {
         elst_reader_t r;
+        elst_entry_t entries[4];
         mp4d_atom_t atom = wrap_buffer(&elst);
         int64_t pt;
         uint32_t off, dur;
 
-        expect( mp4d_elst_init(&r, &atom, 1, 1) == MP4D_NO_ERROR );
+        expect( mp4d_elst_init(&r, &atom, entries, 4, 1, 1) == MP4D_NO_ERROR );
         expect( mp4d_elst_get_presentation_time(&r, 0, 1, &pt, &off, &dur) == MP4D_E_INFO_NOT_AVAIL );
         expect( mp4d_elst_get_presentation_time(&r, 300, 20, &pt, &off, &dur) == MP4D_E_INFO_NOT_AVAIL );
         expect( mp4d_elst_get_presentation_time(&r, 300, 21, &pt, &off, &dur) == MP4D_NO_ERROR ); expect( pt == -20 && off == 20 && dur == 1 );
@@ -1678,11 +2080,12 @@ test_elst_multiple(void)
     write_16(&elst, 0);   /* 0 */
     {
         elst_reader_t r;
+        elst_entry_t entries[4];
         mp4d_atom_t atom = wrap_buffer(&elst);
         int64_t pt;
         uint32_t off, dur;
 
-        expect( mp4d_elst_init(&r, &atom, 1, 1) == MP4D_NO_ERROR );
+        expect( mp4d_elst_init(&r, &atom, entries, 4, 1, 1) == MP4D_NO_ERROR );
 
         expect( mp4d_elst_get_presentation_time(&r, 0, 15, &pt, &off, &dur) == MP4D_E_INFO_NOT_AVAIL );
         expect( mp4d_elst_get_presentation_time(&r, 320, 15, &pt, &off, &dur) == MP4D_NO_ERROR ); expect( pt == -1 && off == 1 && dur == 10 );
@@ -1733,11 +2136,12 @@ test_elst_empty_dwell(void)
     write_16(&elst, 0);   /* 0 */
     {
         elst_reader_t r;
+        elst_entry_t entries[4];
         mp4d_atom_t atom = wrap_buffer(&elst);
         int64_t pt;
         uint32_t off, dur;
 
-        expect( mp4d_elst_init(&r, &atom, 1, 1) == MP4D_NO_ERROR );
+        expect( mp4d_elst_init(&r, &atom, entries, 4, 1, 1) == MP4D_NO_ERROR );
 
         expect( mp4d_elst_get_presentation_time(&r, 300, 5, &pt, &off, &dur) == MP4D_NO_ERROR ); expect( pt == 0 && off == 0 && dur == 5 );
         expect( mp4d_elst_get_presentation_time(&r, 309, 5, &pt, &off, &dur) == MP4D_NO_ERROR ); expect( pt == 9 && off == 0 && dur == 1 );
@@ -1783,12 +2187,13 @@ test_elst_time_scale(void)
         for (n = 1; n <= 1; n++)
         {
             elst_reader_t r;
+            elst_entry_t entries[4];
             mp4d_atom_t atom = wrap_buffer(&elst);
             int64_t pt;
             uint32_t off, dur;
             uint32_t media_time_scale = n * movie_time_scale;
             
-            expect( mp4d_elst_init(&r, &atom, media_time_scale, movie_time_scale) == MP4D_NO_ERROR );
+            expect( mp4d_elst_init(&r, &atom, entries, 4, media_time_scale, movie_time_scale) == MP4D_NO_ERROR );
             
             expect( mp4d_elst_get_presentation_time(&r, 0, 1*n, &pt, &off, &dur) == MP4D_E_INFO_NOT_AVAIL );
             expect( mp4d_elst_get_presentation_time(&r, 320 - 20*n, 20*n, &pt, &off, &dur) == MP4D_E_INFO_NOT_AVAIL );
@@ -1804,6 +2209,120 @@ test_elst_time_scale(void)
     free(elst.p_data);
 }
 
+static void
+test_elst_many(void)
+{
+    /* 300 edits of 10 media time units each, every second edit skips 5 units,
+       every tenth edit is empty */
+    enum { N = 300 };
+    buffer_t elst;
+    uint32_t i;
+    int64_t media_time = 1000;
+
+    buffer_init(&elst);
+
+    write_u8(&elst, 1); /* version */
+    write_u24(&elst, 0); /* flags */
+    write_u32(&elst, N); /* entry count */
+
+    for (i = 0; i < N; i++)
+    {
+        write_u64(&elst, 10); /* segment duration */
+        if (i % 10 == 9)
+        {
+            write_u64(&elst, (uint64_t) -1);  /* media_time */  /* empty */
+        }
+        else
+        {
+            write_u64(&elst, (uint64_t) media_time);
+            media_time += (i % 2) ? 15 : 10;
+        }
+        write_16(&elst, 1);   /* media_rate */
+        write_16(&elst, 0);   /* 0 */
+    }
+    {
+        elst_reader_t r;
+        elst_entry_t *entries = malloc(N * sizeof(*entries));
+        mp4d_atom_t atom = wrap_buffer(&elst);
+        uint32_t count;
+        int64_t pt;
+        uint32_t off, dur;
+
+        expect( mp4d_elst_get_entry_count(&atom, &count) == MP4D_NO_ERROR ); expect( count == N );
+        expect( mp4d_elst_init(&r, &atom, entries, N - 1, 1, 1) == MP4D_E_BUFFER_TOO_SMALL );
+        expect( mp4d_elst_init(&r, &atom, entries, N, 1, 1) == MP4D_NO_ERROR );
+        expect( r.num_entries == N - N / 10 );
+
+        /* Backwards, then forwards: the same mapping in any order */
+        for (i = N; i-- > 0; )
+        {
+            if (i % 10 != 9)
+            {
+                expect( mp4d_elst_get_presentation_time(&r, r.p_entries[i - i / 10].media_time + 2, 1, &pt, &off, &dur) == MP4D_NO_ERROR );
+                expect( pt == 10 * (int64_t) i + 2 && off == 0 && dur == 1 );
+            }
+        }
+        for (i = 0; i < N; i++)
+        {
+            if (i % 10 != 9)
+            {
+                expect( mp4d_elst_get_presentation_time(&r, r.p_entries[i - i / 10].media_time + 8, 5, &pt, &off, &dur) == MP4D_NO_ERROR );
+                expect( pt == 10 * (int64_t) i + 8 && off == 0 && dur == 2 );
+            }
+        }
+        /* Between edits 1 and 2 (1020 - 1025), and after the last edit */
+        expect( mp4d_elst_get_presentation_time(&r, 1021, 2, &pt, &off, &dur) == MP4D_E_INFO_NOT_AVAIL );
+        expect( mp4d_elst_get_presentation_time(&r, 1021, 5, &pt, &off, &dur) == MP4D_NO_ERROR ); expect( pt == 16 && off == 4 && dur == 1 );
+        expect( mp4d_elst_get_presentation_time(&r, (uint64_t) media_time + 100, 5, &pt, &off, &dur) == MP4D_E_INFO_NOT_AVAIL );
+        free(entries);
+    }
+
+    free(elst.p_data);
+}
+
+static void
+test_elst_overlap(void)
+{
+    buffer_t elst;
+    buffer_init(&elst);
+
+    write_u8(&elst, 0); /* version */
+    write_u24(&elst, 0); /* flags */
+    write_u32(&elst, 3); /* entry count */
+
+    write_u32(&elst, 100); /* segment duration (0 - 100) */
+    write_32(&elst, 0);    /* media_time */
+    write_16(&elst, 1);    /* media_rate */
+    write_16(&elst, 0);    /* 0 */
+
+    write_u32(&elst, 10);  /* segment duration (100 - 110), within the first segment */
+    write_32(&elst, 50);   /* media_time */
+    write_16(&elst, 1);    /* media_rate */
+    write_16(&elst, 0);    /* 0 */
+
+    write_u32(&elst, 10);  /* segment duration (110 - 120) */
+    write_32(&elst, 200);  /* media_time */
+    write_16(&elst, 1);    /* media_rate */
+    write_16(&elst, 0);    /* 0 */
+    {
+        elst_reader_t r;
+        elst_entry_t entries[4];
+        mp4d_atom_t atom = wrap_buffer(&elst);
+        int64_t pt;
+        uint32_t off, dur;
+
+        expect( mp4d_elst_init(&r, &atom, entries, 4, 1, 1) == MP4D_NO_ERROR );
+
+        /* The first segment containing the media time */
+        expect( mp4d_elst_get_presentation_time(&r, 205, 1, &pt, &off, &dur) == MP4D_NO_ERROR ); expect( pt == 115 && off == 0 && dur == 1 );
+        expect( mp4d_elst_get_presentation_time(&r, 55, 1, &pt, &off, &dur) == MP4D_NO_ERROR ); expect( pt == 55 && off == 0 && dur == 1 );
+        expect( mp4d_elst_get_presentation_time(&r, 99, 1, &pt, &off, &dur) == MP4D_NO_ERROR ); expect( pt == 99 && off == 0 && dur == 1 );
+        expect( mp4d_elst_get_presentation_time(&r, 100, 1, &pt, &off, &dur) == MP4D_E_INFO_NOT_AVAIL );
+    }
+
+    free(elst.p_data);
+}
+
 static void
 test_subs_no_box(void)
 {
@@ -2057,6 +2576,146 @@ test_subs_multiple_entries(void)
     free(subs.p_data);
 }
 
+static void
+test_subs_skip(void)
+{
+    buffer_t subs;
+    
+    buffer_init(&subs);
+    
+    write_u8(&subs, 0);  /* version */
+    write_u24(&subs, 0); /* flags */
+    write_u32(&subs, 3); /* entry count */
+    
+    write_u32(&subs, 2); /* sample_delta */
+    write_u16(&subs, 2); /* subsample_count */
+    write_u16(&subs, 300); /* subsample_size */
+    write_u16(&subs, 0); write_u32(&subs, 0);   /* not used */
+    write_u16(&subs, 400); /* subsample_size */
+    write_u16(&subs, 0); write_u32(&subs, 0);   /* not used */
+    
+    write_u32(&subs, 1); /* sample_delta */
+    write_u16(&subs, 1); /* subsample_count */
+    write_u16(&subs, 301); /* subsample_size */
+    write_u16(&subs, 0); write_u32(&subs, 0);   /* not used */
+
+    write_u32(&subs, 2); /* sample_delta */
+    write_u16(&subs, 2); /* subsample_count */
+    write_u16(&subs, 302); /* subsample_size */
+    write_u16(&subs, 0); write_u32(&subs, 0);   /* not used */
+    write_u16(&subs, 402); /* subsample_size */
+    write_u16(&subs, 0); write_u32(&subs, 0);   /* not used */
+
+    {
+        /* subsample count and first subsample size of samples 1, ..., 6 */
+        uint16_t counts[] = {1, 2, 1, 1, 2, 1};
+        uint32_t sizes[] = {1000, 300, 301, 1000, 302, 1000};
+        subs_reader_t r;
+        mp4d_atom_t atom = wrap_buffer(&subs);
+        uint32_t first, count;
+
+        for (first = 0; first < 6; first++)
+        {
+            for (count = 0; first + count < 6; count++)
+            {
+                uint16_t c;
+                uint32_t size, offset, i;
+
+                expect( mp4d_subs_init(&r, &atom) == MP4D_NO_ERROR );
+                for (i = 0; i < first; i++)
+                {
+                    expect( mp4d_subs_get_next_count(&r, &c) == MP4D_NO_ERROR );
+                }
+                expect( mp4d_subs_skip(&r, count) == MP4D_NO_ERROR );
+                expect( mp4d_subs_get_next_count(&r, &c) == MP4D_NO_ERROR );
+                expect( c == counts[first + count] );
+                expect( mp4d_subs_get_next_size(&r, 1000, &size, &offset) == MP4D_NO_ERROR );
+                expect( size == sizes[first + count] && offset == 0 );
+            }
+        }
+    }
+
+    free(subs.p_data);
+}
+
+/* subsample_size of the subs version, and the unused fields */
+static void
+write_subs_entry(buffer_t *p_subs, uint32_t version, uint32_t size)
+{
+    if (version == 1)
+    {
+        write_u32(p_subs, size);
+    }
+    else
+    {
+        write_u16(p_subs, (uint16_t) size);
+    }
+    write_u16(p_subs, 0); write_u32(p_subs, 0);   /* not used */
+}
+
+static void
+test_subs_get_sizes(void)
+{
+    buffer_t subs;
+    uint32_t version;
+
+    for (version = 0; version <= 1; version++)
+    {
+        buffer_init(&subs);
+
+        write_u8(&subs, (uint8_t) version);
+        write_u24(&subs, 0); /* flags */
+        write_u32(&subs, 2); /* entry count */
+
+        write_u32(&subs, 2); /* sample_delta */
+        write_u16(&subs, 3); /* subsample_count */
+        write_subs_entry(&subs, version, 300);
+        write_subs_entry(&subs, version, version == 1 ? 70000 : 400);
+        write_subs_entry(&subs, version, 5);
+
+        write_u32(&subs, 1); /* sample_delta */
+        write_u16(&subs, 2); /* subsample_count */
+        write_subs_entry(&subs, version, 10);
+        write_subs_entry(&subs, version, 20);
+
+        {
+            subs_reader_t r;
+            uint16_t count;
+            uint32_t sizes[4];
+            uint32_t second = version == 1 ? 70000 : 400;
+            mp4d_atom_t atom = wrap_buffer(&subs);
+
+            expect( mp4d_subs_init(&r, &atom) == MP4D_NO_ERROR );
+
+            /* implicit */
+            expect( mp4d_subs_get_next_count(&r, &count) == MP4D_NO_ERROR ); expect( count == 1 );
+            expect( mp4d_subs_get_sizes(&r, 1000, count, sizes) == MP4D_NO_ERROR ); expect( sizes[0] == 1000 );
+
+            /* sample too small: fails without consuming the entries */
+            expect( mp4d_subs_get_next_count(&r, &count) == MP4D_NO_ERROR ); expect( count == 3 );
+            expect( mp4d_subs_get_sizes(&r, 300 + second, count, sizes) == MP4D_E_WRONG_ARGUMENT );
+            expect( mp4d_subs_get_sizes(&r, 300 + second + 5, count, sizes) == MP4D_NO_ERROR );
+            expect( sizes[0] == 300 && sizes[1] == second && sizes[2] == 5 );
+
+            /* same as mp4d_subs_get_next_size() */
+            expect( mp4d_subs_get_next_count(&r, &count) == MP4D_NO_ERROR ); expect( count == 2 );
+            expect( mp4d_subs_get_sizes(&r, 30, 1, sizes) == MP4D_NO_ERROR ); expect( sizes[0] == 10 );
+            {
+                uint32_t size, offset;
+
+                expect( mp4d_subs_get_next_size(&r, 30, &size, &offset) == MP4D_NO_ERROR );
+                expect( size == 20 && offset == 10 );
+            }
+
+            expect( mp4d_subs_get_next_count(&r, &count) == MP4D_NO_ERROR ); expect( count == 1 );
+            expect( mp4d_subs_get_sizes(&r, 77, count, sizes) == MP4D_NO_ERROR ); expect( sizes[0] == 77 );
+            expect( mp4d_subs_get_sizes(&r, 77, 0, NULL) == MP4D_NO_ERROR );
+        }
+
+        free(subs.p_data);
+    }
+}
+
 static void
 test_trik_not_init(void)
 {
@@ -2336,71 +2995,1188 @@ test_saio_multiple_entries_version_1(void)
     free(saio.p_data);
 }
 
-int main(void)
+/** @brief decode trun entries, for all combinations of the trun flags and versions
+ */
+static void
+test_trun_decode(void)
 {
-    TEST_START("Trackreader");
+    trun_entry_t defaults;
+    uint32_t fields;
+    uint8_t version;
 
-    /* stts, ctts */
-    test_tts_not_init();
-    test_tts_bad_version();
-    test_tts_empty();
-    test_tts_one_sample();
-    test_tts_one_entry();
-    test_tts_multiple_entries();
-    test_tts_multiple_entries_stts_next();
-    test_tts_multiple_entries_ctts_next();
-    test_tts_first_empty();
-    test_tts_seek();
-    test_tts_seek_nodelta();
-    test_tts_seek_next();
+    defaults.duration = 1000;
+    defaults.size = 2000;
+    defaults.flags = 0x01010000;
+    defaults.composition_offset = 0;
 
-    /* stsz, stz2 */
-    test_stsz_not_init();
-    test_stsz_s0_empty();
-    test_stsz_s0_single();
-    test_stsz_s0_multiple();
-    test_stsz_s1_empty();
-    test_stsz_s1_single();
-    test_stsz_s1_multiple();
-    test_stz2_invalid();
-    test_stz2_4();
-    test_stz2_8();
-    test_stz2_16();
+    for (version = 0; version <= 1; version++)
+    {
+        for (fields = 0; fields < 16; fields++)
+        {
+            buffer_t trun;
+            uint32_t i;
 
-    /* stsc */
-    test_stsc_not_init();
-    test_stsc_empty();
-    test_stsc_empty_entries();
-    test_stsc_one_entry_1();
-    test_stsc_one_entry_2();
-    test_stsc_multiple_entries();
-    test_stsc_multiple_with_empty();
-    test_stsc_first_chunk_not_ascending();
+            buffer_init(&trun);
+            for (i = 0; i < 3; i++)
+            {
+                if (fields & 1) write_u32(&trun, 10 + i);          /* sample_duration */
+                if (fields & 2) write_u32(&trun, 20 + i);          /* sample_size */
+                if (fields & 4) write_u32(&trun, 0x02000000 + i);  /* sample_flags */
+                if (fields & 8) write_32(&trun, (int32_t) i - 1);  /* sample_composition_time_offset */
+            }
 
-    /* stco, co64 */
-    test_co_not_init();
-    test_stco_empty();
-    test_stco_single();
-    test_stco_multiple();
-    test_co64_multiple();
+            {
+                trun_decoder_t d;
+                trun_entry_t entries[3];
+                mp4d_atom_t atom = wrap_buffer(&trun);
+                mp4d_buffer_t p = mp4d_atom_to_buffer(&atom);
+
+                expect( mp4d_trun_decoder_init(&d, version, fields << 8, &defaults) == MP4D_NO_ERROR );
+                expect( d.entry_size * 3 == trun.size );
+                expect( mp4d_trun_decode(&d, &p, entries, 3) == MP4D_NO_ERROR );
+                for (i = 0; i < 3; i++)
+                {
+                    int64_t offset = (int64_t) i - 1;
+
+                    if (version == 0 && offset < 0)
+                    {
+                        offset = (uint32_t) -1;
+                    }
+                    expect( entries[i].duration == ((fields & 1) ? 10 + i : 1000) );
+                    expect( entries[i].size == ((fields & 2) ? 20 + i : 2000) );
+                    expect( entries[i].flags == ((fields & 4) ? 0x02000000 + i : 0x01010000) );
+                    expect( entries[i].composition_offset == ((fields & 8) ? offset : 0) );
+                }
 
-    /* stss */
-    test_stss_no_box();
-    test_stss_illegal_order();
-    test_stss_empty();
-    test_stss_single_first();
-    test_stss_single_not_first();
-    test_stss_multiple();
-    test_stss_all();
+                /* Not consumed */
+                expect( p.size == trun.size );
+                expect( mp4d_trun_decode(&d, &p, entries, 3) == MP4D_NO_ERROR );
+                expect( entries[0].duration == ((fields & 1) ? 10 : 1000) );
 
-    /* edit list */
-    test_elst_empty();
-    test_elst_one_entry_1();
-    test_elst_one_entry_2();
+                if (fields != 0)
+                {
+                    expect( mp4d_trun_decode(&d, &p, entries, 4) == MP4D_E_BUFFER_TOO_SMALL );
+                }
+            }
+
+            free(trun.p_data);
+        }
+    }
+}
+
+static void
+write_traf(buffer_t *traf, uint8_t tfhd_version, uint32_t track_ID)
+{
+    buffer_init(traf);
+    write_u32(traf, 16);
+    write_u32(traf, 0x74666864);  /* 'tfhd' */
+    write_u8(traf, tfhd_version);
+    write_u24(traf, 0x020000);    /* default-base-is-moof */
+    write_u32(traf, track_ID);
+}
+
+/** @brief index the trafs of a moof by track_ID
+ */
+static void
+test_moof_traf_index(void)
+{
+    buffer_t traf[4];
+    mp4d_atom_t atom[4];
+    mp4d_atom_t found;
+    mp4d_moof_t moof;
+    uint32_t track_ID, count, preceding;
+    int i;
+
+    write_traf(&traf[0], 0, 2);
+    write_traf(&traf[1], 1, 3);  /* unsupported tfhd */
+    write_traf(&traf[2], 0, 1);
+    write_traf(&traf[3], 0, 1);
+    for (i = 0; i < 4; i++)
+    {
+        atom[i] = wrap_buffer(&traf[i]);
+    }
+
+    expect( mp4d_traf_get_track_ID(&atom[0], &track_ID) == MP4D_NO_ERROR );
+    expect( track_ID == 2 );
+    expect( mp4d_traf_get_track_ID(&atom[1], &track_ID) == MP4D_E_UNSUPPRTED_FORMAT );
+
+    memset(&moof, 0, sizeof(moof));
+    for (i = 0; i < 4; i++)
+    {
+        expect( mp4d_moof_add_traf(&moof, &atom[i]) == MP4D_NO_ERROR );
+    }
+    expect( moof.num_traf == 4 );
+
+    /* Not used before all of the moof is indexed */
+    expect( mp4d_moof_find_traf(&moof, 1, &found, &count, &preceding) == MP4D_E_INFO_NOT_AVAIL );
+    moof.complete = 1;
+
+    expect( mp4d_moof_find_traf(&moof, 1, &found, &count, &preceding) == MP4D_NO_ERROR );
+    expect( count == 2 );
+    expect( preceding == 1 );
+    expect( found.p_data == atom[2].p_data );
+
+    expect( mp4d_moof_find_traf(&moof, 2, &found, &count, &preceding) == MP4D_NO_ERROR );
+    expect( count == 1 );
+    expect( preceding == 0 );
+    expect( found.p_data == atom[0].p_data );
+
+    expect( mp4d_moof_find_traf(&moof, 3, &found, &count, &preceding) == MP4D_NO_ERROR );
+    expect( count == 0 );
+
+    /* More trafs than the index holds */
+    while (moof.num_traf <= MP4D_MAX_TRAFS)
+    {
+        expect( mp4d_moof_add_traf(&moof, &atom[0]) == MP4D_NO_ERROR );
+    }
+    expect( mp4d_moof_find_traf(&moof, 1, &found, &count, &preceding) == MP4D_E_INFO_NOT_AVAIL );
+
+    for (i = 0; i < 4; i++)
+    {
+        free(traf[i].p_data);
+    }
+}
+
+static void
+test_senc_constant_iv(void)
+{
+    buffer_t senc;
+    int i;
+
+    buffer_init(&senc);
+
+    write_u8(&senc, 0);  /* version */
+    write_u24(&senc, 2); /* flags: subsamples */
+    write_u32(&senc, 3); /* sample_count */
+    for (i = 0; i < 3; i++)
+    {
+        /* No IV: 'cbcs' with a constant IV in 'tenc' */
+        write_u16(&senc, 1);      /* subsample_count */
+        write_u16(&senc, 5 + i);  /* BytesOfClearData */
+        write_u32(&senc, 32);     /* BytesOfProtectedData */
+    }
+
+    {
+        senc_reader_t r;
+        uint8_t iv[16];
+        uint16_t count;
+        const uint8_t *p_entries;
+        mp4d_atom_t atom = wrap_buffer(&senc);
+
+        memset(iv, 0xaa, sizeof(iv));
+        expect( mp4d_senc_init(&r, &atom) == MP4D_NO_ERROR );
+        expect( mp4d_senc_get_next(&r, iv, 0, &count, &p_entries) == MP4D_NO_ERROR );
+        expect( count == 1 );
+        expect( p_entries[0] == 0 && p_entries[1] == 5 );
+        expect( iv[0] == 0xaa );  /* not written */
+
+        expect( mp4d_senc_skip(&r, 0, 1) == MP4D_NO_ERROR );
+        expect( mp4d_senc_get_next(&r, iv, 0, &count, &p_entries) == MP4D_NO_ERROR );
+        expect( count == 1 );
+        expect( p_entries[0] == 0 && p_entries[1] == 7 );
+
+        expect( mp4d_senc_get_next(&r, iv, 4, &count, &p_entries) == MP4D_E_WRONG_ARGUMENT );
+    }
+
+    free(senc.p_data);
+}
+
+static void
+test_senc_decode_subsamples(void)
+{
+    buffer_t senc;
+
+    buffer_init(&senc);
+
+    write_u8(&senc, 0);  /* version */
+    write_u24(&senc, 2); /* flags: subsamples */
+    write_u32(&senc, 1); /* sample_count */
+    write_u32(&senc, 0x01020304); write_u32(&senc, 0x05060708);  /* IV */
+    write_u16(&senc, 2);       /* subsample_count */
+    write_u16(&senc, 0xfffe);  /* BytesOfClearData */
+    write_u32(&senc, 0x10000); /* BytesOfProtectedData */
+    write_u16(&senc, 3);
+    write_u32(&senc, 0xfffffff0);
+
+    {
+        senc_reader_t r;
+        uint8_t iv[16];
+        uint16_t count;
+        const uint8_t *p_entries;
+        uint32_t clear[2], protected_bytes[2];
+        mp4d_atom_t atom = wrap_buffer(&senc);
+
+        expect( mp4d_senc_init(&r, &atom) == MP4D_NO_ERROR );
+        expect( mp4d_senc_get_next(&r, iv, 8, &count, &p_entries) == MP4D_NO_ERROR );
+        expect( count == 2 );
+        expect( mp4d_senc_decode_subsamples(p_entries, count, clear, protected_bytes) == MP4D_NO_ERROR );
+        expect( clear[0] == 0xfffe && protected_bytes[0] == 0x10000 );
+        expect( clear[1] == 3 && protected_bytes[1] == 0xfffffff0 );
+
+        expect( mp4d_senc_decode_subsamples(NULL, 0, NULL, NULL) == MP4D_NO_ERROR );
+        expect( mp4d_senc_decode_subsamples(NULL, 1, clear, protected_bytes) == MP4D_E_WRONG_ARGUMENT );
+    }
+
+    free(senc.p_data);
+}
+
+/* Segments to test the track reader as a whole: a moov with one video track,
+   with the samples in the moov, or in one moof following it */
+
+#define SEG_TRACK_ID 1
+#define SEG_TIME_SCALE 1000
+#define SEG_SAMPLE_DURATION 10
+#define SEG_SAMPLES_PER_CHUNK 4
+
+typedef struct
+{
+    uint32_t num_samples;
+    uint32_t first_sync;  /* samples before the first sync sample */
+    uint32_t gop;         /* distance of the sync samples, 0 if all samples are sync samples */
+    int subs;             /* boolean: moov with a subs box */
+    uint32_t trun_samples;  /* samples per trun of the moof, 0 for one trun */
+    int aux;              /* boolean: sample aux info (saiz, saio) */
+    int first_flags;      /* boolean: the flags of the first sample of each trun in first_sample_flags,
+                             the other samples have the trex default (non-sync) */
+} seg_params_t;
+
+static int
+seg_is_sync(const seg_params_t *p, uint32_t i)
+{
+    return p->gop == 0 || (i >= p->first_sync && (i - p->first_sync) % p->gop == 0);
+}
+
+static uint32_t
+seg_sample_size(uint32_t i)
+{
+    return 100 + i;
+}
+
+static uint8_t
+seg_aux_size(uint32_t i)
+{
+    return (uint8_t) (8 + (i % 3) * 6);
+}
+
+#define SEG_AUX_OFFSET 0x20000  /* of the sample aux info, in the file or from the moof */
+
+/* Writes saiz and saio, with an offset per chunk of samples_per_chunk samples;
+   the aux info of the chunks is contiguous */
+static void
+write_seg_aux(buffer_t *buffer, uint32_t num_samples, uint32_t samples_per_chunk)
+{
+    size_t box;
+    uint32_t offset = SEG_AUX_OFFSET;
+    uint32_t i;
+
+    box = full_box_begin(buffer, "saiz", 0, 1);
+    write_fourcc(buffer, "cenc");  /* aux_info_type */
+    write_u32(buffer, 0);          /* aux_info_type_parameter */
+    write_u8(buffer, 0);           /* default_sample_info_size */
+    write_u32(buffer, num_samples);
+    for (i = 0; i < num_samples; i++)
+    {
+        write_u8(buffer, seg_aux_size(i));
+    }
+    box_end(buffer, box);
+
+    box = full_box_begin(buffer, "saio", 0, 1);
+    write_fourcc(buffer, "cenc");
+    write_u32(buffer, 0);
+    write_u32(buffer, (num_samples + samples_per_chunk - 1) / samples_per_chunk);
+    for (i = 0; i < num_samples; i++)
+    {
+        if (i % samples_per_chunk == 0)
+        {
+            write_u32(buffer, offset);
+        }
+        offset += seg_aux_size(i);
+    }
+    box_end(buffer, box);
+}
+
+static void
+write_seg_stbl(buffer_t *buffer, const seg_params_t *p, int fragmented)
+{
+    size_t stbl = box_begin(buffer, "stbl");
+    size_t box;
+    uint32_t num_samples = fragmented ? 0 : p->num_samples;
+    uint32_t num_chunks = (num_samples + SEG_SAMPLES_PER_CHUNK - 1) / SEG_SAMPLES_PER_CHUNK;
+    uint32_t i;
+
+    box = full_box_begin(buffer, "stsd", 0, 0);
+    write_u32(buffer, 0);  /* entry_count */
+    box_end(buffer, box);
+
+    box = full_box_begin(buffer, "stts", 0, 0);
+    write_u32(buffer, num_samples > 0);
+    if (num_samples > 0)
+    {
+        write_u32(buffer, num_samples);
+        write_u32(buffer, SEG_SAMPLE_DURATION);
+    }
+    box_end(buffer, box);
+
+    if (!fragmented && p->gop > 0)
+    {
+        uint32_t count = 0;
+
+        for (i = 0; i < num_samples; i++)
+        {
+            count += seg_is_sync(p, i) != 0;
+        }
+        box = full_box_begin(buffer, "stss", 0, 0);
+        write_u32(buffer, count);
+        for (i = 0; i < num_samples; i++)
+        {
+            if (seg_is_sync(p, i))
+            {
+                write_u32(buffer, i + 1);
+            }
+        }
+        box_end(buffer, box);
+    }
+
+    box = full_box_begin(buffer, "stsc", 0, 0);
+    write_u32(buffer, num_samples > 0);
+    if (num_samples > 0)
+    {
+        write_u32(buffer, 1);  /* first_chunk */
+        write_u32(buffer, SEG_SAMPLES_PER_CHUNK);
+        write_u32(buffer, 1);  /* sample_description_index */
+    }
+    box_end(buffer, box);
+
+    box = full_box_begin(buffer, "stsz", 0, 0);
+    write_u32(buffer, 0);  /* sample_size */
+    write_u32(buffer, num_samples);
+    for (i = 0; i < num_samples; i++)
+    {
+        write_u32(buffer, seg_sample_size(i));
+    }
+    box_end(buffer, box);
+
+    box = full_box_begin(buffer, "stco", 0, 0);
+    write_u32(buffer, num_chunks);
+    {
+        uint32_t offset = 0x10000;
+
+        for (i = 0; i < num_samples; i++)
+        {
+            if (i % SEG_SAMPLES_PER_CHUNK == 0)
+            {
+                write_u32(buffer, offset);
+            }
+            offset += seg_sample_size(i);
+        }
+    }
+    box_end(buffer, box);
+
+    if (!fragmented && p->aux)
+    {
+        write_seg_aux(buffer, num_samples, SEG_SAMPLES_PER_CHUNK);
+    }
+
+    if (!fragmented && p->subs)
+    {
+        box = full_box_begin(buffer, "subs", 0, 0);
+        write_u32(buffer, num_samples);  /* entry_count */
+        for (i = 0; i < num_samples; i++)
+        {
+            write_u32(buffer, 1);   /* sample_delta */
+            write_u16(buffer, 2);   /* subsample_count */
+            write_u16(buffer, 10);  /* subsample_size */
+            write_u8(buffer, 0);    /* subsample_priority */
+            write_u8(buffer, 0);    /* discardable */
+            write_u32(buffer, 0);   /* codec_specific_parameters */
+            write_u16(buffer, (uint16_t) (seg_sample_size(i) - 10));
+            write_u8(buffer, 0);
+            write_u8(buffer, 0);
+            write_u32(buffer, 0);
+        }
+        box_end(buffer, box);
+    }
+
+    box_end(buffer, stbl);
+}
+
+static void
+write_seg_moov(buffer_t *buffer, const seg_params_t *p, int fragmented)
+{
+    size_t moov = box_begin(buffer, "moov");
+    size_t trak, mdia, minf, box;
+
+    box = full_box_begin(buffer, "mvhd", 0, 0);
+    write_u32(buffer, 0);  /* creation_time */
+    write_u32(buffer, 0);  /* modification_time */
+    write_u32(buffer, SEG_TIME_SCALE);
+    write_u32(buffer, 0);  /* duration */
+    write_u32(buffer, 0x00010000);  /* rate */
+    write_u16(buffer, 0x0100);      /* volume */
+    write_u16(buffer, 0);
+    write_u32(buffer, 0);
+    write_u32(buffer, 0);
+    write_matrix(buffer);
+    write_u32(buffer, 0);  /* pre_defined */
+    write_u32(buffer, 0);
+    write_u32(buffer, 0);
+    write_u32(buffer, 0);
+    write_u32(buffer, 0);
+    write_u32(buffer, 0);
+    write_u32(buffer, SEG_TRACK_ID + 1);  /* next_track_ID */
+    box_end(buffer, box);
+
+    trak = box_begin(buffer, "trak");
+    box = full_box_begin(buffer, "tkhd", 0, 7);
+    write_u32(buffer, 0);  /* creation_time */
+    write_u32(buffer, 0);  /* modification_time */
+    write_u32(buffer, SEG_TRACK_ID);
+    write_u32(buffer, 0);
+    write_u32(buffer, 0);  /* duration */
+    write_u32(buffer, 0);
+    write_u32(buffer, 0);
+    write_u16(buffer, 0);  /* layer */
+    write_u16(buffer, 0);  /* alternate_group */
+    write_u16(buffer, 0);  /* volume */
+    write_u16(buffer, 0);
+    write_matrix(buffer);
+    write_u32(buffer, 640 << 16);
+    write_u32(buffer, 360 << 16);
+    box_end(buffer, box);
+
+    mdia = box_begin(buffer, "mdia");
+    box = full_box_begin(buffer, "mdhd", 0, 0);
+    write_u32(buffer, 0);  /* creation_time */
+    write_u32(buffer, 0);  /* modification_time */
+    write_u32(buffer, SEG_TIME_SCALE);
+    write_u32(buffer, 0);  /* duration */
+    write_u16(buffer, 0x55c4);  /* language */
+    write_u16(buffer, 0);
+    box_end(buffer, box);
+
+    box = full_box_begin(buffer, "hdlr", 0, 0);
+    write_u32(buffer, 0);  /* pre_defined */
+    write_fourcc(buffer, "vide");
+    write_u32(buffer, 0);
+    write_u32(buffer, 0);
+    write_u32(buffer, 0);
+    write_u8(buffer, 0);   /* name */
+    box_end(buffer, box);
+
+    minf = box_begin(buffer, "minf");
+    write_seg_stbl(buffer, p, fragmented);
+    box_end(buffer, minf);
+    box_end(buffer, mdia);
+    box_end(buffer, trak);
+
+    if (fragmented)
+    {
+        size_t mvex = box_begin(buffer, "mvex");
+
+        box = full_box_begin(buffer, "trex", 0, 0);
+        write_u32(buffer, SEG_TRACK_ID);
+        write_u32(buffer, 1);  /* default_sample_description_index */
+        write_u32(buffer, SEG_SAMPLE_DURATION);
+        write_u32(buffer, 0);  /* default_sample_size */
+        write_u32(buffer, 0x01010000);  /* default_sample_flags: non-sync */
+        box_end(buffer, box);
+        box_end(buffer, mvex);
+    }
+
+    box_end(buffer, moov);
+}
+
+/* Writes a moof with the samples in truns of p->trun_samples samples;
+   write_traf_boxes, if not NULL, adds boxes at the end of the traf */
+static void
+write_seg_moof(buffer_t *buffer,
+               const seg_params_t *p,
+               void (*write_traf_boxes)(buffer_t *buffer, const seg_params_t *p))
+{
+    size_t moof = box_begin(buffer, "moof");
+    size_t traf, box;
+    uint32_t trun_samples = p->trun_samples > 0 ? p->trun_samples : p->num_samples;
+    uint32_t data_offset = 0x1000;
+    uint32_t i, k;
+
+    box = full_box_begin(buffer, "mfhd", 0, 0);
+    write_u32(buffer, 1);  /* sequence_number */
+    box_end(buffer, box);
+
+    traf = box_begin(buffer, "traf");
+    box = full_box_begin(buffer, "tfhd", 0, 0x020000);  /* default-base-is-moof */
+    write_u32(buffer, SEG_TRACK_ID);
+    box_end(buffer, box);
+
+    box = full_box_begin(buffer, "tfdt", 1, 0);
+    write_u64(buffer, 0);  /* baseMediaDecodeTime */
+    box_end(buffer, box);
+
+    for (i = 0; i < p->num_samples; i += trun_samples)
+    {
+        uint32_t sample_count = p->num_samples - i < trun_samples ? p->num_samples - i : trun_samples;
+
+        if (p->first_flags)
+        {
+            box = full_box_begin(buffer, "trun", 0, 0x000305);  /* data offset, first flags, duration, size */
+            write_u32(buffer, sample_count);
+            write_32(buffer, (int32_t) data_offset);
+            write_u32(buffer, seg_is_sync(p, i) ? 0x02000000 : 0x01010000);
+        }
+        else
+        {
+            box = full_box_begin(buffer, "trun", 0, 0x000701);  /* data offset, duration, size, flags */
+            write_u32(buffer, sample_count);
+            write_32(buffer, (int32_t) data_offset);
+        }
+        for (k = i; k < i + sample_count; k++)
+        {
+            write_u32(buffer, SEG_SAMPLE_DURATION);
+            write_u32(buffer, seg_sample_size(k));
+            if (!p->first_flags)
+            {
+                write_u32(buffer, seg_is_sync(p, k) ? 0x02000000 : 0x01010000);
+            }
+            data_offset += seg_sample_size(k);
+        }
+        box_end(buffer, box);
+    }
+
+    if (p->aux)
+    {
+        write_seg_aux(buffer, p->num_samples, p->num_samples);
+    }
+
+    if (write_traf_boxes != NULL)
+    {
+        write_traf_boxes(buffer, p);
+    }
+    box_end(buffer, traf);
+    box_end(buffer, moof);
+}
+
+/* A demuxer and a track reader, initialized with a moov and optionally a moof */
+typedef struct
+{
+    mp4d_demuxer_ptr_t p_dmux;
+    void *p_dmux_mem[2];
+    mp4d_trackreader_ptr_t p_tr;
+    void *p_tr_mem[2];
+    uint64_t tr_mem_size;
+    buffer_t moov;
+    buffer_t moof;
+} seg_reader_t;
+
+static int
+seg_reader_init_segment(seg_reader_t *r, const buffer_t *segment)
+{
+    uint64_t box_size;
+    uint64_t time_offset = 0;
+
+    if (mp4d_demuxer_parse(r->p_dmux, segment->p_data, segment->size, 1, 0, &box_size) != MP4D_NO_ERROR)
+    {
+        return 1;
+    }
+    return mp4d_trackreader_init_segment(r->p_tr, r->p_dmux, SEG_TRACK_ID,
+                                         SEG_TIME_SCALE, SEG_TIME_SCALE, &time_offset);
+}
+
+/* Initializes the track reader with the moov, and the moof if not empty */
+static int
+seg_reader_init(seg_reader_t *r)
+{
+    uint64_t static_mem_size, dyn_mem_size;
+
+    mp4d_demuxer_query_mem(&static_mem_size, &dyn_mem_size);
+    r->p_dmux_mem[0] = malloc((size_t) static_mem_size);
+    r->p_dmux_mem[1] = dyn_mem_size > 0 ? malloc((size_t) dyn_mem_size) : NULL;
+    mp4d_demuxer_init(&r->p_dmux, r->p_dmux_mem[0], r->p_dmux_mem[1]);
+
+    mp4d_trackreader_query_mem(&r->tr_mem_size, &dyn_mem_size);
+    r->p_tr_mem[0] = malloc((size_t) r->tr_mem_size);
+    r->p_tr_mem[1] = dyn_mem_size > 0 ? malloc((size_t) dyn_mem_size) : NULL;
+    mp4d_trackreader_init(&r->p_tr, r->p_tr_mem[0], r->p_tr_mem[1]);
+
+    if (seg_reader_init_segment(r, &r->moov) != 0)
+    {
+        return 1;
+    }
+    if (r->moof.size > 0)
+    {
+        return seg_reader_init_segment(r, &r->moof);
+    }
+    return 0;
+}
+
+static void
+seg_reader_free(seg_reader_t *r)
+{
+    free(r->p_dmux_mem[0]);
+    free(r->p_dmux_mem[1]);
+    free(r->p_tr_mem[0]);
+    free(r->p_tr_mem[1]);
+    free(r->moov.p_data);
+    free(r->moof.p_data);
+}
+
+#define SEG_DEFAULT_CHECKPOINTS ((uint32_t) -1)  /* as given to mp4d_trackreader_init() */
+
+/** @brief Iterate the GOPs of a segment backwards
+
+    The segment holds the samples in the moov, with or without subs box,
+    or in a moof. The track reader keeps max_checkpoints GOP checkpoints,
+    or the default number.
+ */
+static void
+check_prev_gop(const seg_params_t *p, int fragmented, uint32_t max_checkpoints)
+{
+    seg_reader_t r;
+    void *p_gop_mem = NULL;
+    uint64_t gop_end = p->num_samples;
+    uint32_t num_gops = 0;
+
+    memset(&r, 0, sizeof(r));
+    buffer_init(&r.moov);
+    buffer_init(&r.moof);
+    write_seg_moov(&r.moov, p, fragmented);
+    if (fragmented)
+    {
+        write_seg_moof(&r.moof, p, NULL);
+    }
+    expect( seg_reader_init(&r) == 0 );
+    if (max_checkpoints == 0)
+    {
+        expect( mp4d_trackreader_set_gop_mem(r.p_tr, NULL, 0) == MP4D_NO_ERROR );
+    }
+    else if (max_checkpoints != SEG_DEFAULT_CHECKPOINTS)
+    {
+        p_gop_mem = malloc((size_t) (max_checkpoints * r.tr_mem_size));
+        expect( mp4d_trackreader_set_gop_mem(r.p_tr, p_gop_mem, max_checkpoints * r.tr_mem_size) == MP4D_NO_ERROR );
+    }
+
+    while (1)
+    {
+        uint32_t num_samples;
+        uint64_t gop_start = gop_end;
+        uint32_t i;
+        int err = mp4d_trackreader_prev_gop(r.p_tr, &num_samples);
+
+        if (gop_end == 0)
+        {
+            expect( err == MP4D_E_PREV_SEGMENT );
+            break;
+        }
+        expect( err == MP4D_NO_ERROR );
+        if (err != MP4D_NO_ERROR)
+        {
+            break;
+        }
+
+        /* A GOP starts at a sync sample, or at the first sample */
+        do
+        {
+            gop_start--;
+        } while (gop_start > 0 && !seg_is_sync(p, (uint32_t) gop_start));
+        expect( num_samples == gop_end - gop_start );
+
+        for (i = 0; i < num_samples; i++)
+        {
+            mp4d_sampleref_t sample;
+            uint32_t index = (uint32_t) gop_start + i;
+
+            expect( mp4d_trackreader_next_sample(r.p_tr, &sample) == MP4D_NO_ERROR );
+            expect( sample.size == seg_sample_size(index) );
+            expect( sample.dts == (uint64_t) index * SEG_SAMPLE_DURATION );
+            expect( ((sample.flags >> 16) & 1) == (uint32_t) !seg_is_sync(p, index) );  /* sample_is_non_sync_sample */
+            if (p->subs && !fragmented)
+            {
+                expect( sample.num_subsamples == 2 );
+            }
+        }
+        gop_end = gop_start;
+        num_gops++;
+    }
+    expect( gop_end == 0 );
+    expect( num_gops > 0 );
+
+    seg_reader_free(&r);
+    free(p_gop_mem);
+}
+
+static void
+test_prev_gop(void)
+{
+    static const seg_params_t params[] =
+    {
+        {23, 2, 5, 0, 0, 0, 0},  /* leading non-sync samples */
+        {23, 0, 5, 1, 0, 0, 0},
+        {23, 2, 5, 1, 0, 0, 0},
+        {7, 0, 0, 0, 0, 0, 0},   /* all samples are sync samples */
+        {7, 0, 0, 1, 0, 0, 0},
+        {1, 0, 1, 0, 0, 0, 0},
+    };
+    static const uint32_t max_checkpoints[] = {0, 1, 2, 3, 64, SEG_DEFAULT_CHECKPOINTS};
+    uint32_t i, k;
+
+    for (i = 0; i < sizeof(params) / sizeof(params[0]); i++)
+    {
+        for (k = 0; k < sizeof(max_checkpoints) / sizeof(max_checkpoints[0]); k++)
+        {
+            check_prev_gop(&params[i], 0, max_checkpoints[k]);
+            check_prev_gop(&params[i], 1, max_checkpoints[k]);
+        }
+    }
+}
+
+/* Many GOPs, more than fit into the checkpoints */
+static void
+test_prev_gop_many(void)
+{
+    static const seg_params_t params[] =
+    {
+        {4000, 3, 4, 0, 0, 0, 0},
+        {4000, 0, 7, 1, 0, 0, 0},
+    };
+    static const uint32_t max_checkpoints[] = {2, 5, SEG_DEFAULT_CHECKPOINTS};
+    uint32_t i, k;
+
+    for (i = 0; i < sizeof(params) / sizeof(params[0]); i++)
+    {
+        for (k = 0; k < sizeof(max_checkpoints) / sizeof(max_checkpoints[0]); k++)
+        {
+            check_prev_gop(&params[i], 1, max_checkpoints[k]);
+            if (params[i].subs)
+            {
+                check_prev_gop(&params[i], 0, max_checkpoints[k]);
+            }
+        }
+    }
+}
+
+/* The fields of a sample that the track reader sets */
+static int
+seg_sample_equal(const mp4d_sampleref_t *a, const mp4d_sampleref_t *b)
+{
+    return a->dts == b->dts && a->cts == b->cts && a->pts == b->pts &&
+           a->flags == b->flags && a->pos == b->pos && a->size == b->size &&
+           a->num_subsamples == b->num_subsamples &&
+           a->auxdata[0].datatype == b->auxdata[0].datatype &&
+           a->auxdata[0].pos == b->auxdata[0].pos &&
+           a->auxdata[0].size == b->auxdata[0].size;
+}
+
+/** @brief Skip samples after reading some, in all combinations
+
+    mp4d_trackreader_skip(n) followed by mp4d_trackreader_next_sample() returns
+    the same sample as n + 1 calls of mp4d_trackreader_next_sample().
+ */
+static void
+check_skip(const seg_params_t *p, int fragmented)
+{
+    seg_reader_t r;
+    const buffer_t *p_segment;
+    mp4d_sampleref_t *samples = malloc(p->num_samples * sizeof(*samples));
+    uint32_t i, k, n;
+
+    memset(&r, 0, sizeof(r));
+    buffer_init(&r.moov);
+    buffer_init(&r.moof);
+    write_seg_moov(&r.moov, p, fragmented);
+    if (fragmented)
+    {
+        write_seg_moof(&r.moof, p, NULL);
+    }
+    expect( seg_reader_init(&r) == 0 );
+    p_segment = fragmented ? &r.moof : &r.moov;
+
+    memset(samples, 0, p->num_samples * sizeof(*samples));
+    for (i = 0; i < p->num_samples; i++)
+    {
+        expect( mp4d_trackreader_next_sample(r.p_tr, &samples[i]) == MP4D_NO_ERROR );
+        expect( samples[i].size == seg_sample_size(i) );
+        expect( samples[i].auxdata[0].size == (p->aux ? seg_aux_size(i) : 0) );
+    }
+
+    for (k = 0; k <= p->num_samples; k++)
+    {
+        for (n = 0; k + n <= p->num_samples; n++)
+        {
+            mp4d_sampleref_t sample;
+
+            expect( seg_reader_init_segment(&r, p_segment) == MP4D_NO_ERROR );
+            for (i = 0; i < k; i++)
+            {
+                expect( mp4d_trackreader_next_sample(r.p_tr, &sample) == MP4D_NO_ERROR );
+            }
+            expect( mp4d_trackreader_skip(r.p_tr, n) == MP4D_NO_ERROR );
+
+            memset(&sample, 0, sizeof(sample));
+            if (k + n < p->num_samples)
+            {
+                expect( mp4d_trackreader_next_sample(r.p_tr, &sample) == MP4D_NO_ERROR );
+                expect( seg_sample_equal(&sample, &samples[k + n]) );
+            }
+            else
+            {
+                expect( mp4d_trackreader_next_sample(r.p_tr, &sample) == MP4D_E_NEXT_SEGMENT );
+            }
+        }
+    }
+
+    seg_reader_free(&r);
+    free(samples);
+}
+
+static void
+test_skip(void)
+{
+    static const seg_params_t moov_params[] =
+    {
+        {13, 1, 4, 0, 0, 0, 0},
+        {13, 1, 4, 1, 0, 0, 0},  /* subs */
+        {13, 0, 3, 0, 0, 1, 0},  /* sample aux info, one saio entry per chunk */
+        {13, 0, 3, 1, 0, 1, 0},
+    };
+    static const seg_params_t moof_params[] =
+    {
+        {13, 1, 4, 0, 5, 0, 0},  /* skipping over trun boundaries */
+        {13, 1, 4, 0, 5, 1, 0},
+        {13, 0, 0, 0, 1, 1, 0},  /* one sample per trun */
+        {13, 2, 5, 0, 0, 1, 0},
+    };
+    uint32_t i;
+
+    for (i = 0; i < sizeof(moov_params) / sizeof(moov_params[0]); i++)
+    {
+        check_skip(&moov_params[i], 0);
+    }
+    for (i = 0; i < sizeof(moof_params) / sizeof(moof_params[0]); i++)
+    {
+        check_skip(&moof_params[i], 1);
+    }
+}
+
+/** @brief Find the sync samples after reading some samples, for all starting points
+
+    Each call of mp4d_trackreader_next_sync_sample() returns the first sync sample
+    after the samples read before, until none is left in the segment.
+ */
+static void
+check_next_sync_sample(const seg_params_t *p, int fragmented)
+{
+    seg_reader_t r;
+    const buffer_t *p_segment;
+    uint32_t i, k;
+
+    memset(&r, 0, sizeof(r));
+    buffer_init(&r.moov);
+    buffer_init(&r.moof);
+    write_seg_moov(&r.moov, p, fragmented);
+    if (fragmented)
+    {
+        write_seg_moof(&r.moof, p, NULL);
+    }
+    expect( seg_reader_init(&r) == 0 );
+    p_segment = fragmented ? &r.moof : &r.moov;
+
+    for (k = 0; k <= p->num_samples; k++)
+    {
+        mp4d_sampleref_t sample;
+        uint32_t index = k;
+
+        expect( seg_reader_init_segment(&r, p_segment) == MP4D_NO_ERROR );
+        for (i = 0; i < k; i++)
+        {
+            expect( mp4d_trackreader_next_sample(r.p_tr, &sample) == MP4D_NO_ERROR );
+        }
+
+        while (1)
+        {
+            int err = mp4d_trackreader_next_sync_sample(r.p_tr, &sample);
+
+            while (index < p->num_samples && !seg_is_sync(p, index))
+            {
+                index++;
+            }
+            if (index == p->num_samples)
+            {
+                expect( err == MP4D_E_NEXT_SEGMENT );
+                break;
+            }
+            expect( err == MP4D_NO_ERROR );
+            if (err != MP4D_NO_ERROR)
+            {
+                break;
+            }
+            expect( sample.size == seg_sample_size(index) );
+            expect( sample.dts == (uint64_t) index * SEG_SAMPLE_DURATION );
+            expect( ((sample.flags >> 16) & 1) == 0 );  /* sample_is_non_sync_sample */
+            index++;
+        }
+    }
+
+    /* The first sync sample presented at or after each time stamp, pts == dts */
+    for (k = 0; k <= p->num_samples; k++)
+    {
+        mp4d_sampleref_t sample;
+        uint32_t index = k;
+        int err;
+
+        expect( seg_reader_init_segment(&r, p_segment) == MP4D_NO_ERROR );
+        err = mp4d_trackreader_next_sync_sample_at(r.p_tr, (int64_t) k * SEG_SAMPLE_DURATION - (k > 0), &sample);
+        while (index < p->num_samples && !seg_is_sync(p, index))
+        {
+            index++;
+        }
+        if (index == p->num_samples)
+        {
+            expect( err == MP4D_E_NEXT_SEGMENT );
+            continue;
+        }
+        expect( err == MP4D_NO_ERROR );
+        expect( sample.size == seg_sample_size(index) );
+        expect( sample.dts == (uint64_t) index * SEG_SAMPLE_DURATION );
+    }
+
+    seg_reader_free(&r);
+}
+
+static void
+test_next_sync_sample(void)
+{
+    static const seg_params_t moov_params[] =
+    {
+        {13, 1, 4, 0, 0, 0, 0},   /* stss */
+        {13, 1, 4, 1, 0, 1, 0},
+        {13, 0, 0, 0, 0, 0, 0},   /* no stss, all samples are sync samples */
+        {13, 0, 12, 0, 0, 0, 0},  /* the last sample is a sync sample */
+        {13, 3, 20, 0, 0, 0, 0},  /* one sync sample */
+    };
+    static const seg_params_t moof_params[] =
+    {
+        {13, 1, 4, 0, 0, 0, 0},   /* per-sample flags */
+        {13, 1, 4, 0, 5, 1, 0},   /* sync samples at and after trun boundaries */
+        {13, 0, 12, 0, 5, 0, 0},  /* the last sample is a sync sample, in the last trun */
+        {12, 0, 4, 0, 4, 0, 1},   /* first_sample_flags, sync */
+        {12, 0, 8, 0, 4, 0, 1},   /* first_sample_flags, also non-sync */
+        {13, 0, 0, 0, 1, 0, 1},   /* first_sample_flags, one sample per trun */
+    };
+    static const seg_params_t next_params[] =
+    {
+        {6, 0, 20, 0, 0, 0, 0},   /* one sync sample at the start */
+        {6, 2, 20, 0, 3, 0, 0},   /* one sync sample, in the second trun */
+    };
+    seg_reader_t r;
+    buffer_t moof;
+    mp4d_sampleref_t sample;
+    uint32_t i;
+
+    for (i = 0; i < sizeof(moov_params) / sizeof(moov_params[0]); i++)
+    {
+        check_next_sync_sample(&moov_params[i], 0);
+    }
+    for (i = 0; i < sizeof(moof_params) / sizeof(moof_params[0]); i++)
+    {
+        check_next_sync_sample(&moof_params[i], 1);
+    }
+
+    /* No more sync sample in the traf of this fragment, the next is in the traf of the next fragment */
+    memset(&r, 0, sizeof(r));
+    buffer_init(&r.moov);
+    buffer_init(&r.moof);
+    buffer_init(&moof);
+    write_seg_moov(&r.moov, &next_params[0], 1);
+    write_seg_moof(&r.moof, &next_params[0], NULL);
+    write_seg_moof(&moof, &next_params[1], NULL);
+    expect( seg_reader_init(&r) == 0 );
+
+    expect( mp4d_trackreader_next_sync_sample(r.p_tr, &sample) == MP4D_NO_ERROR );
+    expect( sample.size == seg_sample_size(0) );
+    expect( mp4d_trackreader_next_sync_sample(r.p_tr, &sample) == MP4D_E_NEXT_SEGMENT );
+
+    expect( seg_reader_init_segment(&r, &moof) == MP4D_NO_ERROR );
+    expect( mp4d_trackreader_next_sync_sample(r.p_tr, &sample) == MP4D_NO_ERROR );
+    expect( sample.size == seg_sample_size(2) );
+    expect( sample.dts == 2 * SEG_SAMPLE_DURATION );
+    expect( mp4d_trackreader_next_sync_sample(r.p_tr, &sample) == MP4D_E_NEXT_SEGMENT );
+
+    free(moof.p_data);
+    seg_reader_free(&r);
+}
+
+#define SEG_PIFF_ALGORITHM_ID 2  /* AES-CBC */
+#define SEG_PIFF_IV_SIZE 16
+
+static const uint8_t seg_default_kid[16] =
+    {0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f};
+static const uint8_t seg_piff_kid[16] =
+    {0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f};
+
+/* PIFF 'senc' box overriding the AlgorithmID, IV size and KID of the track, IV i + 1 for sample i */
+static void
+write_piff_senc(buffer_t *buffer, const seg_params_t *p)
+{
+    static const char piff_senc[] = "\xA2\x39\x4F\x52\x5A\x9B\x4f\x14\xA2\x44\x6C\x42\x7C\x64\x8D\xF4";
+    size_t box = box_begin(buffer, "uuid");
+    uint32_t i, k;
+
+    for (k = 0; k < 16; k++)
+    {
+        write_u8(buffer, (uint8_t) piff_senc[k]);
+    }
+    write_u8(buffer, 0);      /* version */
+    write_u24(buffer, 0x01);  /* flags: override */
+    write_u24(buffer, SEG_PIFF_ALGORITHM_ID);
+    write_u8(buffer, SEG_PIFF_IV_SIZE);
+    for (k = 0; k < 16; k++)
+    {
+        write_u8(buffer, seg_piff_kid[k]);
+    }
+    write_u32(buffer, p->num_samples);
+    for (i = 0; i < p->num_samples; i++)
+    {
+        for (k = 0; k < SEG_PIFF_IV_SIZE; k++)
+        {
+            write_u8(buffer, (uint8_t) (i + 1));
+        }
+    }
+    box_end(buffer, box);
+}
+
+/* The PIFF 'senc' box of a fragment overrides the defaults of 'tenc' until the next fragment */
+static void
+test_piff_senc_override(void)
+{
+    static const seg_params_t params = {5, 0, 0, 0, 0, 0, 0};
+    seg_reader_t r;
+    buffer_t moof;
+    uint8_t default_kid[16];
+    uint32_t algorithm_ID;
+    uint8_t iv_size;
+    uint8_t kid[16];
+    uint32_t i;
+
+    memset(&r, 0, sizeof(r));
+    buffer_init(&r.moov);
+    buffer_init(&r.moof);
+    buffer_init(&moof);
+    write_seg_moov(&r.moov, &params, 1);
+    write_seg_moof(&moof, &params, write_piff_senc);
+    expect( seg_reader_init(&r) == 0 );
+
+    memcpy(default_kid, seg_default_kid, sizeof(default_kid));
+    expect( mp4d_trackreader_set_tenc(r.p_tr, 1, 8, default_kid) == MP4D_NO_ERROR );
+    expect( mp4d_trackreader_get_cur_tenc(r.p_tr, &algorithm_ID, &iv_size, kid) == MP4D_NO_ERROR );
+    expect( algorithm_ID == 1 && iv_size == 8 );
+    expect( memcmp(kid, seg_default_kid, 16) == 0 );
+
+    expect( seg_reader_init_segment(&r, &moof) == MP4D_NO_ERROR );
+    expect( mp4d_trackreader_get_cur_tenc(r.p_tr, &algorithm_ID, &iv_size, kid) == MP4D_NO_ERROR );
+    expect( algorithm_ID == SEG_PIFF_ALGORITHM_ID && iv_size == SEG_PIFF_IV_SIZE );
+    expect( memcmp(kid, seg_piff_kid, 16) == 0 );
+
+    for (i = 0; i < params.num_samples; i++)
+    {
+        mp4d_sampleref_t sample;
+        const uint8_t *p_iv;
+
+        expect( mp4d_trackreader_next_sample(r.p_tr, &sample) == MP4D_NO_ERROR );
+        expect( sample.auxdata[0].datatype == 0x70696666 );  /* piff */
+        expect( sample.auxdata[0].size == SEG_PIFF_IV_SIZE );
+        p_iv = (const uint8_t *) (intptr_t) sample.auxdata[0].pos;
+        expect( p_iv[0] == i + 1 && p_iv[SEG_PIFF_IV_SIZE - 1] == i + 1 );
+    }
+    expect( mp4d_trackreader_get_cur_tenc(r.p_tr, &algorithm_ID, &iv_size, kid) == MP4D_NO_ERROR );
+    expect( algorithm_ID == SEG_PIFF_ALGORITHM_ID && memcmp(kid, seg_piff_kid, 16) == 0 );
+
+    /* A fragment without PIFF 'senc' box is back to the defaults */
+    free(moof.p_data);
+    buffer_init(&moof);
+    write_seg_moof(&moof, &params, NULL);
+    expect( seg_reader_init_segment(&r, &moof) == MP4D_NO_ERROR );
+    expect( mp4d_trackreader_get_cur_tenc(r.p_tr, &algorithm_ID, &iv_size, kid) == MP4D_NO_ERROR );
+    expect( algorithm_ID == 1 && iv_size == 8 );
+    expect( memcmp(kid, seg_default_kid, 16) == 0 );
+
+    free(moof.p_data);
+    seg_reader_free(&r);
+}
+
+int main(void)
+{
+    TEST_START("Trackreader");
+
+    /* stts, ctts */
+    test_tts_not_init();
+    test_tts_bad_version();
+    test_tts_empty();
+    test_tts_one_sample();
+    test_tts_one_entry();
+    test_tts_multiple_entries();
+    test_tts_multiple_entries_stts_next();
+    test_tts_multiple_entries_ctts_next();
+    test_tts_first_empty();
+    test_tts_seek();
+    test_tts_seek_nodelta();
+    test_tts_seek_next();
+    test_tts_skip();
+    test_tts_rewind();
+
+    /* stsz, stz2 */
+    test_stsz_not_init();
+    test_stsz_s0_empty();
+    test_stsz_s0_single();
+    test_stsz_s0_multiple();
+    test_stsz_s1_empty();
+    test_stsz_s1_single();
+    test_stsz_s1_multiple();
+    test_stz2_invalid();
+    test_stz2_4();
+    test_stz2_8();
+    test_stz2_16();
+    test_stz2_4_skip();
+    test_stz2_4_rewind();
+
+    /* stsc */
+    test_stsc_not_init();
+    test_stsc_empty();
+    test_stsc_empty_entries();
+    test_stsc_one_entry_1();
+    test_stsc_one_entry_2();
+    test_stsc_multiple_entries();
+    test_stsc_multiple_with_empty();
+    test_stsc_skip();
+    test_stsc_rewind();
+    test_stsc_first_chunk_not_ascending();
+
+    /* stco, co64 */
+    test_co_not_init();
+    test_stco_empty();
+    test_stco_single();
+    test_stco_multiple();
+    test_co64_multiple();
+
+    /* stss */
+    test_stss_no_box();
+    test_stss_illegal_order();
+    test_stss_empty();
+    test_stss_single_first();
+    test_stss_single_not_first();
+    test_stss_multiple();
+    test_stss_all();
+    test_stss_peek_sync();
+    test_stss_rewind();
+
+    /* edit list */
+    test_elst_empty();
+    test_elst_one_entry_1();
+    test_elst_one_entry_2();
     test_elst_one_entry_offset();
     test_elst_multiple();
     test_elst_empty_dwell();
     test_elst_time_scale();
+    test_elst_many();
+    test_elst_overlap();
 
     /* sub-sample */
     test_subs_no_box();
@@ -2409,6 +4185,8 @@ int main(void)
     test_subs_first_sample();
     test_subs_multiple_entries();
     test_subs_version_1();
+    test_subs_skip();
+    test_subs_get_sizes();
 
     /* sample aux size */
     test_saiz_flag_0();
@@ -2425,5 +4203,22 @@ int main(void)
     test_saio_one_entry();
     test_saio_multiple_entries();
     test_saio_multiple_entries_version_1();
+
+    /* sample encryption */
+    test_senc_constant_iv();
+    test_senc_decode_subsamples();
+
+    /* track fragment run */
+    test_trun_decode();
+
+    /* moof */
+    test_moof_traf_index();
+
+    /* segments */
+    test_prev_gop();
+    test_prev_gop_many();
+    test_skip();
+    test_next_sync_sample();
+    test_piff_senc_override();
     TEST_END(nfailed, ntests);
 }
@@ -317,6 +317,137 @@ test_bloc_parse
     return err;
 }
 
+/* Stream: 'ftyp', 'mdat' with 20 bytes payload, 64-bit 'free' without payload, 'ftyp' */
+static const unsigned char push_stream[] = {
+    0x00, 0x00, 0x00, 0x18, 'f', 't', 'y', 'p',
+    'a', 'b', 'c', 'd', 0x01, 0x02, 0x03, 0x04,
+    'e', 'f', 'g', 'h', 'm', 'n', 'o', 'p',
+    0x00, 0x00, 0x00, 0x1c, 'm', 'd', 'a', 't',
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9,
+    10, 11, 12, 13, 14, 15, 16, 17, 18, 19,
+    0x00, 0x00, 0x00, 0x01, 'f', 'r', 'e', 'e',
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10,
+    0x00, 0x00, 0x00, 0x14, 'f', 't', 'y', 'p',
+    'q', 'r', 's', 't', 0x00, 0x00, 0x00, 0x05,
+    'u', 'v', 'w', 'x'
+};
+
+static int
+test_pusher
+(
+    mp4d_demuxer_ptr_t demuxer_ptr,
+    uint64_t chunk_size,
+    const char *name
+)
+{
+    static const char *exp_types[] = {"ftyp", "mdat", "free", "ftyp"};
+    static const uint64_t exp_offsets[] = {0, 24, 52, 68};
+    static const uint64_t exp_sizes[] = {24, 28, 16, 20};
+    uint64_t mem_size;
+    void *mem;
+    mp4d_pusher_ptr_t p_push;
+    uint64_t pos = 0;
+    uint32_t num_boxes = 0;
+    uint64_t data_offset = 32;
+    int err = 0;
+
+    mp4d_pusher_query_mem(32, &mem_size);
+    mem = malloc((size_t) mem_size);
+    mp4d_pusher_init(&p_push, demuxer_ptr, 32, mem);
+
+    while (pos < sizeof(push_stream) && !err)
+    {
+        uint64_t size = sizeof(push_stream) - pos;
+        mp4d_push_event_t ev;
+
+        if (size > chunk_size)
+        {
+            size = chunk_size;
+        }
+        do
+        {
+            uint64_t consumed;
+            mp4d_error_t res;
+
+            res = (mp4d_error_t) mp4d_pusher_push(p_push, push_stream + pos, size,
+                                                   pos + size == sizeof(push_stream), &consumed, &ev);
+            if (res != MP4D_NO_ERROR) {
+                printf ("%s: return value (%d) not as expected (0)\n", name, res);
+                err |= 1;
+                break;
+            }
+            if (ev.type == MP4D_PUSH_BOX) {
+                if (num_boxes >= 4 ||
+                    !MP4D_FOURCC_EQ(ev.box_type, exp_types[num_boxes]) ||
+                    ev.offset != exp_offsets[num_boxes] ||
+                    ev.size != exp_sizes[num_boxes]) {
+                    printf ("%s: box %u not as expected\n", name, num_boxes);
+                    err |= 2;
+                }
+                else if (num_boxes == 0 && size == sizeof(push_stream) && ev.p_data != push_stream) {
+                    printf ("%s: box in a single chunk was copied\n", name);
+                    err |= 4;
+                }
+                num_boxes++;
+            }
+            else if (ev.type == MP4D_PUSH_DATA) {
+                if (ev.offset != data_offset || ev.offset + ev.size > 52 ||
+                    memcmp(ev.p_data, push_stream + ev.offset, (size_t) ev.size)) {
+                    printf ("%s: data at offset %" PRIu64 " not as expected\n", name, ev.offset);
+                    err |= 8;
+                }
+                data_offset += ev.size;
+            }
+            pos += consumed;
+            size -= consumed;
+        } while (ev.type != MP4D_PUSH_NONE);
+    }
+
+    if (num_boxes != 4 || data_offset != 52) {
+        printf ("%s: got %u boxes and %" PRIu64 " bytes of data\n", name, num_boxes, data_offset - 32);
+        err |= 16;
+    }
+    if (!err) {
+        err |= test_ftyp_parse(demuxer_ptr, MP4D_NO_ERROR, "qrst", 5, 1, "uvwx", name) << 5;
+    }
+
+    free(mem);
+
+    return err;
+}
+
+/* Push the first size bytes of push_stream as a single chunk ending at the end of the file */
+static mp4d_error_t
+test_pusher_truncated
+(
+    mp4d_demuxer_ptr_t demuxer_ptr,
+    uint64_t size
+)
+{
+    uint64_t mem_size;
+    void *mem;
+    mp4d_pusher_ptr_t p_push;
+    uint64_t pos = 0;
+    mp4d_push_event_t ev;
+    mp4d_error_t res;
+
+    mp4d_pusher_query_mem(32, &mem_size);
+    mem = malloc((size_t) mem_size);
+    mp4d_pusher_init(&p_push, demuxer_ptr, 32, mem);
+
+    do
+    {
+        uint64_t consumed;
+
+        res = (mp4d_error_t) mp4d_pusher_push(p_push, push_stream + pos, size - pos, 1, &consumed, &ev);
+        pos += consumed;
+    } while (res == MP4D_NO_ERROR && ev.type != MP4D_PUSH_NONE);
+
+    free(mem);
+
+    return res;
+}
+
 static
 void update_counts(int err, int *nfailed, int *ntests)
 {
@@ -1093,6 +1224,57 @@ main(void)
         
     }    
     
+    {
+        static const unsigned char moov_header[] = {
+            0x00, 0x00, 0x00, 0x40, 'm', 'o', 'o', 'v'
+        };
+        uint64_t chunk_size;
+        char name[64];
+        uint64_t mem_size, consumed;
+        void *mem;
+        mp4d_pusher_ptr_t p_push;
+        mp4d_push_event_t ev;
+        mp4d_error_t res;
+
+        for (chunk_size = 1; chunk_size <= sizeof(push_stream); chunk_size++)
+        {
+            sprintf(name, "push parser with chunk size %" PRIu64, chunk_size);
+            err = test_pusher(p_dmux, chunk_size, name);
+            update_counts(err, &nfailed, &ntests);
+        }
+
+        /* Inside the 'ftyp' (buffered), the 'mdat' header, the 'mdat' payload (streamed), and after a box */
+        {
+            static const uint64_t sizes[] = {20, 28, 40, 52};
+            static const mp4d_error_t exp_res[] = {MP4D_E_INVALID_ATOM, MP4D_E_INVALID_ATOM,
+                                                   MP4D_E_INVALID_ATOM, MP4D_NO_ERROR};
+            uint32_t i;
+
+            for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+            {
+                sprintf(name, "push parser with input ending after %" PRIu64 " bytes", sizes[i]);
+                res = test_pusher_truncated(p_dmux, sizes[i]);
+                err = (res != exp_res[i]);
+                if (err) {
+                    printf ("%s: return value (%d) not as expected (%d)\n", name, res, exp_res[i]);
+                }
+                update_counts(err, &nfailed, &ntests);
+            }
+        }
+
+        testname = "push parser with 'moov' larger than the buffer";
+        mp4d_pusher_query_mem(32, &mem_size);
+        mem = malloc((size_t) mem_size);
+        mp4d_pusher_init(&p_push, p_dmux, 32, mem);
+        res = (mp4d_error_t) mp4d_pusher_push(p_push, moov_header, sizeof(moov_header), 0, &consumed, &ev);
+        err = (res != MP4D_E_BUFFER_TOO_SMALL);
+        if (err) {
+            printf ("%s: return value (%d) not as expected (%d)\n", testname, res, MP4D_E_BUFFER_TOO_SMALL);
+        }
+        update_counts(err, &nfailed, &ntests);
+        free(mem);
+    }
+
     if (dyn_mem_ptr)
         free(dyn_mem_ptr);
     if (static_mem_ptr)
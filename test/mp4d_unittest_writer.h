@@ -0,0 +1,176 @@
+/************************************************************************************************************
+ * Copyright (c) 2017, Dolby Laboratories Inc.
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ *    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+ *    promote products derived from this software without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ ************************************************************************************************************/
+
+/**
+ * @file
+ * @brief API to write atoms and movies to memory, shared by the unit tests
+ */
+#ifndef MP4D_UNITTEST_WRITER_H
+#define MP4D_UNITTEST_WRITER_H
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "mp4d_types.h"
+
+typedef struct
+{
+    unsigned char *p_data;
+    size_t size;
+    size_t alloc;
+} buffer_t;
+
+static
+void buffer_init(buffer_t *buffer)
+{
+    buffer->p_data = NULL;
+    buffer->size = 0;
+    buffer->alloc = 0;
+}
+
+static
+void buffer_grow(buffer_t *buffer, size_t size)
+{
+    buffer->size += size;
+    while (buffer->size > buffer->alloc)
+    {
+        buffer->alloc *= 2;
+        buffer->alloc += 1;
+        buffer->p_data = realloc(buffer->p_data, buffer->alloc);
+    }
+}
+
+static
+void put_u32(unsigned char *p, uint32_t u)
+{
+    p[0] = (u>>24) & 0xFF;
+    p[1] = (u>>16) & 0xFF;
+    p[2] = (u>>8) & 0xFF;
+    p[3] = (u>>0) & 0xFF;
+}
+
+static
+void write_u64(buffer_t *buffer, uint64_t u)
+{
+    buffer_grow(buffer, sizeof(u));
+
+    put_u32(buffer->p_data + buffer->size - 8, (uint32_t) (u>>32));
+    put_u32(buffer->p_data + buffer->size - 4, (uint32_t) u);
+}
+
+static
+void write_u32(buffer_t *buffer, uint32_t u)
+{
+    buffer_grow(buffer, sizeof(u));
+
+    put_u32(buffer->p_data + buffer->size - 4, u);
+}
+
+static
+void write_u24(buffer_t *buffer, uint32_t u)
+{
+    buffer_grow(buffer, 3);
+
+    buffer->p_data[buffer->size - 1] = (u>>0) & 0xFF;
+    buffer->p_data[buffer->size - 2] = (u>>8) & 0xFF;
+    buffer->p_data[buffer->size - 3] = (u>>16) & 0xFF;
+}
+
+static
+void write_u16(buffer_t *buffer, uint16_t u)
+{
+    buffer_grow(buffer, sizeof(u));
+
+    buffer->p_data[buffer->size - 1] = (u>>0) & 0xFF;
+    buffer->p_data[buffer->size - 2] = (u>>8) & 0xFF;
+}
+
+static
+void write_u8(buffer_t *buffer, uint8_t u)
+{
+    buffer_grow(buffer, sizeof(u));
+
+    buffer->p_data[buffer->size - 1] = u;
+}
+
+/* Writes size bytes from p_bytes, or size zero bytes if p_bytes is NULL */
+static
+void write_bytes(buffer_t *buffer, const void *p_bytes, size_t size)
+{
+    buffer_grow(buffer, size);
+    if (p_bytes != NULL)
+    {
+        memcpy(buffer->p_data + buffer->size - size, p_bytes, size);
+    }
+    else
+    {
+        memset(buffer->p_data + buffer->size - size, 0, size);
+    }
+}
+
+static
+void write_fourcc(buffer_t *buffer, const char *type)
+{
+    write_bytes(buffer, type, 4);
+}
+
+/* Write a box header, returns the position of the box, see box_end() */
+static
+size_t box_begin(buffer_t *buffer, const char *type)
+{
+    size_t pos = buffer->size;
+
+    write_u32(buffer, 0);  /* size, see box_end() */
+    write_fourcc(buffer, type);
+
+    return pos;
+}
+
+static
+size_t full_box_begin(buffer_t *buffer, const char *type, uint8_t version, uint32_t flags)
+{
+    size_t pos = box_begin(buffer, type);
+
+    write_u8(buffer, version);
+    write_u24(buffer, flags);
+
+    return pos;
+}
+
+static
+void box_end(buffer_t *buffer, size_t pos)
+{
+    put_u32(buffer->p_data + pos, (uint32_t) (buffer->size - pos));
+}
+
+/* The unity matrix of mvhd and tkhd */
+static
+void write_matrix(buffer_t *buffer)
+{
+    write_u32(buffer, 0x00010000); write_u32(buffer, 0); write_u32(buffer, 0);
+    write_u32(buffer, 0); write_u32(buffer, 0x00010000); write_u32(buffer, 0);
+    write_u32(buffer, 0); write_u32(buffer, 0); write_u32(buffer, 0x40000000);
+}
+
+#endif
@@ -0,0 +1,242 @@
+#!/bin/sh
+#
+# Compares the trackreader footprint profiles (MP4D_TRACKREADER_PROFILE_*):
+# for each profile, the library core is compiled with that profile, and all
+# samples of all tracks of the inputs are read from memory with it.
+#
+# Usage: trackreader_profile_benchmark.sh <input.mp4> [input.mp4...] [runs]
+#
+# e.g.   trackreader_profile_benchmark.sh fragmented.mp4 progressive.mp4 5
+#
+# For each profile and input, the bytes per trackreader instance
+# (mp4d_trackreader_query_mem()) and the best sample throughput of the runs
+# (each run reads the input repeatedly for 0.2 s) are reported. An input
+# which the profile cannot read is reported as such.
+# The compiler is $CC (default cc).
+
+set -e
+
+if [ $# -lt 1 ]; then
+    sed -n '3,15p' "$0" | sed 's/^# \{0,1\}//'
+    exit 1
+fi
+
+runs=3
+inputs=
+for arg in "$@"; do
+    if [ -f "$arg" ]; then
+        inputs="$inputs $arg"
+    else
+        runs=$arg
+    fi
+done
+
+base=$(cd "$(dirname "$0")/.." && pwd)
+cc=${CC:-cc}
+
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+
+cat > "$out/bench.c" << 'EOF'
+#include "mp4d_demux.h"
+#include "mp4d_trackreader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define MAX_TRACKS 16
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* The trackreader needs the IV size of 'tenc' to read 'senc' */
+static void
+set_tenc(mp4d_demuxer_ptr_t p_dmux, uint32_t stream_num, const mp4d_stream_info_t *p_info,
+         mp4d_trackreader_ptr_t p_tr)
+{
+    mp4d_sampleentry_t entry;
+    mp4d_crypt_info_t *p_crypt = NULL;
+
+    if (p_info->num_dsi == 0 || mp4d_demuxer_get_sampleentry(p_dmux, stream_num, 1, &entry) != MP4D_NO_ERROR)
+    {
+        return;
+    }
+    if (MP4D_FOURCC_EQ(p_info->hdlr, "vide"))
+    {
+        p_crypt = &entry.vide.crypt_info;
+    }
+    else if (MP4D_FOURCC_EQ(p_info->hdlr, "soun"))
+    {
+        p_crypt = &entry.soun.crypt_info;
+    }
+    if (p_crypt != NULL)
+    {
+        mp4d_trackreader_set_tenc(p_tr, p_crypt->method, p_crypt->iv_size, p_crypt->key_id);
+    }
+}
+
+/* Reads all samples of all tracks, returns 0 or the first error */
+static int
+read_all(mp4d_demuxer_ptr_t p_dmux, mp4d_trackreader_ptr_t *p_tr,
+         const unsigned char *buf, uint64_t size, uint64_t *p_samples)
+{
+    uint32_t track_ID[MAX_TRACKS];
+    uint32_t time_scale[MAX_TRACKS];
+    uint32_t movie_time_scale = 0;
+    uint32_t num_tracks = 0;
+    uint64_t offset = 0;
+
+    while (offset < size)
+    {
+        uint64_t box_size = 0;
+        mp4d_fourcc_t type;
+        uint32_t i;
+        int err;
+
+        err = mp4d_demuxer_parse(p_dmux, buf + offset, size - offset, 1, offset, &box_size);
+        if (err != MP4D_NO_ERROR || box_size == 0)
+        {
+            return err != MP4D_NO_ERROR ? err : MP4D_E_INVALID_ATOM;
+        }
+        mp4d_demuxer_get_type(p_dmux, &type);
+        if (MP4D_FOURCC_EQ(type, "moov"))
+        {
+            mp4d_movie_info_t movie_info;
+
+            mp4d_demuxer_get_movie_info(p_dmux, &movie_info);
+            movie_time_scale = movie_info.time_scale;
+            num_tracks = movie_info.num_streams < MAX_TRACKS ? movie_info.num_streams : MAX_TRACKS;
+            for (i = 0; i < num_tracks; i++)
+            {
+                mp4d_stream_info_t stream_info;
+
+                mp4d_demuxer_get_stream_info(p_dmux, i, &stream_info);
+                track_ID[i] = stream_info.track_id;
+                time_scale[i] = stream_info.time_scale;
+                set_tenc(p_dmux, i, &stream_info, p_tr[i]);
+            }
+        }
+        if (MP4D_FOURCC_EQ(type, "moov") || MP4D_FOURCC_EQ(type, "moof"))
+        {
+            for (i = 0; i < num_tracks; i++)
+            {
+                const uint64_t zero = 0;
+                mp4d_sampleref_t sample;
+
+                err = mp4d_trackreader_init_segment(p_tr[i], p_dmux, track_ID[i], movie_time_scale,
+                                                    time_scale[i], MP4D_FOURCC_EQ(type, "moov") ? &zero : NULL);
+                if (err == MP4D_E_TRACK_NOT_FOUND)
+                {
+                    continue;
+                }
+                if (err != MP4D_NO_ERROR)
+                {
+                    return err;
+                }
+                while ((err = mp4d_trackreader_next_sample(p_tr[i], &sample)) == MP4D_NO_ERROR)
+                {
+                    (*p_samples)++;
+                }
+                if (err != MP4D_E_NEXT_SEGMENT)
+                {
+                    return err;
+                }
+            }
+        }
+        offset += box_size;
+    }
+
+    return MP4D_NO_ERROR;
+}
+
+int
+main(int argc, char **argv)
+{
+    uint64_t static_size, dynamic_size, size;
+    mp4d_demuxer_ptr_t p_dmux;
+    mp4d_trackreader_ptr_t p_tr[MAX_TRACKS];
+    unsigned char *buf;
+    double best = 0;
+    uint64_t samples = 0;
+    int runs = atoi(argv[2]);
+    int run, i, err = 0;
+    FILE *f;
+
+    (void) argc;
+    f = fopen(argv[1], "rb");
+    if (f == NULL)
+    {
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    size = (uint64_t) ftell(f);
+    fseek(f, 0, SEEK_SET);
+    buf = malloc((size_t) size);
+    if (buf == NULL || fread(buf, 1, (size_t) size, f) != size)
+    {
+        return 1;
+    }
+    fclose(f);
+
+    mp4d_demuxer_query_mem(&static_size, &dynamic_size);
+    mp4d_demuxer_init(&p_dmux, malloc((size_t) static_size), malloc((size_t) dynamic_size));
+    mp4d_trackreader_query_mem(&static_size, &dynamic_size);
+    for (i = 0; i < MAX_TRACKS; i++)
+    {
+        mp4d_trackreader_init(&p_tr[i], malloc((size_t) static_size), NULL);
+    }
+    printf("%6u bytes/instance", (unsigned) static_size);
+
+    for (run = 0; run < runs && err == MP4D_NO_ERROR; run++)
+    {
+        double start = now();
+        double rate;
+        uint64_t total = 0;
+
+        do
+        {
+            samples = 0;
+            err = read_all(p_dmux, p_tr, buf, size, &samples);
+            total += samples;
+        } while (err == MP4D_NO_ERROR && now() - start < 0.2);
+        rate = total / (now() - start);
+        if (rate > best)
+        {
+            best = rate;
+        }
+    }
+    if (err != MP4D_NO_ERROR)
+    {
+        printf("  cannot read (error %d)\n", err);
+    }
+    else
+    {
+        printf("  %8.2f Msamples/s  (%u samples)\n", best * 1e-6, (unsigned) samples);
+    }
+
+    return 0;
+}
+EOF
+
+echo "(best of $runs runs)"
+for profile in DEFAULT CMAF_CLEAR CMAF_ENCRYPTED PROGRESSIVE; do
+    if [ "$profile" = DEFAULT ]; then
+        flags=
+    else
+        flags="-DMP4D_TRACKREADER_PROFILE_$profile"
+    fi
+    "$cc" -O2 -DNDEBUG -D_FILE_OFFSET_BITS=64 $flags -I"$base/include" -I"$base/src" "$out/bench.c" \
+        "$base/src/mp4d_box_read.c" "$base/src/mp4d_buffer.c" "$base/src/mp4d_demux.c" \
+        "$base/src/mp4d_nav.c" "$base/src/mp4d_trackreader.c" -o "$out/bench_$profile"
+    for input in $inputs; do
+        printf "%-15s %-24s " "$profile" "$(basename "$input")"
+        "$out/bench_$profile" "$input" "$runs"
+    done
+done